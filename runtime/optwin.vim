@@ -401,6 +401,12 @@ if has("syntax")
   call append("$", "synmaxcol\tmaximum column to look for syntax items")
   call append("$", "\t(local to buffer)")
   call <SID>OptionL("smc")
+  call append("$", "syntaxahead\tnumber of lines to find the syntax state for when idle")
+  call <SID>OptionG("sya", &sya)
+  if has("persistent_undo")
+    call append("$", "syntaxcache\tremember the syntax state of a file")
+    call <SID>BinOptionG("syc", &syc)
+  endif
 endif
 call append("$", "highlight\twhich highlighting to use for various occasions")
 call <SID>OptionG("hl", &hl)
@@ -730,6 +736,8 @@ call <SID>Header("editing text")
 call append("$", "undolevels\tmaximum number of changes that can be undone")
 call append("$", "\t(global or local to buffer)")
 call append("$", " \tset ul=" . &ul)
+call append("$", "undomaxmem\tmaximum memory in Kbyte used for undo in one buffer")
+call append("$", " \tset umm=" . &umm)
 call append("$", "undoreload\tmaximum number lines to save for undo on a buffer reload")
 call append("$", " \tset ur=" . &ur)
 call append("$", "modified\tchanges have been made and not written to a file")
@@ -1015,6 +1023,10 @@ call append("$", "\t(local to buffer)")
 call <SID>BinOptionL("swf")
 call append("$", "swapsync\t\"sync\", \"fsync\" or empty; how to flush a swap file to disk")
 call <SID>OptionG("sws", &sws)
+if has("swapthread")
+  call append("$", "swapthread\twrite the swap file in a separate thread")
+  call <SID>BinOptionG("swt", &swt)
+endif
 call append("$", "updatecount\tnumber of characters typed to cause a swap file update")
 call append("$", " \tset uc=" . &uc)
 call append("$", "updatetime\ttime in msec after which the swap file will be updated")
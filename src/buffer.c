@@ -634,6 +634,9 @@ buf_freeall(buf, flags)
 
 #ifdef FEAT_TCL
     tcl_buffer_free(buf);
+#endif
+#if defined(FEAT_SYN_HL) && defined(FEAT_PERSISTENT_UNDO)
+    syn_cache_write(buf);	    /* remember the syntax state */
 #endif
     ml_close(buf, TRUE);	    /* close and delete the memline/memfile */
     buf->b_ml.ml_line_count = 0;    /* no lines in buffer */
@@ -718,6 +721,10 @@ free_buffer_stuff(buf, free_options)
 #ifdef FEAT_SIGNS
     buf_delete_signs(buf);		/* delete any signs */
 #endif
+#ifdef FEAT_QUICKFIX
+    qf_adjust_flush();			/* update quickfix line numbers */
+    ga_clear(&buf->b_qf_adjust);
+#endif
 #ifdef FEAT_NETBEANS_INTG
     netbeans_file_killed(buf);
 #endif
@@ -5496,6 +5503,7 @@ buf_addsign(buf, id, lnum, typenr)
     signlist_T	*sign;		/* a sign in the signlist */
     signlist_T	*prev;		/* the previous sign */
 
+    sign_adjust_flush(buf);
     prev = NULL;
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
     {
@@ -5553,6 +5561,7 @@ buf_change_sign_type(buf, markId, typenr)
 {
     signlist_T	*sign;		/* a sign in the signlist */
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
     {
 	if (sign->id == markId)
@@ -5573,6 +5582,7 @@ buf_getsigntype(buf, lnum, type)
 {
     signlist_T	*sign;		/* a sign in a b_signlist */
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
 	if (sign->lnum == lnum
 		&& (type == SIGN_ANY
@@ -5599,6 +5609,7 @@ buf_delsign(buf, id)
     signlist_T	*next;		/* the next sign in a b_signlist */
     linenr_T	lnum;		/* line number whose sign was deleted */
 
+    sign_adjust_flush(buf);
     lastp = &buf->b_signlist;
     lnum = 0;
     for (sign = buf->b_signlist; sign != NULL; sign = next)
@@ -5643,6 +5654,7 @@ buf_findsign(buf, id)
 {
     signlist_T	*sign;		/* a sign in the signlist */
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
 	if (sign->id == id)
 	    return sign->lnum;
@@ -5657,6 +5669,7 @@ buf_findsign_id(buf, lnum)
 {
     signlist_T	*sign;		/* a sign in the signlist */
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
 	if (sign->lnum == lnum)
 	    return sign->id;
@@ -5675,6 +5688,7 @@ buf_findsigntype_id(buf, lnum, typenr)
 {
     signlist_T	*sign;		/* a sign in the signlist */
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
 	if (sign->lnum == lnum && sign->typenr == typenr)
 	    return sign->id;
@@ -5693,6 +5707,7 @@ buf_signcount(buf, lnum)
     signlist_T	*sign;		/* a sign in the signlist */
     int		count = 0;
 
+    sign_adjust_flush(buf);
     for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
 	if (sign->lnum == lnum)
 	    if (sign_get_image(sign->typenr) != NULL)
@@ -5727,6 +5742,7 @@ buf_delete_signs(buf)
 	vim_free(buf->b_signlist);
 	buf->b_signlist = next;
     }
+    ga_clear(&buf->b_sign_adjust);
 }
 
 /*
@@ -5761,6 +5777,7 @@ sign_list_placed(rbuf)
 	buf = rbuf;
     while (buf != NULL && !got_int)
     {
+	sign_adjust_flush(buf);
 	if (buf->b_signlist != NULL)
 	{
 	    vim_snprintf(lbuf, BUFSIZ, _("Signs for %s:"), buf->b_fname);
@@ -5781,7 +5798,8 @@ sign_list_placed(rbuf)
 }
 
 /*
- * Adjust a placed sign for inserted/deleted lines.
+ * Adjust placed signs for inserted/deleted lines.  This is done when the signs
+ * are used, see sign_adjust_flush().
  */
     void
 sign_mark_adjust(line1, line2, amount, amount_after)
@@ -5791,19 +5809,45 @@ sign_mark_adjust(line1, line2, amount, amount_after)
     long	amount_after;
 {
     signlist_T	*sign;		/* a sign in a b_signlist */
+    markadj_T	ma;
+
+    if (curbuf->b_signlist == NULL)
+	return;
+    if (markadj_add(&curbuf->b_sign_adjust, line1, line2, amount,
+						    amount_after, FALSE) == OK)
+	return;
 
+    /* Too many changes: apply them first. */
+    sign_adjust_flush(curbuf);
+    if (markadj_add(&curbuf->b_sign_adjust, line1, line2, amount,
+						    amount_after, FALSE) == OK)
+	return;
+
+    /* Out of memory: adjust the signs now. */
+    ma.ma_line1 = line1;
+    ma.ma_line2 = line2;
+    ma.ma_amount = amount;
+    ma.ma_amount_after = amount_after;
     for (sign = curbuf->b_signlist; sign != NULL; sign = sign->next)
-    {
-	if (sign->lnum >= line1 && sign->lnum <= line2)
-	{
-	    if (amount == MAXLNUM)
-		sign->lnum = line1;
-	    else
-		sign->lnum += amount;
-	}
-	else if (sign->lnum > line2)
-	    sign->lnum += amount_after;
-    }
+	(void)markadj_lnum(&ma, 1, &sign->lnum, FALSE);
+}
+
+/*
+ * Apply the line changes to the signs of "buf".  Must be called before using
+ * the line number of a sign.
+ */
+    void
+sign_adjust_flush(buf)
+    buf_T	*buf;
+{
+    signlist_T	*sign;		/* a sign in a b_signlist */
+
+    if (buf->b_sign_adjust.ga_len == 0)
+	return;
+    for (sign = buf->b_signlist; sign != NULL; sign = sign->next)
+	(void)markadj_lnum((markadj_T *)buf->b_sign_adjust.ga_data,
+				  buf->b_sign_adjust.ga_len, &sign->lnum, FALSE);
+    buf->b_sign_adjust.ga_len = 0;
 }
 #endif /* FEAT_SIGNS */
 
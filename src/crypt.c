@@ -167,6 +167,20 @@ crypt_method_nr_from_magic(ptr, len)
     return -1;
 }
 
+/*
+ * Return TRUE if "ptr[len]", the start of a file, looks like an encrypted
+ * file, also when the method is unknown.  Does not give a message.
+ */
+    int
+crypt_has_magic(ptr, len)
+    char  *ptr;
+    int   len;
+{
+    int i = (int)STRLEN(crypt_magic_head);
+
+    return len >= i && memcmp(ptr, crypt_magic_head, i) == 0;
+}
+
 /*
  * Return TRUE if the crypt method for "method_nr" can be done in-place.
  */
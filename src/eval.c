@@ -161,6 +161,89 @@ static int echo_attr = 0;   /* attributes used for ":echo" */
 #define GLV_QUIET	TFN_QUIET	/* no error messages */
 #define GLV_NO_AUTOLOAD	TFN_NO_AUTOLOAD	/* do not use script autoloading */
 
+/*
+ * A user function is compiled into instructions when it is called.  Lines
+ * that are not compiled are executed with do_cmdline() as before.
+ */
+typedef enum
+{
+    /* statements */
+    ISN_EXEC,		/* execute line "arg1" with do_cmdline() */
+    ISN_STMT,		/* start of line "arg1", "arg2" is the target on
+			   failure, "arg3" the command */
+    ISN_JUMP,		/* jump to "arg1" */
+    ISN_LOOP,		/* check for interrupt and jump to "arg1" */
+    ISN_COND,		/* pop value, jump to "arg1" when FALSE */
+    ISN_STORE,		/* pop value, assign to variable "str" */
+    ISN_RETURN,		/* return from function, value popped if "arg1" */
+    ISN_DROP,		/* pop value and drop it */
+    ISN_FORINIT,	/* pop list, start for loop "arg1" */
+    ISN_FORCHK,		/* jump to "arg2" when for loop "arg1" started */
+    ISN_FORNEXT,	/* assign next item of for loop "arg1", jump to
+			   "arg2" when done */
+    ISN_FORFREE,	/* end for loop "arg1" */
+
+    /* expressions */
+    ISN_PUSH,		/* push constant "tv" */
+    ISN_NEWLIST,	/* pop "arg1" values, push List */
+    ISN_NEWDICT,	/* pop "arg1" keys and values, push Dictionary */
+    ISN_LOADL,		/* push local variable "arg1" */
+    ISN_LOADA,		/* push argument "arg1" */
+    ISN_LOADV,		/* push any other variable "str" */
+    ISN_EVAL,		/* push value of expression "str", use a copy
+			   when "arg1" is TRUE */
+    ISN_JUMPIF,		/* pop value, when TRUE push 1 and jump to "arg1" */
+    ISN_JUMPIFNOT,	/* pop value, when FALSE push 0 and jump to "arg1" */
+    ISN_JUMPFALSE,	/* pop value, jump to "arg1" when FALSE */
+    ISN_TOBOOL,		/* pop value, push 0 or 1 */
+    ISN_COMPARE,	/* pop two values, push result of comparing */
+    ISN_ADDCHK,		/* check value for "+", "-" or "." operator */
+    ISN_ADD,		/* pop two values, push result of "+", "-" or "." */
+    ISN_MULCHK,		/* check value for "*", "/" or "%" operator */
+    ISN_MUL,		/* pop two values, push result of "*", "/" or "%" */
+    ISN_LEADER,		/* apply "!", "-" and "+" in "str" */
+    ISN_INDEXCHK,	/* check value can be indexed */
+    ISN_STRCHK,		/* check index is a Number or String */
+    ISN_INDEX,		/* pop index or range, index value */
+    ISN_MEMBER,		/* get member "str" of Dictionary */
+    ISN_FUNC,		/* start calling function "str" */
+    ISN_CALLNAME,	/* start ":call" of function "str" */
+    ISN_CALL		/* pop "arg1" arguments, call function */
+} isntype_T;
+
+typedef struct
+{
+    isntype_T	isn_type;
+    int		isn_arg1;
+    int		isn_arg2;
+    int		isn_arg3;
+    int		isn_arg4;
+    char_u	*isn_str;	/* text, points into cf_strings */
+    typval_T	isn_tv;		/* constant for ISN_PUSH */
+} isn_T;
+
+typedef struct
+{
+    garray_T	cf_instr;	/* isn_T items */
+    garray_T	cf_strings;	/* allocated strings used by instructions */
+    garray_T	cf_locals;	/* names of local variables with a slot */
+    garray_T	cf_args;	/* names of arguments with a slot */
+    int		cf_nfor;	/* number of for loops */
+} cfunc_T;
+
+/* Execution state of a compiled function. */
+typedef struct
+{
+    cfunc_T	*fv_cfunc;
+    int		fv_pc;		/* next instruction to execute */
+    int		fv_done;	/* TRUE when function has ended */
+    void	**fv_forinfo;	/* state of each for loop */
+    dictitem_T	**fv_locals;	/* local variables found, or NULL */
+    long_u	fv_locals_changed; /* ht_changed of l: when fv_locals filled */
+    dictitem_T	**fv_args;	/* arguments found, or NULL */
+    long_u	fv_args_changed; /* ht_changed of a: when fv_args filled */
+} funcvm_T;
+
 /*
  * Structure to hold info for a user function.
  */
@@ -193,6 +276,8 @@ struct ufunc
     scid_T	uf_script_ID;	/* ID of script where function was defined,
 				   used for s: variables */
     int		uf_refcount;	/* for numbered function: reference count */
+    cfunc_T	*uf_cfunc;	/* compiled instructions or NULL */
+    int		uf_cfunc_failed; /* TRUE when compiling failed */
     char_u	uf_name[1];	/* name of function (actually longer); can
 				   start with <SNR>123_ (<SNR> is K_SPECIAL
 				   KS_EXTRA KE_SNR) */
@@ -254,6 +339,7 @@ struct funccall_S
 #ifdef FEAT_PROFILE
     proftime_T	prof_child;	/* time spent in a child */
 #endif
+    funcvm_T	*vm;		/* state of compiled function or NULL */
     funccall_T	*caller;	/* calling function or NULL */
 };
 
@@ -406,6 +492,22 @@ static int do_lock_var __ARGS((lval_T *lp, char_u *name_end, int deep, int lock)
 static void item_lock __ARGS((typval_T *tv, int deep, int lock));
 static int tv_islocked __ARGS((typval_T *tv));
 
+/*
+ * types for expressions.
+ */
+typedef enum
+{
+    TYPE_UNKNOWN = 0
+    , TYPE_EQUAL	/* == */
+    , TYPE_NEQUAL	/* != */
+    , TYPE_GREATER	/* >  */
+    , TYPE_GEQUAL	/* >= */
+    , TYPE_SMALLER	/* <  */
+    , TYPE_SEQUAL	/* <= */
+    , TYPE_MATCH	/* =~ */
+    , TYPE_NOMATCH	/* !~ */
+} exptype_T;
+
 static int eval0 __ARGS((char_u *arg,  typval_T *rettv, char_u **nextcmd, int evaluate));
 static int eval1 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval2 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
@@ -414,9 +516,18 @@ static int eval4 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval5 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval6 __ARGS((char_u **arg, typval_T *rettv, int evaluate, int want_string));
 static int eval7 __ARGS((char_u **arg, typval_T *rettv, int evaluate, int want_string));
+static exptype_T get_compare_type __ARGS((char_u *p, int *lenp, int *type_is));
+static int eval_compare __ARGS((typval_T *tv1, typval_T *tv2, exptype_T type, int type_is, int ic));
+static int eval_arith_check __ARGS((typval_T *tv, int op));
+static int eval_arith __ARGS((typval_T *tv1, typval_T *tv2, int op));
+static int eval_mult_check __ARGS((typval_T *tv));
+static int eval_mult __ARGS((typval_T *tv1, typval_T *tv2, int op));
+static int eval_leader __ARGS((typval_T *tv, char_u *start_leader, char_u *end_leader));
 
 static int eval_index __ARGS((char_u **arg, typval_T *rettv, int evaluate, int verbose));
+static int eval_index_tv __ARGS((typval_T *rettv, typval_T *var1, typval_T *var2, char_u *key, long keylen, int range, int empty1, int empty2, int verbose));
 static int get_option_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
+static int get_number_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate, int want_string));
 static int get_string_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int get_lit_string_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int get_list_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
@@ -477,6 +588,7 @@ static void f_browsedir __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_bufexists __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_buflisted __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_bufloaded __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_bufmemstat __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_bufname __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_bufnr __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_bufwinnr __ARGS((typval_T *argvars, typval_T *rettv));
@@ -838,6 +950,11 @@ static void func_free __ARGS((ufunc_T *fp));
 static void call_user_func __ARGS((ufunc_T *fp, int argcount, typval_T *argvars, typval_T *rettv, linenr_T firstline, linenr_T lastline, dict_T *selfdict));
 static int can_free_funccal __ARGS((funccall_T *fc, int copyID)) ;
 static void free_funccal __ARGS((funccall_T *fc, int free_val));
+static void free_cfunc __ARGS((cfunc_T *cf));
+static cfunc_T *compile_func __ARGS((ufunc_T *fp));
+static funcvm_T *func_vm_alloc __ARGS((cfunc_T *cf));
+static void func_vm_free __ARGS((funcvm_T *vm));
+static char_u *func_vm_line __ARGS((funccall_T *fc));
 static void add_nr_var __ARGS((dict_T *dp, dictitem_T *v, char *name, varnumber_T nr));
 static win_T *find_win_by_nr __ARGS((typval_T *vp, tabpage_T *tp));
 static void getwinvar __ARGS((typval_T *argvars, typval_T *rettv, int off));
@@ -4050,22 +4167,6 @@ get_user_var_name(xp, idx)
 
 #endif /* FEAT_CMDL_COMPL */
 
-/*
- * types for expressions.
- */
-typedef enum
-{
-    TYPE_UNKNOWN = 0
-    , TYPE_EQUAL	/* == */
-    , TYPE_NEQUAL	/* != */
-    , TYPE_GREATER	/* >  */
-    , TYPE_GEQUAL	/* >= */
-    , TYPE_SMALLER	/* <  */
-    , TYPE_SEQUAL	/* <= */
-    , TYPE_MATCH	/* =~ */
-    , TYPE_NOMATCH	/* !~ */
-} exptype_T;
-
 /*
  * The "evaluate" argument: When FALSE, the argument is only parsed but not
  * executed.  The function may return OK, but the rettv will be of type
@@ -4353,16 +4454,10 @@ eval4(arg, rettv, evaluate)
 {
     typval_T	var2;
     char_u	*p;
-    int		i;
-    exptype_T	type = TYPE_UNKNOWN;
+    exptype_T	type;
     int		type_is = FALSE;    /* TRUE for "is" and "isnot" */
-    int		len = 2;
-    long	n1, n2;
-    char_u	*s1, *s2;
-    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-    regmatch_T	regmatch;
+    int		len;
     int		ic;
-    char_u	*save_cpo;
 
     /*
      * Get the first variable.
@@ -4371,6 +4466,60 @@ eval4(arg, rettv, evaluate)
 	return FAIL;
 
     p = *arg;
+    type = get_compare_type(p, &len, &type_is);
+
+    /*
+     * If there is a comparative operator, use it.
+     */
+    if (type != TYPE_UNKNOWN)
+    {
+	/* extra question mark appended: ignore case */
+	if (p[len] == '?')
+	{
+	    ic = TRUE;
+	    ++len;
+	}
+	/* extra '#' appended: match case */
+	else if (p[len] == '#')
+	{
+	    ic = FALSE;
+	    ++len;
+	}
+	/* nothing appended: use 'ignorecase' */
+	else
+	    ic = p_ic;
+
+	/*
+	 * Get the second variable.
+	 */
+	*arg = skipwhite(p + len);
+	if (eval5(arg, &var2, evaluate) == FAIL)
+	{
+	    clear_tv(rettv);
+	    return FAIL;
+	}
+
+	if (evaluate)
+	    return eval_compare(rettv, &var2, type, type_is, ic);
+    }
+
+    return OK;
+}
+
+/*
+ * Check for a comparison operator at "p".  Returns its type, TYPE_UNKNOWN
+ * when there is none.  "*lenp" is set to the length of the operator, without
+ * a following "?" or "#".  "*type_is" is set to TRUE for "is" and "isnot".
+ */
+    static exptype_T
+get_compare_type(p, lenp, type_is)
+    char_u	*p;
+    int		*lenp;
+    int		*type_is;
+{
+    exptype_T	type = TYPE_UNKNOWN;
+    int		len = 2;
+
     switch (p[0])
     {
 	case '=':   if (p[1] == '=')
@@ -4406,240 +4555,228 @@ eval4(arg, rettv, evaluate)
 			if (!vim_isIDc(p[len]))
 			{
 			    type = len == 2 ? TYPE_EQUAL : TYPE_NEQUAL;
-			    type_is = TRUE;
+			    *type_is = TRUE;
 			}
 		    }
 		    break;
     }
 
-    /*
-     * If there is a comparative operator, use it.
-     */
-    if (type != TYPE_UNKNOWN)
+    *lenp = len;
+    return type;
+}
+
+/*
+ * Compare "tv1" with "tv2" for "type", see eval4().  The Number result
+ * replaces "tv1", "tv2" is cleared.
+ * Returns FAIL and clears both when they can't be compared.
+ */
+    static int
+eval_compare(tv1, tv2, type, type_is, ic)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    exptype_T	type;
+    int		type_is;
+    int		ic;
+{
+    char_u	*s1, *s2;
+    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+    long	n1, n2;
+    int		i;
+    regmatch_T	regmatch;
+    char_u	*save_cpo;
+
+    if (type_is && tv1->v_type != tv2->v_type)
     {
-	/* extra question mark appended: ignore case */
-	if (p[len] == '?')
+	/* For "is" a different type always means FALSE, for "notis"
+	 * it means TRUE. */
+	n1 = (type == TYPE_NEQUAL);
+    }
+    else if (tv1->v_type == VAR_LIST || tv2->v_type == VAR_LIST)
+    {
+	if (type_is)
 	{
-	    ic = TRUE;
-	    ++len;
+	    n1 = (tv1->v_type == tv2->v_type
+			   && tv1->vval.v_list == tv2->vval.v_list);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
 	}
-	/* extra '#' appended: match case */
-	else if (p[len] == '#')
+	else if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
 	{
-	    ic = FALSE;
-	    ++len;
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E691: Can only compare List with List"));
+	    else
+		EMSG(_("E692: Invalid operation for List"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
 	}
-	/* nothing appended: use 'ignorecase' */
 	else
-	    ic = p_ic;
+	{
+	    /* Compare two Lists for being equal or unequal. */
+	    n1 = list_equal(tv1->vval.v_list, tv2->vval.v_list,
+							   ic, FALSE);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
-	/*
-	 * Get the second variable.
-	 */
-	*arg = skipwhite(p + len);
-	if (eval5(arg, &var2, evaluate) == FAIL)
+    else if (tv1->v_type == VAR_DICT || tv2->v_type == VAR_DICT)
+    {
+	if (type_is)
 	{
-	    clear_tv(rettv);
+	    n1 = (tv1->v_type == tv2->v_type
+			   && tv1->vval.v_dict == tv2->vval.v_dict);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+	else if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
+	{
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E735: Can only compare Dictionary with Dictionary"));
+	    else
+		EMSG(_("E736: Invalid operation for Dictionary"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
 	    return FAIL;
 	}
-
-	if (evaluate)
+	else
 	{
-	    if (type_is && rettv->v_type != var2.v_type)
-	    {
-		/* For "is" a different type always means FALSE, for "notis"
-		 * it means TRUE. */
-		n1 = (type == TYPE_NEQUAL);
-	    }
-	    else if (rettv->v_type == VAR_LIST || var2.v_type == VAR_LIST)
-	    {
-		if (type_is)
-		{
-		    n1 = (rettv->v_type == var2.v_type
-				   && rettv->vval.v_list == var2.vval.v_list);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-		else if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E691: Can only compare List with List"));
-		    else
-			EMSG(_("E692: Invalid operation for List"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Lists for being equal or unequal. */
-		    n1 = list_equal(rettv->vval.v_list, var2.vval.v_list,
-								   ic, FALSE);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
-
-	    else if (rettv->v_type == VAR_DICT || var2.v_type == VAR_DICT)
-	    {
-		if (type_is)
-		{
-		    n1 = (rettv->v_type == var2.v_type
-				   && rettv->vval.v_dict == var2.vval.v_dict);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-		else if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E735: Can only compare Dictionary with Dictionary"));
-		    else
-			EMSG(_("E736: Invalid operation for Dictionary"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Dictionaries for being equal or unequal. */
-		    n1 = dict_equal(rettv->vval.v_dict, var2.vval.v_dict,
-								   ic, FALSE);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
+	    /* Compare two Dictionaries for being equal or unequal. */
+	    n1 = dict_equal(tv1->vval.v_dict, tv2->vval.v_dict,
+							   ic, FALSE);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
-	    else if (rettv->v_type == VAR_FUNC || var2.v_type == VAR_FUNC)
-	    {
-		if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E693: Can only compare Funcref with Funcref"));
-		    else
-			EMSG(_("E694: Invalid operation for Funcrefs"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Funcrefs for being equal or unequal. */
-		    if (rettv->vval.v_string == NULL
-						|| var2.vval.v_string == NULL)
-			n1 = FALSE;
-		    else
-			n1 = STRCMP(rettv->vval.v_string,
-						     var2.vval.v_string) == 0;
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
+    else if (tv1->v_type == VAR_FUNC || tv2->v_type == VAR_FUNC)
+    {
+	if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
+	{
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E693: Can only compare Funcref with Funcref"));
+	    else
+		EMSG(_("E694: Invalid operation for Funcrefs"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	else
+	{
+	    /* Compare two Funcrefs for being equal or unequal. */
+	    if (tv1->vval.v_string == NULL
+					|| tv2->vval.v_string == NULL)
+		n1 = FALSE;
+	    else
+		n1 = STRCMP(tv1->vval.v_string,
+					     tv2->vval.v_string) == 0;
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
 #ifdef FEAT_FLOAT
-	    /*
-	     * If one of the two variables is a float, compare as a float.
-	     * When using "=~" or "!~", always compare as string.
-	     */
-	    else if ((rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT)
-		    && type != TYPE_MATCH && type != TYPE_NOMATCH)
-	    {
-		float_T f1, f2;
+    /*
+     * If one of the two variables is a float, compare as a float.
+     * When using "=~" or "!~", always compare as string.
+     */
+    else if ((tv1->v_type == VAR_FLOAT || tv2->v_type == VAR_FLOAT)
+	    && type != TYPE_MATCH && type != TYPE_NOMATCH)
+    {
+	float_T f1, f2;
 
-		if (rettv->v_type == VAR_FLOAT)
-		    f1 = rettv->vval.v_float;
-		else
-		    f1 = get_tv_number(rettv);
-		if (var2.v_type == VAR_FLOAT)
-		    f2 = var2.vval.v_float;
-		else
-		    f2 = get_tv_number(&var2);
-		n1 = FALSE;
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (f1 == f2); break;
-		    case TYPE_NEQUAL:   n1 = (f1 != f2); break;
-		    case TYPE_GREATER:  n1 = (f1 > f2); break;
-		    case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
-		    case TYPE_SMALLER:  n1 = (f1 < f2); break;
-		    case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
-		    case TYPE_UNKNOWN:
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
-		}
-	    }
+	if (tv1->v_type == VAR_FLOAT)
+	    f1 = tv1->vval.v_float;
+	else
+	    f1 = get_tv_number(tv1);
+	if (tv2->v_type == VAR_FLOAT)
+	    f2 = tv2->vval.v_float;
+	else
+	    f2 = get_tv_number(tv2);
+	n1 = FALSE;
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (f1 == f2); break;
+	    case TYPE_NEQUAL:   n1 = (f1 != f2); break;
+	    case TYPE_GREATER:  n1 = (f1 > f2); break;
+	    case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
+	    case TYPE_SMALLER:  n1 = (f1 < f2); break;
+	    case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
+	    case TYPE_UNKNOWN:
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
+	}
+    }
 #endif
 
-	    /*
-	     * If one of the two variables is a number, compare as a number.
-	     * When using "=~" or "!~", always compare as string.
-	     */
-	    else if ((rettv->v_type == VAR_NUMBER || var2.v_type == VAR_NUMBER)
-		    && type != TYPE_MATCH && type != TYPE_NOMATCH)
-	    {
-		n1 = get_tv_number(rettv);
-		n2 = get_tv_number(&var2);
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (n1 == n2); break;
-		    case TYPE_NEQUAL:   n1 = (n1 != n2); break;
-		    case TYPE_GREATER:  n1 = (n1 > n2); break;
-		    case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
-		    case TYPE_SMALLER:  n1 = (n1 < n2); break;
-		    case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
-		    case TYPE_UNKNOWN:
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
-		}
-	    }
-	    else
-	    {
-		s1 = get_tv_string_buf(rettv, buf1);
-		s2 = get_tv_string_buf(&var2, buf2);
-		if (type != TYPE_MATCH && type != TYPE_NOMATCH)
-		    i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
-		else
-		    i = 0;
-		n1 = FALSE;
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (i == 0); break;
-		    case TYPE_NEQUAL:   n1 = (i != 0); break;
-		    case TYPE_GREATER:  n1 = (i > 0); break;
-		    case TYPE_GEQUAL:   n1 = (i >= 0); break;
-		    case TYPE_SMALLER:  n1 = (i < 0); break;
-		    case TYPE_SEQUAL:   n1 = (i <= 0); break;
-
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:
-			    /* avoid 'l' flag in 'cpoptions' */
-			    save_cpo = p_cpo;
-			    p_cpo = (char_u *)"";
-			    regmatch.regprog = vim_regcomp(s2,
-							RE_MAGIC + RE_STRING);
-			    regmatch.rm_ic = ic;
-			    if (regmatch.regprog != NULL)
-			    {
-				n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
-				vim_regfree(regmatch.regprog);
-				if (type == TYPE_NOMATCH)
-				    n1 = !n1;
-			    }
-			    p_cpo = save_cpo;
-			    break;
-
-		    case TYPE_UNKNOWN:  break;  /* avoid gcc warning */
-		}
-	    }
-	    clear_tv(rettv);
-	    clear_tv(&var2);
-	    rettv->v_type = VAR_NUMBER;
-	    rettv->vval.v_number = n1;
+    /*
+     * If one of the two variables is a number, compare as a number.
+     * When using "=~" or "!~", always compare as string.
+     */
+    else if ((tv1->v_type == VAR_NUMBER || tv2->v_type == VAR_NUMBER)
+	    && type != TYPE_MATCH && type != TYPE_NOMATCH)
+    {
+	n1 = get_tv_number(tv1);
+	n2 = get_tv_number(tv2);
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (n1 == n2); break;
+	    case TYPE_NEQUAL:   n1 = (n1 != n2); break;
+	    case TYPE_GREATER:  n1 = (n1 > n2); break;
+	    case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
+	    case TYPE_SMALLER:  n1 = (n1 < n2); break;
+	    case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
+	    case TYPE_UNKNOWN:
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
 	}
     }
+    else
+    {
+	s1 = get_tv_string_buf(tv1, buf1);
+	s2 = get_tv_string_buf(tv2, buf2);
+	if (type != TYPE_MATCH && type != TYPE_NOMATCH)
+	    i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
+	else
+	    i = 0;
+	n1 = FALSE;
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (i == 0); break;
+	    case TYPE_NEQUAL:   n1 = (i != 0); break;
+	    case TYPE_GREATER:  n1 = (i > 0); break;
+	    case TYPE_GEQUAL:   n1 = (i >= 0); break;
+	    case TYPE_SMALLER:  n1 = (i < 0); break;
+	    case TYPE_SEQUAL:   n1 = (i <= 0); break;
+
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:
+		    /* avoid 'l' flag in 'cpoptions' */
+		    save_cpo = p_cpo;
+		    p_cpo = (char_u *)"";
+		    regmatch.regprog = vim_regcomp(s2,
+						RE_MAGIC + RE_STRING);
+		    regmatch.rm_ic = ic;
+		    if (regmatch.regprog != NULL)
+		    {
+			n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
+			vim_regfree(regmatch.regprog);
+			if (type == TYPE_NOMATCH)
+			    n1 = !n1;
+		    }
+		    p_cpo = save_cpo;
+		    break;
 
+	    case TYPE_UNKNOWN:  break;  /* avoid gcc warning */
+	}
+    }
+    clear_tv(tv1);
+    clear_tv(tv2);
+    tv1->v_type = VAR_NUMBER;
+    tv1->vval.v_number = n1;
     return OK;
 }
 
@@ -4661,15 +4798,7 @@ eval5(arg, rettv, evaluate)
     int		evaluate;
 {
     typval_T	var2;
-    typval_T	var3;
     int		op;
-    long	n1, n2;
-#ifdef FEAT_FLOAT
-    float_T	f1 = 0, f2 = 0;
-#endif
-    char_u	*s1, *s2;
-    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-    char_u	*p;
 
     /*
      * Get the first variable.
@@ -4686,25 +4815,8 @@ eval5(arg, rettv, evaluate)
 	if (op != '+' && op != '-' && op != '.')
 	    break;
 
-	if ((op != '+' || rettv->v_type != VAR_LIST)
-#ifdef FEAT_FLOAT
-		&& (op == '.' || rettv->v_type != VAR_FLOAT)
-#endif
-		)
-	{
-	    /* For "list + ...", an illegal use of the first operand as
-	     * a number cannot be determined before evaluating the 2nd
-	     * operand: if this is also a list, all is ok.
-	     * For "something . ...", "something - ..." or "non-list + ...",
-	     * we know that the first operand needs to be a string or number
-	     * without evaluating the 2nd operand.  So check before to avoid
-	     * side effects after an error. */
-	    if (evaluate && get_tv_string_chk(rettv) == NULL)
-	    {
-		clear_tv(rettv);
-		return FAIL;
-	    }
-	}
+	if (evaluate && eval_arith_check(rettv, op) == FAIL)
+	    return FAIL;
 
 	/*
 	 * Get the second variable.
@@ -4716,115 +4828,169 @@ eval5(arg, rettv, evaluate)
 	    return FAIL;
 	}
 
-	if (evaluate)
+	if (evaluate && eval_arith(rettv, &var2, op) == FAIL)
+	    return FAIL;
+    }
+    return OK;
+}
+
+/*
+ * Check the first operand "tv" of "op" ('+', '-' or '.') before the second
+ * operand is evaluated.  Returns FAIL and clears "tv" when it can't be used.
+ */
+    static int
+eval_arith_check(tv, op)
+    typval_T	*tv;
+    int		op;
+{
+    if ((op != '+' || tv->v_type != VAR_LIST)
+#ifdef FEAT_FLOAT
+	    && (op == '.' || tv->v_type != VAR_FLOAT)
+#endif
+	    )
+    {
+	/* For "list + ...", an illegal use of the first operand as
+	 * a number cannot be determined before evaluating the 2nd
+	 * operand: if this is also a list, all is ok.
+	 * For "something . ...", "something - ..." or "non-list + ...",
+	 * we know that the first operand needs to be a string or number
+	 * without evaluating the 2nd operand.  So check before to avoid
+	 * side effects after an error. */
+	if (get_tv_string_chk(tv) == NULL)
 	{
-	    /*
-	     * Compute the result.
-	     */
-	    if (op == '.')
-	    {
-		s1 = get_tv_string_buf(rettv, buf1);	/* already checked */
-		s2 = get_tv_string_buf_chk(&var2, buf2);
-		if (s2 == NULL)		/* type error ? */
-		{
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		p = concat_str(s1, s2);
-		clear_tv(rettv);
-		rettv->v_type = VAR_STRING;
-		rettv->vval.v_string = p;
-	    }
-	    else if (op == '+' && rettv->v_type == VAR_LIST
-						   && var2.v_type == VAR_LIST)
-	    {
-		/* concatenate Lists */
-		if (list_concat(rettv->vval.v_list, var2.vval.v_list,
-							       &var3) == FAIL)
-		{
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		clear_tv(rettv);
-		*rettv = var3;
-	    }
-	    else
-	    {
-		int	    error = FALSE;
+	    clear_tv(tv);
+	    return FAIL;
+	}
+    }
+
+    return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for '+', '-' and '.', the result replaces "tv1".
+ * "tv2" is cleared.  Returns FAIL and clears "tv1" on error.
+ */
+    static int
+eval_arith(tv1, tv2, op)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    int		op;
+{
+    typval_T	var3;
+    long	n1, n2;
+#ifdef FEAT_FLOAT
+    float_T	f1 = 0, f2 = 0;
+#endif
+    char_u	*s1, *s2;
+    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+    char_u	*p;
+
+    /*
+     * Compute the result.
+     */
+    if (op == '.')
+    {
+	s1 = get_tv_string_buf(tv1, buf1);	/* already checked */
+	s2 = get_tv_string_buf_chk(tv2, buf2);
+	if (s2 == NULL)		/* type error ? */
+	{
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	p = concat_str(s1, s2);
+	clear_tv(tv1);
+	tv1->v_type = VAR_STRING;
+	tv1->vval.v_string = p;
+    }
+    else if (op == '+' && tv1->v_type == VAR_LIST
+					   && tv2->v_type == VAR_LIST)
+    {
+	/* concatenate Lists */
+	if (list_concat(tv1->vval.v_list, tv2->vval.v_list,
+						       &var3) == FAIL)
+	{
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	clear_tv(tv1);
+	*tv1 = var3;
+    }
+    else
+    {
+	int	    error = FALSE;
 
 #ifdef FEAT_FLOAT
-		if (rettv->v_type == VAR_FLOAT)
-		{
-		    f1 = rettv->vval.v_float;
-		    n1 = 0;
-		}
-		else
+	if (tv1->v_type == VAR_FLOAT)
+	{
+	    f1 = tv1->vval.v_float;
+	    n1 = 0;
+	}
+	else
 #endif
-		{
-		    n1 = get_tv_number_chk(rettv, &error);
-		    if (error)
-		    {
-			/* This can only happen for "list + non-list".  For
-			 * "non-list + ..." or "something - ...", we returned
-			 * before evaluating the 2nd operand. */
-			clear_tv(rettv);
-			return FAIL;
-		    }
+	{
+	    n1 = get_tv_number_chk(tv1, &error);
+	    if (error)
+	    {
+		/* This can only happen for "list + non-list".  For
+		 * "non-list + ..." or "something - ...", we returned
+		 * before evaluating the 2nd operand. */
+		clear_tv(tv1);
+		clear_tv(tv2);
+		return FAIL;
+	    }
 #ifdef FEAT_FLOAT
-		    if (var2.v_type == VAR_FLOAT)
-			f1 = n1;
+	    if (tv2->v_type == VAR_FLOAT)
+		f1 = n1;
 #endif
-		}
+	}
 #ifdef FEAT_FLOAT
-		if (var2.v_type == VAR_FLOAT)
-		{
-		    f2 = var2.vval.v_float;
-		    n2 = 0;
-		}
-		else
+	if (tv2->v_type == VAR_FLOAT)
+	{
+	    f2 = tv2->vval.v_float;
+	    n2 = 0;
+	}
+	else
 #endif
-		{
-		    n2 = get_tv_number_chk(&var2, &error);
-		    if (error)
-		    {
-			clear_tv(rettv);
-			clear_tv(&var2);
-			return FAIL;
-		    }
+	{
+	    n2 = get_tv_number_chk(tv2, &error);
+	    if (error)
+	    {
+		clear_tv(tv1);
+		clear_tv(tv2);
+		return FAIL;
+	    }
 #ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f2 = n2;
+	    if (tv1->v_type == VAR_FLOAT)
+		f2 = n2;
 #endif
-		}
-		clear_tv(rettv);
+	}
+	clear_tv(tv1);
 
 #ifdef FEAT_FLOAT
-		/* If there is a float on either side the result is a float. */
-		if (rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT)
-		{
-		    if (op == '+')
-			f1 = f1 + f2;
-		    else
-			f1 = f1 - f2;
-		    rettv->v_type = VAR_FLOAT;
-		    rettv->vval.v_float = f1;
-		}
-		else
+	/* If there is a float on either side the result is a float. */
+	if (tv1->v_type == VAR_FLOAT || tv2->v_type == VAR_FLOAT)
+	{
+	    if (op == '+')
+		f1 = f1 + f2;
+	    else
+		f1 = f1 - f2;
+	    tv1->v_type = VAR_FLOAT;
+	    tv1->vval.v_float = f1;
+	}
+	else
 #endif
-		{
-		    if (op == '+')
-			n1 = n1 + n2;
-		    else
-			n1 = n1 - n2;
-		    rettv->v_type = VAR_NUMBER;
-		    rettv->vval.v_number = n1;
-		}
-	    }
-	    clear_tv(&var2);
+	{
+	    if (op == '+')
+		n1 = n1 + n2;
+	    else
+		n1 = n1 - n2;
+	    tv1->v_type = VAR_NUMBER;
+	    tv1->vval.v_number = n1;
 	}
     }
+    clear_tv(tv2);
     return OK;
 }
 
@@ -4848,12 +5014,6 @@ eval6(arg, rettv, evaluate, want_string)
 {
     typval_T	var2;
     int		op;
-    long	n1, n2;
-#ifdef FEAT_FLOAT
-    int		use_float = FALSE;
-    float_T	f1 = 0, f2;
-#endif
-    int		error = FALSE;
 
     /*
      * Get the first variable.
@@ -4870,24 +5030,8 @@ eval6(arg, rettv, evaluate, want_string)
 	if (op != '*' && op != '/' && op != '%')
 	    break;
 
-	if (evaluate)
-	{
-#ifdef FEAT_FLOAT
-	    if (rettv->v_type == VAR_FLOAT)
-	    {
-		f1 = rettv->vval.v_float;
-		use_float = TRUE;
-		n1 = 0;
-	    }
-	    else
-#endif
-		n1 = get_tv_number_chk(rettv, &error);
-	    clear_tv(rettv);
-	    if (error)
-		return FAIL;
-	}
-	else
-	    n1 = 0;
+	if (evaluate && eval_mult_check(rettv) == FAIL)
+	    return FAIL;
 
 	/*
 	 * Get the second variable.
@@ -4896,102 +5040,157 @@ eval6(arg, rettv, evaluate, want_string)
 	if (eval7(arg, &var2, evaluate, FALSE) == FAIL)
 	    return FAIL;
 
-	if (evaluate)
-	{
+	if (evaluate && eval_mult(rettv, &var2, op) == FAIL)
+	    return FAIL;
+    }
+
+    return OK;
+}
+
+/*
+ * Turn the first operand "tv" of '*', '/' or '%' into a Number, unless it is
+ * a Float.  Returns FAIL and clears "tv" when it can't be converted.
+ */
+    static int
+eval_mult_check(tv)
+    typval_T	*tv;
+{
+    long	n;
+    int		error = FALSE;
+
 #ifdef FEAT_FLOAT
-	    if (var2.v_type == VAR_FLOAT)
-	    {
-		if (!use_float)
-		{
-		    f1 = n1;
-		    use_float = TRUE;
-		}
-		f2 = var2.vval.v_float;
-		n2 = 0;
-	    }
-	    else
+    if (tv->v_type == VAR_FLOAT)
+	return OK;
 #endif
-	    {
-		n2 = get_tv_number_chk(&var2, &error);
-		clear_tv(&var2);
-		if (error)
-		    return FAIL;
+    n = get_tv_number_chk(tv, &error);
+    clear_tv(tv);
+    if (error)
+	return FAIL;
+    tv->v_type = VAR_NUMBER;
+    tv->vval.v_number = n;
+    return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for '*', '/' and '%', the result replaces "tv1".
+ * "tv1" must have passed eval_mult_check().  "tv2" is cleared.
+ * Returns FAIL on error.
+ */
+    static int
+eval_mult(tv1, tv2, op)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    int		op;
+{
+    long	n1, n2;
 #ifdef FEAT_FLOAT
-		if (use_float)
-		    f2 = n2;
+    int		use_float = FALSE;
+    float_T	f1 = 0, f2;
 #endif
-	    }
+    int		error = FALSE;
 
-	    /*
-	     * Compute the result.
-	     * When either side is a float the result is a float.
-	     */
 #ifdef FEAT_FLOAT
-	    if (use_float)
-	    {
-		if (op == '*')
-		    f1 = f1 * f2;
-		else if (op == '/')
-		{
+    if (tv1->v_type == VAR_FLOAT)
+    {
+	f1 = tv1->vval.v_float;
+	use_float = TRUE;
+	n1 = 0;
+    }
+    else
+#endif
+	n1 = tv1->vval.v_number;
+
+#ifdef FEAT_FLOAT
+    if (tv2->v_type == VAR_FLOAT)
+    {
+	if (!use_float)
+	{
+	    f1 = n1;
+	    use_float = TRUE;
+	}
+	f2 = tv2->vval.v_float;
+	n2 = 0;
+    }
+    else
+#endif
+    {
+	n2 = get_tv_number_chk(tv2, &error);
+	clear_tv(tv2);
+	if (error)
+	    return FAIL;
+#ifdef FEAT_FLOAT
+	if (use_float)
+	    f2 = n2;
+#endif
+    }
+
+    /*
+     * Compute the result.
+     * When either side is a float the result is a float.
+     */
+#ifdef FEAT_FLOAT
+    if (use_float)
+    {
+	if (op == '*')
+	    f1 = f1 * f2;
+	else if (op == '/')
+	{
 # ifdef VMS
-		    /* VMS crashes on divide by zero, work around it */
-		    if (f2 == 0.0)
-		    {
-			if (f1 == 0)
-			    f1 = -1 * __F_FLT_MAX - 1L;   /* similar to NaN */
-			else if (f1 < 0)
-			    f1 = -1 * __F_FLT_MAX;
-			else
-			    f1 = __F_FLT_MAX;
-		    }
-		    else
-			f1 = f1 / f2;
-# else
-		    /* We rely on the floating point library to handle divide
-		     * by zero to result in "inf" and not a crash. */
-		    f1 = f1 / f2;
-# endif
-		}
+	    /* VMS crashes on divide by zero, work around it */
+	    if (f2 == 0.0)
+	    {
+		if (f1 == 0)
+		    f1 = -1 * __F_FLT_MAX - 1L;   /* similar to NaN */
+		else if (f1 < 0)
+		    f1 = -1 * __F_FLT_MAX;
 		else
-		{
-		    EMSG(_("E804: Cannot use '%' with Float"));
-		    return FAIL;
-		}
-		rettv->v_type = VAR_FLOAT;
-		rettv->vval.v_float = f1;
+		    f1 = __F_FLT_MAX;
 	    }
 	    else
+		f1 = f1 / f2;
+# else
+	    /* We rely on the floating point library to handle divide
+	     * by zero to result in "inf" and not a crash. */
+	    f1 = f1 / f2;
+# endif
+	}
+	else
+	{
+	    EMSG(_("E804: Cannot use '%' with Float"));
+	    return FAIL;
+	}
+	tv1->v_type = VAR_FLOAT;
+	tv1->vval.v_float = f1;
+    }
+    else
 #endif
+    {
+	if (op == '*')
+	    n1 = n1 * n2;
+	else if (op == '/')
+	{
+	    if (n2 == 0)	/* give an error message? */
 	    {
-		if (op == '*')
-		    n1 = n1 * n2;
-		else if (op == '/')
-		{
-		    if (n2 == 0)	/* give an error message? */
-		    {
-			if (n1 == 0)
-			    n1 = -0x7fffffffL - 1L;	/* similar to NaN */
-			else if (n1 < 0)
-			    n1 = -0x7fffffffL;
-			else
-			    n1 = 0x7fffffffL;
-		    }
-		    else
-			n1 = n1 / n2;
-		}
+		if (n1 == 0)
+		    n1 = -0x7fffffffL - 1L;	/* similar to NaN */
+		else if (n1 < 0)
+		    n1 = -0x7fffffffL;
 		else
-		{
-		    if (n2 == 0)	/* give an error message? */
-			n1 = 0;
-		    else
-			n1 = n1 % n2;
-		}
-		rettv->v_type = VAR_NUMBER;
-		rettv->vval.v_number = n1;
+		    n1 = 0x7fffffffL;
 	    }
+	    else
+		n1 = n1 / n2;
+	}
+	else
+	{
+	    if (n2 == 0)	/* give an error message? */
+		n1 = 0;
+	    else
+		n1 = n1 % n2;
 	}
+	tv1->v_type = VAR_NUMBER;
+	tv1->vval.v_number = n1;
     }
-
     return OK;
 }
 
@@ -5026,9 +5225,8 @@ eval7(arg, rettv, evaluate, want_string)
     char_u	**arg;
     typval_T	*rettv;
     int		evaluate;
-    int		want_string UNUSED;	/* after "." operator */
+    int		want_string;	/* after "." operator */
 {
-    long	n;
     int		len;
     char_u	*s;
     char_u	*start_leader, *end_leader;
@@ -5063,58 +5261,8 @@ eval7(arg, rettv, evaluate, want_string)
     case '6':
     case '7':
     case '8':
-    case '9':
-	{
-#ifdef FEAT_FLOAT
-		char_u *p = skipdigits(*arg + 1);
-		int    get_float = FALSE;
-
-		/* We accept a float when the format matches
-		 * "[0-9]\+\.[0-9]\+\([eE][+-]\?[0-9]\+\)\?".  This is very
-		 * strict to avoid backwards compatibility problems.
-		 * Don't look for a float after the "." operator, so that
-		 * ":let vers = 1.2.3" doesn't fail. */
-		if (!want_string && p[0] == '.' && vim_isdigit(p[1]))
-		{
-		    get_float = TRUE;
-		    p = skipdigits(p + 2);
-		    if (*p == 'e' || *p == 'E')
-		    {
-			++p;
-			if (*p == '-' || *p == '+')
-			    ++p;
-			if (!vim_isdigit(*p))
-			    get_float = FALSE;
-			else
-			    p = skipdigits(p + 1);
-		    }
-		    if (ASCII_ISALPHA(*p) || *p == '.')
-			get_float = FALSE;
-		}
-		if (get_float)
-		{
-		    float_T	f;
-
-		    *arg += string2float(*arg, &f);
-		    if (evaluate)
-		    {
-			rettv->v_type = VAR_FLOAT;
-			rettv->vval.v_float = f;
-		    }
-		}
-		else
-#endif
-		{
-		    vim_str2nr(*arg, NULL, &len, TRUE, TRUE, &n, NULL);
-		    *arg += len;
-		    if (evaluate)
-		    {
-			rettv->v_type = VAR_NUMBER;
-			rettv->vval.v_number = n;
-		    }
-		}
+    case '9':	ret = get_number_tv(arg, rettv, evaluate, want_string);
 		break;
-	}
 
     /*
      * String constant: "string".
@@ -5249,63 +5397,74 @@ eval7(arg, rettv, evaluate, want_string)
      * Apply logical NOT and unary '-', from right to left, ignore '+'.
      */
     if (ret == OK && evaluate && end_leader > start_leader)
-    {
-	int	    error = FALSE;
-	int	    val = 0;
+	ret = eval_leader(rettv, start_leader, end_leader);
+
+    return ret;
+}
+
+/*
+ * Apply the '!', '-' and '+' characters between "start_leader" and
+ * "end_leader" to "tv", from right to left.  Returns FAIL and clears "tv"
+ * when it is not a Number or Float.
+ */
+    static int
+eval_leader(tv, start_leader, end_leader)
+    typval_T	*tv;
+    char_u	*start_leader;
+    char_u	*end_leader;
+{
+    int		error = FALSE;
+    int		val = 0;
 #ifdef FEAT_FLOAT
-	float_T	    f = 0.0;
+    float_T	f = 0.0;
 
-	if (rettv->v_type == VAR_FLOAT)
-	    f = rettv->vval.v_float;
-	else
+    if (tv->v_type == VAR_FLOAT)
+	f = tv->vval.v_float;
+    else
 #endif
-	    val = get_tv_number_chk(rettv, &error);
-	if (error)
-	{
-	    clear_tv(rettv);
-	    ret = FAIL;
-	}
-	else
+	val = get_tv_number_chk(tv, &error);
+    if (error)
+    {
+	clear_tv(tv);
+	return FAIL;
+    }
+
+    while (end_leader > start_leader)
+    {
+	--end_leader;
+	if (*end_leader == '!')
 	{
-	    while (end_leader > start_leader)
-	    {
-		--end_leader;
-		if (*end_leader == '!')
-		{
-#ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f = !f;
-		    else
-#endif
-			val = !val;
-		}
-		else if (*end_leader == '-')
-		{
 #ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f = -f;
-		    else
+	    if (tv->v_type == VAR_FLOAT)
+		f = !f;
+	    else
 #endif
-			val = -val;
-		}
-	    }
+		val = !val;
+	}
+	else if (*end_leader == '-')
+	{
 #ifdef FEAT_FLOAT
-	    if (rettv->v_type == VAR_FLOAT)
-	    {
-		clear_tv(rettv);
-		rettv->vval.v_float = f;
-	    }
+	    if (tv->v_type == VAR_FLOAT)
+		f = -f;
 	    else
 #endif
-	    {
-		clear_tv(rettv);
-		rettv->v_type = VAR_NUMBER;
-		rettv->vval.v_number = val;
-	    }
+		val = -val;
 	}
     }
-
-    return ret;
+#ifdef FEAT_FLOAT
+    if (tv->v_type == VAR_FLOAT)
+    {
+	clear_tv(tv);
+	tv->vval.v_float = f;
+    }
+    else
+#endif
+    {
+	clear_tv(tv);
+	tv->v_type = VAR_NUMBER;
+	tv->vval.v_number = val;
+    }
+    return OK;
 }
 
 /*
@@ -5322,10 +5481,8 @@ eval_index(arg, rettv, evaluate, verbose)
 {
     int		empty1 = FALSE, empty2 = FALSE;
     typval_T	var1, var2;
-    long	n1, n2 = 0;
     long	len = -1;
     int		range = FALSE;
-    char_u	*s;
     char_u	*key = NULL;
 
     if (rettv->v_type == VAR_FUNC)
@@ -5413,156 +5570,182 @@ eval_index(arg, rettv, evaluate, verbose)
     }
 
     if (evaluate)
+	return eval_index_tv(rettv, &var1, &var2, key, len,
+						    range, empty1, empty2, verbose);
+    return OK;
+}
+
+/*
+ * Get the item of "rettv" with index "var1", or the range "var1" to "var2",
+ * see eval_index().  For a Dictionary "key" with length "keylen" is used
+ * when "keylen" is not -1.  "var1" and "var2" are cleared when used.
+ * The result replaces "rettv".  Returns FAIL when the item doesn't exist.
+ */
+    static int
+eval_index_tv(rettv, var1, var2, key, keylen, range, empty1, empty2, verbose)
+    typval_T	*rettv;
+    typval_T	*var1;
+    typval_T	*var2;
+    char_u	*key;
+    long	keylen;
+    int		range;
+    int		empty1;
+    int		empty2;
+    int		verbose;	/* give error messages */
+{
+    typval_T	var;
+    long	n1, n2 = 0;
+    long	len;
+    char_u	*s;
+
+    n1 = 0;
+    if (!empty1 && rettv->v_type != VAR_DICT)
     {
-	n1 = 0;
-	if (!empty1 && rettv->v_type != VAR_DICT)
-	{
-	    n1 = get_tv_number(&var1);
-	    clear_tv(&var1);
-	}
-	if (range)
+	n1 = get_tv_number(var1);
+	clear_tv(var1);
+    }
+    if (range)
+    {
+	if (empty2)
+	    n2 = -1;
+	else
 	{
-	    if (empty2)
-		n2 = -1;
-	    else
-	    {
-		n2 = get_tv_number(&var2);
-		clear_tv(&var2);
-	    }
+	    n2 = get_tv_number(var2);
+	    clear_tv(var2);
 	}
+    }
 
-	switch (rettv->v_type)
-	{
-	    case VAR_NUMBER:
-	    case VAR_STRING:
-		s = get_tv_string(rettv);
-		len = (long)STRLEN(s);
-		if (range)
+    switch (rettv->v_type)
+    {
+	case VAR_NUMBER:
+	case VAR_STRING:
+	    s = get_tv_string(rettv);
+	    len = (long)STRLEN(s);
+	    if (range)
+	    {
+		/* The resulting variable is a substring.  If the indexes
+		 * are out of range the result is empty. */
+		if (n1 < 0)
 		{
-		    /* The resulting variable is a substring.  If the indexes
-		     * are out of range the result is empty. */
+		    n1 = len + n1;
 		    if (n1 < 0)
-		    {
-			n1 = len + n1;
-			if (n1 < 0)
-			    n1 = 0;
-		    }
-		    if (n2 < 0)
-			n2 = len + n2;
-		    else if (n2 >= len)
-			n2 = len;
-		    if (n1 >= len || n2 < 0 || n1 > n2)
-			s = NULL;
-		    else
-			s = vim_strnsave(s + n1, (int)(n2 - n1 + 1));
+			n1 = 0;
 		}
+		if (n2 < 0)
+		    n2 = len + n2;
+		else if (n2 >= len)
+		    n2 = len;
+		if (n1 >= len || n2 < 0 || n1 > n2)
+		    s = NULL;
 		else
-		{
-		    /* The resulting variable is a string of a single
-		     * character.  If the index is too big or negative the
-		     * result is empty. */
-		    if (n1 >= len || n1 < 0)
-			s = NULL;
-		    else
-			s = vim_strnsave(s + n1, 1);
-		}
-		clear_tv(rettv);
-		rettv->v_type = VAR_STRING;
-		rettv->vval.v_string = s;
-		break;
+		    s = vim_strnsave(s + n1, (int)(n2 - n1 + 1));
+	    }
+	    else
+	    {
+		/* The resulting variable is a string of a single
+		 * character.  If the index is too big or negative the
+		 * result is empty. */
+		if (n1 >= len || n1 < 0)
+		    s = NULL;
+		else
+		    s = vim_strnsave(s + n1, 1);
+	    }
+	    clear_tv(rettv);
+	    rettv->v_type = VAR_STRING;
+	    rettv->vval.v_string = s;
+	    break;
 
-	    case VAR_LIST:
-		len = list_len(rettv->vval.v_list);
-		if (n1 < 0)
-		    n1 = len + n1;
-		if (!empty1 && (n1 < 0 || n1 >= len))
+	case VAR_LIST:
+	    len = list_len(rettv->vval.v_list);
+	    if (n1 < 0)
+		n1 = len + n1;
+	    if (!empty1 && (n1 < 0 || n1 >= len))
+	    {
+		/* For a range we allow invalid values and return an empty
+		 * list.  A list index out of range is an error. */
+		if (!range)
 		{
-		    /* For a range we allow invalid values and return an empty
-		     * list.  A list index out of range is an error. */
-		    if (!range)
-		    {
-			if (verbose)
-			    EMSGN(_(e_listidx), n1);
-			return FAIL;
-		    }
-		    n1 = len;
+		    if (verbose)
+			EMSGN(_(e_listidx), n1);
+		    return FAIL;
 		}
-		if (range)
+		n1 = len;
+	    }
+	    if (range)
+	    {
+		list_T	*l;
+		listitem_T	*item;
+
+		if (n2 < 0)
+		    n2 = len + n2;
+		else if (n2 >= len)
+		    n2 = len - 1;
+		if (!empty2 && (n2 < 0 || n2 + 1 < n1))
+		    n2 = -1;
+		l = list_alloc();
+		if (l == NULL)
+		    return FAIL;
+		for (item = list_find(rettv->vval.v_list, n1);
+							   n1 <= n2; ++n1)
 		{
-		    list_T	*l;
-		    listitem_T	*item;
-
-		    if (n2 < 0)
-			n2 = len + n2;
-		    else if (n2 >= len)
-			n2 = len - 1;
-		    if (!empty2 && (n2 < 0 || n2 + 1 < n1))
-			n2 = -1;
-		    l = list_alloc();
-		    if (l == NULL)
-			return FAIL;
-		    for (item = list_find(rettv->vval.v_list, n1);
-							       n1 <= n2; ++n1)
+		    if (list_append_tv(l, &item->li_tv) == FAIL)
 		    {
-			if (list_append_tv(l, &item->li_tv) == FAIL)
-			{
-			    list_free(l, TRUE);
-			    return FAIL;
-			}
-			item = item->li_next;
+			list_free(l, TRUE);
+			return FAIL;
 		    }
-		    clear_tv(rettv);
-		    rettv->v_type = VAR_LIST;
-		    rettv->vval.v_list = l;
-		    ++l->lv_refcount;
-		}
-		else
-		{
-		    copy_tv(&list_find(rettv->vval.v_list, n1)->li_tv, &var1);
-		    clear_tv(rettv);
-		    *rettv = var1;
+		    item = item->li_next;
 		}
-		break;
+		clear_tv(rettv);
+		rettv->v_type = VAR_LIST;
+		rettv->vval.v_list = l;
+		++l->lv_refcount;
+	    }
+	    else
+	    {
+		copy_tv(&list_find(rettv->vval.v_list, n1)->li_tv, &var);
+		clear_tv(rettv);
+		*rettv = var;
+	    }
+	    break;
 
-	    case VAR_DICT:
-		if (range)
-		{
-		    if (verbose)
-			EMSG(_(e_dictrange));
-		    if (len == -1)
-			clear_tv(&var1);
-		    return FAIL;
-		}
-		{
-		    dictitem_T	*item;
+	case VAR_DICT:
+	    if (range)
+	    {
+		if (verbose)
+		    EMSG(_(e_dictrange));
+		if (keylen == -1)
+		    clear_tv(var1);
+		return FAIL;
+	    }
+	    {
+		dictitem_T	*item;
 
-		    if (len == -1)
+		if (keylen == -1)
+		{
+		    key = get_tv_string(var1);
+		    if (*key == NUL)
 		    {
-			key = get_tv_string(&var1);
-			if (*key == NUL)
-			{
-			    if (verbose)
-				EMSG(_(e_emptykey));
-			    clear_tv(&var1);
-			    return FAIL;
-			}
+			if (verbose)
+			    EMSG(_(e_emptykey));
+			clear_tv(var1);
+			return FAIL;
 		    }
+		}
 
-		    item = dict_find(rettv->vval.v_dict, key, (int)len);
+		item = dict_find(rettv->vval.v_dict, key, (int)keylen);
 
-		    if (item == NULL && verbose)
-			EMSG2(_(e_dictkey), key);
-		    if (len == -1)
-			clear_tv(&var1);
-		    if (item == NULL)
-			return FAIL;
+		if (item == NULL && verbose)
+		    EMSG2(_(e_dictkey), key);
+		if (keylen == -1)
+		    clear_tv(var1);
+		if (item == NULL)
+		    return FAIL;
 
-		    copy_tv(&item->di_tv, &var1);
-		    clear_tv(rettv);
-		    *rettv = var1;
-		}
-		break;
-	}
+		copy_tv(&item->di_tv, &var);
+		clear_tv(rettv);
+		*rettv = var;
+	    }
+	    break;
     }
 
     return OK;
@@ -5650,46 +5833,110 @@ get_option_tv(arg, rettv, evaluate)
 }
 
 /*
- * Allocate a variable for a string constant.
- * Return OK or FAIL.
+ * Get the value of a number constant, may be a Float, and advance "arg".
+ * Return OK.
  */
     static int
-get_string_tv(arg, rettv, evaluate)
+get_number_tv(arg, rettv, evaluate, want_string)
     char_u	**arg;
     typval_T	*rettv;
     int		evaluate;
+    int		want_string UNUSED;	/* after "." operator */
 {
-    char_u	*p;
-    char_u	*name;
-    int		extra = 0;
+    long	n;
+    int		len;
+#ifdef FEAT_FLOAT
+    char_u	*p = skipdigits(*arg + 1);
+    int		get_float = FALSE;
 
-    /*
-     * Find the end of the string, skipping backslashed characters.
-     */
-    for (p = *arg + 1; *p != NUL && *p != '"'; mb_ptr_adv(p))
+    /* We accept a float when the format matches
+     * "[0-9]\+\.[0-9]\+\([eE][+-]\?[0-9]\+\)\?".  This is very
+     * strict to avoid backwards compatibility problems.
+     * Don't look for a float after the "." operator, so that
+     * ":let vers = 1.2.3" doesn't fail. */
+    if (!want_string && p[0] == '.' && vim_isdigit(p[1]))
     {
-	if (*p == '\\' && p[1] != NUL)
+	get_float = TRUE;
+	p = skipdigits(p + 2);
+	if (*p == 'e' || *p == 'E')
 	{
 	    ++p;
-	    /* A "\<x>" form occupies at least 4 characters, and produces up
-	     * to 6 characters: reserve space for 2 extra */
-	    if (*p == '<')
-		extra += 2;
+	    if (*p == '-' || *p == '+')
+		++p;
+	    if (!vim_isdigit(*p))
+		get_float = FALSE;
+	    else
+		p = skipdigits(p + 1);
 	}
+	if (ASCII_ISALPHA(*p) || *p == '.')
+	    get_float = FALSE;
     }
-
-    if (*p != '"')
-    {
-	EMSG2(_("E114: Missing quote: %s"), *arg);
-	return FAIL;
-    }
-
-    /* If only parsing, set *arg and return here */
-    if (!evaluate)
+    if (get_float)
     {
-	*arg = p + 1;
-	return OK;
-    }
+	float_T	f;
+
+	*arg += string2float(*arg, &f);
+	if (evaluate)
+	{
+	    rettv->v_type = VAR_FLOAT;
+	    rettv->vval.v_float = f;
+	}
+    }
+    else
+#endif
+    {
+	vim_str2nr(*arg, NULL, &len, TRUE, TRUE, &n, NULL);
+	*arg += len;
+	if (evaluate)
+	{
+	    rettv->v_type = VAR_NUMBER;
+	    rettv->vval.v_number = n;
+	}
+    }
+    return OK;
+}
+
+/*
+ * Allocate a variable for a string constant.
+ * Return OK or FAIL.
+ */
+    static int
+get_string_tv(arg, rettv, evaluate)
+    char_u	**arg;
+    typval_T	*rettv;
+    int		evaluate;
+{
+    char_u	*p;
+    char_u	*name;
+    int		extra = 0;
+
+    /*
+     * Find the end of the string, skipping backslashed characters.
+     */
+    for (p = *arg + 1; *p != NUL && *p != '"'; mb_ptr_adv(p))
+    {
+	if (*p == '\\' && p[1] != NUL)
+	{
+	    ++p;
+	    /* A "\<x>" form occupies at least 4 characters, and produces up
+	     * to 6 characters: reserve space for 2 extra */
+	    if (*p == '<')
+		extra += 2;
+	}
+    }
+
+    if (*p != '"')
+    {
+	EMSG2(_("E114: Missing quote: %s"), *arg);
+	return FAIL;
+    }
+
+    /* If only parsing, set *arg and return here */
+    if (!evaluate)
+    {
+	*arg = p + 1;
+	return OK;
+    }
 
     /*
      * Copy the string into allocated memory, handling backslashed
@@ -8045,6 +8292,7 @@ static struct fst
     {"buffer_number",	1, 1, f_bufnr},		/* obsolete */
     {"buflisted",	1, 1, f_buflisted},
     {"bufloaded",	1, 1, f_bufloaded},
+    {"bufmemstat",	1, 1, f_bufmemstat},
     {"bufname",		1, 1, f_bufname},
     {"bufnr",		1, 2, f_bufnr},
     {"bufwinnr",	1, 1, f_bufwinnr},
@@ -9275,6 +9523,36 @@ f_bufloaded(argvars, rettv)
 
 static buf_T *get_buf_tv __ARGS((typval_T *tv, int curtab_only));
 
+/*
+ * "bufmemstat(expr)" function
+ */
+    static void
+f_bufmemstat(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    buf_T	*buf;
+    memfile_T	*mfp;
+    dict_T	*d;
+
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+    (void)get_tv_number(&argvars[0]);	    /* issue errmsg if type error */
+    ++emsg_off;
+    buf = get_buf_tv(&argvars[0], FALSE);
+    --emsg_off;
+    if (buf == NULL || (mfp = buf->b_ml.ml_mfp) == NULL)
+	return;
+
+    d = rettv->vval.v_dict;
+    dict_add_nr_str(d, "hits", mfp->mf_hits, NULL);
+    dict_add_nr_str(d, "misses", mfp->mf_misses, NULL);
+    dict_add_nr_str(d, "evictions", mfp->mf_evictions, NULL);
+    dict_add_nr_str(d, "pages", (long)mfp->mf_used_count, NULL);
+    dict_add_nr_str(d, "hotpages", (long)mfp->mf_hot_count, NULL);
+    dict_add_nr_str(d, "pagesize", (long)mfp->mf_page_size, NULL);
+}
+
 /*
  * Get buffer by number or pattern.
  */
@@ -12780,6 +13058,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SESSION
 	"mksession",
 #endif
+#ifdef FEAT_MMAP
+	"mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"modify_fname",
 #endif
@@ -12865,6 +13146,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_PROFILE
 	"profile",
 #endif
+#ifdef FEAT_RE_CACHE
+	"regexp_cache",
+#endif
 #ifdef FEAT_RELTIME
 	"reltime",
 #endif
@@ -12893,6 +13177,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SNIFF
 	"sniff",
 #endif
+#ifdef FEAT_SORT_THREAD
+	"sortthread",
+#endif
 #ifdef STARTUPTIME
 	"startuptime",
 #endif
@@ -12908,6 +13195,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SPELL
 	"spell",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"swapthread",
+#endif
 #ifdef FEAT_SYN_HL
 	"syntax",
 #endif
@@ -12959,6 +13249,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_VERTSPLIT
 	"vertsplit",
 #endif
+#ifdef FEAT_VIMGREP_THREAD
+	"vimgrepthread",
+#endif
 #ifdef FEAT_VIRTUALEDIT
 	"virtualedit",
 #endif
@@ -20004,6 +20297,9 @@ var2fpos(varp, dollar_lnum, fnum)
     {
 	if (dollar_lnum)
 	{
+# ifdef FEAT_MMAP
+	    ml_mmap_finish(curbuf);
+# endif
 	    pos.lnum = curbuf->b_ml.ml_line_count;
 	    pos.col = 0;
 	}
@@ -20566,6 +20862,10 @@ set_cmdarg(eap, oldarg)
 
     if (eap->read_edit)
 	len += 7;
+# ifdef FEAT_MMAP
+    if (eap->read_mmap)
+	len += 7;
+# endif
 
     if (eap->force_ff != 0)
 	len += (unsigned)STRLEN(eap->cmd + eap->force_ff) + 6;
@@ -20589,6 +20889,10 @@ set_cmdarg(eap, oldarg)
 
     if (eap->read_edit)
 	STRCAT(newval, " ++edit");
+# ifdef FEAT_MMAP
+    if (eap->read_mmap)
+	STRCAT(newval, " ++mmap");
+# endif
 
     if (eap->force_ff != 0)
 	sprintf((char *)newval + STRLEN(newval), " ++ff=%s",
@@ -20963,7 +21267,12 @@ get_tv_lnum_buf(argvars, buf)
 	    && argvars[0].vval.v_string != NULL
 	    && argvars[0].vval.v_string[0] == '$'
 	    && buf != NULL)
+    {
+# ifdef FEAT_MMAP
+	ml_mmap_finish(buf);
+# endif
 	return buf->b_ml.ml_line_count;
+    }
     return get_tv_number_chk(&argvars[0], NULL);
 }
 
@@ -22543,6 +22852,7 @@ ex_function(eap)
 	    /* redefine existing function */
 	    ga_clear_strings(&(fp->uf_args));
 	    ga_clear_strings(&(fp->uf_lines));
+	    free_cfunc(fp->uf_cfunc);
 	    vim_free(name);
 	    name = NULL;
 	}
@@ -22646,6 +22956,8 @@ ex_function(eap)
     }
     fp->uf_args = newargs;
     fp->uf_lines = newlines;
+    fp->uf_cfunc = NULL;
+    fp->uf_cfunc_failed = FALSE;
 #ifdef FEAT_PROFILE
     fp->uf_tml_count = NULL;
     fp->uf_tml_total = NULL;
@@ -23463,6 +23775,7 @@ func_free(fp)
     /* clear this function */
     ga_clear_strings(&(fp->uf_args));
     ga_clear_strings(&(fp->uf_lines));
+    free_cfunc(fp->uf_cfunc);
 #ifdef FEAT_PROFILE
     vim_free(fp->uf_tml_count);
     vim_free(fp->uf_tml_total);
@@ -23757,9 +24070,31 @@ call_user_func(fp, argcount, argvars, rettv, firstline, lastline, selfdict)
     save_did_emsg = did_emsg;
     did_emsg = FALSE;
 
+    /* Execute the compiled function, unless debugging, profiling or
+     * verbose messages for each line are wanted.  It is compiled the first
+     * time it is called. */
+    fc->vm = NULL;
+    if (fc->breakpoint == 0 && debug_break_level < 0 && p_verbose < 15
+#ifdef FEAT_PROFILE
+	    && do_profiling != PROF_YES
+#endif
+	    )
+    {
+	if (fp->uf_cfunc == NULL && !fp->uf_cfunc_failed)
+	{
+	    fp->uf_cfunc = compile_func(fp);
+	    if (fp->uf_cfunc == NULL)
+		fp->uf_cfunc_failed = TRUE;
+	}
+	if (fp->uf_cfunc != NULL)
+	    fc->vm = func_vm_alloc(fp->uf_cfunc);
+    }
+
     /* call do_cmdline() to execute the lines */
     do_cmdline(NULL, get_func_line, (void *)fc,
 				     DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
+    func_vm_free(fc->vm);
+    fc->vm = NULL;
 
     --RedrawingDisabled;
 
@@ -24122,20 +24457,2390 @@ get_return_cmd(rettv)
 }
 
 /*
- * Get next function line.
- * Called by do_cmdline() to get the next line.
- * Returns allocated string, or NULL for end of function.
+ * Compiling user functions.
+ *
+ * The first time a function is called its lines are compiled into
+ * instructions for a small stack machine: ":let", ":if", ":elseif", ":else",
+ * ":endif", ":while", ":for", ":endwhile", ":endfor", ":break", ":continue",
+ * ":return" and ":call".  Other lines are passed to do_cmdline() as before
+ * (ISN_EXEC).  Parts of an expression that can't be compiled are evaluated
+ * from their text (ISN_EVAL).  Local variables and arguments are found once
+ * and then remembered.
+ * When a function can't be compiled, e.g. because it uses ":try", or when
+ * debugging, profiling or being verbose, its lines are executed one by one.
  */
-    char_u *
-get_func_line(c, cookie, indent)
-    int	    c UNUSED;
-    void    *cookie;
-    int	    indent UNUSED;
+
+#define VM_STACK_LEN	50	/* max nr of values on the stack */
+#define VM_MAX_CALLS	10	/* max nr of nested function calls */
+
+/* An ":if", ":while" or ":for" being compiled. */
+typedef struct
 {
-    funccall_T	*fcp = (funccall_T *)cookie;
-    ufunc_T	*fp = fcp->func;
-    char_u	*retval;
-    garray_T	*gap;  /* growarray with function lines */
+    int		cn_cmdidx;	/* CMD_if, CMD_while or CMD_for */
+    int		cn_top;		/* first instruction of the loop */
+    int		cn_cond;	/* ISN_COND to patch at ":elseif" or -1 */
+    int		cn_had_else;	/* ":else" was found */
+    int		cn_forinfo;	/* index of the for loop */
+    garray_T	cn_patch;	/* jumps to patch at the end */
+} ccnest_T;
+
+/* State of compiling a function. */
+typedef struct
+{
+    ufunc_T	*cc_fp;
+    cfunc_T	*cc_cf;
+    int		cc_error;	/* TRUE when function can't be compiled */
+    int		cc_depth;	/* nr of values on the stack */
+    int		cc_calls;	/* nr of nested function calls */
+    int		cc_label;	/* highest jump target */
+    ccnest_T	cc_nest[CSTACK_LEN];
+    int		cc_nest_idx;	/* current entry in cc_nest[] or -1 */
+} cctx_T;
+
+#define CC_ISN(cc, idx) (((isn_T *)(cc)->cc_cf->cf_instr.ga_data) + (idx))
+#define CC_LEN(cc) ((cc)->cc_cf->cf_instr.ga_len)
+
+static struct
+{
+    char	*name;
+    int		len;
+    int		cmdidx;
+} cc_cmds[] =
+{
+    {"elseif", 5, CMD_elseif},
+    {"else", 2, CMD_else},
+    {"endif", 2, CMD_endif},
+    {"endwhile", 4, CMD_endwhile},
+    {"endfor", 5, CMD_endfor},
+    {"endfunction", 4, CMD_endfunction},
+    {"endtry", 4, CMD_endtry},
+    {"if", 2, CMD_if},
+    {"while", 2, CMD_while},
+    {"for", 3, CMD_for},
+    {"break", 4, CMD_break},
+    {"continue", 3, CMD_continue},
+    {"return", 4, CMD_return},
+    {"call", 3, CMD_call},
+    {"let", 3, CMD_let},
+    {"try", 3, CMD_try},
+    {"catch", 3, CMD_catch},
+    {"finally", 4, CMD_finally},
+    {"function", 2, CMD_function},
+    {"append", 1, CMD_append},
+    {"insert", 1, CMD_insert},
+    {"change", 1, CMD_change},
+};
+
+/*
+ * Add an instruction of type "type".
+ * Never returns NULL, but the result must not be used after adding another
+ * instruction.
+ */
+    static isn_T *
+cc_emit(cc, type)
+    cctx_T	*cc;
+    isntype_T	type;
+{
+    static isn_T dummy;
+    isn_T	*isn;
+
+    if (ga_grow(&cc->cc_cf->cf_instr, 1) == FAIL)
+    {
+	cc->cc_error = TRUE;
+	isn = &dummy;
+    }
+    else
+	isn = CC_ISN(cc, CC_LEN(cc)++);
+    vim_memset(isn, 0, sizeof(isn_T));
+    isn->isn_type = type;
+    isn->isn_tv.v_type = VAR_UNKNOWN;
+    return isn;
+}
+
+/*
+ * Remove the instructions from "len" onwards.
+ */
+    static void
+cc_truncate(cc, len)
+    cctx_T	*cc;
+    int		len;
+{
+    while (CC_LEN(cc) > len)
+	clear_tv(&CC_ISN(cc, --CC_LEN(cc))->isn_tv);
+}
+
+/*
+ * Set the jump target "field" (1 or 2) of instruction "idx" to the next
+ * instruction.
+ */
+    static void
+cc_patch(cc, idx, field)
+    cctx_T	*cc;
+    int		idx;
+    int		field;
+{
+    int		target = CC_LEN(cc);
+
+    if (idx < 0 || idx >= target)
+	return;
+    if (field == 1)
+	CC_ISN(cc, idx)->isn_arg1 = target;
+    else
+	CC_ISN(cc, idx)->isn_arg2 = target;
+    if (target > cc->cc_label)
+	cc->cc_label = target;
+}
+
+/*
+ * Remember to patch jump target "field" of instruction "idx" at the end of
+ * the current ":if", ":while" or ":for".
+ */
+    static void
+cc_add_patch(cc, nest, idx, field)
+    cctx_T	*cc;
+    ccnest_T	*nest;
+    int		idx;
+    int		field;
+{
+    if (ga_grow(&nest->cn_patch, 1) == FAIL)
+	cc->cc_error = TRUE;
+    else
+	((int *)nest->cn_patch.ga_data)[nest->cn_patch.ga_len++] =
+							  idx * 2 + field - 1;
+}
+
+/*
+ * Patch all the jumps remembered for "nest" and free the list.
+ */
+    static void
+cc_patch_all(cc, nest)
+    cctx_T	*cc;
+    ccnest_T	*nest;
+{
+    int		i;
+    int		n;
+
+    for (i = 0; i < nest->cn_patch.ga_len; ++i)
+    {
+	n = ((int *)nest->cn_patch.ga_data)[i];
+	cc_patch(cc, n / 2, n % 2 + 1);
+    }
+    ga_clear(&nest->cn_patch);
+}
+
+/*
+ * Return a copy of "len" bytes at "p" that is freed with the function.
+ * Returns NULL when out of memory.
+ */
+    static char_u *
+cc_str(cc, p, len)
+    cctx_T	*cc;
+    char_u	*p;
+    int		len;
+{
+    char_u	*s;
+
+    if (ga_grow(&cc->cc_cf->cf_strings, 1) == FAIL
+				       || (s = vim_strnsave(p, len)) == NULL)
+    {
+	cc->cc_error = TRUE;
+	return NULL;
+    }
+    ((char_u **)cc->cc_cf->cf_strings.ga_data)[
+					 cc->cc_cf->cf_strings.ga_len++] = s;
+    return s;
+}
+
+/*
+ * Return the index of name "p[len]" in "gap", adding it when needed.
+ */
+    static int
+cc_slot(cc, gap, p, len)
+    cctx_T	*cc;
+    garray_T	*gap;
+    char_u	*p;
+    int		len;
+{
+    int		i;
+    char_u	*s;
+
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	s = ((char_u **)gap->ga_data)[i];
+	if (STRNCMP(s, p, len) == 0 && s[len] == NUL)
+	    return i;
+    }
+    if (ga_grow(gap, 1) == FAIL || (s = vim_strnsave(p, len)) == NULL)
+    {
+	cc->cc_error = TRUE;
+	return -1;
+    }
+    ((char_u **)gap->ga_data)[gap->ga_len] = s;
+    return gap->ga_len++;
+}
+
+/*
+ * Return TRUE when "p[len]" is a plain variable name.
+ */
+    static int
+cc_is_ident(p, len)
+    char_u	*p;
+    int		len;
+{
+    int		i;
+
+    if (len <= 0 || !(ASCII_ISALPHA(*p) || *p == '_'))
+	return FALSE;
+    for (i = 1; i < len; ++i)
+	if (!(ASCII_ISALNUM(p[i]) || p[i] == '_'))
+	    return FALSE;
+    return TRUE;
+}
+
+/*
+ * When "p[len]" is a local variable, with or without "l:", return the index
+ * of its slot.  Otherwise return -1.
+ */
+    static int
+cc_local_slot(cc, p, len)
+    cctx_T	*cc;
+    char_u	*p;
+    int		len;
+{
+    char_u	*name;
+    hashitem_T	*hi;
+
+    if (len > 2 && p[0] == 'l' && p[1] == ':')
+    {
+	p += 2;
+	len -= 2;
+    }
+    else
+    {
+	if (!cc_is_ident(p, len))
+	    return -1;
+	/* "count" is "v:count" */
+	name = vim_strnsave(p, len);
+	if (name == NULL)
+	    return -1;
+	hi = hash_find(&compat_hashtab, name);
+	vim_free(name);
+	if (!HASHITEM_EMPTY(hi))
+	    return -1;
+    }
+    if (!cc_is_ident(p, len))
+	return -1;
+    return cc_slot(cc, &cc->cc_cf->cf_locals, p, len);
+}
+
+/*
+ * Account for a value pushed on the stack.  Returns FAIL when the stack
+ * would get too deep.
+ */
+    static int
+cc_push(cc)
+    cctx_T	*cc;
+{
+    if (++cc->cc_depth >= VM_STACK_LEN)
+	return FAIL;
+    return OK;
+}
+
+/*
+ * Add ISN_PUSH for constant "tv".  The value is moved to the instruction.
+ */
+    static int
+cc_push_tv(cc, tv)
+    cctx_T	*cc;
+    typval_T	*tv;
+{
+    isn_T	*isn;
+
+    isn = cc_emit(cc, ISN_PUSH);
+    if (cc->cc_error)
+    {
+	clear_tv(tv);
+	return FAIL;
+    }
+    isn->isn_tv = *tv;
+    isn->isn_tv.v_lock = 0;
+    return cc_push(cc);
+}
+
+/*
+ * When the last instructions compute a constant, replace them with the
+ * result.  The last instruction is the ISN_ADD, ISN_MUL or ISN_LEADER just
+ * added.
+ */
+    static void
+cc_fold(cc)
+    cctx_T	*cc;
+{
+    int		len = CC_LEN(cc);
+    isn_T	*last = CC_ISN(cc, len - 1);
+    isn_T	*first;
+    typval_T	tv1, tv2;
+    int		ret;
+
+    if (last->isn_type == ISN_LEADER)
+    {
+	if (len < 2 || cc->cc_label > len - 2)
+	    return;
+	first = CC_ISN(cc, len - 2);
+	if (first->isn_type != ISN_PUSH || (first->isn_tv.v_type != VAR_NUMBER
+#ifdef FEAT_FLOAT
+				   && first->isn_tv.v_type != VAR_FLOAT
+#endif
+				   ))
+	    return;
+	copy_tv(&first->isn_tv, &tv1);
+	if (eval_leader(&tv1, last->isn_str,
+					  last->isn_str + last->isn_arg1) == OK)
+	{
+	    first->isn_tv = tv1;
+	    CC_LEN(cc) = len - 1;
+	}
+	return;
+    }
+
+    if (len < 4 || cc->cc_label > len - 4)
+	return;
+    first = CC_ISN(cc, len - 4);
+    if (first->isn_type != ISN_PUSH || CC_ISN(cc, len - 2)->isn_type != ISN_PUSH
+	    || (CC_ISN(cc, len - 3)->isn_type != ISN_ADDCHK
+			     && CC_ISN(cc, len - 3)->isn_type != ISN_MULCHK)
+	    || (first->isn_tv.v_type != VAR_NUMBER
+		&& (last->isn_type != ISN_ADD
+				      || first->isn_tv.v_type != VAR_STRING))
+	    || (CC_ISN(cc, len - 2)->isn_tv.v_type != VAR_NUMBER
+		&& (last->isn_type != ISN_ADD
+		      || CC_ISN(cc, len - 2)->isn_tv.v_type != VAR_STRING)))
+	return;
+
+    copy_tv(&first->isn_tv, &tv1);
+    copy_tv(&CC_ISN(cc, len - 2)->isn_tv, &tv2);
+    if (last->isn_type == ISN_ADD)
+	ret = eval_arith_check(&tv1, last->isn_arg1) == OK
+			      && eval_arith(&tv1, &tv2, last->isn_arg1) == OK;
+    else
+	ret = eval_mult_check(&tv1) == OK
+			       && eval_mult(&tv1, &tv2, last->isn_arg1) == OK;
+    clear_tv(&tv2);
+    if (ret)
+    {
+	cc_truncate(cc, len - 3);
+	clear_tv(&first->isn_tv);
+	first->isn_tv = tv1;
+    }
+    else
+	clear_tv(&tv1);
+}
+
+static int cc_expr __ARGS((cctx_T *cc, char_u **arg));
+
+/*
+ * Compile the arguments of a function call, "*arg" points to the "(".
+ * Returns the number of arguments or -1 when they can't be compiled.
+ */
+    static int
+cc_args(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    char_u	*argp = *arg;
+    int		argcount = 0;
+
+    while (argcount < MAX_FUNC_ARGS)
+    {
+	argp = skipwhite(argp + 1);	    /* skip the '(' or ',' */
+	if (*argp == ')' || *argp == ',' || *argp == NUL)
+	    break;
+	if (cc_expr(cc, &argp) == FAIL)
+	    return -1;
+	++argcount;
+	if (*argp != ',')
+	    break;
+    }
+    if (*argp != ')')
+	return -1;
+    *arg = skipwhite(argp + 1);
+    return argcount;
+}
+
+/*
+ * Compile calling function "name[len]" in an expression, "*arg" points to
+ * the "(".
+ */
+    static int
+cc_call(cc, arg, name, len)
+    cctx_T	*cc;
+    char_u	**arg;
+    char_u	*name;
+    int		len;
+{
+    isn_T	*isn;
+    char_u	*s;
+    int		idx = -1;
+    int		argcount;
+
+    if (cc->cc_calls >= VM_MAX_CALLS)
+	return FAIL;
+    s = cc_str(cc, name, len);
+    if (s == NULL)
+	return FAIL;
+    if (builtin_function(s, -1))
+	idx = find_internal_func(s);
+    isn = cc_emit(cc, ISN_FUNC);
+    isn->isn_arg1 = idx;
+    isn->isn_str = s;
+
+    ++cc->cc_calls;
+    argcount = cc_args(cc, arg);
+    --cc->cc_calls;
+    if (argcount < 0)
+	return FAIL;
+    isn = cc_emit(cc, ISN_CALL);
+    isn->isn_arg1 = argcount;
+    isn->isn_arg2 = TRUE;
+    cc->cc_depth -= argcount;
+    return cc_push(cc);
+}
+
+/*
+ * Compile getting the value of variable "name[len]".
+ */
+    static int
+cc_load(cc, name, len)
+    cctx_T	*cc;
+    char_u	*name;
+    int		len;
+{
+    isn_T	*isn;
+    char_u	*s;
+    int		slot;
+    int		i = 0;
+
+    s = cc_str(cc, name, len);
+    if (s == NULL)
+	return FAIL;
+    if (len > 2 && name[0] == 'a' && name[1] == ':')
+    {
+	/* "a:name", "a:0", "a:000", etc. */
+	for (i = 2; i < len; ++i)
+	    if (!(ASCII_ISALNUM(name[i]) || name[i] == '_'))
+		break;
+    }
+    if (len > 2 && name[0] == 'a' && name[1] == ':' && i == len)
+    {
+	slot = cc_slot(cc, &cc->cc_cf->cf_args, name + 2, len - 2);
+	isn = cc_emit(cc, ISN_LOADA);
+	isn->isn_arg1 = slot;
+    }
+    else if ((slot = cc_local_slot(cc, name, len)) >= 0)
+    {
+	isn = cc_emit(cc, ISN_LOADL);
+	isn->isn_arg1 = slot;
+    }
+    else
+	isn = cc_emit(cc, ISN_LOADV);
+    isn->isn_str = s;
+    return cc_push(cc);
+}
+
+/*
+ * Compile a List: [expr, expr].
+ */
+    static int
+cc_list(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    isn_T	*isn;
+    int		count = 0;
+
+    *arg = skipwhite(*arg + 1);
+    while (**arg != ']' && **arg != NUL)
+    {
+	if (cc_expr(cc, arg) == FAIL)
+	    return FAIL;
+	++count;
+	if (**arg == ']')
+	    break;
+	if (**arg != ',')
+	    return FAIL;
+	*arg = skipwhite(*arg + 1);
+    }
+    if (**arg != ']')
+	return FAIL;
+    *arg = skipwhite(*arg + 1);
+    isn = cc_emit(cc, ISN_NEWLIST);
+    isn->isn_arg1 = count;
+    cc->cc_depth -= count;
+    return cc_push(cc);
+}
+
+/*
+ * Compile a Dictionary: {key: val, key: val}.  Only constant keys are
+ * supported.
+ */
+    static int
+cc_dict(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    isn_T	*isn;
+    int		count = 0;
+    int		first_key = CC_LEN(cc);
+    int		i;
+    typval_T	tv;
+    char_u	*key;
+    char_u	buf[NUMBUFLEN];
+    int		ret;
+
+    *arg = skipwhite(*arg + 1);
+    while (**arg != '}' && **arg != NUL)
+    {
+	tv.v_type = VAR_UNKNOWN;
+	if (**arg == '\'')
+	    ret = get_lit_string_tv(arg, &tv, TRUE);
+	else if (**arg == '"')
+	    ret = get_string_tv(arg, &tv, TRUE);
+	else if (VIM_ISDIGIT(**arg))
+	    ret = get_number_tv(arg, &tv, TRUE, FALSE);
+	else
+	    return FAIL;
+	*arg = skipwhite(*arg);
+	if (ret == FAIL || **arg != ':' || tv.v_type == VAR_UNKNOWN
+#ifdef FEAT_FLOAT
+		|| tv.v_type == VAR_FLOAT
+#endif
+		)
+	{
+	    clear_tv(&tv);
+	    return FAIL;
+	}
+
+	/* The key must not be empty and not be used before. */
+	key = get_tv_string_buf(&tv, buf);
+	if (*key == NUL)
+	{
+	    clear_tv(&tv);
+	    return FAIL;
+	}
+	for (i = first_key; i < CC_LEN(cc); ++i)
+	    if (CC_ISN(cc, i)->isn_type == ISN_PUSH
+		    && CC_ISN(cc, i)->isn_arg1 == first_key + 1
+		    && STRCMP(CC_ISN(cc, i)->isn_tv.vval.v_string, key) == 0)
+	    {
+		clear_tv(&tv);
+		return FAIL;
+	    }
+	key = vim_strsave(key);
+	clear_tv(&tv);
+	if (key == NULL)
+	    return FAIL;
+	tv.v_type = VAR_STRING;
+	tv.vval.v_string = key;
+	if (cc_push_tv(cc, &tv) == FAIL)
+	    return FAIL;
+	/* Mark it as a key of this Dictionary. */
+	CC_ISN(cc, CC_LEN(cc) - 1)->isn_arg1 = first_key + 1;
+
+	*arg = skipwhite(*arg + 1);
+	if (cc_expr(cc, arg) == FAIL)
+	    return FAIL;
+	++count;
+	if (**arg == '}')
+	    break;
+	if (**arg != ',')
+	    return FAIL;
+	*arg = skipwhite(*arg + 1);
+    }
+    if (**arg != '}')
+	return FAIL;
+    *arg = skipwhite(*arg + 1);
+    isn = cc_emit(cc, ISN_NEWDICT);
+    isn->isn_arg1 = count;
+    cc->cc_depth -= count * 2;
+    return cc_push(cc);
+}
+
+/*
+ * Compile seventh level expression, see eval7().
+ */
+    static int
+cc_expr7(cc, arg, want_string)
+    cctx_T	*cc;
+    char_u	**arg;
+    int		want_string;
+{
+    char_u	*start_leader, *end_leader;
+    char_u	*s;
+    char_u	*key;
+    char_u	*alias;
+    isn_T	*isn;
+    typval_T	tv;
+    int		len;
+    int		i;
+    int		kind = 0;	/* 1: can't be a Dict or Funcref, 2: a Dict */
+    int		empty1, empty2, range;
+
+    start_leader = *arg;
+    while (**arg == '!' || **arg == '-' || **arg == '+')
+	*arg = skipwhite(*arg + 1);
+    end_leader = *arg;
+
+    tv.v_type = VAR_UNKNOWN;
+    switch (**arg)
+    {
+	case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
+		get_number_tv(arg, &tv, TRUE, want_string);
+		if (cc_push_tv(cc, &tv) == FAIL)
+		    return FAIL;
+		kind = 1;
+		break;
+
+	case '"':
+	case '\'':
+		if ((**arg == '"' ? get_string_tv(arg, &tv, TRUE)
+			       : get_lit_string_tv(arg, &tv, TRUE)) == FAIL
+			|| cc_push_tv(cc, &tv) == FAIL)
+		    return FAIL;
+		kind = 1;
+		break;
+
+	case '[':
+		if (cc_list(cc, arg) == FAIL)
+		    return FAIL;
+		kind = 1;
+		break;
+
+	case '{':
+		if (cc_dict(cc, arg) == FAIL)
+		    return FAIL;
+		kind = 2;
+		break;
+
+	case '(':
+		*arg = skipwhite(*arg + 1);
+		if (cc_expr(cc, arg) == FAIL || **arg != ')')
+		    return FAIL;
+		++*arg;
+		break;
+
+	case '&':
+	case '$':
+	case '@':
+		return FAIL;
+
+	default:
+		s = *arg;
+		len = get_name_len(arg, &alias, FALSE, FALSE);
+		vim_free(alias);
+		if (len <= 0)
+		    return FAIL;
+		for (i = 0; i < len; ++i)
+		    if (s[i] == '{')
+			return FAIL;
+		if (**arg == '(')
+		{
+		    if (cc_call(cc, arg, s, len) == FAIL)
+			return FAIL;
+		}
+		else
+		{
+		    if (cc_load(cc, s, len) == FAIL)
+			return FAIL;
+		    /* "self" is always a Dictionary. */
+		    if ((cc->cc_fp->uf_flags & FC_DICT)
+					   && len == 4 && STRNCMP(s, "self", 4) == 0)
+			kind = 2;
+		}
+		break;
+    }
+
+    *arg = skipwhite(*arg);
+
+    /* Handle following '[', '(' and '.' for expr[expr], expr.name,
+     * expr(expr). */
+    while (!vim_iswhite((*arg)[-1]))
+    {
+	if (**arg == '[')
+	{
+	    isn = cc_emit(cc, ISN_INDEXCHK);
+	    isn->isn_arg1 = '[';
+	    empty1 = FALSE;
+	    empty2 = FALSE;
+	    range = FALSE;
+	    *arg = skipwhite(*arg + 1);
+	    if (**arg == ':')
+		empty1 = TRUE;
+	    else if (cc_expr(cc, arg) == FAIL)
+		return FAIL;
+	    else
+		cc_emit(cc, ISN_STRCHK);
+	    if (**arg == ':')
+	    {
+		range = TRUE;
+		*arg = skipwhite(*arg + 1);
+		if (**arg == ']')
+		    empty2 = TRUE;
+		else if (cc_expr(cc, arg) == FAIL)
+		    return FAIL;
+		else
+		    cc_emit(cc, ISN_STRCHK);
+	    }
+	    if (**arg != ']')
+		return FAIL;
+	    *arg = skipwhite(*arg + 1);
+	    isn = cc_emit(cc, ISN_INDEX);
+	    isn->isn_arg1 = range;
+	    isn->isn_arg2 = empty1;
+	    isn->isn_arg3 = empty2;
+	    if (!empty1)
+		--cc->cc_depth;
+	    if (range && !empty2)
+		--cc->cc_depth;
+	    kind = 0;
+	}
+	else if (**arg == '.' && kind != 1)
+	{
+	    key = *arg + 1;
+	    for (len = 0; ASCII_ISALNUM(key[len]) || key[len] == '_'; ++len)
+		;
+	    if (len == 0)
+	    {
+		/* Fails for a Dict, otherwise it's the "." operator. */
+		isn = cc_emit(cc, ISN_INDEXCHK);
+		isn->isn_arg1 = '.';
+		break;
+	    }
+	    if (kind != 2)
+		return FAIL;
+	    isn = cc_emit(cc, ISN_MEMBER);
+	    isn->isn_arg1 = len;
+	    isn->isn_str = cc_str(cc, key, len);
+	    *arg = skipwhite(key + len);
+	    kind = 0;
+	}
+	else if (**arg == '(' && kind != 1)
+	    return FAIL;
+	else
+	    break;
+    }
+
+    if (end_leader > start_leader)
+    {
+	isn = cc_emit(cc, ISN_LEADER);
+	isn->isn_arg1 = (int)(end_leader - start_leader);
+	isn->isn_str = cc_str(cc, start_leader, isn->isn_arg1);
+	cc_fold(cc);
+    }
+    return cc->cc_error ? FAIL : OK;
+}
+
+/*
+ * Compile sixth level expression, see eval6().
+ */
+    static int
+cc_expr6(cc, arg, want_string)
+    cctx_T	*cc;
+    char_u	**arg;
+    int		want_string;
+{
+    isn_T	*isn;
+    int		op;
+
+    if (cc_expr7(cc, arg, want_string) == FAIL)
+	return FAIL;
+    for (;;)
+    {
+	op = **arg;
+	if (op != '*' && op != '/' && op != '%')
+	    break;
+	cc_emit(cc, ISN_MULCHK);
+	*arg = skipwhite(*arg + 1);
+	if (cc_expr7(cc, arg, FALSE) == FAIL)
+	    return FAIL;
+	isn = cc_emit(cc, ISN_MUL);
+	isn->isn_arg1 = op;
+	--cc->cc_depth;
+	cc_fold(cc);
+    }
+    return OK;
+}
+
+/*
+ * Compile fifth level expression, see eval5().
+ */
+    static int
+cc_expr5(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    isn_T	*isn;
+    int		op;
+
+    if (cc_expr6(cc, arg, FALSE) == FAIL)
+	return FAIL;
+    for (;;)
+    {
+	op = **arg;
+	if (op != '+' && op != '-' && op != '.')
+	    break;
+	isn = cc_emit(cc, ISN_ADDCHK);
+	isn->isn_arg1 = op;
+	*arg = skipwhite(*arg + 1);
+	if (cc_expr6(cc, arg, op == '.') == FAIL)
+	    return FAIL;
+	isn = cc_emit(cc, ISN_ADD);
+	isn->isn_arg1 = op;
+	--cc->cc_depth;
+	cc_fold(cc);
+    }
+    return OK;
+}
+
+/*
+ * Compile fourth level expression, see eval4().
+ */
+    static int
+cc_expr4(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    isn_T	*isn;
+    char_u	*p;
+    exptype_T	type;
+    int		type_is = FALSE;
+    int		len;
+    int		ic;
+
+    if (cc_expr5(cc, arg) == FAIL)
+	return FAIL;
+
+    p = *arg;
+    type = get_compare_type(p, &len, &type_is);
+    if (type != TYPE_UNKNOWN)
+    {
+	if (p[len] == '?')
+	{
+	    ic = TRUE;
+	    ++len;
+	}
+	else if (p[len] == '#')
+	{
+	    ic = FALSE;
+	    ++len;
+	}
+	else
+	    ic = -1;	/* use 'ignorecase' */
+	*arg = skipwhite(p + len);
+	if (cc_expr5(cc, arg) == FAIL)
+	    return FAIL;
+	isn = cc_emit(cc, ISN_COMPARE);
+	isn->isn_arg1 = type;
+	isn->isn_arg2 = type_is;
+	isn->isn_arg3 = ic;
+	--cc->cc_depth;
+    }
+    return OK;
+}
+
+/*
+ * Compile the "||" (when "op" is '|') or "&&" operators, see eval2() and
+ * eval3().
+ */
+    static int
+cc_expr23(cc, arg, op)
+    cctx_T	*cc;
+    char_u	**arg;
+    int		op;
+{
+    isn_T	*isn;
+    int		prev = -1;
+    int		next;
+
+    if ((op == '|' ? cc_expr23(cc, arg, '&') : cc_expr4(cc, arg)) == FAIL)
+	return FAIL;
+    if ((*arg)[0] != op || (*arg)[1] != op)
+	return OK;
+    while ((*arg)[0] == op && (*arg)[1] == op)
+    {
+	/* The jumps are linked with isn_arg1 until patched. */
+	isn = cc_emit(cc, op == '|' ? ISN_JUMPIF : ISN_JUMPIFNOT);
+	isn->isn_arg1 = prev;
+	prev = CC_LEN(cc) - 1;
+	--cc->cc_depth;
+	*arg = skipwhite(*arg + 2);
+	if ((op == '|' ? cc_expr23(cc, arg, '&') : cc_expr4(cc, arg)) == FAIL)
+	    return FAIL;
+    }
+    cc_emit(cc, ISN_TOBOOL);
+    while (prev >= 0 && !cc->cc_error)
+    {
+	next = CC_ISN(cc, prev)->isn_arg1;
+	cc_patch(cc, prev, 1);
+	prev = next;
+    }
+    return OK;
+}
+
+/*
+ * Compile the "expr1 ? expr1 : expr1" operator, see eval1().
+ */
+    static int
+cc_expr1(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    int		jump_false;
+    int		jump_end;
+
+    if (cc_expr23(cc, arg, '|') == FAIL)
+	return FAIL;
+    if ((*arg)[0] == '?')
+    {
+	cc_emit(cc, ISN_JUMPFALSE);
+	jump_false = CC_LEN(cc) - 1;
+	--cc->cc_depth;
+	*arg = skipwhite(*arg + 1);
+	if (cc_expr(cc, arg) == FAIL || (*arg)[0] != ':')
+	    return FAIL;
+	cc_emit(cc, ISN_JUMP);
+	jump_end = CC_LEN(cc) - 1;
+	--cc->cc_depth;
+	cc_patch(cc, jump_false, 1);
+	*arg = skipwhite(*arg + 1);
+	if (cc_expr(cc, arg) == FAIL)
+	    return FAIL;
+	cc_patch(cc, jump_end, 1);
+    }
+    return OK;
+}
+
+/*
+ * Compile expression "*arg" and advance "*arg" to just after it.  When the
+ * expression, or part of it, can't be compiled, add ISN_EVAL to evaluate it
+ * from the text.
+ * Returns FAIL and sets cc_error when the expression is invalid.
+ */
+    static int
+cc_expr(cc, arg)
+    cctx_T	*cc;
+    char_u	**arg;
+{
+    char_u	*start = *arg;
+    int		len = CC_LEN(cc);
+    int		depth = cc->cc_depth;
+    int		calls = cc->cc_calls;
+    isn_T	*isn;
+    typval_T	tv;
+
+    if (cc_expr1(cc, arg) == OK && !cc->cc_error)
+	return OK;
+    if (cc->cc_error)
+	return FAIL;
+
+    cc_truncate(cc, len);
+    cc->cc_depth = depth;
+    cc->cc_calls = calls;
+    *arg = start;
+    tv.v_type = VAR_UNKNOWN;
+    if (eval1(arg, &tv, FALSE) == FAIL)
+	cc->cc_error = TRUE;
+    clear_tv(&tv);
+    if (cc->cc_error)
+	return FAIL;
+    isn = cc_emit(cc, ISN_EVAL);
+    isn->isn_str = cc_str(cc, start, (int)(*arg - start));
+    /* Evaluating "{expr}" in a variable name changes the text, then a copy
+     * is used. */
+    isn->isn_arg1 = isn->isn_str != NULL
+				  && vim_strchr(isn->isn_str, '{') != NULL;
+    if (cc_push(cc) == FAIL)
+	cc->cc_error = TRUE;
+    return cc->cc_error ? FAIL : OK;
+}
+
+/*
+ * Return TRUE when "p" is a valid expression followed by the end of the
+ * line or a comment.
+ */
+    static int
+cc_expr_ends(p)
+    char_u	*p;
+{
+    typval_T	tv;
+    int		ret;
+
+    tv.v_type = VAR_UNKNOWN;
+    ret = eval1(&p, &tv, FALSE);
+    clear_tv(&tv);
+    return ret == OK && (*p == NUL || *p == '"');
+}
+
+/*
+ * Find the command at "*pp" that matters for compiling and advance "*pp" to
+ * its argument.  Returns CMD_SIZE for other commands.  Sets "*forceit" when
+ * "!" follows the command name.
+ */
+    static int
+cc_find_command(pp, forceit)
+    char_u	**pp;
+    int		*forceit;
+{
+    char_u	*p = *pp;
+    int		i;
+
+    while (ASCII_ISALPHA(*p))
+	++p;
+    *forceit = (*p == '!');
+    for (i = 0; i < (int)(sizeof(cc_cmds) / sizeof(cc_cmds[0])); ++i)
+	if (checkforcmd(pp, cc_cmds[i].name, cc_cmds[i].len))
+	    return cc_cmds[i].cmdidx;
+    return CMD_SIZE;
+}
+
+/*
+ * Check that line "p", which is executed with do_cmdline(), does not use a
+ * command that conflicts with the compiled ones or reads the lines that
+ * follow.  Only a simple check for "|" separated commands is done, it may
+ * reject a line that would be fine.
+ */
+    static void
+cc_check_exec(cc, p)
+    cctx_T	*cc;
+    char_u	*p;
+{
+    char_u	*s;
+    int		depth = 0;
+    int		forceit;
+    int		len;
+
+    for (s = p; (s = vim_strchr(s, '<')) != NULL; ++s)
+	if (s[1] == '<')
+	{
+	    /* ":python << EOF" */
+	    cc->cc_error = TRUE;
+	    return;
+	}
+
+    for (;;)
+    {
+	for (;;)
+	{
+	    while (*p == ' ' || *p == '\t' || *p == ':')
+		++p;
+	    len = modifier_len(p);
+	    if (len == 0)
+		break;
+	    p += len;
+	    if (*p == '!')
+		++p;
+	}
+	p = skip_range(p, NULL);
+	switch (cc_find_command(&p, &forceit))
+	{
+	    case CMD_if:
+		++depth;
+		break;
+	    case CMD_endif:
+		if (--depth < 0)
+		    cc->cc_error = TRUE;
+		break;
+	    case CMD_else:
+	    case CMD_elseif:
+		if (depth == 0)
+		    cc->cc_error = TRUE;
+		break;
+	    case CMD_let:
+	    case CMD_call:
+	    case CMD_return:
+	    case CMD_SIZE:
+		break;
+	    default:
+		cc->cc_error = TRUE;
+		break;
+	}
+	p = vim_strchr(p, '|');
+	if (p == NULL)
+	    break;
+	++p;
+    }
+    if (depth != 0)
+	cc->cc_error = TRUE;
+}
+
+/*
+ * Return TRUE when the variable names "p" to "end" use "{expr}".  Evaluating
+ * it changes the text, thus the line must be executed as a command.
+ */
+    static int
+cc_curly(p, end)
+    char_u	*p;
+    char_u	*end;
+{
+    for ( ; p < end; ++p)
+	if (*p == '{')
+	    return TRUE;
+    return FALSE;
+}
+
+/*
+ * Add ISN_STMT for line "lnum" with command "cmdidx".  "expr" is the
+ * expression used in an error message.
+ * Returns the index of the instruction.
+ */
+    static int
+cc_stmt(cc, lnum, cmdidx, expr)
+    cctx_T	*cc;
+    int		lnum;
+    int		cmdidx;
+    char_u	*expr;
+{
+    isn_T	*isn;
+
+    isn = cc_emit(cc, ISN_STMT);
+    isn->isn_arg1 = lnum;
+    isn->isn_arg3 = cmdidx;
+    if (expr != NULL)
+	isn->isn_str = cc_str(cc, expr, (int)STRLEN(expr));
+    cc->cc_depth = 0;
+    return CC_LEN(cc) - 1;
+}
+
+/*
+ * Compile ":let var = expr".  Returns FALSE when it must be executed as a
+ * command.
+ */
+    static int
+cc_let(cc, lnum, arg)
+    cctx_T	*cc;
+    int		lnum;
+    char_u	*arg;
+{
+    char_u	*argend;
+    char_u	*expr;
+    int		var_count = 0;
+    int		semicolon = 0;
+    int		op;
+    int		slot = -1;
+    int		stmt;
+    isn_T	*isn;
+
+    argend = skip_var_list(arg, &var_count, &semicolon);
+    if (argend == NULL || cc_curly(arg, argend))
+	return FALSE;
+    if (argend > arg && argend[-1] == '.')  /* for var.='str' */
+	--argend;
+    expr = skipwhite(argend);
+    if (*expr == '=')
+    {
+	op = '=';
+	expr = skipwhite(expr + 1);
+    }
+    else if (*expr != NUL && vim_strchr((char_u *)"+-.", *expr) != NULL
+							  && expr[1] == '=')
+    {
+	op = *expr;
+	expr = skipwhite(expr + 2);
+    }
+    else
+	return FALSE;
+    if (!cc_expr_ends(expr))
+	return FALSE;
+
+    if (var_count == 0)
+	slot = cc_local_slot(cc, arg, (int)(argend - arg));
+    stmt = cc_stmt(cc, lnum, CMD_let, expr);
+    (void)cc_expr(cc, &expr);
+    isn = cc_emit(cc, ISN_STORE);
+    isn->isn_arg1 = slot;
+    isn->isn_arg2 = op;
+    isn->isn_arg3 = var_count;
+    isn->isn_arg4 = semicolon;
+    isn->isn_str = cc_str(cc, arg, (int)STRLEN(arg));
+    --cc->cc_depth;
+    cc_patch(cc, stmt, 2);
+    return TRUE;
+}
+
+/*
+ * Compile ":call Func(args)".  Returns FALSE when it must be executed as a
+ * command.
+ */
+    static int
+cc_call_cmd(cc, lnum, arg)
+    cctx_T	*cc;
+    int		lnum;
+    char_u	*arg;
+{
+    char_u	*nameend;
+    char_u	*argp;
+    char_u	*p;
+    char_u	*name;
+    typval_T	rettv;
+    int		doesrange;
+    int		ret;
+    int		idx = -1;
+    int		argcount;
+    int		stmt;
+    isn_T	*isn;
+
+    /* Only a plain function name, not "dict.Func()" or "{expr}()". */
+    nameend = arg + eval_fname_script(arg);
+    while (eval_isnamec(*nameend))
+	++nameend;
+    argp = skipwhite(nameend);
+    if (nameend == arg || *argp != '(')
+	return FALSE;
+    p = argp;
+    rettv.v_type = VAR_UNKNOWN;
+    ret = get_func_tv(arg, (int)(nameend - arg), &rettv, &p, (linenr_T)0,
+				      (linenr_T)0, &doesrange, FALSE, NULL);
+    clear_tv(&rettv);
+    if (ret == FAIL || (*p != NUL && *p != '"'))
+	return FALSE;
+
+    stmt = cc_stmt(cc, lnum, CMD_call, NULL);
+    name = cc_str(cc, arg, (int)(nameend - arg));
+    if (name == NULL)
+	return TRUE;
+    if (builtin_function(name, -1))
+	idx = find_internal_func(name);
+    isn = cc_emit(cc, idx >= 0 ? ISN_FUNC : ISN_CALLNAME);
+    isn->isn_arg1 = idx;
+    isn->isn_str = name;
+
+    ++cc->cc_calls;
+    argcount = cc_args(cc, &argp);
+    --cc->cc_calls;
+    if (argcount < 0)
+    {
+	cc->cc_error = TRUE;
+	return TRUE;
+    }
+    isn = cc_emit(cc, ISN_CALL);
+    isn->isn_arg1 = argcount;
+    isn->isn_arg2 = FALSE;
+    cc->cc_depth -= argcount;
+    cc_emit(cc, ISN_DROP);
+    cc_patch(cc, stmt, 2);
+    return TRUE;
+}
+
+/*
+ * Compile ":return [expr]".  Returns FALSE when it must be executed as a
+ * command.
+ */
+    static int
+cc_return(cc, lnum, arg)
+    cctx_T	*cc;
+    int		lnum;
+    char_u	*arg;
+{
+    int		stmt;
+    int		has_value = (*arg != NUL);
+    isn_T	*isn;
+
+    if (has_value && !cc_expr_ends(arg))
+	return FALSE;
+    stmt = cc_stmt(cc, lnum, CMD_return, has_value ? arg : NULL);
+    if (has_value)
+	(void)cc_expr(cc, &arg);
+    isn = cc_emit(cc, ISN_RETURN);
+    isn->isn_arg1 = has_value;
+    cc->cc_depth = 0;
+    cc_patch(cc, stmt, 2);
+    return TRUE;
+}
+
+/*
+ * Start compiling an ":if", ":while" or ":for".
+ */
+    static ccnest_T *
+cc_push_nest(cc, cmdidx)
+    cctx_T	*cc;
+    int		cmdidx;
+{
+    ccnest_T	*nest;
+
+    if (cc->cc_nest_idx + 1 >= CSTACK_LEN)
+    {
+	cc->cc_error = TRUE;
+	return NULL;
+    }
+    nest = &cc->cc_nest[++cc->cc_nest_idx];
+    nest->cn_cmdidx = cmdidx;
+    nest->cn_top = CC_LEN(cc);
+    nest->cn_cond = -1;
+    nest->cn_had_else = FALSE;
+    nest->cn_forinfo = 0;
+    ga_init2(&nest->cn_patch, (int)sizeof(int), 10);
+    return nest;
+}
+
+/*
+ * Compile the condition of ":if", ":elseif" or ":while".
+ */
+    static void
+cc_cond(cc, nest, lnum, cmdidx, arg)
+    cctx_T	*cc;
+    ccnest_T	*nest;
+    int		lnum;
+    int		cmdidx;
+    char_u	*arg;
+{
+    cc_add_patch(cc, nest, cc_stmt(cc, lnum, cmdidx, arg), 2);
+    (void)cc_expr(cc, &arg);
+    cc_emit(cc, ISN_COND);
+    --cc->cc_depth;
+    if (cmdidx == CMD_while)
+	cc_add_patch(cc, nest, CC_LEN(cc) - 1, 1);
+    else
+	nest->cn_cond = CC_LEN(cc) - 1;
+}
+
+/*
+ * Compile ":for var in expr".  Returns FALSE when it must be executed as a
+ * command.
+ */
+    static int
+cc_for(cc, lnum, arg)
+    cctx_T	*cc;
+    int		lnum;
+    char_u	*arg;
+{
+    char_u	*argend;
+    char_u	*expr;
+    char_u	*vars;
+    int		var_count = 0;
+    int		semicolon = 0;
+    int		slot = -1;
+    int		chk;
+    ccnest_T	*nest;
+    isn_T	*isn;
+
+    argend = skip_var_list(arg, &var_count, &semicolon);
+    if (argend == NULL || cc_curly(arg, argend))
+	return FALSE;
+    expr = skipwhite(argend);
+    if (expr[0] != 'i' || expr[1] != 'n' || !vim_iswhite(expr[2]))
+	return FALSE;
+    expr = skipwhite(expr + 2);
+    if (!cc_expr_ends(expr))
+	return FALSE;
+
+    nest = cc_push_nest(cc, CMD_for);
+    if (nest == NULL)
+	return TRUE;
+    nest->cn_forinfo = cc->cc_cf->cf_nfor++;
+    if (var_count == 0)
+	slot = cc_local_slot(cc, arg, (int)(argend - arg));
+    vars = cc_str(cc, arg, (int)STRLEN(arg));
+
+    cc_add_patch(cc, nest, cc_stmt(cc, lnum, CMD_for, expr), 2);
+    isn = cc_emit(cc, ISN_FORCHK);
+    isn->isn_arg1 = nest->cn_forinfo;
+    chk = CC_LEN(cc) - 1;
+    (void)cc_expr(cc, &expr);
+    isn = cc_emit(cc, ISN_FORINIT);
+    isn->isn_arg1 = nest->cn_forinfo;
+    isn->isn_arg2 = var_count;
+    isn->isn_arg3 = semicolon;
+    --cc->cc_depth;
+    cc_patch(cc, chk, 2);
+    isn = cc_emit(cc, ISN_FORNEXT);
+    isn->isn_arg1 = nest->cn_forinfo;
+    isn->isn_arg3 = slot;
+    isn->isn_str = vars;
+    cc_add_patch(cc, nest, CC_LEN(cc) - 1, 2);
+    return TRUE;
+}
+
+/*
+ * Compile line "lnum" (zero based) of the function.
+ */
+    static void
+cc_line(cc, lnum)
+    cctx_T	*cc;
+    int		lnum;
+{
+    char_u	*p = FUNCLINE(cc->cc_fp, lnum);
+    char_u	*cmd;
+    int		cmdidx = CMD_SIZE;
+    int		forceit = FALSE;
+    ccnest_T	*nest = NULL;
+    isn_T	*isn;
+    int		i;
+
+    while (*p == ' ' || *p == '\t' || *p == ':')
+	++p;
+    if (*p == NUL || *p == '"')
+	return;
+    cmd = p;
+    if (modifier_len(p) == 0 && skip_range(p, NULL) == p)
+	cmdidx = cc_find_command(&p, &forceit);
+    if (forceit)
+	cmdidx = CMD_SIZE;
+    if (cc->cc_nest_idx >= 0)
+	nest = &cc->cc_nest[cc->cc_nest_idx];
+
+    switch (cmdidx)
+    {
+	case CMD_let:
+	    if (cc_let(cc, lnum, p))
+		return;
+	    break;
+
+	case CMD_call:
+	    if (cc_call_cmd(cc, lnum, p))
+		return;
+	    break;
+
+	case CMD_return:
+	    if (cc_return(cc, lnum, p))
+		return;
+	    break;
+
+	case CMD_if:
+	case CMD_while:
+	    if (!cc_expr_ends(p))
+		break;
+	    nest = cc_push_nest(cc, cmdidx);
+	    if (nest != NULL)
+		cc_cond(cc, nest, lnum, cmdidx, p);
+	    return;
+
+	case CMD_elseif:
+	case CMD_else:
+	    if (cmdidx == CMD_elseif ? !cc_expr_ends(p)
+					      : (*p != NUL && *p != '"'))
+		break;
+	    if (nest == NULL || nest->cn_cmdidx != CMD_if || nest->cn_had_else)
+	    {
+		cc->cc_error = TRUE;
+		return;
+	    }
+	    /* End of the previous block, continue after ":endif". */
+	    cc_emit(cc, ISN_JUMP);
+	    cc_add_patch(cc, nest, CC_LEN(cc) - 1, 1);
+	    cc_patch(cc, nest->cn_cond, 1);
+	    nest->cn_cond = -1;
+	    if (cmdidx == CMD_elseif)
+		cc_cond(cc, nest, lnum, cmdidx, p);
+	    else
+		nest->cn_had_else = TRUE;
+	    return;
+
+	case CMD_endif:
+	case CMD_endwhile:
+	case CMD_endfor:
+	    if (*p != NUL && *p != '"')
+		break;
+	    if (nest == NULL || nest->cn_cmdidx != (cmdidx == CMD_endif
+			? CMD_if : cmdidx == CMD_endwhile ? CMD_while : CMD_for))
+	    {
+		cc->cc_error = TRUE;
+		return;
+	    }
+	    if (cmdidx == CMD_endif)
+		cc_patch(cc, nest->cn_cond, 1);
+	    else
+	    {
+		isn = cc_emit(cc, ISN_LOOP);
+		isn->isn_arg1 = nest->cn_top;
+	    }
+	    cc_patch_all(cc, nest);
+	    if (cmdidx == CMD_endfor)
+	    {
+		isn = cc_emit(cc, ISN_FORFREE);
+		isn->isn_arg1 = nest->cn_forinfo;
+	    }
+	    --cc->cc_nest_idx;
+	    return;
+
+	case CMD_for:
+	    if (cc_for(cc, lnum, p))
+		return;
+	    break;
+
+	case CMD_break:
+	case CMD_continue:
+	    if (*p != NUL && *p != '"')
+		break;
+	    for (i = cc->cc_nest_idx; i >= 0
+				   && cc->cc_nest[i].cn_cmdidx == CMD_if; --i)
+		;
+	    if (i < 0)
+	    {
+		cc->cc_error = TRUE;
+		return;
+	    }
+	    if (cmdidx == CMD_break)
+	    {
+		cc_emit(cc, ISN_JUMP);
+		cc_add_patch(cc, &cc->cc_nest[i], CC_LEN(cc) - 1, 1);
+	    }
+	    else
+	    {
+		isn = cc_emit(cc, ISN_LOOP);
+		isn->isn_arg1 = cc->cc_nest[i].cn_top;
+	    }
+	    return;
+    }
+
+    /* Execute the line with do_cmdline(). */
+    cc_check_exec(cc, cmd);
+    isn = cc_emit(cc, ISN_EXEC);
+    isn->isn_arg1 = lnum;
+}
+
+/*
+ * Free compiled function "cf".
+ */
+    static void
+free_cfunc(cf)
+    cfunc_T	*cf;
+{
+    int		i;
+
+    if (cf == NULL)
+	return;
+    for (i = 0; i < cf->cf_instr.ga_len; ++i)
+	clear_tv(&((isn_T *)cf->cf_instr.ga_data)[i].isn_tv);
+    ga_clear(&cf->cf_instr);
+    ga_clear_strings(&cf->cf_strings);
+    ga_clear_strings(&cf->cf_locals);
+    ga_clear_strings(&cf->cf_args);
+    vim_free(cf);
+}
+
+/*
+ * Compile user function "fp".  Returns NULL when it can't be compiled.
+ */
+    static cfunc_T *
+compile_func(fp)
+    ufunc_T	*fp;
+{
+    cctx_T	cc;
+    int		lnum;
+
+    vim_memset(&cc, 0, sizeof(cc));
+    cc.cc_fp = fp;
+    cc.cc_nest_idx = -1;
+    cc.cc_cf = (cfunc_T *)alloc_clear((unsigned)sizeof(cfunc_T));
+    if (cc.cc_cf == NULL)
+	return NULL;
+    ga_init2(&cc.cc_cf->cf_instr, (int)sizeof(isn_T), 50);
+    ga_init2(&cc.cc_cf->cf_strings, (int)sizeof(char_u *), 20);
+    ga_init2(&cc.cc_cf->cf_locals, (int)sizeof(char_u *), 10);
+    ga_init2(&cc.cc_cf->cf_args, (int)sizeof(char_u *), 10);
+
+    /* Errors found while parsing are given when executing the line. */
+    ++emsg_skip;
+    for (lnum = 0; lnum < fp->uf_lines.ga_len && !cc.cc_error; ++lnum)
+	if (FUNCLINE(fp, lnum) != NULL)
+	    cc_line(&cc, lnum);
+    --emsg_skip;
+
+    if (cc.cc_nest_idx >= 0)
+	cc.cc_error = TRUE;
+    while (cc.cc_nest_idx >= 0)
+	ga_clear(&cc.cc_nest[cc.cc_nest_idx--].cn_patch);
+    if (cc.cc_error)
+    {
+	free_cfunc(cc.cc_cf);
+	return NULL;
+    }
+    return cc.cc_cf;
+}
+
+/*
+ * Allocate the execution state for calling compiled function "cf".
+ */
+    static funcvm_T *
+func_vm_alloc(cf)
+    cfunc_T	*cf;
+{
+    funcvm_T	*vm;
+
+    vm = (funcvm_T *)alloc_clear((unsigned)sizeof(funcvm_T));
+    if (vm == NULL)
+	return NULL;
+    vm->fv_cfunc = cf;
+    vm->fv_forinfo = (void **)alloc_clear(
+				  (unsigned)((cf->cf_nfor + 1) * sizeof(void *)));
+    vm->fv_locals = (dictitem_T **)alloc_clear(
+		   (unsigned)((cf->cf_locals.ga_len + 1) * sizeof(dictitem_T *)));
+    vm->fv_args = (dictitem_T **)alloc_clear(
+		     (unsigned)((cf->cf_args.ga_len + 1) * sizeof(dictitem_T *)));
+    if (vm->fv_forinfo == NULL || vm->fv_locals == NULL || vm->fv_args == NULL)
+    {
+	func_vm_free(vm);
+	return NULL;
+    }
+    return vm;
+}
+
+/*
+ * Free the execution state "vm".
+ */
+    static void
+func_vm_free(vm)
+    funcvm_T	*vm;
+{
+    int		i;
+
+    if (vm == NULL)
+	return;
+    if (vm->fv_forinfo != NULL)
+	for (i = 0; i < vm->fv_cfunc->cf_nfor; ++i)
+	    free_for_info(vm->fv_forinfo[i]);
+    vim_free(vm->fv_forinfo);
+    vim_free(vm->fv_locals);
+    vim_free(vm->fv_args);
+    vim_free(vm);
+}
+
+/*
+ * Find the variable with name number "slot" of "names" in "ht".  The items
+ * found are remembered in "items[]" until a variable is removed from "ht",
+ * "*changed" is used to notice that.
+ * Returns NULL when the variable does not exist.
+ */
+    static dictitem_T *
+vm_find_var(ht, names, items, changed, slot)
+    hashtab_T	*ht;
+    garray_T	*names;
+    dictitem_T	**items;
+    long_u	*changed;
+    int		slot;
+{
+    hashitem_T	*hi;
+
+    if (*changed != ht->ht_changed)
+    {
+	vim_memset(items, 0, names->ga_len * sizeof(dictitem_T *));
+	*changed = ht->ht_changed;
+    }
+    if (items[slot] == NULL)
+    {
+	hi = hash_find(ht, ((char_u **)names->ga_data)[slot]);
+	if (!HASHITEM_EMPTY(hi))
+	    items[slot] = HI2DI(hi);
+    }
+    return items[slot];
+}
+
+#define VM_LOCAL(fc, slot) vm_find_var(&(fc)->l_vars.dv_hashtab, \
+	    &(fc)->vm->fv_cfunc->cf_locals, (fc)->vm->fv_locals, \
+	    &(fc)->vm->fv_locals_changed, (slot))
+#define VM_ARG(fc, slot) vm_find_var(&(fc)->l_avars.dv_hashtab, \
+	    &(fc)->vm->fv_cfunc->cf_args, (fc)->vm->fv_args, \
+	    &(fc)->vm->fv_args_changed, (slot))
+
+/*
+ * Return TRUE when "tv" can be assigned to variable "di" without any checks,
+ * the same as set_var() would do.
+ */
+    static int
+vm_can_assign(di, tv)
+    dictitem_T	*di;
+    typval_T	*tv;
+{
+    if (di->di_flags != 0 || di->di_tv.v_lock != 0
+					       || tv->v_type == VAR_FUNC)
+	return FALSE;
+    /* Changing the type is only allowed between a Number and a String. */
+    return di->di_tv.v_type == tv->v_type
+	    || ((di->di_tv.v_type == VAR_NUMBER
+					   || di->di_tv.v_type == VAR_STRING)
+		&& (tv->v_type == VAR_NUMBER || tv->v_type == VAR_STRING));
+}
+
+/*
+ * Assign "tv" to local variable "di" for ":let var {op}= expr".  "tv" is
+ * cleared or moved to the variable.
+ * Returns FAIL when the assignment must be done by ex_let_vars().
+ */
+    static int
+vm_store(di, tv, op)
+    dictitem_T	*di;
+    typval_T	*tv;
+    int		op;
+{
+    typval_T	*var = &di->di_tv;
+    char_u	numbuf[NUMBUFLEN];
+    char_u	*s;
+    char_u	*p;
+    int		len;
+
+    if (op == '=')
+    {
+	if (!vm_can_assign(di, tv))
+	    return FAIL;
+	clear_tv(var);
+	*var = *tv;
+	var->v_lock = 0;
+	init_tv(tv);
+	return OK;
+    }
+    if (di->di_flags != 0 || var->v_lock != 0)
+	return FAIL;
+    if (op != '.' && var->v_type == VAR_NUMBER && tv->v_type == VAR_NUMBER)
+    {
+	if (op == '+')
+	    var->vval.v_number += tv->vval.v_number;
+	else
+	    var->vval.v_number -= tv->vval.v_number;
+	return OK;
+    }
+    if (op == '.' && var->v_type == VAR_STRING
+	       && (tv->v_type == VAR_STRING || tv->v_type == VAR_NUMBER))
+    {
+	/* Append to the string in place. */
+	s = get_tv_string_buf(tv, numbuf);
+	len = var->vval.v_string == NULL ? 0 : (int)STRLEN(var->vval.v_string);
+	if (var->vval.v_string == NULL)
+	    p = alloc((unsigned)(STRLEN(s) + 1));
+	else
+	    p = vim_realloc(var->vval.v_string, len + STRLEN(s) + 1);
+	if (p == NULL)
+	    return FAIL;
+	STRCPY(p + len, s);
+	var->vval.v_string = p;
+	clear_tv(tv);
+	return OK;
+    }
+    return FAIL;
+}
+
+/*
+ * Return the name of command "cmdidx" compiled into ISN_STMT.
+ */
+    static char_u *
+vm_cmdname(cmdidx)
+    int		cmdidx;
+{
+    switch (cmdidx)
+    {
+	case CMD_let:	    return (char_u *)"let";
+	case CMD_if:	    return (char_u *)"if";
+	case CMD_elseif:    return (char_u *)"elseif";
+	case CMD_while:	    return (char_u *)"while";
+	case CMD_for:	    return (char_u *)"for";
+	case CMD_return:    return (char_u *)"return";
+	case CMD_call:	    return (char_u *)"call";
+    }
+    return NULL;
+}
+
+/*
+ * Execute the compiled function of "fc" until a line that must be executed
+ * with do_cmdline().  Returns a copy of that line, or NULL when the function
+ * has ended.
+ * Does what do_cmdline() and do_one_cmd() do for the compiled statements,
+ * including giving error messages and turning them into exceptions.
+ */
+    static char_u *
+func_vm_line(fc)
+    funccall_T	*fc;
+{
+    funcvm_T	*vm = fc->vm;
+    cfunc_T	*cf = vm->fv_cfunc;
+    isn_T	*instr = (isn_T *)cf->cf_instr.ga_data;
+    isn_T	*isn;
+    isn_T	*stmt = NULL;
+    int		pc = vm->fv_pc;
+    int		next = 0;
+    typval_T	stack[VM_STACK_LEN];
+    int		sp = 0;
+    struct
+    {
+	char_u	    *name;
+	int	    owned;	/* "name" is allocated */
+	int	    idx;	/* builtin function index or -1 */
+	linenr_T    lnum;
+    }		frames[VM_MAX_CALLS];
+    int		fsp = 0;
+    struct condstack cstack;
+    cmdmod_T	save_cmdmod;
+    typval_T	*tv;
+    typval_T	var1, var2;
+    typval_T	rettv;
+    forinfo_T	*fi;
+    listitem_T	*li;
+    list_T	*l;
+    dict_T	*d;
+    dictitem_T	*di;
+    funcdict_T	fudi;
+    char_u	*name;
+    char_u	*p;
+    char_u	*s;
+    char_u	op[2];
+    int		len;
+    int		argcount;
+    int		doesrange;
+    int		error;
+    int		ret;
+    int		i;
+
+    if (vm->fv_done || func_has_ended(fc))
+	goto done;
+
+    /* The conditionals are compiled, only an exception thrown by a compiled
+     * line is handled with this stack. */
+    cstack.cs_idx = -1;
+    cstack.cs_looplevel = 0;
+    cstack.cs_trylevel = 0;
+    cstack.cs_emsg_silent_list = NULL;
+    cstack.cs_lflags = 0;
+
+    while (pc < cf->cf_instr.ga_len)
+    {
+	isn = &instr[pc];
+	switch (isn->isn_type)
+	{
+	    case ISN_EXEC:
+		fc->linenr = isn->isn_arg1 + 1;
+		sourcing_lnum = fc->linenr;
+		vm->fv_pc = pc + 1;
+		return vim_strsave(FUNCLINE(fc->func, isn->isn_arg1));
+
+	    case ISN_STMT:
+		stmt = isn;
+		fc->linenr = isn->isn_arg1 + 1;
+		sourcing_lnum = fc->linenr;
+		++ex_nesting_level;
+		save_cmdmod = cmdmod;
+		vim_memset(&cmdmod, 0, sizeof(cmdmod));
+		break;
+
+	    case ISN_JUMP:
+		pc = isn->isn_arg1;
+		continue;
+
+	    case ISN_LOOP:
+		line_breakcheck();
+		if (got_int)
+		{
+		    (void)do_intthrow(&cstack);
+		    goto done;
+		}
+		pc = isn->isn_arg1;
+		continue;
+
+	    case ISN_COND:
+		tv = &stack[--sp];
+		error = FALSE;
+		i = get_tv_number_chk(tv, &error) != 0;
+		clear_tv(tv);
+		/* A wrong type is not an invalid expression, no E15. */
+		if (error)
+		    next = stmt->isn_arg2;
+		else
+		    next = i ? pc + 1 : isn->isn_arg1;
+		goto stmt_done;
+
+	    case ISN_STORE:
+		tv = &stack[--sp];
+		if (isn->isn_arg1 < 0
+			|| (di = VM_LOCAL(fc, isn->isn_arg1)) == NULL
+			|| vm_store(di, tv, isn->isn_arg2) == FAIL)
+		{
+		    op[0] = isn->isn_arg2;
+		    op[1] = NUL;
+		    (void)ex_let_vars(isn->isn_str, tv, FALSE, isn->isn_arg4,
+						       isn->isn_arg3, op);
+		}
+		clear_tv(tv);
+		next = pc + 1;
+		goto stmt_done;
+
+	    case ISN_RETURN:
+		if (isn->isn_arg1)
+		{
+		    clear_tv(fc->rettv);
+		    *fc->rettv = stack[--sp];
+		}
+		fc->returned = TRUE;
+		next = pc + 1;
+		goto stmt_done;
+
+	    case ISN_DROP:
+		clear_tv(&stack[--sp]);
+		next = pc + 1;
+		goto stmt_done;
+
+	    case ISN_FORINIT:
+		tv = &stack[--sp];
+		fi = (forinfo_T *)alloc_clear((unsigned)sizeof(forinfo_T));
+		if (fi != NULL)
+		{
+		    fi->fi_varcount = isn->isn_arg2;
+		    fi->fi_semicolon = isn->isn_arg3;
+		    if (tv->v_type != VAR_LIST)
+		    {
+			EMSG(_(e_listreq));
+			clear_tv(tv);
+		    }
+		    else if (tv->vval.v_list == NULL)
+			/* null list: nothing to do */
+			clear_tv(tv);
+		    else
+		    {
+			/* No need to increment the refcount, it's already set
+			 * for the list being used in "tv". */
+			fi->fi_list = tv->vval.v_list;
+			list_add_watch(fi->fi_list, &fi->fi_lw);
+			fi->fi_lw.lw_item = fi->fi_list->lv_first;
+		    }
+		}
+		else
+		    clear_tv(tv);
+		vm->fv_forinfo[isn->isn_arg1] = fi;
+		break;
+
+	    case ISN_FORCHK:
+		if (vm->fv_forinfo[isn->isn_arg1] != NULL)
+		{
+		    pc = isn->isn_arg2;
+		    continue;
+		}
+		break;
+
+	    case ISN_FORNEXT:
+		fi = (forinfo_T *)vm->fv_forinfo[isn->isn_arg1];
+		li = fi == NULL ? NULL : fi->fi_lw.lw_item;
+		if (li == NULL)
+		    ret = FAIL;
+		else
+		{
+		    fi->fi_lw.lw_item = li->li_next;
+		    if (isn->isn_arg3 >= 0
+			    && (di = VM_LOCAL(fc, isn->isn_arg3)) != NULL
+			    && vm_can_assign(di, &li->li_tv))
+		    {
+			copy_tv(&li->li_tv, &var1);
+			clear_tv(&di->di_tv);
+			di->di_tv = var1;
+			ret = OK;
+		    }
+		    else
+			ret = ex_let_vars(isn->isn_str, &li->li_tv, TRUE,
+				       fi->fi_semicolon, fi->fi_varcount, NULL);
+		}
+		next = ret == OK ? pc + 1 : isn->isn_arg2;
+		goto stmt_done;
+
+	    case ISN_FORFREE:
+		free_for_info(vm->fv_forinfo[isn->isn_arg1]);
+		vm->fv_forinfo[isn->isn_arg1] = NULL;
+		break;
+
+	    case ISN_PUSH:
+		copy_tv(&isn->isn_tv, &stack[sp++]);
+		break;
+
+	    case ISN_NEWLIST:
+		l = list_alloc();
+		if (l == NULL)
+		    goto failed;
+		for (i = sp - isn->isn_arg1; i < sp; ++i)
+		{
+		    li = listitem_alloc();
+		    if (li == NULL)
+			clear_tv(&stack[i]);
+		    else
+		    {
+			li->li_tv = stack[i];
+			li->li_tv.v_lock = 0;
+			list_append(l, li);
+		    }
+		}
+		sp -= isn->isn_arg1;
+		tv = &stack[sp++];
+		tv->v_type = VAR_LIST;
+		tv->v_lock = 0;
+		tv->vval.v_list = l;
+		++l->lv_refcount;
+		break;
+
+	    case ISN_NEWDICT:
+		d = dict_alloc();
+		if (d == NULL)
+		    goto failed;
+		for (i = sp - 2 * isn->isn_arg1; i < sp; i += 2)
+		{
+		    di = dictitem_alloc(stack[i].vval.v_string);
+		    if (di == NULL)
+			clear_tv(&stack[i + 1]);
+		    else
+		    {
+			di->di_tv = stack[i + 1];
+			di->di_tv.v_lock = 0;
+			if (dict_add(d, di) == FAIL)
+			    dictitem_free(di);
+		    }
+		    clear_tv(&stack[i]);
+		}
+		sp -= 2 * isn->isn_arg1;
+		tv = &stack[sp++];
+		tv->v_type = VAR_DICT;
+		tv->v_lock = 0;
+		tv->vval.v_dict = d;
+		++d->dv_refcount;
+		break;
+
+	    case ISN_LOADL:
+	    case ISN_LOADA:
+		if (isn->isn_type == ISN_LOADL)
+		    di = VM_LOCAL(fc, isn->isn_arg1);
+		else
+		    di = VM_ARG(fc, isn->isn_arg1);
+		if (di == NULL)
+		{
+		    EMSG2(_(e_undefvar), isn->isn_str);
+		    goto failed;
+		}
+		copy_tv(&di->di_tv, &stack[sp++]);
+		break;
+
+	    case ISN_LOADV:
+		if (get_var_tv(isn->isn_str, (int)STRLEN(isn->isn_str),
+					      &stack[sp], TRUE, FALSE) == FAIL)
+		    goto failed;
+		++sp;
+		break;
+
+	    case ISN_EVAL:
+		if (isn->isn_arg1)
+		{
+		    s = vim_strsave(isn->isn_str);
+		    if (s == NULL)
+			goto failed;
+		}
+		else
+		    s = isn->isn_str;
+		p = s;
+		ret = eval1(&p, &stack[sp], TRUE);
+		if (ret == OK && *p != NUL)
+		{
+		    clear_tv(&stack[sp]);
+		    ret = FAIL;
+		}
+		if (s != isn->isn_str)
+		    vim_free(s);
+		if (ret == FAIL)
+		    goto failed;
+		++sp;
+		break;
+
+	    case ISN_JUMPIF:
+	    case ISN_JUMPIFNOT:
+	    case ISN_JUMPFALSE:
+	    case ISN_TOBOOL:
+		tv = &stack[sp - 1];
+		error = FALSE;
+		i = get_tv_number_chk(tv, &error) != 0;
+		clear_tv(tv);
+		if (error)
+		{
+		    --sp;
+		    goto failed;
+		}
+		tv->v_type = VAR_NUMBER;
+		tv->v_lock = 0;
+		tv->vval.v_number = i;
+		if (isn->isn_type == ISN_TOBOOL)
+		    break;
+		if (isn->isn_type == ISN_JUMPFALSE)
+		    --sp;
+		if (i == (isn->isn_type == ISN_JUMPIF))
+		{
+		    pc = isn->isn_arg1;
+		    continue;
+		}
+		if (isn->isn_type != ISN_JUMPFALSE)
+		    --sp;
+		break;
+
+	    case ISN_COMPARE:
+		--sp;
+		if (eval_compare(&stack[sp - 1], &stack[sp],
+			(exptype_T)isn->isn_arg1, isn->isn_arg2,
+			isn->isn_arg3 < 0 ? p_ic : isn->isn_arg3) == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_ADDCHK:
+		if (eval_arith_check(&stack[sp - 1], isn->isn_arg1) == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_ADD:
+		--sp;
+		if (eval_arith(&stack[sp - 1], &stack[sp], isn->isn_arg1)
+								      == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_MULCHK:
+		if (eval_mult_check(&stack[sp - 1]) == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_MUL:
+		--sp;
+		if (eval_mult(&stack[sp - 1], &stack[sp], isn->isn_arg1)
+								      == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_LEADER:
+		if (eval_leader(&stack[sp - 1], isn->isn_str,
+					 isn->isn_str + isn->isn_arg1) == FAIL)
+		{
+		    --sp;
+		    goto failed;
+		}
+		break;
+
+	    case ISN_INDEXCHK:
+		tv = &stack[sp - 1];
+		if (isn->isn_arg1 == '.')
+		{
+		    /* "dict." without a key */
+		    if (tv->v_type == VAR_DICT)
+			goto failed;
+		}
+		else if (tv->v_type == VAR_FUNC)
+		{
+		    EMSG(_("E695: Cannot index a Funcref"));
+		    goto failed;
+		}
+#ifdef FEAT_FLOAT
+		else if (tv->v_type == VAR_FLOAT)
+		{
+		    EMSG(_(e_float_as_string));
+		    goto failed;
+		}
+#endif
+		break;
+
+	    case ISN_STRCHK:
+		if (get_tv_string_chk(&stack[sp - 1]) == NULL)
+		    goto failed;
+		break;
+
+	    case ISN_INDEX:
+		var1.v_type = VAR_UNKNOWN;
+		var2.v_type = VAR_UNKNOWN;
+		if (isn->isn_arg1 && !isn->isn_arg3)
+		    var2 = stack[--sp];
+		if (!isn->isn_arg2)
+		    var1 = stack[--sp];
+		if (eval_index_tv(&stack[sp - 1], &var1, &var2, NULL, -1L,
+			       isn->isn_arg1, isn->isn_arg2, isn->isn_arg3,
+							       TRUE) == FAIL)
+		{
+		    clear_tv(&var1);
+		    clear_tv(&var2);
+		    goto failed;
+		}
+		break;
+
+	    case ISN_MEMBER:
+		var1.v_type = VAR_UNKNOWN;
+		var2.v_type = VAR_UNKNOWN;
+		if (eval_index_tv(&stack[sp - 1], &var1, &var2, isn->isn_str,
+			    (long)isn->isn_arg1, FALSE, FALSE, FALSE, TRUE)
+								      == FAIL)
+		    goto failed;
+		break;
+
+	    case ISN_FUNC:
+		frames[fsp].idx = isn->isn_arg1;
+		frames[fsp].name = isn->isn_str;
+		frames[fsp].owned = FALSE;
+		if (isn->isn_arg1 < 0)
+		{
+		    /* May be a Funcref variable. */
+		    len = (int)STRLEN(isn->isn_str);
+		    name = deref_func_name(isn->isn_str, &len, FALSE);
+		    if (name != isn->isn_str)
+		    {
+			frames[fsp].name = vim_strnsave(name, len);
+			if (frames[fsp].name == NULL)
+			    goto failed;
+			frames[fsp].owned = TRUE;
+		    }
+		}
+		frames[fsp++].lnum = curwin->w_cursor.lnum;
+		break;
+
+	    case ISN_CALLNAME:
+		/* Like ex_call() */
+		p = isn->isn_str;
+		name = trans_function_name(&p, FALSE, TFN_INT, &fudi);
+		if (fudi.fd_newkey != NULL)
+		{
+		    /* Still need to give an error message for missing key. */
+		    EMSG2(_(e_dictkey), fudi.fd_newkey);
+		    vim_free(fudi.fd_newkey);
+		}
+		if (name == NULL)
+		    goto failed;
+		len = (int)STRLEN(name);
+		p = deref_func_name(name, &len, FALSE);
+		if (p != name)
+		{
+		    s = vim_strnsave(p, len);
+		    vim_free(name);
+		    if (s == NULL)
+			goto failed;
+		    name = s;
+		}
+		frames[fsp].idx = -1;
+		frames[fsp].name = name;
+		frames[fsp].owned = TRUE;
+		frames[fsp++].lnum = curwin->w_cursor.lnum;
+		break;
+
+	    case ISN_CALL:
+		--fsp;
+		argcount = isn->isn_arg1;
+		sp -= argcount;
+		tv = &stack[sp];
+		rettv.v_type = VAR_UNKNOWN;
+		rettv.v_lock = 0;
+		i = frames[fsp].idx;
+		if (i >= 0 && argcount >= functions[i].f_min_argc
+					    && argcount <= functions[i].f_max_argc)
+		{
+		    /* Builtin function, like call_func() does. */
+		    tv[argcount].v_type = VAR_UNKNOWN;
+		    rettv.v_type = VAR_NUMBER;
+		    rettv.vval.v_number = 0;
+		    functions[i].f_func(tv, &rettv);
+		    update_force_abort();
+		    ret = OK;
+		}
+		else
+		    ret = call_func(frames[fsp].name,
+			    (int)STRLEN(frames[fsp].name), &rettv, argcount,
+			    tv, frames[fsp].lnum, frames[fsp].lnum,
+			    &doesrange, TRUE, NULL);
+		for (i = 0; i < argcount; ++i)
+		    clear_tv(&tv[i]);
+		if (frames[fsp].owned)
+		    vim_free(frames[fsp].name);
+		if (ret == FAIL || (isn->isn_arg2 && aborting()))
+		{
+		    clear_tv(&rettv);
+		    goto failed;
+		}
+		stack[sp++] = rettv;
+		break;
+	}
+	++pc;
+	continue;
+
+failed:
+	/* Evaluating the expression failed, give the messages that eval1()
+	 * and get_func_tv() would give. */
+	while (fsp > 0)
+	{
+	    --fsp;
+	    if (!aborting())
+		emsg_funcname(N_("E116: Invalid arguments for function %s"),
+							     frames[fsp].name);
+	    if (frames[fsp].owned)
+		vim_free(frames[fsp].name);
+	}
+	while (sp > 0)
+	    clear_tv(&stack[--sp]);
+	if (stmt->isn_str != NULL && !aborting())
+	    EMSG2(_(e_invexpr2), stmt->isn_str);
+	if (stmt->isn_arg3 == CMD_return)
+	{
+	    /* Like ex_return(): it's safer to return also on error. */
+	    update_force_abort();
+	    if (!aborting())
+		fc->returned = TRUE;
+	}
+	next = stmt->isn_arg2;
+
+stmt_done:
+	/* End of the compiled line, what do_one_cmd() and do_cmdline() do
+	 * after executing a command. */
+	if (need_rethrow)
+	    do_throw(&cstack);
+	need_rethrow = check_cstack = FALSE;
+	if (curwin->w_cursor.lnum == 0)
+	    curwin->w_cursor.lnum = 1;
+	do_errthrow(&cstack, vm_cmdname(stmt->isn_arg3));
+	cmdmod = save_cmdmod;
+	--ex_nesting_level;
+
+	/* reset did_emsg for a function that is not aborted by an error */
+	if (did_emsg && !force_abort && !func_has_abort(fc))
+	    did_emsg = FALSE;
+	if (trylevel == 0 && !did_emsg && !got_int && !did_throw)
+	    force_abort = FALSE;
+	(void)do_intthrow(&cstack);
+	if (got_int || (did_emsg && force_abort) || did_throw
+						     || func_has_ended(fc))
+	    goto done;
+	pc = next;
+    }
+
+done:
+    for (i = 0; i < cf->cf_nfor; ++i)
+    {
+	free_for_info(vm->fv_forinfo[i]);
+	vm->fv_forinfo[i] = NULL;
+    }
+    vm->fv_done = TRUE;
+    return NULL;
+}
+
+/*
+ * Get next function line.
+ * Called by do_cmdline() to get the next line.
+ * Returns allocated string, or NULL for end of function.
+ */
+    char_u *
+get_func_line(c, cookie, indent)
+    int	    c UNUSED;
+    void    *cookie;
+    int	    indent UNUSED;
+{
+    funccall_T	*fcp = (funccall_T *)cookie;
+    ufunc_T	*fp = fcp->func;
+    char_u	*retval;
+    garray_T	*gap;  /* growarray with function lines */
+
+    if (fcp->vm != NULL)
+	return func_vm_line(fcp);
 
     /* If breakpoints have been added/deleted need to check for it. */
     if (fcp->dbg_tick != debug_tick)
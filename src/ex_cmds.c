@@ -14,6 +14,10 @@
 #include "vim.h"
 #include "version.h"
 
+#ifdef FEAT_SORT_THREAD
+# include <pthread.h>
+#endif
+
 #ifdef FEAT_EX_EXTRA
 static int linelen __ARGS((int *has_tab));
 #endif
@@ -270,78 +274,315 @@ linelen(has_tab)
     return len;
 }
 
-/* Buffer for two lines used during sorting.  They are allocated to
- * contain the longest line being sorted. */
-static char_u	*sortbuf1;
-static char_u	*sortbuf2;
-
 static int	sort_ic;		/* ignore case */
 static int	sort_nr;		/* sort on number */
 static int	sort_rx;		/* sort on regex instead of skipping it */
 
-static int	sort_abort;		/* flag to indicate if sorting has been interrupted */
+static volatile int sort_abort;	/* flag to indicate if sorting has been interrupted */
 
 /* Struct to store info to be sorted. */
 typedef struct
 {
     linenr_T	lnum;			/* line number */
-    long	start_col_nr;		/* starting column number or number */
-    long	end_col_nr;		/* ending column number */
+    colnr_T	key_len;		/* length of "st_u.key" */
+    union
+    {
+	long	nr;			/* number to sort on */
+	char_u	*key;			/* text to sort on, not NUL terminated */
+    } st_u;
+    char_u	*line;			/* copy of the line */
 } sorti_T;
 
-static int
-#ifdef __BORLANDC__
-_RTLENTRYF
-#endif
-sort_compare __ARGS((const void *s1, const void *s2));
+#define SORT_SMALL	16	/* use insertion sort for fewer lines */
+#define SORT_APPEND	1000	/* max number of lines appended at once */
+
+static int sort_compare __ARGS((sorti_T *s1, sorti_T *s2));
+static void sort_merge __ARGS((sorti_T *nrs, sorti_T *tmp, size_t mid, size_t count));
+static void sort_merge_sort __ARGS((sorti_T *nrs, sorti_T *tmp, size_t count, int check));
+static void sort_radix __ARGS((sorti_T *nrs, sorti_T *tmp, size_t count));
 
+/*
+ * Compare the text that two lines are sorted on.
+ */
     static int
-#ifdef __BORLANDC__
-_RTLENTRYF
-#endif
 sort_compare(s1, s2)
-    const void	*s1;
-    const void	*s2;
+    sorti_T	*s1;
+    sorti_T	*s2;
 {
-    sorti_T	l1 = *(sorti_T *)s1;
-    sorti_T	l2 = *(sorti_T *)s2;
-    int		result = 0;
+    int		result;
+
+    result = STRNCMP(s1->st_u.key, s2->st_u.key,
+			  s1->key_len < s2->key_len ? s1->key_len : s2->key_len);
+    if (result == 0)
+	result = s1->key_len - s2->key_len;
+    return result;
+}
+
+/*
+ * Merge the sorted lines in nrs[0] to nrs[mid - 1] with the sorted lines in
+ * nrs[mid] to nrs[count - 1].  "tmp" must have room for "mid" items.
+ * Lines that compare equal keep their order.
+ */
+    static void
+sort_merge(nrs, tmp, mid, count)
+    sorti_T	*nrs;
+    sorti_T	*tmp;
+    size_t	mid;
+    size_t	count;
+{
+    size_t	i = 0;
+    size_t	j = mid;
+    size_t	k = 0;
+
+    if (sort_compare(&nrs[mid - 1], &nrs[mid]) <= 0)
+	return;		/* already in order */
+    mch_memmove(tmp, nrs, mid * sizeof(sorti_T));
+    while (i < mid && j < count)
+    {
+	if (sort_compare(&nrs[j], &tmp[i]) < 0)
+	    nrs[k++] = nrs[j++];
+	else
+	    nrs[k++] = tmp[i++];
+    }
+    while (i < mid)
+	nrs[k++] = tmp[i++];
+}
+
+/*
+ * Sort "count" lines on their text with a merge sort, which is stable.
+ * "tmp" must have room for "count" items.
+ * When "check" is TRUE check for an interrupt, this is not possible in
+ * another thread.
+ */
+    static void
+sort_merge_sort(nrs, tmp, count, check)
+    sorti_T	*nrs;
+    sorti_T	*tmp;
+    size_t	count;
+    int		check;
+{
+    size_t	i;
+    size_t	j;
+    sorti_T	item;
 
-    /* If the user interrupts, there's no way to stop qsort() immediately, but
-     * if we return 0 every time, qsort will assume it's done sorting and
-     * exit. */
     if (sort_abort)
-	return 0;
-    fast_breakcheck();
-    if (got_int)
-	sort_abort = TRUE;
+	return;
+    if (count < SORT_SMALL)
+    {
+	for (i = 1; i < count; ++i)
+	{
+	    item = nrs[i];
+	    for (j = i; j > 0 && sort_compare(&nrs[j - 1], &item) > 0; --j)
+		nrs[j] = nrs[j - 1];
+	    nrs[j] = item;
+	}
+	return;
+    }
 
-    /* When sorting numbers "start_col_nr" is the number, not the column
-     * number. */
-    if (sort_nr)
-	result = l1.start_col_nr == l2.start_col_nr ? 0
-				 : l1.start_col_nr > l2.start_col_nr ? 1 : -1;
+    sort_merge_sort(nrs, tmp, count / 2, check);
+    sort_merge_sort(nrs + count / 2, tmp + count / 2, count - count / 2,
+									check);
+    if (check)
+    {
+	fast_breakcheck();
+	if (got_int)
+	    sort_abort = TRUE;
+    }
+    if (!sort_abort)
+	sort_merge(nrs, tmp, count / 2, count);
+}
+
+/*
+ * Sort "count" lines on their number with a radix sort, one byte at a time,
+ * starting with the least significant byte.  Lines with the same number keep
+ * their order.  "tmp" must have room for "count" items.
+ */
+    static void
+sort_radix(nrs, tmp, count)
+    sorti_T	*nrs;
+    sorti_T	*tmp;
+    size_t	count;
+{
+    sorti_T	*orig = nrs;
+    sorti_T	*t;
+    size_t	counts[256];
+    size_t	total;
+    size_t	n;
+    size_t	i;
+    int		shift;
+    int		c;
+    long_u	sign = (long_u)1 << (sizeof(long) * 8 - 1);
+
+/* The byte of a number at "shift", with the sign bit flipped so that
+ * negative numbers come first. */
+#define RADIX_BYTE(nr) (int)((((long_u)(nr) ^ sign) >> shift) & 0xff)
+
+    for (shift = 0; shift < (int)sizeof(long) * 8; shift += 8)
+    {
+	vim_memset(counts, 0, sizeof(counts));
+	for (i = 0; i < count; ++i)
+	    ++counts[RADIX_BYTE(nrs[i].st_u.nr)];
+
+	/* Nothing to do when all numbers have the same byte here, which
+	 * happens for the upper bytes of small numbers. */
+	if (counts[RADIX_BYTE(nrs[0].st_u.nr)] == count)
+	    continue;
+
+	total = 0;
+	for (c = 0; c < 256; ++c)
+	{
+	    n = counts[c];
+	    counts[c] = total;
+	    total += n;
+	}
+	for (i = 0; i < count; ++i)
+	    tmp[counts[RADIX_BYTE(nrs[i].st_u.nr)]++] = nrs[i];
+	t = nrs;
+	nrs = tmp;
+	tmp = t;
+
+	fast_breakcheck();
+	if (got_int)
+	{
+	    sort_abort = TRUE;
+	    return;
+	}
+    }
+#undef RADIX_BYTE
+
+    if (nrs != orig)
+	mch_memmove(orig, nrs, count * sizeof(sorti_T));
+}
+
+#ifdef FEAT_SORT_THREAD
+# define SORT_THREAD_MIN 50000	/* use threads for this many lines */
+# define SORT_THREAD_MAX 16	/* max number of threads */
+
+/* Part of the lines for one thread to sort or merge. */
+typedef struct
+{
+    sorti_T	*nrs;
+    sorti_T	*tmp;
+    size_t	mid;		/* when not zero: merge two sorted parts */
+    size_t	count;
+} sortjob_T;
+
+static void *sort_thread __ARGS((void *arg));
+static void sort_run_jobs __ARGS((sortjob_T *jobs, int njobs));
+static void sort_parallel __ARGS((sorti_T *nrs, sorti_T *tmp, size_t count));
+
+    static void *
+sort_thread(arg)
+    void	*arg;
+{
+    sortjob_T	*job = (sortjob_T *)arg;
+
+    if (job->mid == 0)
+	sort_merge_sort(job->nrs, job->tmp, job->count, FALSE);
+    else if (!sort_abort)
+	sort_merge(job->nrs, job->tmp, job->mid, job->count);
+    return NULL;
+}
+
+/*
+ * Do "njobs" jobs at the same time: the first one in this thread, where an
+ * interrupt is checked for, the others in a new thread each.  When a thread
+ * can't be created its job is done here.
+ */
+    static void
+sort_run_jobs(jobs, njobs)
+    sortjob_T	*jobs;
+    int		njobs;
+{
+    pthread_t	threads[SORT_THREAD_MAX];
+    int		started[SORT_THREAD_MAX];
+    sigset_t	all;
+    sigset_t	old;
+    int		i;
+
+    /* The threads must not handle any signals, block them all while
+     * creating them, they inherit the signal mask. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 1; i < njobs; ++i)
+	started[i] = pthread_create(&threads[i], NULL, sort_thread,
+							   &jobs[i]) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (jobs[0].mid == 0)
+	sort_merge_sort(jobs[0].nrs, jobs[0].tmp, jobs[0].count, TRUE);
     else
+	sort_merge(jobs[0].nrs, jobs[0].tmp, jobs[0].mid, jobs[0].count);
+
+    for (i = 1; i < njobs; ++i)
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	else
+	    (void)sort_thread(&jobs[i]);
+}
+
+/*
+ * Sort "count" lines on their text using a thread per processor: each thread
+ * sorts a part of the lines, then pairs of parts are merged, also in
+ * parallel, until one part is left.
+ * "tmp" must have room for "count" items.
+ */
+    static void
+sort_parallel(nrs, tmp, count)
+    sorti_T	*nrs;
+    sorti_T	*tmp;
+    size_t	count;
+{
+    sortjob_T	jobs[SORT_THREAD_MAX];
+    size_t	bounds[SORT_THREAD_MAX + 1];
+    long	nproc = 1;
+    int		nparts;
+    int		njobs;
+    int		width;
+    int		end;
+    int		i;
+
+# ifdef _SC_NPROCESSORS_ONLN
+    nproc = sysconf(_SC_NPROCESSORS_ONLN);
+# endif
+    /* With one processor still use two parts: sorting two halves and
+     * merging them is no more work than sorting all lines at once. */
+    nparts = nproc > SORT_THREAD_MAX ? SORT_THREAD_MAX
+						: nproc < 2 ? 2 : (int)nproc;
+    if (count < SORT_THREAD_MIN)
     {
-	/* We need to copy one line into "sortbuf1", because there is no
-	 * guarantee that the first pointer becomes invalid when obtaining the
-	 * second one. */
-	STRNCPY(sortbuf1, ml_get(l1.lnum) + l1.start_col_nr,
-					 l1.end_col_nr - l1.start_col_nr + 1);
-	sortbuf1[l1.end_col_nr - l1.start_col_nr] = 0;
-	STRNCPY(sortbuf2, ml_get(l2.lnum) + l2.start_col_nr,
-					 l2.end_col_nr - l2.start_col_nr + 1);
-	sortbuf2[l2.end_col_nr - l2.start_col_nr] = 0;
+	sort_merge_sort(nrs, tmp, count, TRUE);
+	return;
+    }
 
-	result = sort_ic ? STRICMP(sortbuf1, sortbuf2)
-						 : STRCMP(sortbuf1, sortbuf2);
+    for (i = 0; i <= nparts; ++i)
+	bounds[i] = count / nparts * i + count % nparts * i / nparts;
+    for (i = 0; i < nparts; ++i)
+    {
+	jobs[i].nrs = nrs + bounds[i];
+	jobs[i].tmp = tmp + bounds[i];
+	jobs[i].mid = 0;
+	jobs[i].count = bounds[i + 1] - bounds[i];
     }
+    sort_run_jobs(jobs, nparts);
 
-    /* If two lines have the same value, preserve the original line order. */
-    if (result == 0)
-	return (int)(l1.lnum - l2.lnum);
-    return result;
+    /* Merge part "i" with part "i + width", until there is one part. */
+    for (width = 1; width < nparts && !sort_abort; width *= 2)
+    {
+	njobs = 0;
+	for (i = 0; i + width < nparts; i += 2 * width)
+	{
+	    end = i + 2 * width > nparts ? nparts : i + 2 * width;
+	    jobs[njobs].nrs = nrs + bounds[i];
+	    jobs[njobs].tmp = tmp + bounds[i];
+	    jobs[njobs].mid = bounds[i + width] - bounds[i];
+	    jobs[njobs].count = bounds[end] - bounds[i];
+	    ++njobs;
+	}
+	sort_run_jobs(jobs, njobs);
+    }
 }
+#endif
 
 /*
  * ":sort".
@@ -351,12 +592,21 @@ ex_sort(eap)
     exarg_T	*eap;
 {
     regmatch_T	regmatch;
-    int		len;
+    colnr_T	len;
     linenr_T	lnum;
-    long	maxlen = 0;
     sorti_T	*nrs;
+    sorti_T	*tmp = NULL;
+    sorti_T	*nrp;
     size_t	count = (size_t)(eap->line2 - eap->line1 + 1);
     size_t	i;
+    char_u	*text = NULL;		/* copies of the lines */
+    long_u	text_size = 0;
+    char_u	*t;
+    lineiter_T	iter;
+    char_u	*lines[SORT_APPEND];
+    colnr_T	lens[SORT_APPEND];
+    int		n;
+    char_u	*prev = NULL;
     char_u	*p;
     char_u	*s;
     char_u	*s2;
@@ -374,8 +624,6 @@ ex_sort(eap)
 
     if (u_save((linenr_T)(eap->line1 - 1), (linenr_T)(eap->line2 + 1)) == FAIL)
 	return;
-    sortbuf1 = NULL;
-    sortbuf2 = NULL;
     regmatch.regprog = NULL;
     nrs = (sorti_T *)lalloc((long_u)(count * sizeof(sorti_T)), TRUE);
     if (nrs == NULL)
@@ -450,19 +698,35 @@ ex_sort(eap)
     sort_nr += sort_oct + sort_hex;
 
     /*
-     * Make an array with all line numbers.  This avoids having to copy all
-     * the lines into allocated memory.
-     * When sorting on strings "start_col_nr" is the offset in the line, for
-     * numbers sorting it's the number to sort on.  This means the pattern
-     * matching and number conversion only has to be done once per line.
-     * Also get the longest line length for allocating "sortbuf".
+     * Make an array with all line numbers and a copy of the lines, in one
+     * allocated block.  Sorting doesn't need to get the lines from the
+     * buffer again.
+     * When sorting on strings "st_u.key" is the text to sort on, lower cased
+     * for ignoring case, for numbers sorting it's the number to sort on.
+     * This means the pattern matching and number conversion only has to be
+     * done once per line.
      */
+    ml_iter_init(&iter, curbuf, eap->line1);
     for (lnum = eap->line1; lnum <= eap->line2; ++lnum)
     {
-	s = ml_get(lnum);
-	len = (int)STRLEN(s);
-	if (maxlen < len)
-	    maxlen = len;
+	(void)ml_iter_next(&iter, &len);
+	text_size += len + 1;
+    }
+    if (sort_ic && !sort_nr)
+	text_size *= 2;		/* room for the lower cased text */
+    text = lalloc(text_size, TRUE);
+    if (text == NULL)
+	goto sortend;
+
+    t = text;
+    nrp = nrs;
+    ml_iter_init(&iter, curbuf, eap->line1);
+    for (lnum = eap->line1; lnum <= eap->line2; ++lnum, ++nrp)
+    {
+	s = ml_iter_next(&iter, &len);
+	mch_memmove(t, s, (size_t)len + 1);
+	s = t;
+	t += len + 1;
 
 	start_col = 0;
 	end_col = len;
@@ -490,27 +754,35 @@ ex_sort(eap)
 	    /* Sorting on number: Store the number itself. */
 	    p = s + start_col;
 	    if (sort_hex)
-		s = skiptohex(p);
+		s2 = skiptohex(p);
 	    else
-		s = skiptodigit(p);
-	    if (s > p && s[-1] == '-')
-		--s;  /* include preceding negative sign */
-	    if (*s == NUL)
+		s2 = skiptodigit(p);
+	    if (s2 > p && s2[-1] == '-')
+		--s2;  /* include preceding negative sign */
+	    if (*s2 == NUL)
 		/* empty line should sort before any number */
-		nrs[lnum - eap->line1].start_col_nr = -MAXLNUM;
+		nrp->st_u.nr = -MAXLNUM;
 	    else
-		vim_str2nr(s, NULL, NULL, sort_oct, sort_hex,
-				  &nrs[lnum - eap->line1].start_col_nr, NULL);
-	    *s2 = c;
+		vim_str2nr(s2, NULL, NULL, sort_oct, sort_hex,
+							  &nrp->st_u.nr, NULL);
+	    s[end_col] = c;
 	}
 	else
 	{
-	    /* Store the column to sort at. */
-	    nrs[lnum - eap->line1].start_col_nr = start_col;
-	    nrs[lnum - eap->line1].end_col_nr = end_col;
+	    /* Store the text to sort on. */
+	    nrp->key_len = end_col - start_col;
+	    if (sort_ic)
+	    {
+		nrp->st_u.key = t;
+		for (p = s + start_col; p < s + end_col; ++p)
+		    *t++ = TOLOWER_LOC(*p);
+	    }
+	    else
+		nrp->st_u.key = s + start_col;
 	}
 
-	nrs[lnum - eap->line1].lnum = lnum;
+	nrp->line = s;
+	nrp->lnum = lnum;
 
 	if (regmatch.regprog != NULL)
 	    fast_breakcheck();
@@ -518,36 +790,47 @@ ex_sort(eap)
 	    goto sortend;
     }
 
-    /* Allocate a buffer that can hold the longest line. */
-    sortbuf1 = alloc((unsigned)maxlen + 1);
-    if (sortbuf1 == NULL)
+    /* Sort the array of lines.  Numbers with a radix sort, text with a merge
+     * sort, using threads when there are many lines. */
+    tmp = (sorti_T *)lalloc((long_u)(count * sizeof(sorti_T)), TRUE);
+    if (tmp == NULL)
 	goto sortend;
-    sortbuf2 = alloc((unsigned)maxlen + 1);
-    if (sortbuf2 == NULL)
-	goto sortend;
-
-    /* Sort the array of line numbers.  Note: can't be interrupted! */
-    qsort((void *)nrs, count, sizeof(sorti_T), sort_compare);
+    if (sort_nr)
+	sort_radix(nrs, tmp, count);
+    else
+#ifdef FEAT_SORT_THREAD
+	sort_parallel(nrs, tmp, count);
+#else
+	sort_merge_sort(nrs, tmp, count, TRUE);
+#endif
+    vim_free(tmp);
+    tmp = NULL;
 
     if (sort_abort)
 	goto sortend;
 
-    /* Insert the lines in the sorted order below the last one. */
+    /* Insert the lines in the sorted order below the last one, a number of
+     * them at a time. */
     lnum = eap->line2;
+    n = 0;
     for (i = 0; i < count; ++i)
     {
-	s = ml_get(nrs[eap->forceit ? count - i - 1 : i].lnum);
+	s = nrs[eap->forceit ? count - i - 1 : i].line;
 	if (!unique || i == 0
-		|| (sort_ic ? STRICMP(s, sortbuf1) : STRCMP(s, sortbuf1)) != 0)
+		|| (sort_ic ? STRICMP(s, prev) : STRCMP(s, prev)) != 0)
+	{
+	    lines[n] = s;
+	    lens[n] = (colnr_T)STRLEN(s) + 1;
+	    ++n;
+	    prev = s;
+	}
+	if (n == SORT_APPEND || (i == count - 1 && n > 0))
 	{
-	    if (ml_append(lnum++, s, (colnr_T)0, FALSE) == FAIL)
+	    if (ml_append_lines(lnum, lines, lens, (long)n, FALSE) == FAIL)
 		break;
-	    if (unique)
-		STRCPY(sortbuf1, s);
+	    lnum += n;
+	    n = 0;
 	}
-	fast_breakcheck();
-	if (got_int)
-	    goto sortend;
     }
 
     /* delete the original lines if appending worked */
@@ -570,8 +853,8 @@ ex_sort(eap)
 
 sortend:
     vim_free(nrs);
-    vim_free(sortbuf1);
-    vim_free(sortbuf2);
+    vim_free(tmp);
+    vim_free(text);
     vim_regfree(regmatch.regprog);
     if (got_int)
 	EMSG(_(e_interr));
@@ -5486,7 +5769,7 @@ ex_global(eap)
 #ifdef FEAT_CLIPBOARD
 	start_global_changes();
 #endif
-	global_exe(cmd);
+	global_exe(cmd, (linenr_T)ndone);
 #ifdef FEAT_CLIPBOARD
 	end_global_changes();
 #endif
@@ -5496,16 +5779,71 @@ ex_global(eap)
     vim_regfree(regmatch.regprog);
 }
 
+/*
+ * Check if "cmd" deletes the line, optionally into a register, or moves it to
+ * the end of the buffer.  Then a range of marked lines can be handled with
+ * one command, instead of one line at a time.
+ * Returns 'd' for ":delete" and sets "*regp" to the register name (NUL for
+ * the unnamed register), 'm' for ":move $", NUL otherwise.
+ */
+    static int
+global_range_cmd(cmd, regp)
+    char_u	*cmd;
+    int		*regp;
+{
+    char_u	*p = cmd;
+    int		len;
+    int		c;
+
+    *regp = NUL;
+    while (*p == ':' || vim_iswhite(*p))
+	++p;
+    for (len = 0; ASCII_ISALPHA(p[len]); ++len)
+	;
+    if (len >= 1 && len <= 6 && STRNCMP(p, "delete", len) == 0)
+    {
+	c = 'd';
+	p = skipwhite(p + len);
+	if (*p == '_' || ASCII_ISALPHA(*p)
+#ifdef FEAT_CLIPBOARD
+		|| *p == '*' || *p == '+'
+#endif
+		)
+	    *regp = *p++;
+    }
+    else if (len >= 1 && len <= 4 && STRNCMP(p, "move", len) == 0)
+    {
+	c = 'm';
+	p = skipwhite(p + len);
+	if (*p++ != '$')
+	    return NUL;
+    }
+    else
+	return NUL;
+    p = skipwhite(p);
+    if (*p != NUL && *p != '\n')
+	return NUL;
+    return c;
+}
+
 /*
  * Execute "cmd" on lines marked with ml_setmarked().
+ * "count" is the number of marked lines, zero when not known.
  */
     void
-global_exe(cmd)
+global_exe(cmd, count)
     char_u	*cmd;
+    linenr_T	count;
 {
     linenr_T old_lcount;	/* b_ml.ml_line_count before the command */
     buf_T    *old_buf = curbuf;	/* remember what buffer we started in */
     linenr_T lnum;		/* line number according to old situation */
+    linenr_T done = 0;		/* number of marked lines handled */
+    linenr_T tail;		/* no of last lines to do one at a time */
+    linenr_T n;
+    int	     range_cmd;
+    int	     regname;
+    char_u   range_buf[60];
 
     /*
      * Set current position only once for a global command.
@@ -5522,11 +5860,44 @@ global_exe(cmd)
     global_need_beginline = FALSE;
     global_busy = 1;
     old_lcount = curbuf->b_ml.ml_line_count;
+
+    /*
+     * For ":d" and ":m$" a run of marked lines is deleted or moved with one
+     * command, that results in one undo entry and one mark adjustment.  The
+     * last nine lines are deleted one at a time, so that the registers end up
+     * the same as when deleting every line by itself: each delete also
+     * shifts the numbered registers, also when a register is given.  The
+     * lines before them are deleted into the black hole register, or
+     * appended to an uppercase register, that works the same for a range.
+     */
+    range_cmd = global_range_cmd(cmd, &regname);
+    if (regname == '_' || range_cmd == 'm')
+	tail = 0;
+    else
+	tail = 9;
+    if (count == 0 && tail > 0)
+	range_cmd = NUL;
+
     while (!got_int && (lnum = ml_firstmarked()) != 0 && global_busy == 1)
     {
 	curwin->w_cursor.lnum = lnum;
 	curwin->w_cursor.col = 0;
-	if (*cmd == NUL || *cmd == '\n')
+	++done;
+	if (range_cmd != NUL && (tail == 0 || done <= count - tail))
+	{
+	    n = tail == 0 ? MAXLNUM : count - tail - done;
+	    n = ml_marked_below(lnum, n);
+	    done += n;
+	    if (range_cmd == 'd')
+		vim_snprintf((char *)range_buf, sizeof(range_buf), "%ld,%ldd %c",
+		     (long)lnum, (long)(lnum + n),
+					 ASCII_ISUPPER(regname) ? regname : '_');
+	    else
+		vim_snprintf((char *)range_buf, sizeof(range_buf), "%ld,%ldm$",
+						   (long)lnum, (long)(lnum + n));
+	    do_cmdline(range_buf, NULL, NULL, DOCMD_NOWAIT);
+	}
+	else if (*cmd == NUL || *cmd == '\n')
 	    do_cmdline((char_u *)"p", NULL, NULL, DOCMD_NOWAIT);
 	else
 	    do_cmdline(cmd, NULL, NULL, DOCMD_NOWAIT);
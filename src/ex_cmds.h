@@ -879,6 +879,9 @@ EX(CMD_menutranslate,	"menutranslate", ex_menutranslate,
 EX(CMD_messages,	"messages",	ex_messages,
 			TRLBAR|CMDWIN,
 			ADDR_LINES),
+EX(CMD_memcompact,	"memcompact",	ex_memcompact,
+			TRLBAR|CMDWIN,
+			ADDR_LINES),
 EX(CMD_mkexrc,		"mkexrc",	ex_mkrc,
 			BANG|FILE1|TRLBAR|CMDWIN,
 			ADDR_LINES),
@@ -1128,6 +1131,9 @@ EX(CMD_redrawstatus,	"redrawstatus",	ex_redrawstatus,
 EX(CMD_registers,	"registers",	ex_display,
 			EXTRA|NOTRLCOM|TRLBAR|CMDWIN,
 			ADDR_LINES),
+EX(CMD_regexpcache,	"regexpcache",	ex_regexpcache,
+			WORD1|TRLBAR|CMDWIN,
+			ADDR_LINES),
 EX(CMD_resize,		"resize",	ex_resize,
 			RANGE|NOTADR|TRLBAR|WORD1,
 			ADDR_LINES),
@@ -1714,6 +1720,9 @@ struct exarg
     int		regname;	/* register name (NUL if none) */
     int		force_bin;	/* 0, FORCE_BIN or FORCE_NOBIN */
     int		read_edit;	/* ++edit argument */
+#ifdef FEAT_MMAP
+    int		read_mmap;	/* ++mmap argument */
+#endif
     int		force_ff;	/* ++ff= argument (index in cmd[]) */
 #ifdef FEAT_MBYTE
     int		force_enc;	/* ++enc= argument (index in cmd[]) */
@@ -63,7 +63,24 @@ static char_u *get_user_command_name __ARGS((int idx));
 
 static int compute_buffer_local_count __ARGS((int addr_type, int lnum, int local));
 #ifdef FEAT_EVAL
-static char_u	*do_one_cmd __ARGS((char_u **, int, struct condstack *, char_u *(*fgetline)(int, void *, int), void *cookie));
+/*
+ * Struct for storing a line inside a while/for loop.
+ * The stored line never changes, thus the result of parsing it the first time
+ * it is executed is kept to avoid looking up the command again.  Only the part
+ * that depends on nothing but the text is kept, the range is evaluated again.
+ */
+typedef struct
+{
+    char_u	*line;		/* command line */
+    linenr_T	lnum;		/* sourcing_lnum of the line */
+    cmdidx_T	cmdidx;		/* command index, CMD_SIZE when not parsed */
+    int		flags;		/* ea.flags set by find_command() */
+    int		range_off;	/* offset of the range in "line" */
+    int		cmd_off;	/* offset of the command name in "line" */
+    int		arg_off;	/* offset of what follows the command name */
+} wcmd_T;
+
+static char_u	*do_one_cmd __ARGS((char_u **, int, struct condstack *, wcmd_T *wcmd, char_u *(*fgetline)(int, void *, int), void *cookie));
 #else
 static char_u	*do_one_cmd __ARGS((char_u **, int, char_u *(*fgetline)(int, void *, int), void *cookie));
 static int	if_level = 0;		/* depth in :if */
@@ -252,6 +269,9 @@ static void	ex_popup __ARGS((exarg_T *eap));
 #if !defined(FEAT_SYN_HL) || !defined(FEAT_PROFILE)
 # define ex_syntime		ex_ni
 #endif
+#ifndef FEAT_RE_CACHE
+# define ex_regexpcache		ex_ni
+#endif
 #ifndef FEAT_SPELL
 # define ex_spell		ex_ni
 # define ex_mkspell		ex_ni
@@ -540,13 +560,6 @@ static char_u dollar_command[2] = {'$', 0};
 
 
 #ifdef FEAT_EVAL
-/* Struct for storing a line inside a while/for loop */
-typedef struct
-{
-    char_u	*line;		/* command line */
-    linenr_T	lnum;		/* sourcing_lnum of the line */
-} wcmd_T;
-
 /*
  * Structure used to store info for line position in a while or for loop.
  * This is required, because do_one_cmd() may invoke ex_function(), which
@@ -1133,6 +1146,9 @@ do_cmdline(cmdline, fgetline, cookie, flags)
 	next_cmdline = do_one_cmd(&cmdline_copy, flags & DOCMD_VERBOSE,
 #ifdef FEAT_EVAL
 				&cstack,
+				cstack.cs_looplevel > 0
+					&& current_line < lines_ga.ga_len
+				     ? (wcmd_T *)lines_ga.ga_data + current_line : NULL,
 #endif
 				cmd_getline, cmd_cookie);
 	--recursive;
@@ -1602,6 +1618,7 @@ store_loop_line(gap, line)
 	return FAIL;
     ((wcmd_T *)(gap->ga_data))[gap->ga_len].line = vim_strsave(line);
     ((wcmd_T *)(gap->ga_data))[gap->ga_len].lnum = sourcing_lnum;
+    ((wcmd_T *)(gap->ga_data))[gap->ga_len].cmdidx = CMD_SIZE;
     ++gap->ga_len;
     return OK;
 }
@@ -1804,13 +1821,15 @@ current_tab_nr(tab)
     static char_u *
 do_one_cmd(cmdlinep, sourcing,
 #ifdef FEAT_EVAL
-			    cstack,
+			    cstack, wcmd,
 #endif
 				    fgetline, cookie)
     char_u		**cmdlinep;
     int			sourcing;
 #ifdef FEAT_EVAL
     struct condstack	*cstack;
+    wcmd_T		*wcmd;	/* stored loop line that "*cmdlinep" is a copy
+				   of, or NULL */
 #endif
     char_u		*(*fgetline) __ARGS((int, void *, int));
     void		*cookie;		/* argument for fgetline() */
@@ -1830,6 +1849,9 @@ do_one_cmd(cmdlinep, sourcing,
     cmdmod_T		save_cmdmod;
     int			ni;			/* set when Not Implemented */
     char_u		*cmd;
+#ifdef FEAT_EVAL
+    int			star_range = FALSE;
+#endif
 
     vim_memset(&ea, 0, sizeof(ea));
     ea.line1 = 1;
@@ -1866,6 +1888,12 @@ do_one_cmd(cmdlinep, sourcing,
      * Repeat until no more command modifiers are found.
      */
     ea.cmd = *cmdlinep;
+#ifdef FEAT_EVAL
+    /* A loop line that was parsed before has no command modifiers. */
+    if (wcmd != NULL && wcmd->cmdidx != CMD_SIZE)
+	ea.cmd += wcmd->range_off;
+    else
+#endif
     for (;;)
     {
 /*
@@ -2108,10 +2136,47 @@ do_one_cmd(cmdlinep, sourcing,
  * We need the command to know what kind of range it uses.
  */
     cmd = ea.cmd;
-    ea.cmd = skip_range(ea.cmd, NULL);
-    if (*ea.cmd == '*' && vim_strchr(p_cpo, CPO_STAR) == NULL)
-	ea.cmd = skipwhite(ea.cmd + 1);
-    p = find_command(&ea, NULL);
+#ifdef FEAT_EVAL
+    if (wcmd != NULL && wcmd->cmdidx != CMD_SIZE)
+    {
+	/* Use the command found when the loop line was executed before. */
+	ea.cmd = *cmdlinep + wcmd->cmd_off;
+	ea.cmdidx = wcmd->cmdidx;
+	ea.flags = wcmd->flags;
+	p = *cmdlinep + wcmd->arg_off;
+    }
+    else
+#endif
+    {
+	ea.cmd = skip_range(ea.cmd, NULL);
+#ifdef FEAT_EVAL
+	star_range = (*ea.cmd == '*');
+#endif
+	if (*ea.cmd == '*' && vim_strchr(p_cpo, CPO_STAR) == NULL)
+	    ea.cmd = skipwhite(ea.cmd + 1);
+	p = find_command(&ea, NULL);
+#ifdef FEAT_EVAL
+	/* Remember the command for a loop line, unless the result depends on
+	 * more than the text: command modifiers, a "*" range that depends on
+	 * 'cpoptions' or a user command. */
+	if (wcmd != NULL && p != NULL && !star_range && ea.cmdidx != CMD_SIZE
+		&& !IS_USER_CMDIDX(ea.cmdidx) && ea.cmdidx != CMD_Print)
+	{
+	    char_u	*s = *cmdlinep;
+
+	    while (*s == ' ' || *s == '\t' || *s == ':')
+		++s;
+	    if (s == cmd)
+	    {
+		wcmd->flags = ea.flags;
+		wcmd->range_off = (int)(cmd - *cmdlinep);
+		wcmd->cmd_off = (int)(ea.cmd - *cmdlinep);
+		wcmd->arg_off = (int)(p - *cmdlinep);
+		wcmd->cmdidx = ea.cmdidx;
+	    }
+	}
+#endif
+    }
 
 /*
  * 4. parse a range specifier of the form: addr [,addr] [;addr] ..
@@ -2186,6 +2251,9 @@ do_one_cmd(cmdlinep, sourcing,
 		switch (ea.addr_type)
 		{
 		    case ADDR_LINES:
+#ifdef FEAT_MMAP
+			ml_mmap_finish(curbuf);
+#endif
 			ea.line1 = 1;
 			ea.line2 = curbuf->b_ml.ml_line_count;
 			break;
@@ -2664,6 +2732,9 @@ do_one_cmd(cmdlinep, sourcing,
 	switch (ea.addr_type)
 	{
 	    case ADDR_LINES:
+#ifdef FEAT_MMAP
+		ml_mmap_finish(curbuf);
+#endif
 		ea.line2 = curbuf->b_ml.ml_line_count;
 		break;
 	    case ADDR_LOADED_BUFFERS:
@@ -4369,6 +4440,9 @@ get_address(ptr, addr_type, skip, to_other_file)
 		switch (addr_type)
 		{
 		    case ADDR_LINES:
+#ifdef FEAT_MMAP
+			ml_mmap_finish(curbuf);
+#endif
 			lnum = curbuf->b_ml.ml_line_count;
 			break;
 		    case ADDR_WINDOWS:
@@ -4587,6 +4661,13 @@ get_address(ptr, addr_type, skip, to_other_file)
 	}
     } while (*cmd == '/' || *cmd == '?');
 
+#ifdef FEAT_MMAP
+    /* A line past the lines found so far in a file read with "++mmap". */
+    if (addr_type == ADDR_LINES && lnum != MAXLNUM
+					 && lnum > curbuf->b_ml.ml_line_count)
+	ml_mmap_finish(curbuf);
+#endif
+
 error:
     *ptr = cmd;
     return lnum;
@@ -5294,6 +5375,16 @@ getargopt(eap)
 	return OK;
     }
 
+#ifdef FEAT_MMAP
+    /* ":edit ++mmap file" */
+    if (STRNCMP(arg, "mmap", 4) == 0)
+    {
+	eap->read_mmap = TRUE;
+	eap->arg = skipwhite(arg + 4);
+	return OK;
+    }
+#endif
+
     if (STRNCMP(arg, "ff", 2) == 0)
     {
 	arg += 2;
@@ -12104,7 +12195,7 @@ ex_folddo(eap)
 	    ml_setmarked(lnum);
 
     /* Execute the command on the marked lines. */
-    global_exe(eap->arg);
+    global_exe(eap->arg, (linenr_T)0);
     ml_clearmarked();	   /* clear rest of the marks */
 #ifdef FEAT_CLIPBOARD
     end_global_changes();
@@ -483,6 +483,41 @@
 # define FEAT_BYTEOFF
 #endif
 
+/*
+ * +mmap		":edit ++mmap": build the data blocks of a huge file
+ *			from the mapped file when they are needed.
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_MMAP) \
+	&& defined(HAVE_SYS_MMAN_H)
+# define FEAT_MMAP
+#endif
+
+/*
+ * +swapthread		'swapthread': write the swap file in a separate
+ *			thread.
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_PTHREAD_H) \
+	&& defined(HAVE_LIBPTHREAD)
+# define FEAT_SWAP_THREAD
+#endif
+
+/*
+ * +sortthread		":sort" uses a thread per processor to sort many
+ *			lines.
+ */
+#if defined(UNIX) && defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+# define FEAT_SORT_THREAD
+#endif
+
+/*
+ * +vimgrepthread	":vimgrep" searches files that are not loaded in a
+ *			thread per processor.
+ */
+#if defined(UNIX) && defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD) \
+	&& defined(FEAT_QUICKFIX)
+# define FEAT_VIMGREP_THREAD
+#endif
+
 /*
  * +wildignore		'wildignore' and 'backupskip' options
  *			Needed for Unix to make "crontab -e" work.
@@ -518,6 +553,13 @@
 # define FEAT_SYN_HL
 #endif
 
+/*
+ * +regexp_cache	Share compiled patterns, ":regexpcache".
+ */
+#if defined(FEAT_NORMAL) && (defined(FEAT_EVAL) || defined(FEAT_SYN_HL))
+# define FEAT_RE_CACHE
+#endif
+
 /*
  * +conceal		'conceal' option.  Needs syntax highlighting
  *			as this is how the concealed text is defined.
@@ -43,6 +43,9 @@ static void check_marks_read __ARGS((void));
 #ifdef FEAT_CRYPT
 static char_u *check_for_cryptkey __ARGS((char_u *cryptkey, char_u *ptr, long *sizep, off_t *filesizep, int newfile, char_u *fname, int *did_ask));
 #endif
+#ifdef FEAT_MMAP
+static int readfile_mmap __ARGS((int fd, int *fileformatp, int try_dos, int try_unix, int try_mac, off_t *filesizep, int *noeolp));
+#endif
 #ifdef UNIX
 static void set_file_time __ARGS((char_u *fname, time_t atime, time_t mtime));
 #endif
@@ -50,10 +53,10 @@ static int set_rw_fname __ARGS((char_u *fname, char_u *sfname));
 static int msg_add_fileformat __ARGS((int eol_type));
 static void msg_add_eol __ARGS((void));
 static int check_mtime __ARGS((buf_T *buf, struct stat *s));
-static int time_differs __ARGS((long t1, long t2));
 #ifdef FEAT_AUTOCMD
 static int apply_autocmds_exarg __ARGS((event_T event, char_u *fname, char_u *fname_io, int force, buf_T *buf, exarg_T *eap));
 static int au_find_group __ARGS((char_u *name));
+static int has_autocmd_events __ARGS((event_T *events, int count, char_u *sfname, buf_T *buf, int skip_group));
 
 # define AUGROUP_DEFAULT    -1	    /* default autocmd group */
 # define AUGROUP_ERROR	    -2	    /* erroneous autocmd group */
@@ -184,7 +187,8 @@ filemess(buf, name, s, attr)
  *
  * 1. We allocate blocks with lalloc, as big as possible.
  * 2. Each block is filled with characters from the file with a single read().
- * 3. The lines are inserted in the buffer with ml_append().
+ * 3. The lines are inserted in the buffer with ml_append_lines(), for each
+ *    block at once.
  *
  * (caller must check that fname != NULL, unless READ_STDIN is used)
  *
@@ -240,7 +244,6 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		did_ask_for_key = FALSE;
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
-    context_sha256_T sha_ctx;
     int		read_undo_file = FALSE;
 #endif
     int		split = 0;		/* number of split lines */
@@ -249,6 +252,8 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		error = FALSE;		/* errors encountered */
     int		ff_error = EOL_UNKNOWN; /* file format with errors */
     long	linerest = 0;		/* remaining chars in line */
+    garray_T	lines_ga;		/* lines found in the read buffer */
+    garray_T	lens_ga;		/* their lengths, including NUL */
 #ifdef UNIX
     int		perm = 0;
     int		swap_mode = -1;		/* protection bits for swap file */
@@ -268,6 +273,10 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		try_dos = (vim_strchr(p_ffs, 'd') != NULL);
     int		try_unix = (vim_strchr(p_ffs, 'x') != NULL);
     int		file_rewind = FALSE;
+#ifdef FEAT_MMAP
+    int		read_mmap;		/* ":edit ++mmap" */
+    int		mmap_noeol;
+#endif
 #ifdef FEAT_MBYTE
     int		can_retry;
     linenr_T	conv_error = 0;		/* line nr with conversion error */
@@ -306,6 +315,8 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
 #endif
 
     curbuf->b_no_eol_lnum = 0;	/* in case it was set by the previous read */
+    ga_init2(&lines_ga, (int)sizeof(char_u *), 1000);
+    ga_init2(&lens_ga, (int)sizeof(colnr_T), 1000);
 
     /*
      * If there is no file name yet, use the one for the read file.
@@ -789,6 +800,22 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     /* Autocommands may add lines to the file, need to check if it is empty */
     wasempty = (curbuf->b_ml.ml_flags & ML_EMPTY);
 
+#ifdef FEAT_MMAP
+    /* "++mmap" only works when the whole file is read into an empty buffer,
+     * without conversion. */
+    read_mmap = (eap != NULL && eap->read_mmap && newfile && wasempty
+	    && from == 0 && lines_to_skip == 0 && lines_to_read == MAXLNUM
+	    && !filtering && !read_stdin && !read_buffer
+	    && !(flags & READ_DUMMY) && !recoverymode
+# ifdef FEAT_MBYTE
+	    && eap->force_enc == 0
+# endif
+# ifdef FEAT_CRYPT
+	    && *curbuf->b_p_key == NUL
+# endif
+	    );
+#endif
+
     if (!recoverymode && !filtering && !(flags & READ_DUMMY))
     {
 	/*
@@ -843,9 +870,13 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
 	fenc_alloced = TRUE;
 	keep_dest_enc = TRUE;
     }
-    else if (curbuf->b_p_bin)
+    else if (curbuf->b_p_bin
+# ifdef FEAT_MMAP
+	    || read_mmap
+# endif
+	    )
     {
-	fenc = (char_u *)"";		/* binary: don't convert */
+	fenc = (char_u *)"";		/* binary or ++mmap: don't convert */
 	fenc_alloced = FALSE;
     }
     else if (curbuf->b_help)
@@ -1152,8 +1183,6 @@ retry:
 				  && !filtering
 				  && !read_stdin
 				  && !read_buffer);
-	if (read_undo_file)
-	    sha256_start(&sha_ctx);
 #endif
 #ifdef FEAT_CRYPT
 	if (curbuf->b_cryptstate != NULL)
@@ -1166,6 +1195,35 @@ retry:
 #endif
     }
 
+#ifdef FEAT_MMAP
+    if (read_mmap)
+    {
+	/* Only try this once, when it doesn't work the file is read the
+	 * normal way. */
+	read_mmap = FALSE;
+	if (readfile_mmap(fd, &fileformat, try_dos, try_unix, try_mac,
+					      &filesize, &mmap_noeol) == OK)
+	{
+	    if (set_options)
+	    {
+		set_fileformat(fileformat, OPT_LOCAL);
+		if (mmap_noeol)
+		    curbuf->b_p_eol = FALSE;
+	    }
+	    lnum = curbuf->b_ml.ml_line_count;
+	    if (mmap_noeol)
+		read_no_eol_lnum = lnum;
+	    /* The lines replaced the empty line. */
+	    wasempty = FALSE;
+	    linecnt = 0;
+# ifdef FEAT_PERSISTENT_UNDO
+	    read_undo_file = FALSE;
+# endif
+	    goto failed;
+	}
+    }
+#endif
+
     while (!error && !got_int)
     {
 	/*
@@ -2181,15 +2239,15 @@ rewind_retry:
 		    {
 			*ptr = NUL;	    /* end of line */
 			len = (colnr_T) (ptr - line_start + 1);
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			if (ga_grow(&lines_ga, 1) == FAIL
+					       || ga_grow(&lens_ga, 1) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
-#endif
+			((char_u **)lines_ga.ga_data)[lines_ga.ga_len++] =
+								  line_start;
+			((colnr_T *)lens_ga.ga_data)[lens_ga.ga_len++] = len;
 			++lnum;
 			if (--read_count == 0)
 			{
@@ -2244,20 +2302,24 @@ rewind_retry:
 					set_fileformat(EOL_UNIX, OPT_LOCAL);
 				    file_rewind = TRUE;
 				    keep_fileformat = TRUE;
+				    /* lines not appended yet are dropped */
+				    lnum -= lines_ga.ga_len;
+				    lines_ga.ga_len = 0;
+				    lens_ga.ga_len = 0;
 				    goto retry;
 				}
 				ff_error = EOL_DOS;
 			    }
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			if (ga_grow(&lines_ga, 1) == FAIL
+					       || ga_grow(&lens_ga, 1) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
-#endif
+			((char_u **)lines_ga.ga_data)[lines_ga.ga_len++] =
+								  line_start;
+			((colnr_T *)lens_ga.ga_data)[lens_ga.ga_len++] = len;
 			++lnum;
 			if (--read_count == 0)
 			{
@@ -2272,6 +2334,20 @@ rewind_retry:
 		}
 	    }
 	}
+
+	/* Append the lines found before the read buffer is used again. */
+	if (lines_ga.ga_len > 0)
+	{
+	    if (ml_append_lines(lnum - lines_ga.ga_len,
+			(char_u **)lines_ga.ga_data, (colnr_T *)lens_ga.ga_data,
+				     (long)lines_ga.ga_len, newfile) == FAIL)
+	    {
+		error = TRUE;
+		lnum -= lines_ga.ga_len;
+	    }
+	    lines_ga.ga_len = 0;
+	    lens_ga.ga_len = 0;
+	}
 	linerest = (long)(ptr - line_start);
 	ui_breakcheck();
     }
@@ -2303,10 +2379,6 @@ failed:
 	    error = TRUE;
 	else
 	{
-#ifdef FEAT_PERSISTENT_UNDO
-	    if (read_undo_file)
-		sha256_update(&sha_ctx, line_start, len);
-#endif
 	    read_no_eol_lnum = ++lnum;
 	}
     }
@@ -2354,6 +2426,8 @@ failed:
     }
 #endif
     vim_free(buffer);
+    ga_clear(&lines_ga);
+    ga_clear(&lens_ga);
 
 #ifdef HAVE_DUP
     if (read_stdin)
@@ -2495,6 +2569,14 @@ failed:
 		STRCAT(IObuff, _("[long lines split]"));
 		c = TRUE;
 	    }
+#ifdef FEAT_MMAP
+	    if (curbuf->b_ml.ml_mmap != NULL)
+	    {
+		/* The line count is for the lines found so far. */
+		STRCAT(IObuff, _("[mapped]"));
+		c = TRUE;
+	    }
+#endif
 #ifdef FEAT_MBYTE
 	    if (notconverted)
 	    {
@@ -2643,7 +2725,7 @@ failed:
     {
 	char_u	hash[UNDO_HASH_SIZE];
 
-	sha256_finish(&sha_ctx, hash);
+	ml_hash_root(curbuf, hash);
 	u_read_undo(NULL, hash, fname);
     }
 #endif
@@ -2760,6 +2842,9 @@ prep_exarg(eap, buf)
 
     eap->force_bin = buf->b_p_bin ? FORCE_BIN : FORCE_NOBIN;
     eap->read_edit = FALSE;
+#ifdef FEAT_MMAP
+    eap->read_mmap = FALSE;
+#endif
     eap->forceit = FALSE;
     return OK;
 }
@@ -2928,6 +3013,195 @@ check_marks_read()
 }
 #endif
 
+#ifdef FEAT_MMAP
+/*
+ * Read file "fd" for ":edit ++mmap" into the current buffer: the file is only
+ * scanned for line breaks, the data blocks are built from the mapped file
+ * when they are needed.
+ * "*fileformatp" is the format to use, or EOL_UNKNOWN to detect it from the
+ * first line.  Mac format is not supported.
+ * Returns FAIL when the file must be read the normal way, the file position
+ * is at the start then.
+ */
+    static int
+readfile_mmap(fd, fileformatp, try_dos, try_unix, try_mac, filesizep, noeolp)
+    int		fd;
+    int		*fileformatp;
+    int		try_dos;
+    int		try_unix;
+    int		try_mac;
+    off_t	*filesizep;
+    int		*noeolp;
+{
+    char_u	head[1024];
+    long	len;
+    char_u	*nl;
+    char_u	*p;
+    int		fileformat = *fileformatp;
+    struct stat	st;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	return FAIL;
+
+    len = read_eintr(fd, head, sizeof(head));
+    if (lseek(fd, (off_t)0L, SEEK_SET) != 0 || len <= 0)
+	return FAIL;
+# ifdef FEAT_CRYPT
+    /* An encrypted file must be decrypted while reading. */
+    if (crypt_method_nr_from_magic((char *)head, (int)len) >= 0)
+	return FAIL;
+# endif
+
+    if (fileformat == EOL_UNKNOWN)
+    {
+	/* Like readfile(): a CR before the first NL means Dos format.  When
+	 * there is a CR without NL it could be Mac format, read it the
+	 * normal way then. */
+	nl = (char_u *)memchr(head, NL, (size_t)len);
+	if (try_mac)
+	    for (p = head; p < (nl == NULL ? head + len : nl - 1); ++p)
+		if (*p == CAR)
+		    return FAIL;
+	if (nl != NULL)
+	{
+	    if (try_dos && nl > head && nl[-1] == CAR)
+		fileformat = EOL_DOS;
+	    else if (try_unix)
+		fileformat = EOL_UNIX;
+	}
+	if (fileformat == EOL_UNKNOWN)
+	    fileformat = default_fileformat();
+    }
+    if (fileformat == EOL_MAC)
+	return FAIL;
+
+    if (ml_mmap_open(curbuf, fd, st.st_size, fileformat == EOL_DOS, noeolp)
+									== FAIL)
+	return FAIL;
+    *fileformatp = fileformat;
+    *filesizep = st.st_size;
+    return OK;
+}
+#endif
+
+/*
+ * Return how readfile_unchanged() decides that the text of a file is read
+ * into a buffer unchanged, depending on 'fileformats', 'fileencodings' and
+ * 'encoding':
+ * RU_NEVER: the text is always changed
+ * RU_ASCII: ASCII text is unchanged
+ * RU_UTF8:  valid UTF-8 is unchanged
+ * RU_ANY:   any text is unchanged
+ * Must be called in the main thread.
+ */
+    int
+readfile_unchanged_how()
+{
+#ifdef FEAT_MBYTE
+    char_u	*fenc;
+    char_u	*fenc_next;
+    int		how;
+#endif
+
+    /* Without a CR the lines are split at a NL when Unix or Dos format is
+     * allowed. */
+    if (vim_strchr(p_ffs, 'd') == NULL && vim_strchr(p_ffs, 'x') == NULL)
+	return RU_NEVER;
+
+#ifdef FEAT_MBYTE
+    /* Only the first encoding in 'fileencodings' is checked, skipping
+     * "ucs-bom".  Don't bother about the global 'fileencoding' being used
+     * when it is empty. */
+    if (*p_fencs == NUL)
+	return RU_NEVER;
+    fenc_next = p_fencs;
+    fenc = next_fenc(&fenc_next);
+    while (fenc_next != NULL && STRCMP(fenc, "ucs-bom") == 0)
+    {
+	vim_free(fenc);
+	fenc = next_fenc(&fenc_next);
+    }
+
+    if (!need_conversion(fenc))
+	/* Reading UTF-8 tries the next encoding when a byte is illegal. */
+	how = enc_utf8 ? RU_UTF8 : RU_ANY;
+    else if (enc_unicode == 0
+		    && (enc_utf8 || (enc_canon_props(p_enc) & ENC_8BIT))
+		    && (get_fio_flags(fenc) == FIO_UTF8
+				     || (enc_canon_props(fenc) & ENC_8BIT)))
+	/* Converting ASCII text between UTF-8 and an 8-bit encoding does not
+	 * change it. */
+	how = RU_ASCII;
+    else
+	how = RU_NEVER;
+
+    if (fenc_next != NULL)
+	vim_free(fenc);
+    return how;
+#else
+    return RU_ANY;
+#endif
+}
+
+/*
+ * Return TRUE if "text[len]", the contents of a file, would be split into
+ * lines at each NL and not be changed otherwise when it is read into a new
+ * buffer: no conversion, CR, byte order mark or encryption.  Used to search
+ * a file without loading it into a buffer.
+ * "how" is what readfile_unchanged_how() returned.  This does not allocate
+ * memory or give messages, it may be called in any thread.
+ */
+    int
+readfile_unchanged(text, len, how)
+    char_u	*text;
+    long	len;
+    int		how;
+{
+    char_u	*p;
+    int		ascii = TRUE;
+#ifdef FEAT_MBYTE
+    int		l;
+#endif
+
+    if (how == RU_NEVER)
+	return FALSE;
+#ifdef FEAT_CRYPT
+    if (crypt_has_magic((char *)text, (int)len))
+	return FALSE;
+#endif
+    for (p = text; p < text + len; ++p)
+    {
+	if (*p == CAR)
+	    return FALSE;
+	if (*p >= 0x80)
+	    ascii = FALSE;
+    }
+    if (ascii)
+	return TRUE;
+    if (how == RU_ASCII)
+	return FALSE;
+
+#ifdef FEAT_MBYTE
+    /* A byte order mark is removed when 'fileencodings' has "ucs-bom". */
+    if (text[0] == 0xef || text[0] == 0xfe || text[0] == 0xff)
+	return FALSE;
+
+    if (how == RU_UTF8)
+	for (p = text; p < text + len; p += l)
+	{
+	    if (*p < 0x80)
+		l = 1;
+	    else
+	    {
+		l = utf_ptr2len_len(p, (int)(text + len - p));
+		if (l == 1 || l > text + len - p)
+		    return FALSE;
+	    }
+	}
+#endif
+    return TRUE;
+}
+
 #if defined(FEAT_CRYPT) || defined(PROTO)
 /*
  * Check for magic number used for encryption.  Applies to the current buffer.
@@ -3112,6 +3386,8 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
     char_u	    c;
     int		    len;
     linenr_T	    lnum;
+    lineiter_T	    iter;
+    colnr_T	    linelen;
     long	    nchars;
     char_u	    *errmsg = NULL;
     int		    errmsg_allocated = FALSE;
@@ -3158,7 +3434,6 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
     int		    write_undo_file = FALSE;
-    context_sha256_T sha_ctx;
 #endif
     unsigned int    bkc = get_bkc_value(buf);
 
@@ -3199,6 +3474,15 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 #ifdef FEAT_CRYPT
     write_info.bw_buffer = buf;
 #endif
+#ifdef FEAT_MMAP
+    /* Writing all lines of a file read with "++mmap" includes the lines that
+     * were not added yet. */
+    if (whole && buf->b_ml.ml_mmap != NULL)
+    {
+	ml_mmap_finish(buf);
+	end = buf->b_ml.ml_line_count;
+    }
+#endif
 
     /* After writing a file changedtick changes but we don't want to display
      * the line. */
@@ -4187,6 +4471,16 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 	}
 #endif
 
+#ifdef FEAT_MMAP
+    /* The text of a file read with "++mmap" is still in that file, get all
+     * of it before the file is overwritten. */
+    if (overwriting && !append && ml_mmap_detach(buf) == FAIL)
+    {
+	errmsg = (char_u *)_("E890: Cannot get all lines of the mapped file");
+	goto restore_backup;
+    }
+#endif
+
 #ifdef VMS
     vms_remove_version(fname); /* remove version */
 #endif
@@ -4498,9 +4792,6 @@ restore_backup:
 #ifdef FEAT_PERSISTENT_UNDO
     write_undo_file = (buf->b_p_udf && overwriting && !append
 					      && !filtering && reset_changed);
-    if (write_undo_file)
-	/* Prepare for computing the hash value of the text. */
-	sha256_start(&sha_ctx);
 #endif
 
     write_info.bw_len = bufsize;
@@ -4510,17 +4801,14 @@ restore_backup:
     fileformat = get_fileformat_force(buf, eap);
     s = buffer;
     len = 0;
+    ml_iter_init(&iter, buf, start);
     for (lnum = start; lnum <= end; ++lnum)
     {
 	/*
 	 * The next while loop is done once for each character written.
 	 * Keep it fast!
 	 */
-	ptr = ml_get_buf(buf, lnum, FALSE) - 1;
-#ifdef FEAT_PERSISTENT_UNDO
-	if (write_undo_file)
-	    sha256_update(&sha_ctx, ptr + 1, (UINT32_T)(STRLEN(ptr + 1) + 1));
-#endif
+	ptr = ml_iter_next(&iter, &linelen) - 1;
 	while ((c = *++ptr) != NUL)
 	{
 	    if (c == NL)
@@ -5064,7 +5352,8 @@ nofail:
     {
 	char_u	    hash[UNDO_HASH_SIZE];
 
-	sha256_finish(&sha_ctx, hash);
+	/* Only the lines changed since the last time are hashed. */
+	ml_hash_root(buf, hash);
 	u_write_undo(NULL, FALSE, buf, hash);
     }
 #endif
@@ -5298,7 +5587,10 @@ check_mtime(buf, st)
     return OK;
 }
 
-    static int
+/*
+ * Return TRUE if file times "t1" and "t2" differ.
+ */
+    int
 time_differs(t1, t2)
     long	t1, t2;
 {
@@ -9770,11 +10062,52 @@ has_autocmd(event, sfname, buf)
     event_T	event;
     char_u	*sfname;
     buf_T       *buf;
+{
+    return has_autocmd_events(&event, 1, sfname, buf, AUGROUP_ERROR);
+}
+
+/*
+ * Return TRUE if there is an autocommand that may be triggered when "sfname"
+ * is read into a new buffer, which is then wiped out again.  Autocommands in
+ * the group "skip_group" are ignored when it is not NULL.
+ */
+    int
+has_readfile_autocmd(sfname, skip_group)
+    char_u	*sfname;
+    char_u	*skip_group;
+{
+    static event_T events[] = {EVENT_BUFREADCMD, EVENT_BUFREADPRE,
+		EVENT_BUFREADPOST, EVENT_SWAPEXISTS, EVENT_FILECHANGEDRO,
+		EVENT_BUFUNLOAD, EVENT_BUFDELETE, EVENT_BUFWIPEOUT};
+
+    return has_autocmd_events(events, (int)(sizeof(events) / sizeof(event_T)),
+		       sfname, NULL, skip_group == NULL ? AUGROUP_ERROR
+						 : au_find_group(skip_group));
+}
+
+/*
+ * Return TRUE if there is a matching autocommand for "fname" for one of the
+ * "count" events in "events", not counting the ones in group "skip_group".
+ */
+    static int
+has_autocmd_events(events, count, sfname, buf, skip_group)
+    event_T	*events;
+    int		count;
+    char_u	*sfname;
+    buf_T       *buf;
+    int		skip_group;
 {
     AutoPat	*ap;
     char_u	*fname;
     char_u	*tail = gettail(sfname);
     int		retval = FALSE;
+    int		i;
+
+    for (i = 0; i < count; ++i)
+	if (first_autopat[(int)events[i]] != NULL)
+	    break;
+    if (i == count)
+	return FALSE;
 
     fname = FullName_save(sfname, FALSE);
     if (fname == NULL)
@@ -9791,17 +10124,19 @@ has_autocmd(event, sfname, buf)
     forward_slash(fname);
 #endif
 
-    for (ap = first_autopat[(int)event]; ap != NULL; ap = ap->next)
-	if (ap->pat != NULL && ap->cmds != NULL
-	      && (ap->buflocal_nr == 0
-		? match_file_pat(NULL, &ap->reg_prog,
+    for ( ; i < count && !retval; ++i)
+	for (ap = first_autopat[(int)events[i]]; ap != NULL; ap = ap->next)
+	    if (ap->pat != NULL && ap->cmds != NULL
+		  && ap->group != skip_group
+		  && (ap->buflocal_nr == 0
+		    ? match_file_pat(NULL, &ap->reg_prog,
 					  fname, sfname, tail, ap->allow_dirs)
-		: buf != NULL && ap->buflocal_nr == buf->b_fnum
-	   ))
-	{
-	    retval = TRUE;
-	    break;
-	}
+		    : buf != NULL && ap->buflocal_nr == buf->b_fnum
+	       ))
+	    {
+		retval = TRUE;
+		break;
+	    }
 
     vim_free(fname);
 #ifdef BACKSLASH_IN_FILENAME
@@ -2897,6 +2897,15 @@ gui_wait_for_chars(wtime)
      */
     gui_mch_start_blink();
 
+#ifdef FEAT_SYN_HL
+    /* Compute the syntax state below the window, see 'syntaxahead'. */
+    while (syn_idle_pending() && gui_mch_wait_for_chars(0L) == FAIL)
+	syn_idle_update();
+#endif
+    /* Merge sparse memline blocks after lines were deleted. */
+    while (ml_compact_pending() && gui_mch_wait_for_chars(0L) == FAIL)
+	ml_compact_idle();
+
     retval = FAIL;
     /*
      * We may want to trigger the CursorHold event.  First wait for
@@ -284,6 +284,7 @@ hash_remove(ht, hi)
     hashitem_T	*hi;
 {
     --ht->ht_used;
+    ++ht->ht_changed;
     hi->hi_key = HI_KEY_REMOVED;
     hash_may_resize(ht, 0);
 }
@@ -1364,8 +1364,11 @@ getout_preserve_modified(exitval)
 getout(exitval)
     int		exitval;
 {
-#ifdef FEAT_AUTOCMD
+#if defined(FEAT_AUTOCMD) \
+	|| (defined(FEAT_SYN_HL) && defined(FEAT_PERSISTENT_UNDO))
     buf_T	*buf;
+#endif
+#ifdef FEAT_AUTOCMD
     win_T	*wp;
     tabpage_T	*tp, *next_tp;
 #endif
@@ -1437,6 +1440,12 @@ getout(exitval)
     }
 #endif
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_PERSISTENT_UNDO)
+    /* Remember the syntax state of the loaded buffers. */
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	syn_cache_write(buf);
+#endif
+
 #ifdef FEAT_VIMINFO
     if (*p_viminfo != NUL)
 	/* Write out the registers, history, marks etc, to the viminfo file */
@@ -1080,14 +1080,12 @@ mark_adjust(line1, line2, amount, amount_after)
 	one_adjust_nodel(&(curbuf->b_visual.vi_end.lnum));
 
 #ifdef FEAT_QUICKFIX
-	/* quickfix marks */
-	qf_mark_adjust(NULL, line1, line2, amount, amount_after);
-	/* location lists */
-	FOR_ALL_TAB_WINDOWS(tab, win)
-	    qf_mark_adjust(win, line1, line2, amount, amount_after);
+	/* quickfix marks and location lists, adjusted when used */
+	qf_mark_adjust(line1, line2, amount, amount_after);
 #endif
 
 #ifdef FEAT_SIGNS
+	/* signs, adjusted when used */
 	sign_mark_adjust(line1, line2, amount, amount_after);
 #endif
     }
@@ -1187,6 +1185,110 @@ mark_adjust(line1, line2, amount, amount_after)
 #endif
 }
 
+#if defined(FEAT_QUICKFIX) || defined(FEAT_SIGNS) || defined(PROTO)
+
+#define MARKADJ_MAX 1000    /* max number of changes kept in a list */
+
+/*
+ * Add a change of line numbers, with the arguments of mark_adjust(), to the
+ * list "gap" of changes that are applied later with markadj_lnum().  This is
+ * for marks that there can be many of, adjusting them for every changed line
+ * would be slow.
+ * When lines are inserted next to where the previous change inserted lines
+ * the change is merged with the previous one.  The same is done for deleted
+ * lines, unless "keep_deleted" is TRUE: a mark in deleted lines then keeps
+ * its line number, which gives a different result when merged.
+ * Returns FAIL when the list is full or out of memory, the changes in "gap"
+ * must then be applied before adding this one.
+ */
+    int
+markadj_add(gap, line1, line2, amount, amount_after, keep_deleted)
+    garray_T	*gap;
+    linenr_T	line1;
+    linenr_T	line2;
+    long	amount;
+    long	amount_after;
+    int		keep_deleted;
+{
+    markadj_T	*ma;
+
+    if (gap->ga_itemsize == 0)
+	ga_init2(gap, (int)sizeof(markadj_T), 20);
+
+    if (gap->ga_len > 0)
+    {
+	ma = (markadj_T *)gap->ga_data + gap->ga_len - 1;
+
+	/* Lines inserted at or just below the previously inserted lines. */
+	if (ma->ma_line2 == MAXLNUM && line2 == MAXLNUM
+		&& ma->ma_amount > 0 && amount > 0 && amount != MAXLNUM
+		&& ma->ma_amount_after == 0 && amount_after == 0
+		&& line1 >= ma->ma_line1
+		&& line1 <= ma->ma_line1 + ma->ma_amount)
+	{
+	    ma->ma_amount += amount;
+	    return OK;
+	}
+
+	/* Lines deleted that include or touch the line where the previously
+	 * deleted lines were. */
+	if (!keep_deleted && ma->ma_amount == MAXLNUM && amount == MAXLNUM
+		&& line2 >= line1 && amount_after == -(long)(line2 - line1 + 1)
+		&& ma->ma_amount_after == -(long)(ma->ma_line2 - ma->ma_line1 + 1)
+		&& line1 <= ma->ma_line1 && line2 + 1 >= ma->ma_line1)
+	{
+	    ma->ma_line2 = line2 - ma->ma_amount_after;
+	    ma->ma_line1 = line1;
+	    ma->ma_amount_after = -(long)(ma->ma_line2 - line1 + 1);
+	    return OK;
+	}
+    }
+
+    if (gap->ga_len >= MARKADJ_MAX || ga_grow(gap, 1) == FAIL)
+	return FAIL;
+    ma = (markadj_T *)gap->ga_data + gap->ga_len++;
+    ma->ma_line1 = line1;
+    ma->ma_line2 = line2;
+    ma->ma_amount = amount;
+    ma->ma_amount_after = amount_after;
+    return OK;
+}
+
+/*
+ * Apply the "count" changes in "ma" to line number "*lp".
+ * Returns TRUE when the line was deleted.  "*lp" is then where the line was,
+ * like one_adjust_nodel(), or unchanged when "keep_deleted" is TRUE.
+ */
+    int
+markadj_lnum(ma, count, lp, keep_deleted)
+    markadj_T	*ma;
+    int		count;
+    linenr_T	*lp;
+    int		keep_deleted;
+{
+    int		deleted = FALSE;
+    int		i;
+
+    for (i = 0; i < count; ++i, ++ma)
+    {
+	if (*lp >= ma->ma_line1 && *lp <= ma->ma_line2)
+	{
+	    if (ma->ma_amount == MAXLNUM)
+	    {
+		if (!keep_deleted)
+		    *lp = ma->ma_line1;
+		deleted = TRUE;
+	    }
+	    else
+		*lp += ma->ma_amount;
+	}
+	else if (ma->ma_amount_after && *lp > ma->ma_line2)
+	    *lp += ma->ma_amount_after;
+    }
+    return deleted;
+}
+#endif
+
 /* This code is used often, needs to be fast. */
 #define col_adjust(pp) \
     { \
@@ -67,7 +67,80 @@ extern int dos2;			/* this is in os_amiga.c */
 
 #define MEMFILE_PAGE_SIZE 4096		/* default page size */
 
+/*
+ * A block that is not dirty and still has a negative number was built from a
+ * file read with "++mmap".  It can be dropped without writing it, memline
+ * builds it again when it is needed.
+ */
+#define MF_CAN_DROP(hp)	((hp)->bh_bnum < 0 && !((hp)->bh_flags & BH_DIRTY))
+
 static long_u	total_mem_used = 0;	/* total memory used for memfiles */
+static long_u	mf_stamp = 0;		/* incremented for each block inserted
+					   in a used list */
+
+/*
+ * At most this part (in 1/8) of the pages in the used list is hot.
+ */
+#define MF_HOT_EIGHTHS	5
+
+/*
+ * A block that is used again within this many seconds after it was read or
+ * created does not become hot: it's most likely the same command using it
+ * again, e.g. when reading a file and then going over all its lines.
+ */
+#define MF_HOT_DELAY	1
+
+#ifdef FEAT_SWAP_THREAD
+# include <pthread.h>
+# ifdef HAVE_PWRITEV
+#  include <sys/uio.h>
+# endif
+
+/*
+ * With 'swapthread' set, the blocks that mf_sync() writes for ml_sync_all()
+ * while typing are not written directly: a copy of each block is added to a
+ * job, and the job is handed to a writer thread.  That thread writes the
+ * blocks with pwritev() and syncs the file, thus typing is not delayed.
+ * Everything else that uses the swap file first waits for the writer thread
+ * to finish with mf_bg_wait(), so the file is the same as when the blocks
+ * were written directly.  A clean block is not released from memory before
+ * it has been written.
+ */
+typedef struct
+{
+    off_t	bb_offset;	/* offset in the file */
+    int		bb_seq;		/* order in which the block was added */
+    unsigned	bb_size;	/* number of bytes */
+    char_u	*bb_data;	/* copy of the block */
+} mf_bgblock_T;
+
+typedef struct mf_bgjob_S mf_bgjob_T;
+struct mf_bgjob_S
+{
+    mf_bgjob_T	*bj_next;	/* next job in bg_queue or bg_done */
+    memfile_T	*bj_mfp;	/* memfile the blocks are for */
+    int		bj_fd;		/* file descriptor of the swap file */
+    int		bj_sync;	/* MF_BG_FSYNC, MF_BG_SYNC or zero */
+    garray_T	bj_blocks;	/* mf_bgblock_T items */
+};
+
+# define MF_BG_FSYNC	1	/* call fsync() after writing */
+# define MF_BG_SYNC	2	/* call sync() after writing */
+
+# define MF_BG_IOV	64	/* max number of blocks for one pwritev() */
+
+static pthread_mutex_t	bg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	bg_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	bg_done_cond = PTHREAD_COND_INITIALIZER;
+static int		bg_started = FALSE;	/* writer thread is running */
+static mf_bgjob_T	*bg_queue = NULL;	/* jobs to do, the first one is
+						   being done */
+static mf_bgjob_T	*bg_done = NULL;	/* jobs done, to be freed */
+static mf_bgjob_T	*bg_job = NULL;		/* job filled by mf_sync() */
+static volatile int	bg_stop = FALSE;	/* preserve_exit(): don't write
+						   any more */
+static volatile int	bg_writing = FALSE;	/* writer thread is writing */
+#endif
 
 static void mf_ins_hash __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_hash __ARGS((memfile_T *, bhdr_T *));
@@ -75,6 +148,8 @@ static bhdr_T *mf_find_hash __ARGS((memfile_T *, blocknr_T));
 static void mf_ins_used __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_used __ARGS((memfile_T *, bhdr_T *));
 static bhdr_T *mf_release __ARGS((memfile_T *, int));
+static bhdr_T *mf_find_release __ARGS((memfile_T *));
+static bhdr_T *mf_find_release_all __ARGS((memfile_T **mfpp));
 static bhdr_T *mf_alloc_bhdr __ARGS((memfile_T *, int));
 static void mf_free_bhdr __ARGS((bhdr_T *));
 static void mf_ins_free __ARGS((memfile_T *, bhdr_T *));
@@ -91,6 +166,15 @@ static mf_hashitem_T *mf_hash_find __ARGS((mf_hashtab_T *, blocknr_T));
 static void mf_hash_add_item __ARGS((mf_hashtab_T *, mf_hashitem_T *));
 static void mf_hash_rem_item __ARGS((mf_hashtab_T *, mf_hashitem_T *));
 static int mf_hash_grow __ARGS((mf_hashtab_T *));
+#ifdef FEAT_SWAP_THREAD
+static mf_bgjob_T *mf_bg_new_job __ARGS((memfile_T *mfp));
+static int mf_bg_add __ARGS((char_u *data, off_t offset, unsigned size));
+static void mf_bg_queue __ARGS((mf_bgjob_T *job));
+static void mf_bg_free_jobs __ARGS((mf_bgjob_T *job));
+static void *mf_bg_thread __ARGS((void *arg));
+static int mf_bg_write __ARGS((mf_bgjob_T *job));
+static int mf_bg_compare __ARGS((const void *s1, const void *s2));
+#endif
 
 /*
  * The functions for using a memfile:
@@ -156,14 +240,25 @@ mf_open(fname, flags)
     mfp->mf_free_first = NULL;		/* free list is empty */
     mfp->mf_used_first = NULL;		/* used list is empty */
     mfp->mf_used_last = NULL;
+    mfp->mf_used_mid = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
+    mfp->mf_hot_count = 0;
+    mfp->mf_hits = 0;
+    mfp->mf_misses = 0;
+    mfp->mf_evictions = 0;
     mf_hash_init(&mfp->mf_hash);
     mf_hash_init(&mfp->mf_trans);
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
+#ifdef FEAT_MMAP
+    mfp->mf_lazy = FALSE;
+#endif
 #ifdef FEAT_CRYPT
     mfp->mf_old_key = NULL;
 #endif
+#ifdef FEAT_SWAP_THREAD
+    mfp->mf_bg_failed = FALSE;
+#endif
 
 #ifdef USE_FSTATFS
     /*
@@ -250,6 +345,9 @@ mf_close(mfp, del_file)
 	return;
     if (mfp->mf_fd >= 0)
     {
+#ifdef FEAT_SWAP_THREAD
+	(void)mf_bg_wait(mfp);
+#endif
 	if (close(mfp->mf_fd) < 0)
 	    EMSG(_(e_swapclose));
     }
@@ -296,6 +394,9 @@ mf_close_file(buf, getlines)
 	/* TODO: should check if all blocks are really in core */
     }
 
+#ifdef FEAT_SWAP_THREAD
+    (void)mf_bg_wait(mfp);
+#endif
     if (close(mfp->mf_fd) < 0)			/* close the file */
 	EMSG(_(e_swapclose));
     mfp->mf_fd = -1;
@@ -405,6 +506,7 @@ mf_new(mfp, negative, page_count)
     hp->bh_flags = BH_LOCKED | BH_DIRTY;	/* new block is always dirty */
     mfp->mf_dirty = TRUE;
     hp->bh_page_count = page_count;
+    hp->bh_time = time(NULL);
     mf_ins_used(mfp, hp);
     mf_ins_hash(mfp, hp);
 
@@ -440,11 +542,22 @@ mf_get(mfp, nr, page_count)
     hp = mf_find_hash(mfp, nr);
     if (hp == NULL)	/* not in the hash list */
     {
-	if (nr < 0 || nr >= mfp->mf_infile_count)   /* can't be in the file */
+	if (nr >= mfp->mf_infile_count)		    /* can't be in the file */
 	    return NULL;
+	if (nr < 0)
+	{
+#ifdef FEAT_MMAP
+	    /* A data block of a file read with "++mmap" that was not built
+	     * yet or was released, memline builds it again. */
+	    if (!mfp->mf_lazy)
+#endif
+		return NULL;
+	}
 
 	/* could check here if the block is in the free list */
 
+	++mfp->mf_misses;
+
 	/*
 	 * Check if we need to flush an existing block.
 	 * If so, use that block.
@@ -457,6 +570,18 @@ mf_get(mfp, nr, page_count)
 	hp->bh_bnum = nr;
 	hp->bh_flags = 0;
 	hp->bh_page_count = page_count;
+	hp->bh_time = time(NULL);
+#ifdef FEAT_MMAP
+	if (nr < 0)
+	{
+	    if (ml_mmap_read(mfp, hp) == FAIL)
+	    {
+		mf_free_bhdr(hp);
+		return NULL;
+	    }
+	}
+	else
+#endif
 	if (mf_read(mfp, hp) == FAIL)	    /* cannot read the block! */
 	{
 	    mf_free_bhdr(hp);
@@ -467,10 +592,14 @@ mf_get(mfp, nr, page_count)
     {
 	mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
 	mf_rem_hash(mfp, hp);
+	++mfp->mf_hits;
+	if (!(hp->bh_flags & BH_HOT)
+			      && time(NULL) - hp->bh_time >= MF_HOT_DELAY)
+	    hp->bh_flags |= BH_HOT;	/* used again later: it's hot now */
     }
 
     hp->bh_flags |= BH_LOCKED;
-    mf_ins_used(mfp, hp);	/* put in front of used list */
+    mf_ins_used(mfp, hp);	/* put in front of (hot part of) used list */
     mf_ins_hash(mfp, hp);	/* put in front of hash list */
 
     return hp;
@@ -500,6 +629,11 @@ mf_put(mfp, hp, dirty, infile)
     flags &= ~BH_LOCKED;
     if (dirty)
     {
+	/* mf_neg_count counts the negative blocks that need a translation
+	 * when written, these are always dirty.  Only a block built from a
+	 * file read with "++mmap" is not dirty until it is changed. */
+	if (hp->bh_bnum < 0 && !(flags & BH_DIRTY))
+	    mfp->mf_neg_count++;
 	flags |= BH_DIRTY;
 	mfp->mf_dirty = TRUE;
     }
@@ -521,8 +655,9 @@ mf_free(mfp, hp)
     mf_rem_used(mfp, hp);	/* get *hp out of the used list */
     if (hp->bh_bnum < 0)
     {
+	if (hp->bh_flags & BH_DIRTY)
+	    mfp->mf_neg_count--;
 	vim_free(hp);		/* don't want negative numbers in free list */
-	mfp->mf_neg_count--;
     }
     else
 	mf_ins_free(mfp, hp);	/* put *hp in the free list */
@@ -550,6 +685,9 @@ fdtofh(int filedescriptor)
  *		system crash.
  *  MFS_ZERO	Only write block 0.
  *
+ * With 'swapthread' set and MFS_STOP given the blocks are written by the
+ * writer thread, a write error is reported later.
+ *
  * Return FAIL for failure, OK otherwise
  */
     int
@@ -574,6 +712,21 @@ mf_sync(mfp, flags)
      * previously. */
     got_int = FALSE;
 
+#ifdef FEAT_SWAP_THREAD
+    /* Only when called while typing the writer thread is used, otherwise
+     * the caller expects the blocks to be in the file. */
+    if (p_swt && (flags & MFS_STOP) && !really_exiting)
+	bg_job = mf_bg_new_job(mfp);
+    if (bg_job == NULL)
+	(void)mf_bg_wait(mfp);
+    if (bg_started && really_exiting)
+	/* Blocks that the writer thread did not write yet are clean, write
+	 * them all. */
+	for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	    if (hp->bh_bnum >= 0)
+		hp->bh_flags |= BH_DIRTY;
+#endif
+
     /*
      * sync from last to first (may reduce the probability of an inconsistent
      * file) If a write fails, it is very likely caused by a full filesystem.
@@ -614,6 +767,21 @@ mf_sync(mfp, flags)
     if (hp == NULL || status == FAIL)
 	mfp->mf_dirty = FALSE;
 
+#ifdef FEAT_SWAP_THREAD
+    if (bg_job != NULL)
+    {
+	/* The writer thread does the syncing as well. */
+	if ((flags & MFS_FLUSH) && *p_sws != NUL)
+	    bg_job->bj_sync = STRCMP(p_sws, "fsync") == 0
+						     ? MF_BG_FSYNC : MF_BG_SYNC;
+	if (bg_job->bj_blocks.ga_len > 0 || bg_job->bj_sync != 0)
+	    mf_bg_queue(bg_job);
+	else
+	    mf_bg_free_jobs(bg_job);
+	bg_job = NULL;
+    }
+    else
+#endif
     if ((flags & MFS_FLUSH) && *p_sws != NUL)
     {
 #if defined(UNIX)
@@ -767,22 +935,51 @@ mf_find_hash(mfp, nr)
 }
 
 /*
- * insert block *hp in front of used list of memfile *mfp
+ * insert block *hp in used list of memfile *mfp: in front when it is hot,
+ * otherwise in front of the blocks that are not hot.
  */
     static void
 mf_ins_used(mfp, hp)
     memfile_T	*mfp;
     bhdr_T	*hp;
 {
-    hp->bh_next = mfp->mf_used_first;
-    mfp->mf_used_first = hp;
-    hp->bh_prev = NULL;
-    if (hp->bh_next == NULL)	    /* list was empty, adjust last pointer */
+    bhdr_T	*next;
+
+    if (hp->bh_flags & BH_HOT)
+    {
+	next = mfp->mf_used_first;
+	mfp->mf_hot_count += hp->bh_page_count;
+    }
+    else
+    {
+	next = mfp->mf_used_mid;
+	mfp->mf_used_mid = hp;
+    }
+    hp->bh_next = next;
+    hp->bh_prev = next == NULL ? mfp->mf_used_last : next->bh_prev;
+    if (hp->bh_next == NULL)	    /* at the end, adjust last pointer */
 	mfp->mf_used_last = hp;
     else
 	hp->bh_next->bh_prev = hp;
+    if (hp->bh_prev == NULL)	    /* at the start, adjust first pointer */
+	mfp->mf_used_first = hp;
+    else
+	hp->bh_prev->bh_next = hp;
+    hp->bh_stamp = ++mf_stamp;
     mfp->mf_used_count += hp->bh_page_count;
     total_mem_used += hp->bh_page_count * mfp->mf_page_size;
+
+    /* When too many pages are hot the least recently used hot block goes to
+     * the other part. */
+    while (mfp->mf_hot_count * 8 > mfp->mf_used_count * MF_HOT_EIGHTHS)
+    {
+	hp = mfp->mf_used_mid == NULL ? mfp->mf_used_last
+						 : mfp->mf_used_mid->bh_prev;
+	hp->bh_flags &= ~BH_HOT;
+	hp->bh_time = time(NULL);
+	mfp->mf_hot_count -= hp->bh_page_count;
+	mfp->mf_used_mid = hp;
+    }
 }
 
 /*
@@ -793,6 +990,10 @@ mf_rem_used(mfp, hp)
     memfile_T	*mfp;
     bhdr_T	*hp;
 {
+    if (hp->bh_flags & BH_HOT)
+	mfp->mf_hot_count -= hp->bh_page_count;
+    else if (mfp->mf_used_mid == hp)
+	mfp->mf_used_mid = hp->bh_next;
     if (hp->bh_next == NULL)	    /* last block in used list */
 	mfp->mf_used_last = hp->bh_prev;
     else
@@ -818,6 +1019,7 @@ mf_release(mfp, page_count)
     int		page_count;
 {
     bhdr_T	*hp;
+    memfile_T	*rmfp;		/* memfile to release a block from */
     int		need_release;
     buf_T	*buf;
 
@@ -848,30 +1050,51 @@ mf_release(mfp, page_count)
 
     /*
      * don't release a block if
-     *	there is no file for this memfile
-     * or
      *	the number of blocks for this memfile is lower than the maximum
      *	  and
      *	total memory used is not up to 'maxmemtot'
      */
-    if (mfp->mf_fd < 0 || !need_release)
+    if (!need_release)
 	return NULL;
 
-    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
-	if (!(hp->bh_flags & BH_LOCKED))
-	    break;
+    /*
+     * Over the maximum for this memfile: release one of its own blocks.
+     * Over 'maxmemtot': release the least useful block of any memfile.
+     */
+    if (mfp->mf_used_count >= mfp->mf_used_count_max)
+    {
+	rmfp = mfp;
+	hp = mf_find_release(mfp);
+    }
+    else
+	hp = mf_find_release_all(&rmfp);
     if (hp == NULL)	/* not a single one that can be released */
 	return NULL;
 
+#ifdef FEAT_SWAP_THREAD
+    /* A clean block may still have to be written by the writer thread. */
+    if (rmfp->mf_fd >= 0 && mf_bg_wait(rmfp) == FAIL)
+	return NULL;
+#endif
+
     /*
      * If the block is dirty, write it.
      * If the write fails we don't free it.
      */
-    if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
+    if ((hp->bh_flags & BH_DIRTY) && mf_write(rmfp, hp) == FAIL)
 	return NULL;
 
-    mf_rem_used(mfp, hp);
-    mf_rem_hash(mfp, hp);
+    mf_rem_used(rmfp, hp);
+    mf_rem_hash(rmfp, hp);
+    ++rmfp->mf_evictions;
+
+    /* The block of another memfile is not re-used, its page size may be
+     * different. */
+    if (rmfp != mfp)
+    {
+	mf_free_bhdr(hp);
+	return NULL;
+    }
 
     /*
      * If a bhdr_T is returned, make sure that the page_count of bh_data is
@@ -890,6 +1113,64 @@ mf_release(mfp, page_count)
     return hp;
 }
 
+/*
+ * Find the block of memfile "mfp" to release: the least recently used block
+ * that is not locked.  Because blocks that were used only once are at the
+ * end of the used list they go first.
+ * Without a swap file only blocks that can be built again can be released.
+ * Returns NULL when there is none.
+ */
+    static bhdr_T *
+mf_find_release(mfp)
+    memfile_T	*mfp;
+{
+    bhdr_T	*hp;
+
+    if (mfp->mf_fd < 0)
+    {
+#ifdef FEAT_MMAP
+	if (!mfp->mf_lazy)
+#endif
+	    return NULL;
+    }
+    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	if (!(hp->bh_flags & BH_LOCKED)
+		&& (mfp->mf_fd >= 0 || MF_CAN_DROP(hp)))
+	    break;
+    return hp;
+}
+
+/*
+ * Find the block to release from all memfiles, to stay below 'maxmemtot':
+ * a block that is not hot is preferred, then the one that was used least
+ * recently.  "*mfpp" is set to the memfile of the block.
+ * Returns NULL when there is none.
+ */
+    static bhdr_T *
+mf_find_release_all(mfpp)
+    memfile_T	**mfpp;
+{
+    buf_T	*buf;
+    bhdr_T	*hp;
+    bhdr_T	*found = NULL;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+    {
+	if (buf->b_ml.ml_mfp == NULL
+			    || (hp = mf_find_release(buf->b_ml.ml_mfp)) == NULL)
+	    continue;
+	if (found == NULL
+		|| ((hp->bh_flags & BH_HOT) == (found->bh_flags & BH_HOT)
+		    ? hp->bh_stamp < found->bh_stamp
+		    : (found->bh_flags & BH_HOT)))
+	{
+	    found = hp;
+	    *mfpp = buf->b_ml.ml_mfp;
+	}
+    }
+    return found;
+}
+
 /*
  * release as many blocks as possible
  * Used in case of out of memory
@@ -913,18 +1194,28 @@ mf_release_all()
 	    if (mfp->mf_fd < 0 && buf->b_may_swap)
 		ml_open_file(buf);
 
-	    /* only if there is a swapfile */
-	    if (mfp->mf_fd >= 0)
+	    /* only if there is a swapfile or blocks can be built again */
+	    if (mfp->mf_fd >= 0
+#ifdef FEAT_MMAP
+		    || mfp->mf_lazy
+#endif
+		    )
 	    {
+#ifdef FEAT_SWAP_THREAD
+		if (mfp->mf_fd >= 0)
+		    (void)mf_bg_wait(mfp);
+#endif
 		for (hp = mfp->mf_used_last; hp != NULL; )
 		{
 		    if (!(hp->bh_flags & BH_LOCKED)
+			    && (mfp->mf_fd >= 0 || MF_CAN_DROP(hp))
 			    && (!(hp->bh_flags & BH_DIRTY)
 				|| mf_write(mfp, hp) != FAIL))
 		    {
 			mf_rem_used(mfp, hp);
 			mf_rem_hash(mfp, hp);
 			mf_free_bhdr(hp);
+			++mfp->mf_evictions;
 			hp = mfp->mf_used_last;	/* re-start, list was changed */
 			retval = TRUE;
 		    }
@@ -1014,6 +1305,9 @@ mf_read(mfp, hp)
 
     if (mfp->mf_fd < 0)	    /* there is no file, can't read */
 	return FAIL;
+#ifdef FEAT_SWAP_THREAD
+    (void)mf_bg_wait(mfp);
+#endif
 
     page_size = mfp->mf_page_size;
     offset = (off_t)page_size * hp->bh_bnum;
@@ -1057,6 +1351,12 @@ mf_write(mfp, hp)
 
     if (mfp->mf_fd < 0)	    /* there is no file, can't write */
 	return FAIL;
+#ifdef FEAT_SWAP_THREAD
+    /* An older copy of the block may still be written by the writer
+     * thread. */
+    if (bg_job == NULL || bg_job->bj_mfp != mfp)
+	(void)mf_bg_wait(mfp);
+#endif
 
     if (hp->bh_bnum < 0)	/* must assign file block number */
 	if (mf_trans_add(mfp, hp) == FAIL)
@@ -1142,6 +1442,11 @@ mf_write_block(mfp, hp, offset, size)
     }
 #endif
 
+#ifdef FEAT_SWAP_THREAD
+    if (bg_job != NULL && bg_job->bj_mfp == mfp)
+	result = mf_bg_add(data, offset, size);
+    else
+#endif
     if ((unsigned)write_eintr(mfp->mf_fd, data, size) != size)
 	result = FAIL;
 
@@ -1366,6 +1671,290 @@ mf_do_open(mfp, fname, flags)
     }
 }
 
+#ifdef FEAT_SWAP_THREAD
+/*
+ * Functions for the swap file writer thread, see 'swapthread'.
+ */
+
+/*
+ * Create a job for writing blocks of "mfp".  Starts the writer thread when
+ * this wasn't done yet.
+ * Returns NULL when the blocks must be written directly.
+ */
+    static mf_bgjob_T *
+mf_bg_new_job(mfp)
+    memfile_T	*mfp;
+{
+    mf_bgjob_T	*job;
+    pthread_t	thread;
+    pthread_attr_t attr;
+    sigset_t	all;
+    sigset_t	old;
+    int		ok;
+
+    if (!bg_started)
+    {
+	/* The writer thread must not handle any signals, block them all
+	 * while creating it, it inherits the signal mask. */
+	if (pthread_attr_init(&attr) != 0)
+	    return NULL;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ok = pthread_create(&thread, &attr, mf_bg_thread, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+	if (!ok)
+	    return NULL;
+	bg_started = TRUE;
+    }
+
+    job = (mf_bgjob_T *)alloc_clear((unsigned)sizeof(mf_bgjob_T));
+    if (job != NULL)
+    {
+	job->bj_mfp = mfp;
+	job->bj_fd = mfp->mf_fd;
+	ga_init2(&job->bj_blocks, (int)sizeof(mf_bgblock_T), 32);
+    }
+    return job;
+}
+
+/*
+ * Add a copy of "size" bytes at "data" to "bg_job", to be written at
+ * "offset".
+ */
+    static int
+mf_bg_add(data, offset, size)
+    char_u	*data;
+    off_t	offset;
+    unsigned	size;
+{
+    mf_bgblock_T    *bb;
+    char_u	    *copy;
+
+    if (ga_grow(&bg_job->bj_blocks, 1) == FAIL)
+	return FAIL;
+    if ((copy = alloc(size)) == NULL)
+	return FAIL;
+    mch_memmove(copy, data, (size_t)size);
+    bb = (mf_bgblock_T *)bg_job->bj_blocks.ga_data + bg_job->bj_blocks.ga_len;
+    bb->bb_offset = offset;
+    bb->bb_seq = bg_job->bj_blocks.ga_len;
+    bb->bb_size = size;
+    bb->bb_data = copy;
+    ++bg_job->bj_blocks.ga_len;
+    return OK;
+}
+
+/*
+ * Hand "job" to the writer thread.
+ */
+    static void
+mf_bg_queue(job)
+    mf_bgjob_T	*job;
+{
+    mf_bgjob_T	**jpp;
+    mf_bgjob_T	*done;
+
+    pthread_mutex_lock(&bg_mutex);
+    for (jpp = &bg_queue; *jpp != NULL; jpp = &(*jpp)->bj_next)
+	;
+    *jpp = job;
+    done = bg_done;
+    bg_done = NULL;
+    pthread_cond_signal(&bg_work_cond);
+    pthread_mutex_unlock(&bg_mutex);
+
+    mf_bg_free_jobs(done);
+}
+
+/*
+ * Free "job" and the jobs linked to it.
+ */
+    static void
+mf_bg_free_jobs(job)
+    mf_bgjob_T	*job;
+{
+    mf_bgjob_T	*next;
+    int		i;
+
+    for ( ; job != NULL; job = next)
+    {
+	next = job->bj_next;
+	for (i = 0; i < job->bj_blocks.ga_len; ++i)
+	    vim_free(((mf_bgblock_T *)job->bj_blocks.ga_data)[i].bb_data);
+	ga_clear(&job->bj_blocks);
+	vim_free(job);
+    }
+}
+
+/*
+ * Wait for the writer thread to finish all jobs.  When writing blocks of
+ * "mfp" failed give an error message and mark its blocks dirty, so that they
+ * are written again.
+ * Return FAIL when writing failed, OK otherwise.
+ */
+    int
+mf_bg_wait(mfp)
+    memfile_T	*mfp;
+{
+    mf_bgjob_T	*done;
+    int		failed;
+    int		n;
+
+    if (!bg_started)
+	return OK;
+    if (really_exiting)
+    {
+	/* Called from preserve_exit(), possibly in a signal handler, where
+	 * the mutex can't be used.  Stop the writer thread and give it a
+	 * moment to finish the write it is doing.  mf_sync() writes all
+	 * blocks again. */
+	bg_stop = TRUE;
+	for (n = 0; bg_writing && n < 100; ++n)
+	    mch_delay(10L, TRUE);
+	return OK;
+    }
+    pthread_mutex_lock(&bg_mutex);
+    while (bg_queue != NULL)
+	pthread_cond_wait(&bg_done_cond, &bg_mutex);
+    failed = mfp->mf_bg_failed;
+    mfp->mf_bg_failed = FALSE;
+    done = bg_done;
+    bg_done = NULL;
+    pthread_mutex_unlock(&bg_mutex);
+
+    mf_bg_free_jobs(done);
+    if (failed)
+    {
+	if (!did_swapwrite_msg)
+	    EMSG(_("E297: Write error in swap file"));
+	did_swapwrite_msg = TRUE;
+	mf_set_dirty(mfp);
+	return FAIL;
+    }
+    return OK;
+}
+
+/*
+ * The writer thread: write the blocks of each job in the queue.
+ * Only uses the job, never calls Vim functions that are not thread-safe.
+ */
+    static void *
+mf_bg_thread(arg)
+    void	*arg UNUSED;
+{
+    mf_bgjob_T	*job;
+    int		status;
+
+    pthread_mutex_lock(&bg_mutex);
+    for (;;)
+    {
+	while (bg_queue == NULL)
+	    pthread_cond_wait(&bg_work_cond, &bg_mutex);
+	job = bg_queue;
+	pthread_mutex_unlock(&bg_mutex);
+
+	/* Set "bg_writing" before checking "bg_stop", mf_bg_wait() does it
+	 * the other way around. */
+	bg_writing = TRUE;
+	status = bg_stop ? OK : mf_bg_write(job);
+	bg_writing = FALSE;
+
+	pthread_mutex_lock(&bg_mutex);
+	if (status == FAIL)
+	    job->bj_mfp->mf_bg_failed = TRUE;
+	bg_queue = job->bj_next;
+	job->bj_next = bg_done;
+	bg_done = job;
+	pthread_cond_broadcast(&bg_done_cond);
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+
+/*
+ * Write the blocks of "job", in order of their offset, and sync the file.
+ * Blocks that follow each other in the file are written with one call.
+ * Called in the writer thread.
+ */
+    static int
+mf_bg_write(job)
+    mf_bgjob_T	*job;
+{
+    mf_bgblock_T    *bb = (mf_bgblock_T *)job->bj_blocks.ga_data;
+    int		    count = job->bj_blocks.ga_len;
+    int		    status = OK;
+    int		    i;
+    int		    n;
+    size_t	    len;
+#ifdef HAVE_PWRITEV
+    struct iovec    iov[MF_BG_IOV];
+#endif
+
+    qsort((void *)bb, (size_t)count, sizeof(mf_bgblock_T), mf_bg_compare);
+    for (i = 0; i < count; i += n)
+    {
+	/* Find the blocks that follow block "i" in the file. */
+	len = bb[i].bb_size;
+	for (n = 1; i + n < count && n < MF_BG_IOV
+		    && bb[i + n].bb_offset == bb[i].bb_offset + (off_t)len; ++n)
+	    len += bb[i + n].bb_size;
+#ifdef HAVE_PWRITEV
+	if (n > 1)
+	{
+	    int	    j;
+
+	    for (j = 0; j < n; ++j)
+	    {
+		iov[j].iov_base = (void *)bb[i + j].bb_data;
+		iov[j].iov_len = bb[i + j].bb_size;
+	    }
+	    if (pwritev(job->bj_fd, iov, n, bb[i].bb_offset) == (ssize_t)len)
+		continue;
+	    /* Try writing them one by one. */
+	    n = 1;
+	}
+#else
+	n = 1;
+#endif
+	if (pwrite(job->bj_fd, bb[i].bb_data, (size_t)bb[i].bb_size,
+				bb[i].bb_offset) != (ssize_t)bb[i].bb_size)
+	    status = FAIL;
+    }
+
+#ifdef HAVE_FSYNC
+    if (job->bj_sync == MF_BG_FSYNC)
+    {
+	if (fsync(job->bj_fd))
+	    status = FAIL;
+    }
+    else
+#endif
+    if (job->bj_sync != 0)
+	sync();
+
+    return status;
+}
+
+/*
+ * Compare two blocks for qsort(): on offset, a block added later after one
+ * that was added earlier.
+ */
+    static int
+mf_bg_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    mf_bgblock_T    *b1 = (mf_bgblock_T *)s1;
+    mf_bgblock_T    *b2 = (mf_bgblock_T *)s2;
+
+    if (b1->bb_offset != b2->bb_offset)
+	return b1->bb_offset < b2->bb_offset ? -1 : 1;
+    return b1->bb_seq - b2->bb_seq;
+}
+#endif
+
 /*
  * Implementation of mf_hashtab_T follows.
  */
@@ -52,6 +52,10 @@
 # include <proto/dos.h>	    /* for Open() and Close() */
 #endif
 
+#ifdef FEAT_MMAP
+# include <sys/mman.h>	    /* for mmap() */
+#endif
+
 typedef struct block0		ZERO_BL;    /* contents of the first block */
 typedef struct pointer_block	PTR_BL;	    /* contents of a pointer block */
 typedef struct data_block	DATA_BL;    /* contents of a data block */
@@ -248,7 +252,13 @@ static void add_b0_fenc __ARGS((ZERO_BL *b0p, buf_T *buf));
 static time_t swapfile_info __ARGS((char_u *));
 static int recov_file_names __ARGS((char_u **, char_u *, int prepend_dot));
 static int ml_append_int __ARGS((buf_T *, linenr_T, char_u *, colnr_T, int, int));
+static void ml_add_data_lines __ARGS((DATA_BL *dp, char_u **lines, colnr_T *lens, int count));
+static int ml_append_lines_int __ARGS((buf_T *buf, linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
+static int ml_add_ptr __ARGS((buf_T *buf, int lineadd, PTR_EN *pe, int count));
 static int ml_delete_int __ARGS((buf_T *, linenr_T, int));
+static void ml_compact_later __ARGS((buf_T *buf, linenr_T lnum));
+static bhdr_T *ml_get_entry __ARGS((memfile_T *mfp, PTR_BL *pp, int idx, int *dirtyp));
+static int ml_merge_entries __ARGS((memfile_T *mfp, PTR_BL *pp, int idx, int *dirtyp));
 static char_u *findswapname __ARGS((buf_T *, char_u **, char_u *));
 static void ml_flush_line __ARGS((buf_T *));
 static bhdr_T *ml_new_data __ARGS((memfile_T *, int, int));
@@ -270,6 +280,17 @@ static cryptstate_T *ml_crypt_prepare __ARGS((memfile_T *mfp, off_t offset, int
 #endif
 #ifdef FEAT_BYTEOFF
 static void ml_updatechunk __ARGS((buf_T *buf, long line, long len, int updtype));
+static int ml_chunktree_build __ARGS((buf_T *buf));
+static void ml_chunktree_update __ARGS((buf_T *buf, int idx, int lines, long size));
+static int ml_chunk_find __ARGS((buf_T *buf, linenr_T lnum, long offset, int ffdos, linenr_T *curlinep, long *sizep));
+#endif
+#ifdef FEAT_PERSISTENT_UNDO
+static unsigned ml_hash_line __ARGS((char_u *p));
+static void ml_hash_changed __ARGS((buf_T *buf, linenr_T lnum, long count));
+static void ml_hash_free __ARGS((buf_T *buf));
+#endif
+#ifdef FEAT_MMAP
+static void ml_mmap_free __ARGS((mlmmap_T *mmp));
 #endif
 
 /*
@@ -295,8 +316,19 @@ ml_open(buf)
     buf->b_ml.ml_stack_top = 0;	/* nothing in the stack */
     buf->b_ml.ml_locked = NULL;	/* no cached block */
     buf->b_ml.ml_line_lnum = 0;	/* no cached line */
+    buf->b_ml.ml_compact_lnum = 0; /* nothing to merge */
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_len = -1;
+#endif
+#ifdef FEAT_PERSISTENT_UNDO
+    buf->b_ml.ml_hashchunk = NULL;
+    buf->b_ml.ml_hashchunk_len = 0;
+#endif
+#ifdef FEAT_MMAP
+    buf->b_ml.ml_mmap = NULL;
 #endif
 
     if (cmdmod.noswapfile)
@@ -318,7 +350,7 @@ ml_open(buf)
 	goto error;
 
     buf->b_ml.ml_mfp = mfp;
-#ifdef FEAT_CRYPT
+#if defined(FEAT_CRYPT) || defined(FEAT_MMAP)
     mfp->mf_buffer = buf;
 #endif
     buf->b_ml.ml_flags = ML_EMPTY;
@@ -678,6 +710,9 @@ ml_setname(buf)
 	/* need to close the swap file before renaming */
 	if (mfp->mf_fd >= 0)
 	{
+#ifdef FEAT_SWAP_THREAD
+	    (void)mf_bg_wait(mfp);
+#endif
 	    close(mfp->mf_fd);
 	    mfp->mf_fd = -1;
 	}
@@ -849,6 +884,17 @@ ml_close(buf, del_file)
 #ifdef FEAT_BYTEOFF
     vim_free(buf->b_ml.ml_chunksize);
     buf->b_ml.ml_chunksize = NULL;
+    vim_free(buf->b_ml.ml_chunktree);
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_len = -1;
+#endif
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_free(buf);
+#endif
+#ifdef FEAT_MMAP
+    ml_mmap_free(buf->b_ml.ml_mmap);
+    buf->b_ml.ml_mmap = NULL;
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -1127,6 +1173,7 @@ ml_recover()
     long	error;
     int		cannot_open;
     linenr_T	line_count;
+    linenr_T	old_lnum;
     int		has_error;
     int		idx;
     int		top;
@@ -1212,6 +1259,7 @@ ml_recover()
     buf->b_ml.ml_stack_top = 0;		/* nothing in the stack */
     buf->b_ml.ml_line_lnum = 0;		/* no cached line */
     buf->b_ml.ml_locked = NULL;		/* no locked block */
+    buf->b_ml.ml_compact_lnum = 0;	/* nothing to merge */
     buf->b_ml.ml_flags = 0;
 #ifdef FEAT_CRYPT
     buf->b_p_key = empty_option;
@@ -1520,10 +1568,20 @@ ml_recover()
 			 */
 			if (!cannot_open)
 			{
+			    old_lnum = pp->pb_pointer[idx].pe_old_lnum;
 			    line_count = pp->pb_pointer[idx].pe_line_count;
+
+			    /* Following blocks with the next lines of the
+			     * original file are read at the same time, there
+			     * can be many of them after ":edit ++mmap". */
+			    while (idx + 1 < (int)pp->pb_count
+				    && pp->pb_pointer[idx + 1].pe_bnum < 0
+				    && pp->pb_pointer[idx + 1].pe_old_lnum
+						       == old_lnum + line_count)
+				line_count +=
+					  pp->pb_pointer[++idx].pe_line_count;
 			    if (readfile(curbuf->b_ffname, NULL, lnum,
-					pp->pb_pointer[idx].pe_old_lnum - 1,
-					line_count, NULL, 0) == FAIL)
+					old_lnum - 1, line_count, NULL, 0) == FAIL)
 				cannot_open = TRUE;
 			    else
 				lnum += line_count;
@@ -2524,7 +2582,13 @@ errorret:
 	buf->b_ml.ml_flags &= ~ML_LINE_DIRTY;
     }
     if (will_change)
+    {
 	buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+#ifdef FEAT_PERSISTENT_UNDO
+	/* The text is changed in place, e.g. by "r", without ml_replace(). */
+	ml_hash_changed(buf, lnum, 0L);
+#endif
+    }
 
     return buf->b_ml.ml_line_ptr;
 }
@@ -2539,6 +2603,65 @@ ml_line_alloced()
     return (curbuf->b_ml.ml_flags & ML_LINE_DIRTY);
 }
 
+/*
+ * Prepare "lip" for getting the lines of "buf" in order, starting with line
+ * "lnum".
+ */
+    void
+ml_iter_init(lip, buf, lnum)
+    lineiter_T	*lip;
+    buf_T	*buf;
+    linenr_T	lnum;
+{
+    lip->li_buf = buf;
+    lip->li_lnum = lnum;
+}
+
+/*
+ * Get the next line for "lip" and set "*lenp" to its length, excluding the
+ * NUL, when "lenp" is not NULL.  Like ml_get_buf(), the text is only valid
+ * until the buffer is used again.
+ * The data block of the line stays locked, for the lines after it in the
+ * same block the length follows from the index and no lookup in the tree or
+ * the memfile is needed.  When the buffer was used in between, e.g. a line
+ * was changed, the block is checked again.
+ */
+    char_u *
+ml_iter_next(lip, lenp)
+    lineiter_T	*lip;
+    colnr_T	*lenp;
+{
+    buf_T	*buf = lip->li_buf;
+    linenr_T	lnum = lip->li_lnum++;
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    char_u	*ptr;
+    int		idx;
+    unsigned	start;
+
+    hp = buf->b_ml.ml_locked;
+    if (lnum == buf->b_ml.ml_line_lnum || lnum > buf->b_ml.ml_line_count
+	    || mf_dont_release || hp == NULL
+	    || lnum < buf->b_ml.ml_locked_low
+	    || lnum > buf->b_ml.ml_locked_high)
+    {
+	/* Not in the locked block, or the line was changed: let ml_get_buf()
+	 * find the line, also handles errors. */
+	ptr = ml_get_buf(buf, lnum, FALSE);
+	if (lenp != NULL)
+	    *lenp = (colnr_T)STRLEN(ptr);
+	return ptr;
+    }
+
+    dp = (DATA_BL *)(hp->bh_data);
+    idx = lnum - buf->b_ml.ml_locked_low;
+    start = dp->db_index[idx] & DB_INDEX_MASK;
+    if (lenp != NULL)
+	*lenp = (colnr_T)((idx == 0 ? dp->db_txt_end
+			 : (dp->db_index[idx - 1] & DB_INDEX_MASK)) - start - 1);
+    return (char_u *)dp + start;
+}
+
 /*
  * Append a line after lnum (may be 0 to insert a line in front of the file).
  * "line" does not need to be allocated, but can't be another line in a
@@ -2609,9 +2732,12 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
     bhdr_T	*hp;
     memfile_T	*mfp;
     DATA_BL	*dp;
-    PTR_BL	*pp;
-    infoptr_T	*ip;
 
+#ifdef FEAT_MMAP
+    /* Changing the tree while lines are still being added is not possible. */
+    if (buf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(buf);
+#endif
 					/* lnum out of range */
     if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 	return FAIL;
@@ -2743,13 +2869,11 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
 	int	    data_moved = 0;	    /* init to shut up gcc */
 	int	    total_moved = 0;	    /* init to shut up gcc */
 	DATA_BL	    *dp_right, *dp_left;
-	int	    stack_idx;
 	int	    in_left;
 	int	    lineadd;
 	blocknr_T   bnum_left, bnum_right;
 	linenr_T    lnum_left, lnum_right;
-	int	    pb_idx;
-	PTR_BL	    *pp_new;
+	PTR_EN	    pe[2];
 
 	/*
 	 * We are going to allocate a new data block. Depending on the
@@ -2914,167 +3038,25 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
 	/*
 	 * update pointer blocks for the new data block
 	 */
-	for (stack_idx = buf->b_ml.ml_stack_top - 1; stack_idx >= 0;
-								  --stack_idx)
-	{
-	    ip = &(buf->b_ml.ml_stack[stack_idx]);
-	    pb_idx = ip->ip_index;
-	    if ((hp = mf_get(mfp, ip->ip_bnum, 1)) == NULL)
-		return FAIL;
-	    pp = (PTR_BL *)(hp->bh_data);   /* must be pointer block */
-	    if (pp->pb_id != PTR_ID)
-	    {
-		EMSG(_("E317: pointer block id wrong 3"));
-		mf_put(mfp, hp, FALSE, FALSE);
-		return FAIL;
-	    }
-	    /*
-	     * TODO: If the pointer block is full and we are adding at the end
-	     * try to insert in front of the next block
-	     */
-	    /* block not full, add one entry */
-	    if (pp->pb_count < pp->pb_count_max)
-	    {
-		if (pb_idx + 1 < (int)pp->pb_count)
-		    mch_memmove(&pp->pb_pointer[pb_idx + 2],
-				&pp->pb_pointer[pb_idx + 1],
-			(size_t)(pp->pb_count - pb_idx - 1) * sizeof(PTR_EN));
-		++pp->pb_count;
-		pp->pb_pointer[pb_idx].pe_line_count = line_count_left;
-		pp->pb_pointer[pb_idx].pe_bnum = bnum_left;
-		pp->pb_pointer[pb_idx].pe_page_count = page_count_left;
-		pp->pb_pointer[pb_idx + 1].pe_line_count = line_count_right;
-		pp->pb_pointer[pb_idx + 1].pe_bnum = bnum_right;
-		pp->pb_pointer[pb_idx + 1].pe_page_count = page_count_right;
-
-		if (lnum_left != 0)
-		    pp->pb_pointer[pb_idx].pe_old_lnum = lnum_left;
-		if (lnum_right != 0)
-		    pp->pb_pointer[pb_idx + 1].pe_old_lnum = lnum_right;
-
-		mf_put(mfp, hp, TRUE, FALSE);
-		buf->b_ml.ml_stack_top = stack_idx + 1;	    /* truncate stack */
-
-		if (lineadd)
-		{
-		    --(buf->b_ml.ml_stack_top);
-		    /* fix line count for rest of blocks in the stack */
-		    ml_lineadd(buf, lineadd);
-							/* fix stack itself */
-		    buf->b_ml.ml_stack[buf->b_ml.ml_stack_top].ip_high +=
-								      lineadd;
-		    ++(buf->b_ml.ml_stack_top);
-		}
-
-		/*
-		 * We are finished, break the loop here.
-		 */
-		break;
-	    }
-	    else			/* pointer block full */
-	    {
-		/*
-		 * split the pointer block
-		 * allocate a new pointer block
-		 * move some of the pointer into the new block
-		 * prepare for updating the parent block
-		 */
-		for (;;)	/* do this twice when splitting block 1 */
-		{
-		    hp_new = ml_new_ptr(mfp);
-		    if (hp_new == NULL)	    /* TODO: try to fix tree */
-			return FAIL;
-		    pp_new = (PTR_BL *)(hp_new->bh_data);
-
-		    if (hp->bh_bnum != 1)
-			break;
-
-		    /*
-		     * if block 1 becomes full the tree is given an extra level
-		     * The pointers from block 1 are moved into the new block.
-		     * block 1 is updated to point to the new block
-		     * then continue to split the new block
-		     */
-		    mch_memmove(pp_new, pp, (size_t)page_size);
-		    pp->pb_count = 1;
-		    pp->pb_pointer[0].pe_bnum = hp_new->bh_bnum;
-		    pp->pb_pointer[0].pe_line_count = buf->b_ml.ml_line_count;
-		    pp->pb_pointer[0].pe_old_lnum = 1;
-		    pp->pb_pointer[0].pe_page_count = 1;
-		    mf_put(mfp, hp, TRUE, FALSE);   /* release block 1 */
-		    hp = hp_new;		/* new block is to be split */
-		    pp = pp_new;
-		    CHECK(stack_idx != 0, _("stack_idx should be 0"));
-		    ip->ip_index = 0;
-		    ++stack_idx;	/* do block 1 again later */
-		}
-		/*
-		 * move the pointers after the current one to the new block
-		 * If there are none, the new entry will be in the new block.
-		 */
-		total_moved = pp->pb_count - pb_idx - 1;
-		if (total_moved)
-		{
-		    mch_memmove(&pp_new->pb_pointer[0],
-				&pp->pb_pointer[pb_idx + 1],
-				(size_t)(total_moved) * sizeof(PTR_EN));
-		    pp_new->pb_count = total_moved;
-		    pp->pb_count -= total_moved - 1;
-		    pp->pb_pointer[pb_idx + 1].pe_bnum = bnum_right;
-		    pp->pb_pointer[pb_idx + 1].pe_line_count = line_count_right;
-		    pp->pb_pointer[pb_idx + 1].pe_page_count = page_count_right;
-		    if (lnum_right)
-			pp->pb_pointer[pb_idx + 1].pe_old_lnum = lnum_right;
-		}
-		else
-		{
-		    pp_new->pb_count = 1;
-		    pp_new->pb_pointer[0].pe_bnum = bnum_right;
-		    pp_new->pb_pointer[0].pe_line_count = line_count_right;
-		    pp_new->pb_pointer[0].pe_page_count = page_count_right;
-		    pp_new->pb_pointer[0].pe_old_lnum = lnum_right;
-		}
-		pp->pb_pointer[pb_idx].pe_bnum = bnum_left;
-		pp->pb_pointer[pb_idx].pe_line_count = line_count_left;
-		pp->pb_pointer[pb_idx].pe_page_count = page_count_left;
-		if (lnum_left)
-		    pp->pb_pointer[pb_idx].pe_old_lnum = lnum_left;
-		lnum_left = 0;
-		lnum_right = 0;
-
-		/*
-		 * recompute line counts
-		 */
-		line_count_right = 0;
-		for (i = 0; i < (int)pp_new->pb_count; ++i)
-		    line_count_right += pp_new->pb_pointer[i].pe_line_count;
-		line_count_left = 0;
-		for (i = 0; i < (int)pp->pb_count; ++i)
-		    line_count_left += pp->pb_pointer[i].pe_line_count;
-
-		bnum_left = hp->bh_bnum;
-		bnum_right = hp_new->bh_bnum;
-		page_count_left = 1;
-		page_count_right = 1;
-		mf_put(mfp, hp, TRUE, FALSE);
-		mf_put(mfp, hp_new, TRUE, FALSE);
-	    }
-	}
-
-	/*
-	 * Safety check: fallen out of for loop?
-	 */
-	if (stack_idx < 0)
-	{
-	    EMSG(_("E318: Updated too many blocks?"));
-	    buf->b_ml.ml_stack_top = 0;	/* invalidate stack */
-	}
+	pe[0].pe_bnum = bnum_left;
+	pe[0].pe_line_count = line_count_left;
+	pe[0].pe_old_lnum = lnum_left;
+	pe[0].pe_page_count = page_count_left;
+	pe[1].pe_bnum = bnum_right;
+	pe[1].pe_line_count = line_count_right;
+	pe[1].pe_old_lnum = lnum_right;
+	pe[1].pe_page_count = page_count_right;
+	if (ml_add_ptr(buf, lineadd, pe, 2) == FAIL)
+	    return FAIL;
     }
 
 #ifdef FEAT_BYTEOFF
     /* The line was inserted below 'lnum' */
     ml_updatechunk(buf, lnum + 1, (long)len, ML_CHNK_ADDLINE);
 #endif
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_changed(buf, lnum + 1, 1L);
+#endif
 #ifdef FEAT_NETBEANS_INTG
     if (netbeans_active())
     {
@@ -3088,145 +3070,587 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
 }
 
 /*
- * Replace line lnum, with buffering, in current buffer.
- *
- * If "copy" is TRUE, make a copy of the line, otherwise the line has been
- * copied to allocated memory already.
- *
+ * Append "count" lines after line "lnum" (can be 0) in the current buffer.
+ * "lines[i]" is the text of a line, "lens[i]" its length including the NUL.
+ * Does the same as calling ml_append() for each line, but the lines are
+ * packed into new data blocks which are added to the pointer blocks at once.
+ * This avoids finding the position in the tree and splitting a data block
+ * for every line, which matters when reading a large file.
+ * "newfile" is used like with ml_append().
  * Check: The caller of this function should probably also call
- * changed_lines(), unless update_screen(NOT_VALID) is used.
+ * appended_lines().
  *
  * return FAIL for failure, OK otherwise
  */
     int
-ml_replace(lnum, line, copy)
-    linenr_T	lnum;
-    char_u	*line;
-    int		copy;
+ml_append_lines(lnum, lines, lens, count, newfile)
+    linenr_T	lnum;		/* append after this line (can be 0) */
+    char_u	**lines;	/* text of the new lines */
+    colnr_T	*lens;		/* lengths of the lines, including NUL */
+    long	count;		/* number of lines */
+    int		newfile;	/* flag, see ml_append() */
 {
-    if (line == NULL)		/* just checking... */
-	return FAIL;
-
     /* When starting up, we might still need to create the memfile */
     if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
 	return FAIL;
 
-    if (copy && (line = vim_strsave(line)) == NULL) /* allocate memory */
-	return FAIL;
-#ifdef FEAT_NETBEANS_INTG
-    if (netbeans_active())
-    {
-	netbeans_removed(curbuf, lnum, 0, (long)STRLEN(ml_get(lnum)));
-	netbeans_inserted(curbuf, lnum, 0, line, (int)STRLEN(line));
-    }
-#endif
-    if (curbuf->b_ml.ml_line_lnum != lnum)	    /* other line buffered */
-	ml_flush_line(curbuf);			    /* flush it */
-    else if (curbuf->b_ml.ml_flags & ML_LINE_DIRTY) /* same line allocated */
-	vim_free(curbuf->b_ml.ml_line_ptr);	    /* free it */
-    curbuf->b_ml.ml_line_ptr = line;
-    curbuf->b_ml.ml_line_lnum = lnum;
-    curbuf->b_ml.ml_flags = (curbuf->b_ml.ml_flags | ML_LINE_DIRTY) & ~ML_EMPTY;
-
-    return OK;
+    if (curbuf->b_ml.ml_line_lnum != 0)
+	ml_flush_line(curbuf);
+    return ml_append_lines_int(curbuf, lnum, lines, lens, count, newfile);
 }
 
 /*
- * Delete line 'lnum' in the current buffer.
- *
- * Check: The caller of this function should probably also call
- * deleted_lines() after this.
- *
- * return FAIL for failure, OK otherwise
+ * Add "count" lines at the end of data block "dp", which must have room for
+ * them.
  */
-    int
-ml_delete(lnum, message)
-    linenr_T	lnum;
-    int		message;
+    static void
+ml_add_data_lines(dp, lines, lens, count)
+    DATA_BL	*dp;
+    char_u	**lines;
+    colnr_T	*lens;
+    int		count;
 {
-    ml_flush_line(curbuf);
-    return ml_delete_int(curbuf, lnum, message);
+    int		i;
+
+    for (i = 0; i < count; ++i)
+    {
+	dp->db_txt_start -= lens[i];
+	dp->db_free -= lens[i] + INDEX_SIZE;
+	dp->db_index[dp->db_line_count++] = dp->db_txt_start;
+	mch_memmove((char *)dp + dp->db_txt_start, lines[i], (size_t)lens[i]);
+    }
 }
 
     static int
-ml_delete_int(buf, lnum, message)
+ml_append_lines_int(buf, lnum, lines, lens, count, newfile)
     buf_T	*buf;
     linenr_T	lnum;
-    int		message;
+    char_u	**lines;
+    colnr_T	*lens;
+    long	count;
+    int		newfile;
 {
-    bhdr_T	*hp;
     memfile_T	*mfp;
+    int		page_size;
+    long	size;
+    long	done;
+    long	i;
+    int		n;
+    int		db_idx;		/* index for lnum in data block */
+    int		head_count;	/* lines that fit in the data block of lnum */
+    int		lines_moved = 0;
+    int		data_moved = 0;
+    int		total_moved = 0;
+    int		offset;
+    int		page_count;
+    bhdr_T	*hp;
+    bhdr_T	*hp_new;
     DATA_BL	*dp;
-    PTR_BL	*pp;
-    infoptr_T	*ip;
-    int		count;	    /* number of entries in block */
-    int		idx;
-    int		stack_idx;
-    int		text_start;
-    int		line_start;
-    long	line_size;
-    int		i;
-
-    if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
+    DATA_BL	*dp_new;
+    PTR_EN	*pe;
+    garray_T	ga;
+    int		retval = FAIL;
+
+#ifdef FEAT_MMAP
+    /* Changing the tree while lines are still being added is not possible. */
+    if (buf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(buf);
+#endif
+					/* lnum out of range */
+    if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 	return FAIL;
 
+    mfp = buf->b_ml.ml_mfp;
+    page_size = mfp->mf_page_size;
+
+    /*
+     * When the lines fit in a block, or to insert before line one, appending
+     * one line at a time is simpler.
+     */
+    size = 0;
+    for (i = 0; i < count && size < page_size; ++i)
+	size += lens[i] + INDEX_SIZE;
+    for (done = 0; done < count && (lnum == 0 || size < page_size); ++done)
+	if (ml_append_int(buf, lnum++, lines[done], lens[done], newfile,
+							       FALSE) == FAIL)
+	    return FAIL;
+    if (done == count)
+	return OK;
+    lines += done;
+    lens += done;
+    count -= done;
+
     if (lowest_marked && lowest_marked > lnum)
-	lowest_marked--;
+	lowest_marked = lnum + 1;
 
-/*
- * If the file becomes empty the last line is replaced by an empty line.
- */
-    if (buf->b_ml.ml_line_count == 1)	    /* file becomes empty */
-    {
-	if (message
-#ifdef FEAT_NETBEANS_INTG
-		&& !netbeansSuppressNoLines
-#endif
-	   )
-	    set_keep_msg((char_u *)_(no_lines_msg), 0);
+    /*
+     * Find the data block containing "lnum".  Release the locked block first,
+     * so that the pointer blocks and the stack have the right line counts.
+     */
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	return FAIL;
+    dp = (DATA_BL *)(hp->bh_data);
+    db_idx = lnum - buf->b_ml.ml_locked_low;
 
-	/* FEAT_BYTEOFF already handled in there, don't worry 'bout it below */
-	i = ml_replace((linenr_T)1, (char_u *)"", TRUE);
-	buf->b_ml.ml_flags |= ML_EMPTY;
+    /*
+     * The lines after "lnum" in the block are moved to a new block, which
+     * goes after the new lines.  The free space is filled with new lines.
+     */
+    lines_moved = buf->b_ml.ml_locked_high - lnum;
+    if (lines_moved > 0)
+    {
+	data_moved = ((dp->db_index[db_idx]) & DB_INDEX_MASK)
+							   - dp->db_txt_start;
+	total_moved = data_moved + lines_moved * INDEX_SIZE;
+    }
+    size = dp->db_free + total_moved;
+    for (head_count = 0; head_count < count
+		  && lens[head_count] + INDEX_SIZE <= size; ++head_count)
+	size -= lens[head_count] + INDEX_SIZE;
 
-	return i;
+    /*
+     * Pack the other lines into new data blocks, as many in a block as fit.
+     * A line that does not fit in a page gets a block of its own.  The first
+     * entry is for the block of "lnum", it is filled in below.
+     * When something fails here the tree has not been changed yet.
+     */
+    ga_init2(&ga, (int)sizeof(PTR_EN), 100);
+    if (ga_grow(&ga, 1) == FAIL)
+	goto theend;
+    ++ga.ga_len;
+    for (done = head_count; done < count; done += n)
+    {
+	size = lens[done] + INDEX_SIZE;
+	for (n = 1; done + n < count && size + lens[done + n] + INDEX_SIZE
+					    <= page_size - HEADER_SIZE; ++n)
+	    size += lens[done + n] + INDEX_SIZE;
+	page_count = (size + HEADER_SIZE + page_size - 1) / page_size;
+	if (ga_grow(&ga, 1) == FAIL
+		|| (hp_new = ml_new_data(mfp, newfile, page_count)) == NULL)
+	    goto theend;
+	ml_add_data_lines((DATA_BL *)(hp_new->bh_data), lines + done,
+							      lens + done, n);
+	pe = (PTR_EN *)ga.ga_data + ga.ga_len++;
+	pe->pe_bnum = hp_new->bh_bnum;
+	pe->pe_line_count = n;
+	pe->pe_old_lnum = lnum + 1 + done;
+	pe->pe_page_count = page_count;
+	mf_put(mfp, hp_new, TRUE, FALSE);
     }
 
-/*
- * find the data block containing the line
- * This also fills the stack with the blocks from the root to the data block
- * This also releases any locked block.
- */
-    mfp = buf->b_ml.ml_mfp;
-    if (mfp == NULL)
-	return FAIL;
+    if (lines_moved > 0)
+    {
+	page_count = (total_moved + HEADER_SIZE + page_size - 1) / page_size;
+	if (ga_grow(&ga, 1) == FAIL
+		|| (hp_new = ml_new_data(mfp, newfile, page_count)) == NULL)
+	    goto theend;
+	dp_new = (DATA_BL *)(hp_new->bh_data);
+	dp_new->db_txt_start -= data_moved;
+	dp_new->db_free -= total_moved;
+	mch_memmove((char *)dp_new + dp_new->db_txt_start,
+			(char *)dp + dp->db_txt_start, (size_t)data_moved);
+	offset = dp_new->db_txt_start - dp->db_txt_start;
+	for (n = 0; n < lines_moved; ++n)
+	    dp_new->db_index[n] = dp->db_index[db_idx + 1 + n] + offset;
+	dp_new->db_line_count = lines_moved;
+	pe = (PTR_EN *)ga.ga_data + ga.ga_len++;
+	pe->pe_bnum = hp_new->bh_bnum;
+	pe->pe_line_count = lines_moved;
+	pe->pe_old_lnum = lnum + 1 + count;
+	pe->pe_page_count = page_count;
+	mf_put(mfp, hp_new, TRUE, FALSE);
 
-    if ((hp = ml_find_line(buf, lnum, ML_DELETE)) == NULL)
-	return FAIL;
+	dp->db_txt_start += data_moved;
+	dp->db_free += total_moved;
+	dp->db_line_count -= lines_moved;
+	buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    }
 
-    dp = (DATA_BL *)(hp->bh_data);
-    /* compute line count before the delete */
-    count = (long)(buf->b_ml.ml_locked_high)
-					- (long)(buf->b_ml.ml_locked_low) + 2;
-    idx = lnum - buf->b_ml.ml_locked_low;
+    if (head_count > 0)
+    {
+	ml_add_data_lines(dp, lines, lens, head_count);
+	buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+	if (!newfile)
+	    buf->b_ml.ml_flags |= ML_LOCKED_POS;
+    }
+    pe = (PTR_EN *)ga.ga_data;
+    pe->pe_bnum = hp->bh_bnum;
+    pe->pe_line_count = dp->db_line_count;
+    pe->pe_old_lnum = 0;
+    pe->pe_page_count = hp->bh_page_count;
 
-    --buf->b_ml.ml_line_count;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    buf->b_ml.ml_line_count += count;
 
-    line_start = ((dp->db_index[idx]) & DB_INDEX_MASK);
-    if (idx == 0)		/* first line in block, text at the end */
-	line_size = dp->db_txt_end - line_start;
-    else
-	line_size = ((dp->db_index[idx - 1]) & DB_INDEX_MASK) - line_start;
+    /*
+     * Release the data block and add the entries for the new blocks to the
+     * pointer blocks.
+     */
+    buf->b_ml.ml_locked_lineadd = 0;
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    if (ml_add_ptr(buf, (int)count, (PTR_EN *)ga.ga_data, ga.ga_len) == FAIL)
+	goto theend;
 
-#ifdef FEAT_NETBEANS_INTG
-    if (netbeans_active())
-	netbeans_removed(buf, lnum, 0, (long)line_size);
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_changed(buf, lnum + 1, count);
 #endif
-
-/*
- * special case: If there is only one line in the data block it becomes empty.
- * Then we have to remove the entry, pointing to this data block, from the
- * pointer block. If this pointer block also becomes empty, we go up another
+    for (i = 0; i < count; ++i)
+    {
+#ifdef FEAT_BYTEOFF
+	ml_updatechunk(buf, lnum + 1 + i, (long)lens[i], ML_CHNK_ADDLINE);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+	if (netbeans_active())
+	{
+	    if (lens[i] > 1)
+		netbeans_inserted(buf, lnum + 1 + i, (colnr_T)0, lines[i],
+							       lens[i] - 1);
+	    netbeans_inserted(buf, lnum + 1 + i, lens[i] - 1,
+							   (char_u *)"\n", 1);
+	}
+#endif
+    }
+    retval = OK;
+
+theend:
+    ga_clear(&ga);
+    return retval;
+}
+
+/*
+ * Update the pointer blocks on the stack for a data block that was changed:
+ * the entry for the data block is replaced by the "count" entries in "pe".
+ * When they don't fit in the pointer block, it is split into full blocks and
+ * the entries for those replace the entry in the block above it, up to the
+ * root if needed.  The split is done just after the new entries, which is
+ * more efficient when inserting a lot of lines at one place.
+ * A pe_old_lnum of zero in the first entry keeps the old value.
+ * "lineadd" is the number of lines to add to the pointer blocks further up.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    static int
+ml_add_ptr(buf, lineadd, pe, count)
+    buf_T	*buf;
+    int		lineadd;
+    PTR_EN	*pe;
+    int		count;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    PTR_EN	*entries = pe;
+    PTR_EN	*all = NULL;	    /* all entries of a block being split */
+    PTR_EN	*new_pe = NULL;	    /* entries for the blocks it is split in */
+    int		stack_idx;
+    int		pb_idx;
+    int		total;
+    int		total_new;	    /* number of entries up to the new ones */
+    int		block_count;
+    int		max;
+    int		start;
+    int		n;
+    int		b;
+    int		i;
+    int		is_root;
+    infoptr_T	*ip;
+    bhdr_T	*hp;
+    bhdr_T	*hp_new;
+    PTR_BL	*pp;
+    PTR_BL	*pp_new;
+    int		retval = FAIL;
+
+    for (stack_idx = buf->b_ml.ml_stack_top - 1; stack_idx >= 0;
+							      --stack_idx)
+    {
+	ip = &(buf->b_ml.ml_stack[stack_idx]);
+	pb_idx = ip->ip_index;
+	if ((hp = mf_get(mfp, ip->ip_bnum, 1)) == NULL)
+	    goto theend;
+	pp = (PTR_BL *)(hp->bh_data);   /* must be pointer block */
+	if (pp->pb_id != PTR_ID)
+	{
+	    EMSG(_("E317: pointer block id wrong 3"));
+	    mf_put(mfp, hp, FALSE, FALSE);
+	    goto theend;
+	}
+	if (entries[0].pe_old_lnum == 0)
+	    entries[0].pe_old_lnum = pp->pb_pointer[pb_idx].pe_old_lnum;
+
+	total = pp->pb_count - 1 + count;
+	if (total <= (int)pp->pb_count_max)    /* block not full, add entries */
+	{
+	    if (pb_idx + 1 < (int)pp->pb_count)
+		mch_memmove(&pp->pb_pointer[pb_idx + count],
+			    &pp->pb_pointer[pb_idx + 1],
+		    (size_t)(pp->pb_count - pb_idx - 1) * sizeof(PTR_EN));
+	    mch_memmove(&pp->pb_pointer[pb_idx], entries,
+					     (size_t)count * sizeof(PTR_EN));
+	    pp->pb_count = total;
+
+	    mf_put(mfp, hp, TRUE, FALSE);
+	    buf->b_ml.ml_stack_top = stack_idx + 1;	    /* truncate stack */
+
+	    if (lineadd)
+	    {
+		--(buf->b_ml.ml_stack_top);
+		/* fix line count for rest of blocks in the stack */
+		ml_lineadd(buf, lineadd);
+						    /* fix stack itself */
+		buf->b_ml.ml_stack[buf->b_ml.ml_stack_top].ip_high +=
+								  lineadd;
+		++(buf->b_ml.ml_stack_top);
+	    }
+
+	    /*
+	     * We are finished, break the loop here.
+	     */
+	    retval = OK;
+	    break;
+	}
+
+	/*
+	 * Pointer block full: collect its entries with the new ones and divide
+	 * them over full pointer blocks, the first one is this block.  If this
+	 * is block 1 the tree is given an extra level: all entries go into new
+	 * blocks and block 1 gets the entries for them.
+	 */
+	all = (PTR_EN *)alloc((unsigned)(total * sizeof(PTR_EN)));
+	if (all == NULL)
+	{
+	    mf_put(mfp, hp, FALSE, FALSE);
+	    goto theend;
+	}
+	mch_memmove(all, pp->pb_pointer, (size_t)pb_idx * sizeof(PTR_EN));
+	mch_memmove(all + pb_idx, entries, (size_t)count * sizeof(PTR_EN));
+	mch_memmove(all + pb_idx + count, &pp->pb_pointer[pb_idx + 1],
+		       (size_t)(pp->pb_count - pb_idx - 1) * sizeof(PTR_EN));
+	vim_free(new_pe);
+	entries = NULL;
+
+	max = pp->pb_count_max;
+	total_new = pb_idx + count;
+	block_count = (total_new + max - 1) / max
+					 + (total - total_new + max - 1) / max;
+	new_pe = (PTR_EN *)alloc((unsigned)(block_count * sizeof(PTR_EN)));
+	if (new_pe == NULL)
+	{
+	    mf_put(mfp, hp, FALSE, FALSE);
+	    goto theend;
+	}
+
+	is_root = (hp->bh_bnum == 1);
+	for (b = 0, start = 0; b < block_count; ++b, start += n)
+	{
+	    if (b == 0 && !is_root)
+		hp_new = hp;
+	    else if ((hp_new = ml_new_ptr(mfp)) == NULL)
+	    {
+		/* TODO: try to fix tree */
+		mf_put(mfp, hp, TRUE, FALSE);
+		goto theend;
+	    }
+	    pp_new = (PTR_BL *)(hp_new->bh_data);
+	    n = (start < total_new ? total_new : total) - start;
+	    if (n > max)
+		n = max;
+	    mch_memmove(pp_new->pb_pointer, all + start,
+						 (size_t)n * sizeof(PTR_EN));
+	    pp_new->pb_count = n;
+
+	    new_pe[b].pe_bnum = hp_new->bh_bnum;
+	    new_pe[b].pe_line_count = 0;
+	    for (i = 0; i < n; ++i)
+		new_pe[b].pe_line_count += all[start + i].pe_line_count;
+	    new_pe[b].pe_old_lnum = 0;
+	    new_pe[b].pe_page_count = 1;
+	    if (hp_new != hp)
+		mf_put(mfp, hp_new, TRUE, FALSE);
+	}
+	vim_free(all);
+	all = NULL;
+
+	if (is_root)
+	{
+	    /* Do block 1 again, its only entry is replaced by the entries for
+	     * the new blocks. */
+	    new_pe[0].pe_old_lnum = 1;
+	    pp->pb_count = 1;
+	    ip->ip_index = 0;
+	    ++stack_idx;
+	}
+	mf_put(mfp, hp, TRUE, FALSE);
+	entries = new_pe;
+	count = block_count;
+    }
+
+    /*
+     * Safety check: fallen out of for loop?
+     */
+    if (stack_idx < 0)
+    {
+	EMSG(_("E318: Updated too many blocks?"));
+	buf->b_ml.ml_stack_top = 0;	/* invalidate stack */
+    }
+
+theend:
+    vim_free(all);
+    vim_free(new_pe);
+    return retval;
+}
+
+/*
+ * Replace line lnum, with buffering, in current buffer.
+ *
+ * If "copy" is TRUE, make a copy of the line, otherwise the line has been
+ * copied to allocated memory already.
+ *
+ * Check: The caller of this function should probably also call
+ * changed_lines(), unless update_screen(NOT_VALID) is used.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_replace(lnum, line, copy)
+    linenr_T	lnum;
+    char_u	*line;
+    int		copy;
+{
+    if (line == NULL)		/* just checking... */
+	return FAIL;
+
+    /* When starting up, we might still need to create the memfile */
+    if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
+	return FAIL;
+
+#ifdef FEAT_MMAP
+    /* A changed line may split a block when it is flushed. */
+    if (curbuf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(curbuf);
+#endif
+
+    if (copy && (line = vim_strsave(line)) == NULL) /* allocate memory */
+	return FAIL;
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_changed(curbuf, lnum, 0L);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+    {
+	netbeans_removed(curbuf, lnum, 0, (long)STRLEN(ml_get(lnum)));
+	netbeans_inserted(curbuf, lnum, 0, line, (int)STRLEN(line));
+    }
+#endif
+    if (curbuf->b_ml.ml_line_lnum != lnum)	    /* other line buffered */
+	ml_flush_line(curbuf);			    /* flush it */
+    else if (curbuf->b_ml.ml_flags & ML_LINE_DIRTY) /* same line allocated */
+	vim_free(curbuf->b_ml.ml_line_ptr);	    /* free it */
+    curbuf->b_ml.ml_line_ptr = line;
+    curbuf->b_ml.ml_line_lnum = lnum;
+    curbuf->b_ml.ml_flags = (curbuf->b_ml.ml_flags | ML_LINE_DIRTY) & ~ML_EMPTY;
+
+    return OK;
+}
+
+/*
+ * Delete line 'lnum' in the current buffer.
+ *
+ * Check: The caller of this function should probably also call
+ * deleted_lines() after this.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_delete(lnum, message)
+    linenr_T	lnum;
+    int		message;
+{
+    ml_flush_line(curbuf);
+    return ml_delete_int(curbuf, lnum, message);
+}
+
+    static int
+ml_delete_int(buf, lnum, message)
+    buf_T	*buf;
+    linenr_T	lnum;
+    int		message;
+{
+    bhdr_T	*hp;
+    memfile_T	*mfp;
+    DATA_BL	*dp;
+    PTR_BL	*pp;
+    infoptr_T	*ip;
+    int		count;	    /* number of entries in block */
+    int		idx;
+    int		stack_idx;
+    int		text_start;
+    int		line_start;
+    long	line_size;
+    int		i;
+
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(buf);
+#endif
+    if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
+	return FAIL;
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked--;
+
+/*
+ * If the file becomes empty the last line is replaced by an empty line.
+ */
+    if (buf->b_ml.ml_line_count == 1)	    /* file becomes empty */
+    {
+	if (message
+#ifdef FEAT_NETBEANS_INTG
+		&& !netbeansSuppressNoLines
+#endif
+	   )
+	    set_keep_msg((char_u *)_(no_lines_msg), 0);
+
+	/* FEAT_BYTEOFF already handled in there, don't worry 'bout it below */
+	i = ml_replace((linenr_T)1, (char_u *)"", TRUE);
+	buf->b_ml.ml_flags |= ML_EMPTY;
+
+	return i;
+    }
+
+/*
+ * find the data block containing the line
+ * This also fills the stack with the blocks from the root to the data block
+ * This also releases any locked block.
+ */
+    mfp = buf->b_ml.ml_mfp;
+    if (mfp == NULL)
+	return FAIL;
+
+    if ((hp = ml_find_line(buf, lnum, ML_DELETE)) == NULL)
+	return FAIL;
+
+    dp = (DATA_BL *)(hp->bh_data);
+    /* compute line count before the delete */
+    count = (long)(buf->b_ml.ml_locked_high)
+					- (long)(buf->b_ml.ml_locked_low) + 2;
+    idx = lnum - buf->b_ml.ml_locked_low;
+
+    --buf->b_ml.ml_line_count;
+
+    line_start = ((dp->db_index[idx]) & DB_INDEX_MASK);
+    if (idx == 0)		/* first line in block, text at the end */
+	line_size = dp->db_txt_end - line_start;
+    else
+	line_size = ((dp->db_index[idx - 1]) & DB_INDEX_MASK) - line_start;
+
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	netbeans_removed(buf, lnum, 0, (long)line_size);
+#endif
+
+/*
+ * special case: If there is only one line in the data block it becomes empty.
+ * Then we have to remove the entry, pointing to this data block, from the
+ * pointer block. If this pointer block also becomes empty, we go up another
  * block, and so on, up to the root if necessary.
  * The line counts in the pointer blocks have already been adjusted by
  * ml_find_line().
@@ -3256,6 +3680,8 @@ ml_delete_int(buf, lnum, message)
 		mf_free(mfp, hp);
 	    else
 	    {
+		if (count < (int)pp->pb_count_max / 2)
+		    ml_compact_later(buf, lnum);
 		if (count != idx)	/* move entries after the deleted one */
 		    mch_memmove(&pp->pb_pointer[idx], &pp->pb_pointer[idx + 1],
 				      (size_t)(count - idx) * sizeof(PTR_EN));
@@ -3300,33 +3726,331 @@ ml_delete_int(buf, lnum, message)
 	 * mark the block dirty and make sure it is in the file (for recovery)
 	 */
 	buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+
+	/* less than half full: may merge it with a neighbour later */
+	if (dp->db_free > (dp->db_txt_end - HEADER_SIZE) / 2)
+	    ml_compact_later(buf, lnum);
     }
 
 #ifdef FEAT_BYTEOFF
     ml_updatechunk(buf, lnum, line_size, ML_CHNK_DELLINE);
+#endif
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_changed(buf, lnum, -1L);
 #endif
     return OK;
 }
 
 /*
- * set the B_MARKED flag for line 'lnum'
+ * Remember that blocks around line "lnum" of "buf" became sparse, they may be
+ * merged with a neighbour later.
  */
-    void
-ml_setmarked(lnum)
-    linenr_T lnum;
+    static void
+ml_compact_later(buf, lnum)
+    buf_T	*buf;
+    linenr_T	lnum;
 {
-    bhdr_T    *hp;
-    DATA_BL *dp;
-				    /* invalid line number */
-    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count
-					       || curbuf->b_ml.ml_mfp == NULL)
-	return;			    /* give error message? */
+    if (buf->b_ml.ml_compact_lnum == 0 || lnum < buf->b_ml.ml_compact_lnum)
+	buf->b_ml.ml_compact_lnum = lnum;
+}
 
-    if (lowest_marked == 0 || lowest_marked > lnum)
-	lowest_marked = lnum;
+/*
+ * Get the block for entry "idx" of pointer block "pp".  A negative block
+ * number that was changed is updated, then "*dirtyp" is set.
+ */
+    static bhdr_T *
+ml_get_entry(mfp, pp, idx, dirtyp)
+    memfile_T	*mfp;
+    PTR_BL	*pp;
+    int		idx;
+    int		*dirtyp;
+{
+    PTR_EN	*pe = &pp->pb_pointer[idx];
+    blocknr_T	bnum;
 
-    /*
-     * find the data block containing the line
+    if (pe->pe_bnum < 0)
+    {
+	bnum = mf_trans_del(mfp, pe->pe_bnum);
+	if (bnum != pe->pe_bnum)
+	{
+	    pe->pe_bnum = bnum;
+	    *dirtyp = TRUE;
+	}
+    }
+    return mf_get(mfp, pe->pe_bnum, pe->pe_page_count);
+}
+
+/*
+ * Move the contents of the block for entry "idx + 1" of pointer block "pp"
+ * into the block for entry "idx", if it fits.  Two data blocks or two pointer
+ * blocks can be merged.  The emptied block is freed and its entry removed.
+ * Sets "*dirtyp" when "pp" was changed.
+ * Returns TRUE when the blocks were merged.
+ */
+    static int
+ml_merge_entries(mfp, pp, idx, dirtyp)
+    memfile_T	*mfp;
+    PTR_BL	*pp;
+    int		idx;
+    int		*dirtyp;
+{
+    bhdr_T	*hp_left;
+    bhdr_T	*hp_right;
+    DATA_BL	*dp_left;
+    DATA_BL	*dp_right;
+    PTR_BL	*pp_left;
+    PTR_BL	*pp_right;
+    int		text_size;
+    int		offset;
+    int		i;
+    int		merged = FALSE;
+    int		infile = FALSE;
+
+    if ((hp_left = ml_get_entry(mfp, pp, idx, dirtyp)) == NULL)
+	return FALSE;
+    if ((hp_right = ml_get_entry(mfp, pp, idx + 1, dirtyp)) == NULL)
+    {
+	mf_put(mfp, hp_left, FALSE, FALSE);
+	return FALSE;
+    }
+    dp_left = (DATA_BL *)(hp_left->bh_data);
+    dp_right = (DATA_BL *)(hp_right->bh_data);
+    pp_left = (PTR_BL *)dp_left;
+    pp_right = (PTR_BL *)dp_right;
+
+    if (dp_left->db_id == DATA_ID && dp_right->db_id == DATA_ID)
+    {
+	text_size = dp_right->db_txt_end - dp_right->db_txt_start;
+	if (text_size + dp_right->db_line_count * INDEX_SIZE
+						      <= dp_left->db_free)
+	{
+	    /* Put the text of the right block below the text of the left
+	     * block and add its indexes, adjusted for the text movement. */
+	    dp_left->db_txt_start -= text_size;
+	    mch_memmove((char *)dp_left + dp_left->db_txt_start,
+			 (char *)dp_right + dp_right->db_txt_start,
+							 (size_t)text_size);
+	    offset = dp_left->db_txt_start - dp_right->db_txt_start;
+	    for (i = 0; i < (int)dp_right->db_line_count; ++i)
+		dp_left->db_index[dp_left->db_line_count + i] =
+						dp_right->db_index[i] + offset;
+	    dp_left->db_line_count += dp_right->db_line_count;
+	    dp_left->db_free -= text_size
+				      + dp_right->db_line_count * INDEX_SIZE;
+	    merged = TRUE;
+	    infile = TRUE;	/* lines moved, can't recover from the file */
+	}
+    }
+    else if (pp_left->pb_id == PTR_ID && pp_right->pb_id == PTR_ID)
+    {
+	if (pp_left->pb_count + pp_right->pb_count <= pp_left->pb_count_max)
+	{
+	    mch_memmove(&pp_left->pb_pointer[pp_left->pb_count],
+			pp_right->pb_pointer,
+			       (size_t)pp_right->pb_count * sizeof(PTR_EN));
+	    pp_left->pb_count += pp_right->pb_count;
+	    merged = TRUE;
+	}
+    }
+
+    if (!merged)
+    {
+	mf_put(mfp, hp_right, FALSE, FALSE);
+	mf_put(mfp, hp_left, FALSE, FALSE);
+	return FALSE;
+    }
+
+    mf_free(mfp, hp_right);
+    mf_put(mfp, hp_left, TRUE, infile);
+    pp->pb_pointer[idx].pe_line_count += pp->pb_pointer[idx + 1].pe_line_count;
+    --pp->pb_count;
+    if (idx + 1 < (int)pp->pb_count)
+	mch_memmove(&pp->pb_pointer[idx + 1], &pp->pb_pointer[idx + 2],
+			(size_t)(pp->pb_count - idx - 1) * sizeof(PTR_EN));
+    *dirtyp = TRUE;
+    return TRUE;
+}
+
+/*
+ * Merge blocks of "buf" that are not full, starting at line "lnum": the
+ * children of the pointer block above the data block with "lnum", then that
+ * pointer block with the one before it, and so on up to the root.  When the
+ * root has only one pointer block below it the tree loses a level.
+ * "*freedp" is incremented for each block that was freed.
+ * Returns the line to continue with, zero when at the end.
+ */
+    linenr_T
+ml_compact_step(buf, lnum, freedp)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	*freedp;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    infoptr_T	*ip;
+    bhdr_T	*hp;
+    bhdr_T	*hp_child;
+    PTR_BL	*pp;
+    PTR_BL	*pp_child;
+    linenr_T	next;
+    int		top;
+    int		level;
+    int		idx;
+    int		dirty;
+
+    if (mfp == NULL || lnum < 1 || lnum > buf->b_ml.ml_line_count)
+	return 0;
+#ifdef FEAT_MMAP
+    /* Changing the tree while lines are still being added is not possible. */
+    if (buf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(buf);
+#endif
+
+    /* Only the stack to the data block is used, blocks are going to be
+     * freed. */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    if (ml_find_line(buf, lnum, ML_FIND) == NULL)
+	return 0;
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    top = buf->b_ml.ml_stack_top - 1;
+    buf->b_ml.ml_stack_top = 0;	    /* stack is invalid after this */
+    next = buf->b_ml.ml_stack[top].ip_high + 1;
+
+    for (level = top; level >= 0; --level)
+    {
+	ip = &(buf->b_ml.ml_stack[level]);
+	if ((hp = mf_get(mfp, ip->ip_bnum, 1)) == NULL)
+	    return 0;
+	pp = (PTR_BL *)(hp->bh_data);
+	if (pp->pb_id != PTR_ID)
+	{
+	    EMSG(_("E317: pointer block id wrong"));
+	    mf_put(mfp, hp, FALSE, FALSE);
+	    return 0;
+	}
+	dirty = FALSE;
+
+	if (level == top)
+	{
+	    /* merge the data blocks below the lowest pointer block */
+	    idx = 0;
+	    while (idx + 1 < (int)pp->pb_count)
+	    {
+		if (ml_merge_entries(mfp, pp, idx, &dirty))
+		    ++*freedp;
+		else
+		    ++idx;
+	    }
+	}
+	else if (ip->ip_index > 0 && ip->ip_index < (int)pp->pb_count)
+	{
+	    /* merge the pointer block below with the one before it */
+	    if (ml_merge_entries(mfp, pp, ip->ip_index - 1, &dirty))
+		++*freedp;
+	}
+
+	/* The root must stay block 1: when there is only one pointer block
+	 * below it, move the entries of that block into the root. */
+	while (level == 0 && pp->pb_count == 1)
+	{
+	    if ((hp_child = ml_get_entry(mfp, pp, 0, &dirty)) == NULL)
+		break;
+	    pp_child = (PTR_BL *)(hp_child->bh_data);
+	    if (pp_child->pb_id != PTR_ID)
+	    {
+		mf_put(mfp, hp_child, FALSE, FALSE);
+		break;
+	    }
+	    mch_memmove(pp->pb_pointer, pp_child->pb_pointer,
+				  (size_t)pp_child->pb_count * sizeof(PTR_EN));
+	    pp->pb_count = pp_child->pb_count;
+	    mf_free(mfp, hp_child);
+	    ++*freedp;
+	    dirty = TRUE;
+	}
+	mf_put(mfp, hp, dirty, FALSE);
+    }
+
+    return next > buf->b_ml.ml_line_count ? 0 : next;
+}
+
+/*
+ * Return TRUE when there is a buffer with blocks that may be merged while
+ * waiting for a character.  Only in Normal mode, elsewhere a pointer to the
+ * text of a line may be in use.
+ */
+    int
+ml_compact_pending()
+{
+    buf_T	*buf;
+
+    if (State != NORMAL)
+	return FALSE;
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	if (buf->b_ml.ml_compact_lnum != 0)
+	    return TRUE;
+    return FALSE;
+}
+
+/*
+ * Called while waiting for the user to type a character: merge the blocks
+ * below one pointer block of a buffer where blocks became sparse.
+ */
+    void
+ml_compact_idle()
+{
+    buf_T	*buf;
+    long	freed = 0;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	if (buf->b_ml.ml_compact_lnum != 0)
+	{
+	    buf->b_ml.ml_compact_lnum = ml_compact_step(buf,
+					    buf->b_ml.ml_compact_lnum, &freed);
+	    break;
+	}
+}
+
+/*
+ * ":memcompact": merge the blocks of the current buffer that are not full and
+ * report the number of blocks freed.
+ */
+    void
+ex_memcompact(eap)
+    exarg_T	*eap UNUSED;
+{
+    linenr_T	lnum = 1;
+    long	freed = 0;
+
+    while (lnum != 0 && !got_int)
+    {
+	lnum = ml_compact_step(curbuf, lnum, &freed);
+	ui_breakcheck();
+    }
+    if (lnum == 0)
+	curbuf->b_ml.ml_compact_lnum = 0;
+    smsg((char_u *)_("%ld blocks reclaimed"), freed);
+}
+
+/*
+ * set the B_MARKED flag for line 'lnum'
+ */
+    void
+ml_setmarked(lnum)
+    linenr_T lnum;
+{
+    bhdr_T    *hp;
+    DATA_BL *dp;
+				    /* invalid line number */
+    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count
+					       || curbuf->b_ml.ml_mfp == NULL)
+	return;			    /* give error message? */
+
+    if (lowest_marked == 0 || lowest_marked > lnum)
+	lowest_marked = lnum;
+
+    /*
+     * find the data block containing the line
      * This also fills the stack with the blocks from the root to the data block
      * This also releases any locked block.
      */
@@ -3382,6 +4106,49 @@ ml_firstmarked()
     return (linenr_T) 0;
 }
 
+/*
+ * Clear the B_MARKED flag of the lines just below "lnum" that have it set, at
+ * most "maxcount" lines.  Used by ":global" to handle a range of marked lines
+ * at once.
+ * Returns the number of lines.
+ */
+    linenr_T
+ml_marked_below(lnum, maxcount)
+    linenr_T	lnum;
+    linenr_T	maxcount;
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    linenr_T	count = 0;
+    int		i;
+
+    if (curbuf->b_ml.ml_mfp == NULL)
+	return (linenr_T)0;
+
+    for (++lnum; count < maxcount && lnum <= curbuf->b_ml.ml_line_count; )
+    {
+	if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
+	    break;
+	dp = (DATA_BL *)(hp->bh_data);
+
+	for (i = lnum - curbuf->b_ml.ml_locked_low; count < maxcount
+			    && lnum <= curbuf->b_ml.ml_locked_high; ++i, ++lnum)
+	{
+	    if (!((dp->db_index[i]) & DB_MARKED))
+	    {
+		maxcount = count;	/* end of the marked lines */
+		break;
+	    }
+	    (dp->db_index[i]) &= DB_INDEX_MASK;
+	    curbuf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+	    ++count;
+	}
+    }
+    if (count > 0)
+	lowest_marked = lnum;
+    return count;
+}
+
 /*
  * clear all DB_MARKED flags
  */
@@ -4967,6 +5734,143 @@ ml_crypt_prepare(mfp, offset, reading)
 #define MLCS_MAXL 800	/* max no of lines in chunk */
 #define MLCS_MINL 400   /* should be half of MLCS_MAXL */
 
+/*
+ * To find the chunk for a line or byte offset quickly, ml_chunktree[] is a
+ * Fenwick tree (binary indexed tree) over ml_chunksize[]: entry "i" (one
+ * based) holds the sum of the lines and bytes of the (i & -i) chunks ending
+ * with chunk "i".  Changing the size of a chunk updates O(log n) entries.
+ * When chunks are split, joined or removed the tree is built again the next
+ * time it is needed, which is O(n).
+ */
+
+/*
+ * Build ml_chunktree[] for the chunks of "buf".
+ * Returns FAIL when out of memory, then byte offsets are not available.
+ */
+    static int
+ml_chunktree_build(buf)
+    buf_T	*buf;
+{
+    int		n = buf->b_ml.ml_usedchunks;
+    int		i;
+    int		j;
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+
+    if (n + 1 > buf->b_ml.ml_chunktree_size)
+    {
+	vim_free(tree);
+	buf->b_ml.ml_chunktree_size = buf->b_ml.ml_numchunks + 1;
+	if (buf->b_ml.ml_chunktree_size < n + 1)
+	    buf->b_ml.ml_chunktree_size = n + 1;
+	tree = (chunksize_T *)alloc((unsigned)(sizeof(chunksize_T)
+					     * buf->b_ml.ml_chunktree_size));
+	buf->b_ml.ml_chunktree = tree;
+	if (tree == NULL)
+	{
+	    buf->b_ml.ml_chunktree_size = 0;
+	    buf->b_ml.ml_chunktree_len = -1;
+	    buf->b_ml.ml_usedchunks = -1;
+	    return FAIL;
+	}
+    }
+
+    mch_memmove(tree + 1, buf->b_ml.ml_chunksize,
+					       (size_t)n * sizeof(chunksize_T));
+    for (i = 1; i <= n; ++i)
+    {
+	j = i + (i & -i);
+	if (j <= n)
+	{
+	    tree[j].mlcs_numlines += tree[i].mlcs_numlines;
+	    tree[j].mlcs_totalsize += tree[i].mlcs_totalsize;
+	}
+    }
+    buf->b_ml.ml_chunktree_len = n;
+    return OK;
+}
+
+/*
+ * Add "lines" and "size" to chunk "idx" (zero based) in ml_chunktree[].
+ * Nothing to do when the tree needs to be built again anyway.
+ */
+    static void
+ml_chunktree_update(buf, idx, lines, size)
+    buf_T	*buf;
+    int		idx;
+    int		lines;
+    long	size;
+{
+    int		i;
+    int		n = buf->b_ml.ml_chunktree_len;
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+
+    if (n != buf->b_ml.ml_usedchunks)
+	return;
+    for (i = idx + 1; i <= n; i += i & -i)
+    {
+	tree[i].mlcs_numlines += lines;
+	tree[i].mlcs_totalsize += size;
+    }
+}
+
+/*
+ * Find the chunk that contains line "lnum", or when "lnum" is zero, the chunk
+ * that contains byte "offset".  When the line or byte is after all chunks the
+ * last chunk is used.
+ * Sets "*curlinep" to the first line in the chunk and "*sizep" to the number
+ * of bytes before it.  When "ffdos" is TRUE a CR is counted for every line,
+ * but only for finding an offset.
+ * Returns the index of the chunk, -1 when out of memory.
+ */
+    static int
+ml_chunk_find(buf, lnum, offset, ffdos, curlinep, sizep)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	offset;
+    int		ffdos;
+    linenr_T	*curlinep;
+    long	*sizep;
+{
+    chunksize_T	*tree;
+    int		n = buf->b_ml.ml_usedchunks - 1;  /* last one never skipped */
+    int		idx = 0;
+    int		step;
+    linenr_T	lines = 0;
+    long	size = 0;
+    linenr_T	next_lines;
+    long	next_size;
+
+    if (buf->b_ml.ml_chunktree_len != buf->b_ml.ml_usedchunks
+					     && ml_chunktree_build(buf) == FAIL)
+	return -1;
+    tree = buf->b_ml.ml_chunktree;
+
+    /* Find the largest number of chunks that are before the line or offset,
+     * going down the tree. */
+    for (step = 1; step * 2 <= n; step *= 2)
+	;
+    for ( ; step > 0; step /= 2)
+    {
+	if (idx + step > n)
+	    continue;
+	next_lines = lines + tree[idx + step].mlcs_numlines;
+	next_size = size + tree[idx + step].mlcs_totalsize;
+	if ((lnum != 0 && lnum >= next_lines + 1)
+		|| (offset != 0 && offset > next_size + ffdos * next_lines))
+	{
+	    idx += step;
+	    lines = next_lines;
+	    size = next_size;
+	}
+    }
+
+    *curlinep = lines + 1;
+    *sizep = size;
+    if (offset != 0 && ffdos)
+	*sizep += lines;
+    return idx;
+}
+
 /*
  * Keep information for finding byte offset of a line, updtype may be one of:
  * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
@@ -5009,6 +5913,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+	buf->b_ml.ml_chunktree_len = -1;
     }
 
     if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
@@ -5020,6 +5925,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
 				  (long)STRLEN(buf->b_ml.ml_line_ptr) + 1;
+	buf->b_ml.ml_chunktree_len = -1;
 	return;
     }
 
@@ -5030,13 +5936,9 @@ ml_updatechunk(buf, line, len, updtype)
     if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
 	    || updtype != ML_CHNK_ADDLINE)
     {
-	for (curline = 1, curix = 0;
-	     curix < buf->b_ml.ml_usedchunks - 1
-	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	     curix++)
-	{
-	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	}
+	curix = ml_chunk_find(buf, line, 0L, FALSE, &curline, &size);
+	if (curix < 0)
+	    return;
     }
     else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
 		 && curix < buf->b_ml.ml_usedchunks - 1)
@@ -5050,6 +5952,8 @@ ml_updatechunk(buf, line, len, updtype)
     if (updtype == ML_CHNK_DELLINE)
 	len = -len;
     curchnk->mlcs_totalsize += len;
+    ml_chunktree_update(buf, curix, updtype == ML_CHNK_ADDLINE ? 1
+				 : updtype == ML_CHNK_DELLINE ? -1 : 0, len);
     if (updtype == ML_CHNK_ADDLINE)
     {
 	curchnk->mlcs_numlines++;
@@ -5122,6 +6026,7 @@ ml_updatechunk(buf, line, len, updtype)
 	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
 	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
 	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree_len = -1;
 	    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	    return;
 	}
@@ -5135,6 +6040,7 @@ ml_updatechunk(buf, line, len, updtype)
 	     */
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree_len = -1;
 	    if (line == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
@@ -5182,6 +6088,7 @@ ml_updatechunk(buf, line, len, updtype)
 	    buf->b_ml.ml_usedchunks--;
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
+	    buf->b_ml.ml_chunktree_len = -1;
 	    return;
 	}
 	else if (curix == 0 || (curchnk->mlcs_numlines > 10
@@ -5195,6 +6102,7 @@ ml_updatechunk(buf, line, len, updtype)
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
+	buf->b_ml.ml_chunktree_len = -1;
 	if (curix < buf->b_ml.ml_usedchunks)
 	{
 	    mch_memmove(buf->b_ml.ml_chunksize + curix,
@@ -5223,7 +6131,6 @@ ml_find_line_or_offset(buf, lnum, offp)
     long	*offp;
 {
     linenr_T	curline;
-    int		curix;
     long	size;
     bhdr_T	*hp;
     DATA_BL	*dp;
@@ -5251,24 +6158,11 @@ ml_find_line_or_offset(buf, lnum, offp)
     if (lnum == 0 && offset <= 0)
 	return 1;   /* Not a "find offset" and offset 0 _must_ be in line 1 */
     /*
-     * Find the last chunk before the one containing our line. Last chunk is
-     * special because it will never qualify
+     * Find the chunk containing our line.  Last chunk is special because it
+     * will never be skipped.
      */
-    curline = 1;
-    curix = size = 0;
-    while (curix < buf->b_ml.ml_usedchunks - 1
-	    && ((lnum != 0
-	     && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-		|| (offset != 0
-	       && offset > size + buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-		      + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines)))
-    {
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-	if (offset && ffdos)
-	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
-    }
+    if (ml_chunk_find(buf, lnum, offset, ffdos, &curline, &size) < 0)
+	return -1;
 
     while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
     {
@@ -5352,6 +6246,9 @@ goto_byte(cnt)
     linenr_T	lnum;
 
     ml_flush_line(curbuf);	/* cached line may be dirty */
+#ifdef FEAT_MMAP
+    ml_mmap_finish(curbuf);
+#endif
     setpcmark();
     if (boff)
 	--boff;
@@ -5380,3 +6277,894 @@ goto_byte(cnt)
 # endif
 }
 #endif
+
+#if defined(FEAT_PERSISTENT_UNDO) || defined(PROTO)
+
+#define MLHC_MINL 16	/* min no of lines in a hash chunk */
+#define MLHC_MAXL 1024	/* max no of lines in a hash chunk */
+#define MLHC_MASK 0x3f	/* a chunk ends after one in 64 lines on average */
+
+/*
+ * The hash of the buffer text that is stored in the undo file is computed
+ * over chunks of lines: ml_hash_root() is the SHA-256 of the SHA-256 of each
+ * chunk.  A chunk ends after a line of which the text hashes to a value with
+ * the MLHC_MASK bits zero.  Thus where a chunk ends only depends on the text,
+ * not on the data blocks or how the text was edited, reading the file again
+ * results in the same hash.
+ * ml_hashchunk[] is only kept after ml_hash_root() was used.  Changing a line
+ * marks the chunk it is in as dirty, only the dirty chunks are hashed again,
+ * until a chunk ends where a chunk ended before.
+ */
+
+/*
+ * Simple hash of the text of a line, used to find the end of a chunk.
+ */
+    static unsigned
+ml_hash_line(p)
+    char_u	*p;
+{
+    unsigned	hash = 0;
+
+    while (*p != NUL)
+	hash = hash * 101 + *p++;
+    return hash ^ (hash >> 12);
+}
+
+/*
+ * "count" lines were inserted at line "lnum" of "buf", or deleted when
+ * negative, or line "lnum" was changed when zero: mark its chunk dirty.
+ * The chunk of the last change is remembered, changes are often near it.
+ */
+    static void
+ml_hash_changed(buf, lnum, count)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	count;
+{
+    hashchunk_T	*chunks = buf->b_ml.ml_hashchunk;
+    int		idx;
+    linenr_T	first;
+
+    if (chunks == NULL)
+	return;
+    idx = buf->b_ml.ml_hashchunk_idx;
+    first = buf->b_ml.ml_hashchunk_lnum;
+    while (idx > 0 && lnum < first)
+	first -= chunks[--idx].mlhc_lines;
+    while (idx < buf->b_ml.ml_hashchunk_len - 1
+				       && lnum >= first + chunks[idx].mlhc_lines)
+	first += chunks[idx++].mlhc_lines;
+    chunks[idx].mlhc_lines += count;
+    chunks[idx].mlhc_dirty = TRUE;
+    buf->b_ml.ml_hashchunk_idx = idx;
+    buf->b_ml.ml_hashchunk_lnum = first;
+}
+
+/*
+ * Forget the chunks of "buf", the next ml_hash_root() hashes all lines.
+ */
+    static void
+ml_hash_free(buf)
+    buf_T	*buf;
+{
+    vim_free(buf->b_ml.ml_hashchunk);
+    buf->b_ml.ml_hashchunk = NULL;
+    buf->b_ml.ml_hashchunk_len = 0;
+}
+
+/*
+ * Compute the hash of the text of "buf" into hash[32].
+ * The first time all lines are hashed, after that only the chunks with
+ * changed lines.
+ */
+    void
+ml_hash_root(buf, hash)
+    buf_T	*buf;
+    char_u	*hash;
+{
+    hashchunk_T		*old = buf->b_ml.ml_hashchunk;
+    int			old_len = buf->b_ml.ml_hashchunk_len;
+    hashchunk_T		all;
+    hashchunk_T		*hc;
+    garray_T		ga;
+    context_sha256_T	root;
+    context_sha256_T	ctx;
+    lineiter_T		iter;
+    char_u		chunk_hash[32];
+    linenr_T		total = 0;
+    linenr_T		lnum;
+    linenr_T		old_end;
+    linenr_T		count;
+    char_u		*p;
+    colnr_T		len;
+    int			i;
+    int			ok = TRUE;
+
+    for (i = 0; i < old_len; ++i)
+	total += old[i].mlhc_lines;
+    if (old == NULL || total != buf->b_ml.ml_line_count)
+    {
+	/* No chunks yet, or they don't match the text: use one dirty chunk
+	 * with all lines. */
+	all.mlhc_lines = buf->b_ml.ml_line_count;
+	all.mlhc_dirty = TRUE;
+	old = &all;
+	old_len = 1;
+    }
+
+    ga_init2(&ga, (int)sizeof(hashchunk_T), 100);
+    sha256_start(&root);
+    lnum = 1;
+    i = 0;
+    while (i < old_len)
+    {
+	if (!old[i].mlhc_dirty)
+	{
+	    /* Lines did not change, the hash is still valid. */
+	    sha256_update(&root, old[i].mlhc_hash, 32);
+	    if (ok && ga_grow(&ga, 1) == OK)
+		((hashchunk_T *)ga.ga_data)[ga.ga_len++] = old[i];
+	    else
+		ok = FALSE;
+	    lnum += old[i].mlhc_lines;
+	    ++i;
+	    continue;
+	}
+
+	/* Hash the lines from "lnum" on until a chunk ends where an old chunk
+	 * ended and the old chunk after it is not dirty. */
+	old_end = lnum - 1;
+	count = 0;
+	sha256_start(&ctx);
+	ml_iter_init(&iter, buf, lnum);
+	for ( ; lnum <= buf->b_ml.ml_line_count; ++lnum)
+	{
+	    p = ml_iter_next(&iter, &len);
+	    sha256_update(&ctx, p, (UINT32_T)(len + 1));
+	    ++count;
+	    if (lnum < buf->b_ml.ml_line_count && count < MLHC_MAXL
+		    && (count < MLHC_MINL || (ml_hash_line(p) & MLHC_MASK) != 0))
+		continue;
+
+	    /* End of a chunk. */
+	    if (ok && ga_grow(&ga, 1) == OK)
+	    {
+		hc = (hashchunk_T *)ga.ga_data + ga.ga_len++;
+		hc->mlhc_lines = count;
+		hc->mlhc_dirty = FALSE;
+		sha256_finish(&ctx, hc->mlhc_hash);
+		sha256_update(&root, hc->mlhc_hash, 32);
+	    }
+	    else
+	    {
+		ok = FALSE;
+		sha256_finish(&ctx, chunk_hash);
+		sha256_update(&root, chunk_hash, 32);
+	    }
+	    count = 0;
+	    sha256_start(&ctx);
+
+	    while (i < old_len && old_end < lnum)
+		old_end += old[i++].mlhc_lines;
+	    if (old_end == lnum)
+	    {
+		while (i < old_len && old[i].mlhc_lines == 0)
+		    ++i;
+		if (i == old_len || !old[i].mlhc_dirty)
+		{
+		    ++lnum;
+		    break;
+		}
+	    }
+	}
+	if (lnum > buf->b_ml.ml_line_count)
+	    i = old_len;
+    }
+    sha256_finish(&root, hash);
+
+    ml_hash_free(buf);
+    if (ok)
+    {
+	buf->b_ml.ml_hashchunk = (hashchunk_T *)ga.ga_data;
+	buf->b_ml.ml_hashchunk_len = ga.ga_len;
+    }
+    else
+	ga_clear(&ga);
+    buf->b_ml.ml_hashchunk_idx = 0;
+    buf->b_ml.ml_hashchunk_lnum = 1;
+}
+#endif
+
+#if defined(FEAT_MMAP) || defined(PROTO)
+/*
+ * A file read with "++mmap" is not copied into data blocks when it is read.
+ * The file is mapped into memory and only scanned for line breaks.  Each data
+ * block gets a negative block number but no memory.  When memfile needs such
+ * a block ml_mmap_read() builds it from the mapped file.  As long as the block
+ * is not changed memfile may drop it again, thus the memory used depends on
+ * what part of the file is looked at, not on the size of the file.
+ * This is like the negative blocks that are filled when starting to edit a
+ * file: recovery reads the lines from the original file.
+ *
+ * Only the start of the file is scanned when it is read, the rest is scanned
+ * while waiting for the user to type a character, see ml_mmap_background().
+ * Lines are only added at the end of the tree, the right-most pointer block
+ * of each level is remembered in mm_spine[].  Before the text is changed or
+ * the whole buffer is needed ml_mmap_finish() scans the rest of the file.
+ */
+typedef struct
+{
+    size_t	mb_offset;	/* offset of the first line in the file */
+    linenr_T	mb_line_count;	/* number of lines in the block */
+    int		mb_page_count;	/* number of pages in the block */
+} mmapblock_T;
+
+#define MM_MAXLEVEL 10		/* enough pointer block levels for any file */
+
+struct mlmmap
+{
+    char_u	*mm_addr;	/* start of the mapped file */
+    size_t	mm_size;	/* size of the mapping */
+    int		mm_fd;		/* file descriptor to check the file */
+    time_t	mm_mtime;	/* modification time of the file */
+    int		mm_changed;	/* file was changed by another program */
+    size_t	mm_len;		/* number of bytes used for lines */
+    size_t	mm_scanned;	/* lines before this offset are in the tree */
+    int		mm_done;	/* no more lines to be added */
+    int		mm_dos;		/* remove a CR before each NL */
+    blocknr_T	mm_bnum;	/* block number of mm_blocks[0], mm_blocks[i]
+				   has number "mm_bnum - i" */
+    long	mm_count;	/* number of used entries in mm_blocks */
+    long	mm_max_count;	/* number of allocated entries in mm_blocks */
+    mmapblock_T	*mm_blocks;	/* info for each data block */
+    int		mm_levels;	/* number of pointer block levels */
+    blocknr_T	mm_spine[MM_MAXLEVEL];	/* last pointer block of each
+					   level, mm_spine[0] is the root */
+};
+
+#define MM_SCAN_SIZE	0x100000L   /* bytes scanned at a time */
+
+static int ml_mmap_add_entry __ARGS((buf_T *buf, int level, blocknr_T bnum, linenr_T line_count, linenr_T old_lnum, int page_count));
+#ifdef FEAT_BYTEOFF
+static void ml_mmap_add_chunk __ARGS((buf_T *buf, linenr_T line_count, long size));
+#endif
+static int ml_mmap_check __ARGS((mlmmap_T *mmp));
+static int ml_mmap_scan __ARGS((buf_T *buf, size_t maxbytes));
+static void ml_mmap_stop __ARGS((buf_T *buf));
+
+static int mmap_loading = 0;	/* number of buffers not scanned completely */
+
+/*
+ * Add an entry for block "bnum" at the end of the pointer block at "level".
+ * When that block is full a new one is added to the level above it.
+ * Returns FAIL when out of memory.
+ */
+    static int
+ml_mmap_add_entry(buf, level, bnum, line_count, old_lnum, page_count)
+    buf_T	*buf;
+    int		level;
+    blocknr_T	bnum;
+    linenr_T	line_count;
+    linenr_T	old_lnum;
+    int		page_count;
+{
+    mlmmap_T	*mmp = buf->b_ml.ml_mmap;
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    bhdr_T	*hp;
+    bhdr_T	*new_hp;
+    PTR_BL	*pp;
+    PTR_BL	*new_pp;
+    PTR_EN	*pe;
+    linenr_T	total;
+    int		i;
+
+    if ((hp = mf_get(mfp, mmp->mm_spine[level], 1)) == NULL)
+	return FAIL;
+    pp = (PTR_BL *)(hp->bh_data);
+    if (pp->pb_count < pp->pb_count_max)
+    {
+	pe = &pp->pb_pointer[pp->pb_count++];
+	pe->pe_bnum = bnum;
+	pe->pe_line_count = line_count;
+	pe->pe_old_lnum = old_lnum;
+	pe->pe_page_count = page_count;
+	mf_put(mfp, hp, TRUE, FALSE);
+
+	/* The last entry of each block above it gets the lines. */
+	while (--level >= 0)
+	{
+	    if ((hp = mf_get(mfp, mmp->mm_spine[level], 1)) == NULL)
+		return FAIL;
+	    pp = (PTR_BL *)(hp->bh_data);
+	    pp->pb_pointer[pp->pb_count - 1].pe_line_count += line_count;
+	    mf_put(mfp, hp, TRUE, FALSE);
+	}
+	return OK;
+    }
+
+    if (level == 0)
+    {
+	/*
+	 * The root is full: move its entries to a new block, which becomes
+	 * the only entry of the root.  Then add the entry again one level
+	 * lower.
+	 */
+	if (mmp->mm_levels == MM_MAXLEVEL || (new_hp = ml_new_ptr(mfp)) == NULL)
+	{
+	    mf_put(mfp, hp, FALSE, FALSE);
+	    return FAIL;
+	}
+	new_pp = (PTR_BL *)(new_hp->bh_data);
+	mch_memmove(new_pp->pb_pointer, pp->pb_pointer,
+					  (size_t)pp->pb_count * sizeof(PTR_EN));
+	new_pp->pb_count = pp->pb_count;
+	total = 0;
+	for (i = 0; i < (int)pp->pb_count; ++i)
+	    total += pp->pb_pointer[i].pe_line_count;
+	pp->pb_count = 1;
+	pp->pb_pointer[0].pe_bnum = new_hp->bh_bnum;
+	pp->pb_pointer[0].pe_line_count = total;
+	pp->pb_pointer[0].pe_old_lnum = new_pp->pb_pointer[0].pe_old_lnum;
+	pp->pb_pointer[0].pe_page_count = 1;
+	mch_memmove(mmp->mm_spine + 2, mmp->mm_spine + 1,
+			       (size_t)(mmp->mm_levels - 1) * sizeof(blocknr_T));
+	mmp->mm_spine[1] = new_hp->bh_bnum;
+	++mmp->mm_levels;
+	mf_put(mfp, new_hp, TRUE, FALSE);
+	mf_put(mfp, hp, TRUE, FALSE);
+	return ml_mmap_add_entry(buf, 1, bnum, line_count, old_lnum,
+								  page_count);
+    }
+
+    /* Start a new block at this level. */
+    mf_put(mfp, hp, FALSE, FALSE);
+    if ((new_hp = ml_new_ptr(mfp)) == NULL)
+	return FAIL;
+    new_pp = (PTR_BL *)(new_hp->bh_data);
+    pe = &new_pp->pb_pointer[0];
+    pe->pe_bnum = bnum;
+    pe->pe_line_count = line_count;
+    pe->pe_old_lnum = old_lnum;
+    pe->pe_page_count = page_count;
+    new_pp->pb_count = 1;
+    mf_put(mfp, new_hp, TRUE, FALSE);
+    if (ml_mmap_add_entry(buf, level - 1, new_hp->bh_bnum, line_count,
+						      old_lnum, 1) == FAIL)
+	return FAIL;
+    mmp->mm_spine[level] = new_hp->bh_bnum;
+    return OK;
+}
+
+#ifdef FEAT_BYTEOFF
+/*
+ * Add "line_count" lines of "size" bytes to the byte offset chunks.
+ */
+    static void
+ml_mmap_add_chunk(buf, line_count, size)
+    buf_T	*buf;
+    linenr_T	line_count;
+    long	size;
+{
+    chunksize_T	*chunks = buf->b_ml.ml_chunksize;
+    chunksize_T	*new_chunks;
+    int		used = buf->b_ml.ml_usedchunks;
+
+    if (used == -1)
+	return;
+    if (used == 0 || chunks[used - 1].mlcs_numlines >= MLCS_MINL)
+    {
+	if (used == buf->b_ml.ml_numchunks)
+	{
+	    if (chunks == NULL)
+		new_chunks = (chunksize_T *)alloc((unsigned)(
+		   sizeof(chunksize_T) * (buf->b_ml.ml_numchunks * 3 / 2 + 100)));
+	    else
+		new_chunks = (chunksize_T *)vim_realloc(chunks,
+		   sizeof(chunksize_T) * (size_t)(buf->b_ml.ml_numchunks * 3 / 2
+									+ 100));
+	    if (new_chunks == NULL)
+	    {
+		/* Out of memory: no byte offsets for this buffer. */
+		vim_free(chunks);
+		buf->b_ml.ml_chunksize = NULL;
+		buf->b_ml.ml_numchunks = 0;
+		buf->b_ml.ml_usedchunks = -1;
+		return;
+	    }
+	    buf->b_ml.ml_chunksize = chunks = new_chunks;
+	    buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2 + 100;
+	}
+	chunks[used].mlcs_numlines = 0;
+	chunks[used].mlcs_totalsize = 0;
+	buf->b_ml.ml_usedchunks = ++used;
+	buf->b_ml.ml_chunktree_len = -1;
+    }
+    chunks[used - 1].mlcs_numlines += line_count;
+    chunks[used - 1].mlcs_totalsize += size;
+    ml_chunktree_update(buf, used - 1, (int)line_count, size);
+}
+#endif
+
+/*
+ * Check that the mapped file was not changed by another program: the text
+ * would be different, and using a part that was truncated causes a SIGBUS.
+ * Returns FAIL when it was changed, the error message is given only once.
+ */
+    static int
+ml_mmap_check(mmp)
+    mlmmap_T	*mmp;
+{
+    struct stat	st;
+
+    if (mmp->mm_changed)
+	return FAIL;
+    if (fstat(mmp->mm_fd, &st) == 0 && (size_t)st.st_size == mmp->mm_size
+					       && st.st_mtime == mmp->mm_mtime)
+	return OK;
+    mmp->mm_changed = TRUE;
+    EMSG(_("E894: The mapped file was changed by another program"));
+    return FAIL;
+}
+
+/*
+ * Scan about "maxbytes" more of the file mapped for "buf" and add data blocks
+ * for the lines found to the tree.  Lines that do not fill a data block are
+ * left for the next time, unless at the end of the file.
+ * Returns FAIL when out of memory or a line is too long.
+ */
+    static int
+ml_mmap_scan(buf, maxbytes)
+    buf_T	*buf;
+    size_t	maxbytes;
+{
+    mlmmap_T	*mmp = buf->b_ml.ml_mmap;
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    mmapblock_T	*mbp;
+    mmapblock_T	*new_blocks;
+    char_u	*p;
+    char_u	*end;
+    char_u	*stop;
+    char_u	*nl;
+    size_t	len;
+    size_t	need;
+    size_t	page_size = mfp->mf_page_size;
+    long	size;
+
+    if (ml_mmap_check(mmp) == FAIL)
+	return FAIL;
+    p = mmp->mm_addr + mmp->mm_scanned;
+    end = mmp->mm_addr + mmp->mm_len;
+    stop = (size_t)(end - p) > maxbytes ? p + maxbytes : end;
+
+    /* The pointer blocks are going to change.  The cached line points into
+     * the locked block, which may be released. */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    buf->b_ml.ml_stack_top = 0;
+
+    while (p < stop)
+    {
+	if (mmp->mm_count == mmp->mm_max_count)
+	{
+	    new_blocks = (mmapblock_T *)vim_realloc(mmp->mm_blocks,
+		     (size_t)(mmp->mm_max_count * 2 + 1000) * sizeof(mmapblock_T));
+	    if (new_blocks == NULL)
+		return FAIL;
+	    mmp->mm_blocks = new_blocks;
+	    mmp->mm_max_count = mmp->mm_max_count * 2 + 1000;
+	}
+
+	/* The block numbers must be consecutive, nothing else may take a
+	 * negative number. */
+	if (mfp->mf_blocknr_min != mmp->mm_bnum - mmp->mm_count)
+	    return FAIL;
+
+	/*
+	 * Find the lines for the data block, filling it like ml_append()
+	 * would.  A line that does not fit in a page gets a block of its own.
+	 */
+	mbp = &mmp->mm_blocks[mmp->mm_count];
+	mbp->mb_offset = p - mmp->mm_addr;
+	mbp->mb_line_count = 0;
+	need = HEADER_SIZE;
+	size = 0;
+	while (p < end)
+	{
+	    nl = (char_u *)memchr(p, NL, end - p);
+	    len = (nl == NULL ? end : nl) - p;
+	    if (mmp->mm_dos && nl != NULL && len > 0 && nl[-1] == CAR)
+		--len;
+	    if (len >= (size_t)MAXCOL - page_size)
+		return FAIL;	/* line too long for a data block */
+	    if (mbp->mb_line_count > 0
+				   && need + len + 1 + INDEX_SIZE > page_size)
+		break;
+	    need += len + 1 + INDEX_SIZE;
+	    size += (long)len + 1;
+	    ++mbp->mb_line_count;
+	    p = (nl == NULL ? end : nl + 1);
+	}
+	mbp->mb_page_count = (int)((need + page_size - 1) / page_size);
+
+	if (ml_mmap_add_entry(buf, mmp->mm_levels - 1,
+		    mmp->mm_bnum - mmp->mm_count, mbp->mb_line_count,
+		    buf->b_ml.ml_line_count + 1, mbp->mb_page_count) == FAIL)
+	    return FAIL;
+	--mfp->mf_blocknr_min;
+	++mmp->mm_count;
+#ifdef FEAT_PERSISTENT_UNDO
+	ml_hash_changed(buf, buf->b_ml.ml_line_count + 1,
+						      (long)mbp->mb_line_count);
+#endif
+	buf->b_ml.ml_line_count += mbp->mb_line_count;
+#ifdef FEAT_BYTEOFF
+	ml_mmap_add_chunk(buf, mbp->mb_line_count, size);
+#endif
+	mmp->mm_scanned = p - mmp->mm_addr;
+    }
+    return OK;
+}
+
+/*
+ * Stop scanning the mapped file of "buf".
+ */
+    static void
+ml_mmap_stop(buf)
+    buf_T	*buf;
+{
+    mlmmap_T	*mmp = buf->b_ml.ml_mmap;
+
+    if (!mmp->mm_done)
+    {
+	mmp->mm_done = TRUE;
+	--mmap_loading;
+    }
+}
+
+/*
+ * Use the file "fd" of "size" bytes for the lines of "buf", which must be
+ * empty.  The file is mapped into memory and the start of it is scanned for
+ * line breaks, the data blocks are built when they are needed.
+ * When "ffdos" is TRUE a CR before a NL is removed.
+ * "*noeolp" is set when the last line does not end in a NL.
+ * Returns FAIL when the file can't be used this way, "buf" is unchanged then.
+ */
+    int
+ml_mmap_open(buf, fd, size, ffdos, noeolp)
+    buf_T	*buf;
+    int		fd;
+    off_t	size;
+    int		ffdos;
+    int		*noeolp;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    mlmmap_T	*mmp;
+    char_u	*addr;
+    char_u	*end;
+    bhdr_T	*hp;
+    bhdr_T	*data_hp;
+    PTR_BL	*pp;
+    struct stat	st;
+    int		mm_fd;
+
+    if (mfp == NULL || buf->b_ml.ml_mmap != NULL
+	    || !(buf->b_ml.ml_flags & ML_EMPTY)
+	    || size <= 0 || (off_t)(size_t)size != size
+	    || fstat(fd, &st) < 0)
+	return FAIL;
+
+    /*
+     * The tree of the empty buffer must be a root with one data block.
+     */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    if ((hp = mf_get(mfp, (blocknr_T)1, 1)) == NULL)
+	return FAIL;
+    pp = (PTR_BL *)(hp->bh_data);
+    data_hp = NULL;
+    if (pp->pb_id == PTR_ID && pp->pb_count == 1
+				       && pp->pb_pointer[0].pe_bnum >= 0)
+	data_hp = mf_get(mfp, pp->pb_pointer[0].pe_bnum,
+					    pp->pb_pointer[0].pe_page_count);
+    if (data_hp != NULL && ((DATA_BL *)(data_hp->bh_data))->db_id != DATA_ID)
+    {
+	mf_put(mfp, data_hp, FALSE, FALSE);
+	data_hp = NULL;
+    }
+    if (data_hp == NULL)
+    {
+	mf_put(mfp, hp, FALSE, FALSE);
+	return FAIL;
+    }
+
+    /* The file is kept open to check that it wasn't changed. */
+    mmp = NULL;
+    mm_fd = dup(fd);
+    addr = (char_u *)MAP_FAILED;
+    if (mm_fd >= 0)
+    {
+# ifdef HAVE_FD_CLOEXEC
+	int fdflags = fcntl(mm_fd, F_GETFD);
+	if (fdflags >= 0 && (fdflags & FD_CLOEXEC) == 0)
+	    fcntl(mm_fd, F_SETFD, fdflags | FD_CLOEXEC);
+# endif
+	addr = (char_u *)mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd,
+								   (off_t)0);
+    }
+    if (addr != (char_u *)MAP_FAILED
+	    && (mmp = (mlmmap_T *)alloc_clear((unsigned)sizeof(mlmmap_T)))
+								       == NULL)
+	munmap(addr, (size_t)size);
+    if (mmp == NULL)
+    {
+	if (mm_fd >= 0)
+	    close(mm_fd);
+	mf_put(mfp, data_hp, FALSE, FALSE);
+	mf_put(mfp, hp, FALSE, FALSE);
+	return FAIL;
+    }
+    mmp->mm_addr = addr;
+    mmp->mm_size = (size_t)size;
+    mmp->mm_fd = mm_fd;
+    mmp->mm_mtime = st.st_mtime;
+    mmp->mm_dos = ffdos;
+
+    /* In Dos format a CTRL-Z at the end of the file is ignored, unless
+     * 'binary' is set. */
+    end = addr + (size_t)size;
+    if (ffdos && !buf->b_p_bin && end[-1] == Ctrl_Z
+					     && (end - 1 == addr || end[-2] == NL))
+	--end;
+    mmp->mm_len = end - addr;
+    *noeolp = (end > addr && end[-1] != NL);
+
+    /* Replace the empty line with the lines of the file. */
+    mf_free(mfp, data_hp);
+    pp->pb_count = 0;
+    mf_put(mfp, hp, TRUE, FALSE);
+    mmp->mm_bnum = mfp->mf_blocknr_min;
+    mmp->mm_levels = 1;
+    mmp->mm_spine[0] = 1;
+    buf->b_ml.ml_mmap = mmp;
+    buf->b_ml.ml_line_count = 0;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    mfp->mf_lazy = TRUE;
+#ifdef FEAT_PERSISTENT_UNDO
+    ml_hash_free(buf);
+#endif
+#ifdef FEAT_BYTEOFF
+    buf->b_ml.ml_usedchunks = 0;
+    if (buf->b_ml.ml_chunksize == NULL)
+	buf->b_ml.ml_numchunks = 0;	/* may be left from a previous file */
+#endif
+    ++mmap_loading;
+
+    /* Scan enough for the first screen now, a line may be longer though. */
+    if (ml_mmap_scan(buf, (size_t)(Rows * Columns) + 1) == FAIL
+				       || buf->b_ml.ml_line_count == 0)
+    {
+	ml_mmap_stop(buf);
+	if (buf->b_ml.ml_line_count == 0)
+	{
+	    /* Nothing usable, restore an empty buffer.  Since the memline
+	     * can't easily be put back close and open it. */
+	    ml_close(buf, TRUE);
+	    (void)ml_open(buf);
+	    return FAIL;
+	}
+    }
+    else if (mmp->mm_scanned >= mmp->mm_len)
+	ml_mmap_stop(buf);
+    return OK;
+}
+
+/*
+ * Return TRUE when a buffer read with "++mmap" still has lines to be added.
+ */
+    int
+ml_mmap_loading()
+{
+    return mmap_loading > 0;
+}
+
+/*
+ * Add the rest of the lines of "buf", if it was read with "++mmap".  Used
+ * before the text is changed or when all lines are needed.
+ */
+    void
+ml_mmap_finish(buf)
+    buf_T	*buf;
+{
+    mlmmap_T	*mmp = buf->b_ml.ml_mmap;
+
+    if (mmp != NULL && !mmp->mm_done)
+    {
+	if (ml_mmap_scan(buf, mmp->mm_len - mmp->mm_scanned) == FAIL)
+	    EMSG(_("E891: Cannot add all lines of the mapped file"));
+	ml_mmap_stop(buf);
+    }
+}
+
+/*
+ * Called while waiting for the user to type a character: add the next lines
+ * of a file read with "++mmap" and show the new line count.
+ */
+    void
+ml_mmap_background()
+{
+    static int	count = 0;
+    buf_T	*buf;
+    mlmmap_T	*mmp = NULL;
+    win_T	*wp;
+    linenr_T	old_line_count;
+    int		done = TRUE;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+    {
+	mmp = buf->b_ml.ml_mmap;
+	if (mmp != NULL && !mmp->mm_done)
+	    break;
+    }
+    if (buf == NULL)
+    {
+	mmap_loading = 0;
+	return;
+    }
+
+    old_line_count = buf->b_ml.ml_line_count;
+    if (ml_mmap_scan(buf, MM_SCAN_SIZE) == FAIL)
+	EMSG(_("E891: Cannot add all lines of the mapped file"));
+    else if (mmp->mm_scanned < mmp->mm_len)
+	done = FALSE;
+    if (done)
+	ml_mmap_stop(buf);
+
+    /* A window that showed the end of the buffer shows more lines now. */
+    FOR_ALL_WINDOWS(wp)
+	if (wp->w_buffer == buf)
+	{
+	    if (wp->w_botline > old_line_count)
+		redraw_win_later(wp, NOT_VALID);
+	    wp->w_redr_status = TRUE;
+	}
+
+    /* Only redraw now and then, but always when done.  Not when the
+     * command line or a prompt is being used. */
+    if ((done || ++count >= 20) && !(State & CMDLINE) && State < HITRETURN
+								&& redrawing())
+    {
+	count = 0;
+	update_topline();
+	validate_cursor();
+	update_screen(0);
+	showruler(FALSE);
+	setcursor();
+	out_flush();
+    }
+}
+
+/*
+ * Build the data block "hp" from the mapped file.  Called by memfile for a
+ * negative block number that is not in memory.  When the file was changed by
+ * another program the lines are empty.
+ * Returns FAIL if "hp" is not a block of a file read with "++mmap".
+ */
+    int
+ml_mmap_read(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    mlmmap_T	*mmp = mfp->mf_buffer->b_ml.ml_mmap;
+    mmapblock_T	*mbp;
+    DATA_BL	*dp;
+    char_u	*p;
+    char_u	*end;
+    char_u	*nl;
+    char_u	*text;
+    char_u	*s;
+    size_t	len;
+    unsigned	txt_start;
+    long	idx;
+    linenr_T	i;
+    int		changed;
+
+    if (mmp == NULL)
+	return FAIL;
+    idx = (long)(mmp->mm_bnum - hp->bh_bnum);
+    if (idx < 0 || idx >= mmp->mm_count)
+	return FAIL;
+    mbp = &mmp->mm_blocks[idx];
+    if (mbp->mb_page_count != hp->bh_page_count)
+	return FAIL;
+    changed = ml_mmap_check(mmp) == FAIL;
+
+    p = mmp->mm_addr + mbp->mb_offset;
+    if (idx + 1 < mmp->mm_count)
+	end = mmp->mm_addr + mbp[1].mb_offset;
+    else
+	end = mmp->mm_addr + mmp->mm_scanned;
+
+    dp = (DATA_BL *)(hp->bh_data);
+    dp->db_id = DATA_ID;
+    txt_start = hp->bh_page_count * mfp->mf_page_size;
+    dp->db_txt_end = txt_start;
+    for (i = 0; i < mbp->mb_line_count; ++i)
+    {
+	if (changed)
+	{
+	    --txt_start;
+	    *((char_u *)dp + txt_start) = NUL;
+	    dp->db_index[i] = txt_start;
+	    continue;
+	}
+	nl = (char_u *)memchr(p, NL, end - p);
+	len = (nl == NULL ? end : nl) - p;
+	if (mmp->mm_dos && nl != NULL && len > 0 && nl[-1] == CAR)
+	    --len;
+	txt_start -= (unsigned)len + 1;
+	text = (char_u *)dp + txt_start;
+	mch_memmove(text, p, len);
+	text[len] = NUL;
+	/* NULs are replaced by newlines! */
+	for (s = text; (s = (char_u *)memchr(s, NUL, text + len - s)) != NULL;)
+	    *s++ = NL;
+	dp->db_index[i] = txt_start;
+	p = (nl == NULL ? end : nl + 1);
+    }
+    dp->db_txt_start = txt_start;
+    dp->db_line_count = mbp->mb_line_count;
+    dp->db_free = txt_start - (unsigned)(HEADER_SIZE
+					     + mbp->mb_line_count * INDEX_SIZE);
+    return OK;
+}
+
+/*
+ * Make the lines of "buf" no longer depend on the mapped file: build all data
+ * blocks that are not in memory and mark them changed, so that they are kept
+ * in memory or written to the swap file.  Must be done before the file is
+ * overwritten.
+ * Returns FAIL when a block could not be built, the file is still used then.
+ */
+    int
+ml_mmap_detach(buf)
+    buf_T	*buf;
+{
+    linenr_T	lnum;
+
+    if (buf->b_ml.ml_mmap == NULL)
+	return OK;
+
+    ml_mmap_finish(buf);
+    ml_flush_line(buf);
+    for (lnum = 1; lnum <= buf->b_ml.ml_line_count;
+					     lnum = buf->b_ml.ml_locked_high + 1)
+    {
+	if (ml_find_line(buf, lnum, ML_FIND) == NULL)
+	    return FAIL;
+	buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    }
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+
+    buf->b_ml.ml_mfp->mf_lazy = FALSE;
+    ml_mmap_free(buf->b_ml.ml_mmap);
+    buf->b_ml.ml_mmap = NULL;
+    return OK;
+}
+
+/*
+ * Unmap the file and free the info in "mmp".
+ */
+    static void
+ml_mmap_free(mmp)
+    mlmmap_T	*mmp;
+{
+    if (mmp == NULL)
+	return;
+    if (!mmp->mm_done)
+	--mmap_loading;
+    munmap(mmp->mm_addr, mmp->mm_size);
+    close(mmp->mm_fd);
+    vim_free(mmp->mm_blocks);
+    vim_free(mmp);
+}
+#endif
@@ -1877,7 +1877,9 @@ vim_strchr(string, c)
     int		c;
 {
     char_u	*p;
+#ifdef FEAT_MBYTE
     int		b;
+#endif
 
     p = string;
 #ifdef FEAT_MBYTE
@@ -1904,7 +1906,9 @@ vim_strchr(string, c)
 	}
 	return NULL;
     }
-    if (has_mbyte)
+    /* In UTF-8 an ASCII byte is never part of a multi-byte character, but
+     * for a double-byte encoding a trail byte may be equal to "c". */
+    if (enc_dbcs != 0)
     {
 	while ((b = *p) != NUL)
 	{
@@ -1915,13 +1919,7 @@ vim_strchr(string, c)
 	return NULL;
     }
 #endif
-    while ((b = *p) != NUL)
-    {
-	if (b == c)
-	    return p;
-	++p;
-    }
-    return NULL;
+    return vim_strbyte(p, c);
 }
 
 /*
@@ -1934,15 +1932,11 @@ vim_strbyte(string, c)
     char_u	*string;
     int		c;
 {
-    char_u	*p = string;
-
-    while (*p != NUL)
-    {
-	if (*p == c)
-	    return p;
-	++p;
-    }
-    return NULL;
+    /* The library strchr() is usually a lot faster than a loop, it checks
+     * several bytes at a time. */
+    if (c <= 0 || c > 255)
+	return NULL;
+    return (char_u *)strchr((char *)string, c);
 }
 
 /*
@@ -3494,6 +3494,7 @@ netbeans_is_guarded(linenr_T top, linenr_T bot)
     if (!NETBEANS_OPEN)
 	return FALSE;
 
+    sign_adjust_flush(curbuf);
     for (p = curbuf->b_signlist; p != NULL; p = p->next)
 	if (p->id >= GUARDEDOFFSET)
 	    for (lnum = top + 1; lnum < bot; lnum++)
@@ -3578,6 +3579,7 @@ netbeans_gutter_click(linenr_T lnum)
     if (!NETBEANS_OPEN)
 	return;
 
+    sign_adjust_flush(curbuf);
     for (p = curbuf->b_signlist; p != NULL; p = p->next)
     {
 	if (p->lnum == lnum && p->next && p->next->lnum == lnum)
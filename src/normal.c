@@ -6815,6 +6815,9 @@ nv_percent(cap)
 	{
 	    cap->oap->motion_type = MLINE;
 	    setpcmark();
+#ifdef FEAT_MMAP
+	    ml_mmap_finish(curbuf);
+#endif
 	    /* Round up, so CTRL-G will give same value.  Watch out for a
 	     * large line count, the line number must not go negative! */
 	    if (curbuf->b_ml.ml_line_count > 1000000)
@@ -8914,6 +8917,12 @@ nv_goto(cap)
 {
     linenr_T	lnum;
 
+#ifdef FEAT_MMAP
+    /* "G" goes to the last line, also when still adding lines. */
+    if ((cap->arg && cap->count0 == 0)
+			       || cap->count0 > curbuf->b_ml.ml_line_count)
+	ml_mmap_finish(curbuf);
+#endif
     if (cap->arg)
 	lnum = curbuf->b_ml.ml_line_count;
     else
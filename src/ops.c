@@ -6810,6 +6810,12 @@ cursor_pos_info()
     pos_T	min_pos, max_pos;
     oparg_T	oparg;
     struct block_def	bd;
+    lineiter_T	iter;
+
+#ifdef FEAT_MMAP
+    /* All lines are counted, add the ones not found yet. */
+    ml_mmap_finish(curbuf);
+#endif
 
     /*
      * Compute the length of the file in characters.
@@ -6869,6 +6875,7 @@ cursor_pos_info()
 	    line_count_selected = max_pos.lnum - min_pos.lnum + 1;
 	}
 
+	ml_iter_init(&iter, curbuf, (linenr_T)1);
 	for (lnum = 1; lnum <= curbuf->b_ml.ml_line_count; ++lnum)
 	{
 	    /* Check for a CTRL-C every 100000 characters. */
@@ -6941,8 +6948,8 @@ cursor_pos_info()
 		}
 	    }
 	    /* Add to the running totals */
-	    byte_count += line_count_info(ml_get(lnum), &word_count,
-					 &char_count, (long)MAXCOL, eol_size);
+	    byte_count += line_count_info(ml_iter_next(&iter, NULL),
+			   &word_count, &char_count, (long)MAXCOL, eol_size);
 	}
 
 	/* Correction for when last line doesn't have an EOL. */
@@ -2510,6 +2510,13 @@ static struct vimoption
     {"swapsync",    "sws",  P_STRING|P_VI_DEF,
 			    (char_u *)&p_sws, PV_NONE,
 			    {(char_u *)"fsync", (char_u *)0L} SCRIPTID_INIT},
+    {"swapthread",  "swt",  P_BOOL|P_VI_DEF,
+#ifdef FEAT_SWAP_THREAD
+			    (char_u *)&p_swt, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
     {"switchbuf",   "swb",  P_STRING|P_VI_DEF|P_COMMA|P_NODUP,
 			    (char_u *)&p_swb, PV_NONE,
 			    {(char_u *)"", (char_u *)0L} SCRIPTID_INIT},
@@ -2531,6 +2538,20 @@ static struct vimoption
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"syntaxahead", "sya",  P_NUM|P_VI_DEF,
+#ifdef FEAT_SYN_HL
+			    (char_u *)&p_sya, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
+    {"syntaxcache", "syc",  P_BOOL|P_VI_DEF,
+#if defined(FEAT_SYN_HL) && defined(FEAT_PERSISTENT_UNDO)
+			    (char_u *)&p_syc, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
     {"tabline",	    "tal",  P_STRING|P_VI_DEF|P_RALL,
 #ifdef FEAT_STL_OPT
 			    (char_u *)&p_tal, PV_NONE,
@@ -2720,6 +2741,9 @@ static struct vimoption
 			    (char_u *)100L,
 #endif
 				(char_u *)0L} SCRIPTID_INIT},
+    {"undomaxmem",  "umm",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_umm, PV_NONE,
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"undoreload",  "ur",   P_NUM|P_VI_DEF,
 			    (char_u *)&p_ur, PV_NONE,
 			    { (char_u *)10000L, (char_u *)0L} SCRIPTID_INIT},
@@ -8692,6 +8716,13 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	errmsg = e_positive;
 	p_report = 1;
     }
+#ifdef FEAT_SYN_HL
+    if (p_sya < 0)
+    {
+	errmsg = e_positive;
+	p_sya = 0;
+    }
+#endif
     if ((p_sj < -100 || p_sj >= Rows) && full_screen)
     {
 	if (Rows != old_Rows)	/* Rows changed, just adjust p_sj */
@@ -762,6 +762,9 @@ EXTERN int	p_spr;		/* 'splitright' */
 EXTERN int	p_sol;		/* 'startofline' */
 EXTERN char_u	*p_su;		/* 'suffixes' */
 EXTERN char_u	*p_sws;		/* 'swapsync' */
+#ifdef FEAT_SWAP_THREAD
+EXTERN int	p_swt;		/* 'swapthread' */
+#endif
 EXTERN char_u	*p_swb;		/* 'switchbuf' */
 EXTERN unsigned	swb_flags;
 #ifdef IN_OPTION_C
@@ -771,6 +774,12 @@ static char *(p_swb_values[]) = {"useopen", "usetab", "split", "newtab", NULL};
 #define SWB_USETAB		0x002
 #define SWB_SPLIT		0x004
 #define SWB_NEWTAB		0x008
+#ifdef FEAT_SYN_HL
+EXTERN long	p_sya;		/* 'syntaxahead' */
+# ifdef FEAT_PERSISTENT_UNDO
+EXTERN int	p_syc;		/* 'syntaxcache' */
+# endif
+#endif
 EXTERN int	p_tbs;		/* 'tagbsearch' */
 EXTERN long	p_tl;		/* 'taglength' */
 EXTERN int	p_tr;		/* 'tagrelative' */
@@ -840,6 +849,7 @@ static char *(p_ttym_values[]) = {"xterm", "xterm2", "dec", "netterm", "jsbterm"
 #endif
 EXTERN char_u	*p_udir;	/* 'undodir' */
 EXTERN long	p_ul;		/* 'undolevels' */
+EXTERN long	p_umm;		/* 'undomaxmem' */
 EXTERN long	p_ur;		/* 'undoreload' */
 EXTERN long	p_uc;		/* 'updatecount' */
 EXTERN long	p_ut;		/* 'updatetime' */
@@ -413,6 +413,21 @@ mch_inchar(buf, maxlen, wtime, tb_change_cnt)
     }
     else	/* wtime == -1 */
     {
+#ifdef FEAT_MMAP
+	/* Continue adding the lines of a file read with "++mmap" until a
+	 * character is typed. */
+	while (ml_mmap_loading() && WaitForChar(0L) == 0)
+	    ml_mmap_background();
+#endif
+#ifdef FEAT_SYN_HL
+	/* Compute the syntax state below the window, see 'syntaxahead'. */
+	while (syn_idle_pending() && WaitForChar(0L) == 0)
+	    syn_idle_update();
+#endif
+	/* Merge sparse memline blocks after lines were deleted. */
+	while (ml_compact_pending() && WaitForChar(0L) == 0)
+	    ml_compact_idle();
+
 	/*
 	 * If there is no character available within 'updatetime' seconds
 	 * flush all the swap files to disk.
@@ -65,6 +65,7 @@ void buf_delete_signs __ARGS((buf_T *buf));
 void buf_delete_all_signs __ARGS((void));
 void sign_list_placed __ARGS((buf_T *rbuf));
 void sign_mark_adjust __ARGS((linenr_T line1, linenr_T line2, long amount, long amount_after));
+void sign_adjust_flush __ARGS((buf_T *buf));
 void set_buflisted __ARGS((int on));
 int buf_contents_changed __ARGS((buf_T *buf));
 void wipe_buffer __ARGS((buf_T *buf, int aucmd));
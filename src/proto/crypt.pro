@@ -1,6 +1,7 @@
 /* crypt.c */
 int crypt_method_nr_from_name __ARGS((char_u *name));
 int crypt_method_nr_from_magic __ARGS((char *ptr, int len));
+int crypt_has_magic __ARGS((char *ptr, int len));
 int crypt_works_inplace __ARGS((cryptstate_T *state));
 int crypt_get_method_nr __ARGS((buf_T *buf));
 int crypt_whole_undofile __ARGS((int method_nr));
@@ -38,7 +38,7 @@ int check_secure __ARGS((void));
 void do_sub __ARGS((exarg_T *eap));
 int do_sub_msg __ARGS((int count_only));
 void ex_global __ARGS((exarg_T *eap));
-void global_exe __ARGS((char_u *cmd));
+void global_exe __ARGS((char_u *cmd, linenr_T count));
 int read_viminfo_sub_string __ARGS((vir_T *virp, int force));
 void write_viminfo_sub_string __ARGS((FILE *fp));
 void free_old_sub __ARGS((void));
@@ -18,6 +18,8 @@ void ex_delmarks __ARGS((exarg_T *eap));
 void ex_jumps __ARGS((exarg_T *eap));
 void ex_changes __ARGS((exarg_T *eap));
 void mark_adjust __ARGS((linenr_T line1, linenr_T line2, long amount, long amount_after));
+int markadj_add __ARGS((garray_T *gap, linenr_T line1, linenr_T line2, long amount, long amount_after, int keep_deleted));
+int markadj_lnum __ARGS((markadj_T *ma, int count, linenr_T *lp, int keep_deleted));
 void mark_col_adjust __ARGS((linenr_T lnum, colnr_T mincol, long lnum_amount, long col_amount));
 void copy_jumplist __ARGS((win_T *from, win_T *to));
 void free_jumplist __ARGS((win_T *wp));
@@ -15,4 +15,5 @@ blocknr_T mf_trans_del __ARGS((memfile_T *mfp, blocknr_T old_nr));
 void mf_set_ffname __ARGS((memfile_T *mfp));
 void mf_fullname __ARGS((memfile_T *mfp));
 int mf_need_trans __ARGS((memfile_T *mfp));
+int mf_bg_wait __ARGS((memfile_T *mfp));
 /* vim: set ft=c : */
@@ -19,12 +19,20 @@ char_u *ml_get_curline __ARGS((void));
 char_u *ml_get_cursor __ARGS((void));
 char_u *ml_get_buf __ARGS((buf_T *buf, linenr_T lnum, int will_change));
 int ml_line_alloced __ARGS((void));
+void ml_iter_init __ARGS((lineiter_T *lip, buf_T *buf, linenr_T lnum));
+char_u *ml_iter_next __ARGS((lineiter_T *lip, colnr_T *lenp));
 int ml_append __ARGS((linenr_T lnum, char_u *line, colnr_T len, int newfile));
 int ml_append_buf __ARGS((buf_T *buf, linenr_T lnum, char_u *line, colnr_T len, int newfile));
+int ml_append_lines __ARGS((linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 int ml_replace __ARGS((linenr_T lnum, char_u *line, int copy));
 int ml_delete __ARGS((linenr_T lnum, int message));
+linenr_T ml_compact_step __ARGS((buf_T *buf, linenr_T lnum, long *freedp));
+int ml_compact_pending __ARGS((void));
+void ml_compact_idle __ARGS((void));
+void ex_memcompact __ARGS((exarg_T *eap));
 void ml_setmarked __ARGS((linenr_T lnum));
 linenr_T ml_firstmarked __ARGS((void));
+linenr_T ml_marked_below __ARGS((linenr_T lnum, linenr_T maxcount));
 void ml_clearmarked __ARGS((void));
 int resolve_symlink __ARGS((char_u *fname, char_u *buf));
 char_u *makeswapname __ARGS((char_u *fname, char_u *ffname, buf_T *buf, char_u *dir_name));
@@ -34,4 +42,11 @@ char_u *ml_encrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsi
 void ml_decrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
 long ml_find_line_or_offset __ARGS((buf_T *buf, linenr_T lnum, long *offp));
 void goto_byte __ARGS((long cnt));
+void ml_hash_root __ARGS((buf_T *buf, char_u *hash));
+int ml_mmap_open __ARGS((buf_T *buf, int fd, off_t size, int ffdos, int *noeolp));
+int ml_mmap_loading __ARGS((void));
+void ml_mmap_finish __ARGS((buf_T *buf));
+void ml_mmap_background __ARGS((void));
+int ml_mmap_read __ARGS((memfile_T *mfp, bhdr_T *hp));
+int ml_mmap_detach __ARGS((buf_T *buf));
 /* vim: set ft=c : */
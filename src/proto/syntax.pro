@@ -1,5 +1,8 @@
 /* syntax.c */
 void syntax_start __ARGS((win_T *wp, linenr_T lnum));
+int syn_idle_pending __ARGS((void));
+void syn_idle_update __ARGS((void));
+void syn_cache_write __ARGS((buf_T *buf));
 void syn_stack_free_all __ARGS((synblock_T *block));
 void syn_stack_apply_changes __ARGS((buf_T *buf));
 void syntax_end_parsing __ARGS((linenr_T lnum));
@@ -13,6 +13,10 @@
 
 #include "vim.h"
 
+#ifdef FEAT_VIMGREP_THREAD
+# include <pthread.h>
+#endif
+
 #if defined(FEAT_QUICKFIX) || defined(PROTO)
 
 struct dir_stack_T
@@ -76,6 +80,8 @@ struct qf_info_S
 
 static qf_info_T ql_info;	/* global quickfix list */
 
+static int qf_adjust_pending = FALSE;	/* line changes in b_qf_adjust */
+
 #define FMT_PATTERNS 10		/* maximum number of % recognized */
 
 /*
@@ -106,6 +112,48 @@ struct efm_S
     int		    conthere;	/* %> used */
 };
 
+/*
+ * A match found by ":vimgrep" in a file that was read without loading it
+ * into a buffer, before it is added to the quickfix list.
+ */
+typedef struct vgrmatch_S vgrmatch_T;
+struct vgrmatch_S
+{
+    vgrmatch_T	*vm_next;	/* next match in the same file */
+    long	vm_lnum;	/* line number of the match */
+    colnr_T	vm_col;		/* byte index of the match in the line */
+    char_u	vm_line[1];	/* text of the line, actually longer */
+};
+
+#ifdef FEAT_VIMGREP_THREAD
+# define VGR_THREAD_MAX 16	/* max number of threads */
+
+/*
+ * A file to be searched for ":vimgrep" by one of the threads.
+ */
+typedef struct
+{
+    char_u	*vf_fname;	/* file name, relative to the start dir */
+    int		vf_state;	/* VGR_SKIP, VGR_TODO or VGR_DONE */
+    vgrmatch_T	*vf_matches;	/* when VGR_DONE: matches found */
+} vgrfile_T;
+
+# define VGR_SKIP	0	/* file is searched the usual way */
+# define VGR_TODO	1	/* file is to be searched by a thread */
+# define VGR_DONE	2	/* file was searched, matches in vf_matches */
+
+/* Files to be searched by the threads, the next one to be taken, the
+ * ":vimgrep" flags and what readfile_unchanged_how() returned.
+ * "vgr_next_file" is protected by "vgr_mutex". */
+static vgrfile_T	*vgr_files;
+static int		vgr_fcount;
+static int		vgr_next_file;
+static int		vgr_flags;
+static int		vgr_how;
+static volatile int	vgr_abort;	/* interrupted, threads must stop */
+static pthread_mutex_t	vgr_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static int	qf_init_ext __ARGS((qf_info_T *qi, char_u *efile, buf_T *buf, typval_T *tv, char_u *errorformat, int newlist, linenr_T lnumfirst, linenr_T lnumlast, char_u *qf_title));
 static void	qf_store_title __ARGS((qf_info_T *qi, char_u *title));
 static void	qf_new_list __ARGS((qf_info_T *qi, char_u *qf_title));
@@ -129,9 +177,25 @@ static buf_T	*qf_find_buf __ARGS((qf_info_T *qi));
 static void	qf_update_buffer __ARGS((qf_info_T *qi));
 static void	qf_set_title_var __ARGS((qf_info_T *qi));
 static void	qf_fill_buffer __ARGS((qf_info_T *qi));
+static void	qf_adjust_entries __ARGS((int fnum, markadj_T *ma, int count));
+static void	qf_adjust_list __ARGS((qf_info_T *qi, int fnum, markadj_T *ma, int count));
+static void	qf_adjust_buf __ARGS((buf_T *buf));
 #endif
 static char_u	*get_mef_name __ARGS((void));
 static void	restore_start_dir __ARGS((char_u *dirname_start));
+static void	vgr_display_fname __ARGS((char_u *fname, time_t *secondsp));
+static char_u	*vgr_read_file __ARGS((char_u *fname, long *lenp));
+static char_u	*vgr_read_text __ARGS((char_u *fname, long *lenp, int how, int thread));
+static char_u	*vgr_alloc __ARGS((long_u size, int thread));
+static int	vgr_find_matches __ARGS((char_u *text, long len, regmatch_T *regmatch, int flags, long maxcount, vgrmatch_T **matchesp, int thread));
+static int	vgr_add_matches __ARGS((qf_info_T *qi, qfline_T **prevp, char_u *fname, vgrmatch_T *matches, long *tomatch));
+static void	vgr_free_matches __ARGS((vgrmatch_T *matches));
+static int	vgr_match_text __ARGS((qf_info_T *qi, qfline_T **prevp, char_u *fname, char_u *text, long len, regmatch_T *regmatch, int flags, long *tomatch));
+#ifdef FEAT_VIMGREP_THREAD
+static void	vgr_search_files __ARGS((regmatch_T *regmatch, int thread, time_t *secondsp));
+static void	*vgr_thread __ARGS((void *arg));
+static void	vgr_parallel __ARGS((regmatch_T *regmatch, char_u *pat, vgrfile_T *files, int fcount, int flags, time_t *secondsp));
+#endif
 static buf_T	*load_dummy_buffer __ARGS((char_u *fname, char_u *dirname_start, char_u *resulting_dir));
 static void	wipe_dummy_buffer __ARGS((buf_T *buf, char_u *dirname_start));
 static void	unload_dummy_buffer __ARGS((buf_T *buf, char_u *dirname_start));
@@ -1006,6 +1070,8 @@ qf_add_entry(qi, prevp, dir, fname, bufnum, mesg, lnum, col, vis_col, pattern,
 {
     qfline_T	*qfp;
 
+    /* Line changes apply to the existing entries only. */
+    qf_adjust_flush();
     if ((qfp = (qfline_T *)alloc((unsigned)sizeof(qfline_T))) == NULL)
 	return FAIL;
     if (bufnum != 0)
@@ -1125,6 +1191,7 @@ copy_loclist(from, to)
 
     if (qi == NULL)		    /* no location list to copy */
 	return;
+    qf_adjust_flush();
 
     /* allocate a new location list */
     if ((to->w_llist = ll_new_list()) == NULL)
@@ -1483,6 +1550,7 @@ qf_jump(qi, dir, errornr, forceit)
 
     if (qi == NULL)
 	qi = &ql_info;
+    qf_adjust_flush();
 
     if (qi->qf_curlist >= qi->qf_listcount
 	|| qi->qf_lists[qi->qf_curlist].qf_count == 0)
@@ -1977,6 +2045,7 @@ qf_list(eap)
 	    return;
 	}
     }
+    qf_adjust_flush();
 
     if (qi->qf_curlist >= qi->qf_listcount
 	|| qi->qf_lists[qi->qf_curlist].qf_count == 0)
@@ -2181,44 +2250,116 @@ qf_free(qi, idx)
 }
 
 /*
- * qf_mark_adjust: adjust marks
+ * Lines "line1" to "line2" of the current buffer moved "amount" lines, lines
+ * below it "amount_after" lines (arguments of mark_adjust()).  The entries in
+ * the quickfix and location lists are adjusted when they are used, see
+ * qf_adjust_flush().
  */
-   void
-qf_mark_adjust(wp, line1, line2, amount, amount_after)
-    win_T	*wp;
+    void
+qf_mark_adjust(line1, line2, amount, amount_after)
     linenr_T	line1;
     linenr_T	line2;
     long	amount;
     long	amount_after;
 {
-    int		i;
-    qfline_T	*qfp;
-    int		idx;
-    qf_info_T	*qi = &ql_info;
+    markadj_T	ma;
 
-    if (wp != NULL)
+    /* An entry in deleted lines keeps its line number, it is marked as
+     * cleared. */
+    if (markadj_add(&curbuf->b_qf_adjust, line1, line2, amount, amount_after,
+								TRUE) == FAIL)
     {
-	if (wp->w_llist == NULL)
+	/* Too many changes: apply them first. */
+	qf_adjust_buf(curbuf);
+	if (markadj_add(&curbuf->b_qf_adjust, line1, line2, amount,
+						   amount_after, TRUE) == FAIL)
+	{
+	    /* Out of memory: adjust the entries now. */
+	    ma.ma_line1 = line1;
+	    ma.ma_line2 = line2;
+	    ma.ma_amount = amount;
+	    ma.ma_amount_after = amount_after;
+	    qf_adjust_entries(curbuf->b_fnum, &ma, 1);
 	    return;
-	qi = wp->w_llist;
+	}
     }
+    qf_adjust_pending = TRUE;
+}
+
+/*
+ * Apply the "count" line changes "ma" to the entries for buffer "fnum" in the
+ * quickfix list and all location lists.
+ */
+    static void
+qf_adjust_entries(fnum, ma, count)
+    int		fnum;
+    markadj_T	*ma;
+    int		count;
+{
+    win_T	*win;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tab;
+#endif
+
+    qf_adjust_list(&ql_info, fnum, ma, count);
+    FOR_ALL_TAB_WINDOWS(tab, win)
+	if (win->w_llist != NULL)
+	    qf_adjust_list(win->w_llist, fnum, ma, count);
+}
+
+/*
+ * Apply the "count" line changes "ma" to the entries for buffer "fnum" in the
+ * lists of "qi".
+ */
+    static void
+qf_adjust_list(qi, fnum, ma, count)
+    qf_info_T	*qi;
+    int		fnum;
+    markadj_T	*ma;
+    int		count;
+{
+    int		i;
+    qfline_T	*qfp;
+    int		idx;
 
     for (idx = 0; idx < qi->qf_listcount; ++idx)
 	if (qi->qf_lists[idx].qf_count)
 	    for (i = 0, qfp = qi->qf_lists[idx].qf_start;
 		       i < qi->qf_lists[idx].qf_count; ++i, qfp = qfp->qf_next)
-		if (qfp->qf_fnum == curbuf->b_fnum)
-		{
-		    if (qfp->qf_lnum >= line1 && qfp->qf_lnum <= line2)
-		    {
-			if (amount == MAXLNUM)
-			    qfp->qf_cleared = TRUE;
-			else
-			    qfp->qf_lnum += amount;
-		    }
-		    else if (amount_after && qfp->qf_lnum > line2)
-			qfp->qf_lnum += amount_after;
-		}
+		if (qfp->qf_fnum == fnum
+			   && markadj_lnum(ma, count, &qfp->qf_lnum, TRUE))
+		    qfp->qf_cleared = TRUE;
+}
+
+/*
+ * Apply the line changes of buffer "buf" that were not applied yet.
+ */
+    static void
+qf_adjust_buf(buf)
+    buf_T	*buf;
+{
+    if (buf->b_qf_adjust.ga_len > 0)
+    {
+	qf_adjust_entries(buf->b_fnum, (markadj_T *)buf->b_qf_adjust.ga_data,
+						     buf->b_qf_adjust.ga_len);
+	buf->b_qf_adjust.ga_len = 0;
+    }
+}
+
+/*
+ * Apply the line changes of all buffers to the quickfix and location lists.
+ * Must be called before using the line numbers or adding entries.
+ */
+    void
+qf_adjust_flush()
+{
+    buf_T	*buf;
+
+    if (!qf_adjust_pending)
+	return;
+    qf_adjust_pending = FALSE;
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	qf_adjust_buf(buf);
 }
 
 /*
@@ -2647,6 +2788,8 @@ qf_fill_buffer(qi)
     int		len;
     int		old_KeyTyped = KeyTyped;
 
+    qf_adjust_flush();
+
     /* delete all existing lines */
     while ((curbuf->b_ml.ml_flags & ML_EMPTY) == 0)
 	(void)ml_delete((linenr_T)1, FALSE);
@@ -3164,6 +3307,14 @@ ex_vimgrep(eap)
     int		using_dummy;
     int		redraw_for_dummy = FALSE;
     int		found_match;
+    int		read_text;
+    char_u	*text;
+    long	textlen;
+    regmatch_T	textmatch;
+    int		thread_searched;
+#ifdef FEAT_VIMGREP_THREAD
+    vgrfile_T	*files = NULL;
+#endif
     buf_T	*first_match_buf = NULL;
     time_t	seconds = 0;
     int		save_mls;
@@ -3243,6 +3394,22 @@ ex_vimgrep(eap)
     regmatch.rmm_ic = p_ic;
     regmatch.rmm_maxcol = 0;
 
+    /* A file that is not loaded can be searched without reading it into a
+     * buffer, when the pattern only matches inside a line and does not
+     * depend on the buffer, also not on its 'iskeyword'. */
+    read_text = !re_multiline(regmatch.regprog) && !re_bufpos(regmatch.regprog);
+    if (read_text)
+    {
+	long	n;
+	char_u	*isk = NULL;
+
+	read_text = get_option_value((char_u *)"isk", &n, &isk, OPT_GLOBAL)
+							       == 0 && isk != NULL
+					    && STRCMP(isk, curbuf->b_p_isk) == 0;
+	vim_free(isk);
+    }
+    textmatch.rm_ic = regmatch.rmm_ic;
+
     p = skipwhite(p);
     if (*p == NUL)
     {
@@ -3286,32 +3453,66 @@ ex_vimgrep(eap)
 #endif
 
     seconds = (time_t)0;
-    for (fi = 0; fi < fcount && !got_int && tomatch > 0; ++fi)
+
+#ifdef FEAT_VIMGREP_THREAD
+    /* Without a count, first search the files that can be read without
+     * loading them into a buffer in parallel.  The matches are added to the
+     * list below, in the order of the files. */
+    if (read_text && tomatch == MAXLNUM && fcount > 1)
+	files = (vgrfile_T *)alloc_clear(
+				       (unsigned)(fcount * sizeof(vgrfile_T)));
+    if (files != NULL)
     {
-	fname = shorten_fname1(fnames[fi]);
-	if (time(NULL) > seconds)
+	int	todo = 0;
+
+	for (fi = 0; fi < fcount; ++fi)
 	{
-	    /* Display the file name every second or so, show the user we are
-	     * working on it. */
-	    seconds = time(NULL);
-	    msg_start();
-	    p = msg_strtrunc(fname, TRUE);
-	    if (p == NULL)
-		msg_outtrans(fname);
-	    else
+	    fname = shorten_fname1(fnames[fi]);
+	    files[fi].vf_fname = fname;
+	    buf = buflist_findname_exp(fnames[fi]);
+	    if ((buf == NULL || buf->b_ml.ml_mfp == NULL)
+# ifdef FEAT_AUTOCMD
+		    && !has_readfile_autocmd(fname,
+						  (char_u *)"filetypedetect")
+# endif
+		    )
 	    {
-		msg_outtrans(p);
-		vim_free(p);
+		files[fi].vf_state = VGR_TODO;
+		++todo;
 	    }
-	    msg_clr_eos();
-	    msg_didout = FALSE;	    /* overwrite this message */
-	    msg_nowait = TRUE;	    /* don't wait for this message */
-	    msg_col = 0;
-	    out_flush();
 	}
+	if (todo > 1)
+	{
+	    /* The regprog may be changed when switching engines. */
+	    textmatch.regprog = regmatch.regprog;
+	    vgr_parallel(&textmatch, *s == NUL ? last_search_pat() : s,
+					     files, fcount, flags, &seconds);
+	    regmatch.regprog = textmatch.regprog;
+	}
+    }
+#endif
+
+    for (fi = 0; fi < fcount && !got_int && tomatch > 0; ++fi)
+    {
+	fname = shorten_fname1(fnames[fi]);
+	vgr_display_fname(fname, &seconds);
 
 	buf = buflist_findname_exp(fnames[fi]);
-	if (buf == NULL || buf->b_ml.ml_mfp == NULL)
+	text = NULL;
+	thread_searched = FALSE;
+#ifdef FEAT_VIMGREP_THREAD
+	/* The file may have been searched already, unless autocommands
+	 * loaded it into a buffer meanwhile. */
+	if (files != NULL && files[fi].vf_state == VGR_DONE
+				&& (buf == NULL || buf->b_ml.ml_mfp == NULL))
+	    thread_searched = TRUE;
+	else
+#endif
+	if ((buf == NULL || buf->b_ml.ml_mfp == NULL) && read_text)
+	    text = vgr_read_file(fname, &textlen);
+	if (text != NULL || thread_searched)
+	    using_dummy = FALSE;
+	else if (buf == NULL || buf->b_ml.ml_mfp == NULL)
 	{
 	    /* Remember that a buffer with this name already exists. */
 	    duplicate_name = (buf != NULL);
@@ -3362,7 +3563,30 @@ ex_vimgrep(eap)
 	}
 #endif
 
-	if (buf == NULL)
+#ifdef FEAT_VIMGREP_THREAD
+	if (thread_searched)
+	{
+	    vgr_add_matches(qi, &prevp, fname, files[fi].vf_matches,
+								    &tomatch);
+# ifdef FEAT_AUTOCMD
+	    cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
+# endif
+	}
+	else
+#endif
+	if (text != NULL)
+	{
+	    /* The regprog may be changed when switching engines. */
+	    textmatch.regprog = regmatch.regprog;
+	    vgr_match_text(qi, &prevp, fname, text, textlen, &textmatch,
+							     flags, &tomatch);
+	    regmatch.regprog = textmatch.regprog;
+	    vim_free(text);
+#ifdef FEAT_AUTOCMD
+	    cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
+#endif
+	}
+	else if (buf == NULL)
 	{
 	    if (!got_int)
 		smsg((char_u *)_("Cannot open file \"%s\""), fname);
@@ -3372,6 +3596,10 @@ ex_vimgrep(eap)
 	    /* Try for a match in all lines of the buffer.
 	     * For ":1vimgrep" look for first match only. */
 	    found_match = FALSE;
+#ifdef FEAT_MMAP
+	    /* A buffer read with "++mmap" may not have all lines yet. */
+	    ml_mmap_finish(buf);
+#endif
 	    for (lnum = 1; lnum <= buf->b_ml.ml_line_count && tomatch > 0;
 								       ++lnum)
 	    {
@@ -3476,6 +3704,14 @@ ex_vimgrep(eap)
 	}
     }
 
+#ifdef FEAT_VIMGREP_THREAD
+    if (files != NULL)
+    {
+	for (fi = 0; fi < fcount; ++fi)
+	    vgr_free_matches(files[fi].vf_matches);
+	vim_free(files);
+    }
+#endif
     FreeWild(fcount, fnames);
 
     qi->qf_lists[qi->qf_curlist].qf_nonevalid = FALSE;
@@ -3618,6 +3854,442 @@ restore_start_dir(dirname_start)
     }
 }
 
+/*
+ * Display the file name "fname" searched by ":vimgrep" every second or so,
+ * show the user we are working on it.  "*secondsp" is the time it was last
+ * displayed.
+ */
+    static void
+vgr_display_fname(fname, secondsp)
+    char_u	*fname;
+    time_t	*secondsp;
+{
+    char_u	*p;
+
+    if (time(NULL) <= *secondsp)
+	return;
+    *secondsp = time(NULL);
+    msg_start();
+    p = msg_strtrunc(fname, TRUE);
+    if (p == NULL)
+	msg_outtrans(fname);
+    else
+    {
+	msg_outtrans(p);
+	vim_free(p);
+    }
+    msg_clr_eos();
+    msg_didout = FALSE;	    /* overwrite this message */
+    msg_nowait = TRUE;	    /* don't wait for this message */
+    msg_col = 0;
+    out_flush();
+}
+
+/*
+ * Read file "fname" for ":vimgrep" without loading it into a buffer.  Only
+ * done when no autocommands are triggered and the text does not need to be
+ * changed, see readfile_unchanged().  Autocommands for filetype detection are
+ * ignored, they only set 'filetype' and the FileType event is not used for
+ * ":vimgrep".
+ * Returns the text in allocated memory with a NUL after it, and sets "*lenp"
+ * to its length.  Returns NULL when the file must be loaded into a buffer.
+ */
+    static char_u *
+vgr_read_file(fname, lenp)
+    char_u	*fname;
+    long	*lenp;
+{
+#ifdef FEAT_AUTOCMD
+    if (has_readfile_autocmd(fname, (char_u *)"filetypedetect"))
+	return NULL;
+#endif
+    return vgr_read_text(fname, lenp, readfile_unchanged_how(), FALSE);
+}
+
+/*
+ * The part of vgr_read_file() that doesn't check for autocommands.  "how" is
+ * what readfile_unchanged_how() returned.  When "thread" is TRUE it is called
+ * in a thread other than the main thread.
+ */
+    static char_u *
+vgr_read_text(fname, lenp, how, thread)
+    char_u	*fname;
+    long	*lenp;
+    int		how;
+    int		thread;
+{
+    struct stat	st;
+    int		fd;
+    char_u	*text;
+    long	len;
+
+    /* Don't use more memory than 'maxmem' for the text. */
+    if (mch_stat((char *)fname, &st) < 0
+#ifdef S_ISREG
+	    || !S_ISREG(st.st_mode)
+#else
+	    || mch_isdir(fname)
+#endif
+	    || st.st_size > (off_t)p_mm * 1024)
+	return NULL;
+
+    fd = mch_open((char *)fname, O_RDONLY | O_EXTRA, 0);
+    if (fd < 0)
+	return NULL;
+    len = (long)st.st_size;
+    text = vgr_alloc((long_u)(len + 1), thread);
+    if (text != NULL && read_eintr(fd, text, (size_t)len) != len)
+    {
+	vim_free(text);
+	text = NULL;
+    }
+    close(fd);
+    if (text == NULL)
+	return NULL;
+
+    text[len] = NUL;
+    if (!readfile_unchanged(text, len, how))
+    {
+	vim_free(text);
+	return NULL;
+    }
+    *lenp = len;
+    return text;
+}
+
+/*
+ * Allocate "size" bytes for ":vimgrep", without an error message.  In a
+ * thread other than the main thread malloc() is used, lalloc() may free
+ * memory in other places when out of memory.
+ */
+    static char_u *
+vgr_alloc(size, thread)
+    long_u	size;
+    int		thread;
+{
+#ifndef MEM_PROFILE
+    if (thread)
+	return (char_u *)malloc((size_t)size);
+#endif
+    return lalloc(size, FALSE);
+}
+
+/*
+ * Find matches for ":vimgrep" in "text[len]", read by vgr_read_text(), at
+ * most "maxcount".  "regmatch" must not match a line break.  The text is
+ * split into lines in place.  The matches are put in a list in "*matchesp",
+ * to be added to the quickfix list with vgr_add_matches() and freed with
+ * vgr_free_matches().
+ * When "thread" is TRUE this is called in a thread other than the main
+ * thread: CTRL-C is not checked for, it stops when "vgr_abort" is set.
+ * Returns FAIL when out of memory or, in a thread, when the main thread must
+ * search the text.  "*matchesp" is set anyway.
+ */
+    static int
+vgr_find_matches(text, len, regmatch, flags, maxcount, matchesp, thread)
+    char_u	*text;
+    long	len;
+    regmatch_T	*regmatch;
+    int		flags;
+    long	maxcount;
+    vgrmatch_T	**matchesp;
+    int		thread;
+{
+    char_u	*line = text;
+    char_u	*end = text + len;
+    char_u	*p;
+    long	lnum;
+    colnr_T	col;
+    long	count = 0;
+    int		r;
+    vgrmatch_T	*vm;
+    vgrmatch_T	**tailp = matchesp;
+
+    *matchesp = NULL;
+
+    /* An empty file has one empty line. */
+    for (lnum = 1; (line < end || lnum == 1) && count < maxcount; ++lnum)
+    {
+	p = (char_u *)memchr(line, NL, (size_t)(end - line));
+	if (p == NULL)
+	    p = end;
+	*p = NUL;
+
+	/* A NUL in the file is a NL in the buffer. */
+	for (col = (colnr_T)STRLEN(line); line + col < p;
+					  col += (colnr_T)STRLEN(line + col))
+	    line[col] = NL;
+
+	col = 0;
+	for (;;)
+	{
+#ifdef FEAT_VIMGREP_THREAD
+	    if (thread)
+	    {
+		r = vim_regexec_thread(regmatch, line, col);
+		if (r == RE_NEED_MAIN)
+		    return FAIL;
+	    }
+	    else
+#endif
+		r = vim_regexec(regmatch, line, col);
+	    if (!r)
+		break;
+
+	    vm = (vgrmatch_T *)vgr_alloc(
+			   (long_u)(sizeof(vgrmatch_T) + (p - line)), thread);
+	    if (vm == NULL)
+		return FAIL;
+	    vm->vm_next = NULL;
+	    vm->vm_lnum = lnum;
+	    vm->vm_col = (colnr_T)(regmatch->startp[0] - line);
+	    mch_memmove(vm->vm_line, line, (size_t)(p - line + 1));
+	    *tailp = vm;
+	    tailp = &vm->vm_next;
+
+	    if (++count == maxcount || (flags & VGR_GLOBAL) == 0)
+		break;
+	    col = (colnr_T)(regmatch->endp[0] - line)
+				 + (line + col == regmatch->endp[0]);
+	    if (line + col > p)
+		break;
+	}
+#ifdef FEAT_VIMGREP_THREAD
+	if (thread)
+	{
+	    if (vgr_abort)
+		break;
+	}
+	else
+#endif
+	{
+	    line_breakcheck();
+	    if (got_int)
+		break;
+	}
+	line = p + 1;
+    }
+    return OK;
+}
+
+/*
+ * Add the matches found by vgr_find_matches() in file "fname" to the quickfix
+ * list "qi", at most "*tomatch" of them.
+ * Returns TRUE if a match was added.
+ */
+    static int
+vgr_add_matches(qi, prevp, fname, matches, tomatch)
+    qf_info_T	*qi;
+    qfline_T	**prevp;
+    char_u	*fname;
+    vgrmatch_T	*matches;
+    long	*tomatch;
+{
+    vgrmatch_T	*vm;
+    int		found_match = FALSE;
+
+    for (vm = matches; vm != NULL && *tomatch > 0; vm = vm->vm_next)
+    {
+	if (qf_add_entry(qi, prevp,
+		    NULL,       /* dir */
+		    fname,
+		    0,
+		    vm->vm_line,
+		    vm->vm_lnum,
+		    vm->vm_col + 1,
+		    FALSE,      /* vis_col */
+		    NULL,	/* search pattern */
+		    0,		/* nr */
+		    0,		/* type */
+		    TRUE	/* valid */
+		    ) == FAIL)
+	{
+	    got_int = TRUE;
+	    break;
+	}
+	found_match = TRUE;
+	--*tomatch;
+    }
+    return found_match;
+}
+
+/*
+ * Free the list of matches returned by vgr_find_matches().
+ */
+    static void
+vgr_free_matches(matches)
+    vgrmatch_T	*matches;
+{
+    vgrmatch_T	*vm;
+
+    while (matches != NULL)
+    {
+	vm = matches->vm_next;
+	vim_free(matches);
+	matches = vm;
+    }
+}
+
+/*
+ * Find matches for ":vimgrep" in "text[len]", read from file "fname" by
+ * vgr_read_file(), and add them to the quickfix list "qi".  "regmatch" must
+ * not match a line break.  The text is split into lines in place.
+ * Returns TRUE if a match was found.
+ */
+    static int
+vgr_match_text(qi, prevp, fname, text, len, regmatch, flags, tomatch)
+    qf_info_T	*qi;
+    qfline_T	**prevp;
+    char_u	*fname;
+    char_u	*text;
+    long	len;
+    regmatch_T	*regmatch;
+    int		flags;
+    long	*tomatch;
+{
+    vgrmatch_T	*matches;
+    int		found_match;
+
+    if (vgr_find_matches(text, len, regmatch, flags, *tomatch, &matches,
+								FALSE) == FAIL)
+	got_int = TRUE;	    /* out of memory */
+    found_match = vgr_add_matches(qi, prevp, fname, matches, tomatch);
+    vgr_free_matches(matches);
+    return found_match;
+}
+
+#ifdef FEAT_VIMGREP_THREAD
+/*
+ * Search the files in "vgr_files" that are VGR_TODO for ":vimgrep", taking
+ * the next one until none is left.  Used in each thread, and in the main
+ * thread with "thread" FALSE, where the file name is displayed and CTRL-C is
+ * checked for.
+ * A file that can't be read this way or where the main thread must do the
+ * search is set to VGR_SKIP, ex_vimgrep() will search it the usual way.
+ */
+    static void
+vgr_search_files(regmatch, thread, secondsp)
+    regmatch_T	*regmatch;
+    int		thread;
+    time_t	*secondsp;
+{
+    vgrfile_T	*vf;
+    char_u	*text;
+    long	len;
+    int		fi;
+
+    for (;;)
+    {
+	/* The files after "vgr_next_file" are not used by any thread yet. */
+	pthread_mutex_lock(&vgr_mutex);
+	fi = vgr_next_file;
+	while (fi < vgr_fcount && vgr_files[fi].vf_state != VGR_TODO)
+	    ++fi;
+	vgr_next_file = fi + 1;
+	pthread_mutex_unlock(&vgr_mutex);
+	if (fi >= vgr_fcount || vgr_abort)
+	    break;
+
+	vf = &vgr_files[fi];
+	vf->vf_state = VGR_SKIP;
+	if (!thread)
+	    vgr_display_fname(vf->vf_fname, secondsp);
+	text = vgr_read_text(vf->vf_fname, &len, vgr_how, thread);
+	if (text != NULL)
+	{
+	    if (vgr_find_matches(text, len, regmatch, vgr_flags, MAXLNUM,
+					  &vf->vf_matches, thread) == OK)
+		vf->vf_state = VGR_DONE;
+	    else
+	    {
+		vgr_free_matches(vf->vf_matches);
+		vf->vf_matches = NULL;
+	    }
+	    vim_free(text);
+	}
+	if (!thread && got_int)
+	    vgr_abort = TRUE;
+    }
+}
+
+    static void *
+vgr_thread(arg)
+    void	*arg;
+{
+    vgr_search_files((regmatch_T *)arg, TRUE, NULL);
+    return NULL;
+}
+
+/*
+ * Search the "fcount" files in "files" that are VGR_TODO for ":vimgrep"
+ * with a thread per processor, this thread is one of them and uses
+ * "regmatch".  The other threads each execute their own program, compiled
+ * from "pat".  The matches are added to the quickfix list later, in the order
+ * of the files.
+ */
+    static void
+vgr_parallel(regmatch, pat, files, fcount, flags, secondsp)
+    regmatch_T	*regmatch;
+    char_u	*pat;
+    vgrfile_T	*files;
+    int		fcount;
+    int		flags;
+    time_t	*secondsp;
+{
+    pthread_t	threads[VGR_THREAD_MAX];
+    int		started[VGR_THREAD_MAX];
+    regmatch_T	matches[VGR_THREAD_MAX];
+    sigset_t	all;
+    sigset_t	old;
+    long	nproc = 1;
+    int		nthreads;
+    int		i;
+
+# ifdef _SC_NPROCESSORS_ONLN
+    nproc = sysconf(_SC_NPROCESSORS_ONLN);
+# endif
+    /* With one processor still use two threads, reading one file can be
+     * done while searching another one. */
+    nthreads = nproc > VGR_THREAD_MAX ? VGR_THREAD_MAX
+						: nproc < 2 ? 2 : (int)nproc;
+
+    vgr_files = files;
+    vgr_fcount = fcount;
+    vgr_next_file = 0;
+    vgr_flags = flags;
+    vgr_how = readfile_unchanged_how();
+    vgr_abort = FALSE;
+
+    /* Compiling must be done here, it uses global variables. */
+    for (i = 1; i < nthreads; ++i)
+    {
+	matches[i].regprog = vim_regcomp_unshared(pat, RE_MAGIC);
+	matches[i].rm_ic = regmatch->rm_ic;
+	started[i] = FALSE;
+    }
+
+    /* The threads must not handle any signals, block them all while
+     * creating them, they inherit the signal mask. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 1; i < nthreads; ++i)
+	if (matches[i].regprog != NULL)
+	    started[i] = pthread_create(&threads[i], NULL, vgr_thread,
+							 &matches[i]) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    vgr_search_files(regmatch, FALSE, secondsp);
+
+    for (i = 1; i < nthreads; ++i)
+    {
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	vim_regfree(matches[i].regprog);
+    }
+    vgr_files = NULL;
+}
+#endif
+
 /*
  * Load file "fname" into a dummy buffer and return the buffer pointer,
  * placing the directory resulting from the buffer load into the
@@ -3785,6 +4457,7 @@ get_errorlist(wp, list)
     if (qi->qf_curlist >= qi->qf_listcount
 	    || qi->qf_lists[qi->qf_curlist].qf_count == 0)
 	return FAIL;
+    qf_adjust_flush();
 
     qfp = qi->qf_lists[qi->qf_curlist].qf_start;
     for (i = 1; !got_int && i <= qi->qf_lists[qi->qf_curlist].qf_count; ++i)
@@ -3976,6 +4649,9 @@ ex_cbuffer(eap)
 	EMSG(_("E681: Buffer is not loaded"));
     else
     {
+#ifdef FEAT_MMAP
+	ml_mmap_finish(buf);
+#endif
 	if (eap->addr_count == 0)
 	{
 	    eap->line1 = 1;
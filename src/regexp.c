@@ -348,8 +348,8 @@ toggle_Magic(x)
 #define MAX_LIMIT	(32767L << 16L)
 
 static int re_multi_type __ARGS((int));
-static int cstrncmp __ARGS((char_u *s1, char_u *s2, int *n));
-static char_u *cstrchr __ARGS((char_u *, int));
+static int cstrncmp __ARGS((regexec_T *rex, char_u *s1, char_u *s2, int *n));
+static char_u *cstrchr __ARGS((regexec_T *rex, char_u *, int));
 
 #ifdef BT_REGEXP_DUMP
 static void	regdump __ARGS((char_u *, bt_regprog_T *));
@@ -597,6 +597,7 @@ init_class_tab()
 #define RF_HASNL    4	/* can match a NL */
 #define RF_ICOMBINE 8	/* ignore combining characters */
 #define RF_LOOKBH   16	/* uses "\@<=" or "\@<!" */
+#define RF_BUFPOS   32	/* uses a position in the buffer, e.g. "\%23l" */
 
 /*
  * Global work variables for vim_regcomp().
@@ -711,7 +712,7 @@ static char_u	*regnode __ARGS((int));
 #ifdef FEAT_MBYTE
 static int	use_multibytecode __ARGS((int c));
 #endif
-static int	prog_magic_wrong __ARGS((void));
+static int	prog_magic_wrong __ARGS((regexec_T *rex));
 static char_u	*regnext __ARGS((char_u *));
 static void	regc __ARGS((int b));
 #ifdef FEAT_MBYTE
@@ -755,6 +756,18 @@ re_lookbehind(prog)
     return (prog->regflags & RF_LOOKBH);
 }
 
+/*
+ * Return TRUE if compiled regular expression "prog" refers to a position in
+ * the buffer: "\%^", "\%$", "\%#", "\%V", "\%'m" or "\%23l".  Matching
+ * such a pattern against a string gives a different result.
+ */
+    int
+re_bufpos(prog)
+    regprog_T *prog;
+{
+    return (prog->regflags & RF_BUFPOS);
+}
+
 /*
  * Check for an equivalence class name "[=a=]".  "pp" points to the '['.
  * Returns a character representing the class. Zero means that no item was
@@ -1453,6 +1466,9 @@ bt_regcomp(expr, re_flags)
     }
 #ifdef BT_REGEXP_DUMP
     regdump(expr, r);
+#endif
+#ifdef FEAT_RE_CACHE
+    r->pattern = vim_strsave(expr);
 #endif
     r->engine = &bt_regengine;
     return (regprog_T *)r;
@@ -1465,6 +1481,10 @@ bt_regcomp(expr, re_flags)
 bt_regfree(prog)
     regprog_T   *prog;
 {
+#ifdef FEAT_RE_CACHE
+    if (prog != NULL)
+	vim_free(((bt_regprog_T *)prog)->pattern);
+#endif
     vim_free(prog);
 }
 
@@ -2201,18 +2221,22 @@ regatom(flagp)
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    ret = regnode(RE_BOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '$':
 		    ret = regnode(RE_EOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '#':
 		    ret = regnode(CURSOR);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'V':
 		    ret = regnode(RE_VISUAL);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'C':
@@ -2335,6 +2359,7 @@ regatom(flagp)
 				  /* "\%'m", "\%<'m" and "\%>'m": Mark */
 				  c = getchr();
 				  ret = regnode(RE_MARK);
+				  regflags |= RF_BUFPOS;
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 2;
 				  else
@@ -2347,7 +2372,10 @@ regatom(flagp)
 			      else if (c == 'l' || c == 'c' || c == 'v')
 			      {
 				  if (c == 'l')
+				  {
 				      ret = regnode(RE_LNUM);
+				      regflags |= RF_BUFPOS;
+				  }
 				  else if (c == 'c')
 				      ret = regnode(RE_COL);
 				  else
@@ -3461,22 +3489,6 @@ read_limits(minval, maxval)
  * vim_regexec and friends
  */
 
-/*
- * Global work variables for vim_regexec().
- */
-
-/* The current match-position is remembered with these variables: */
-static linenr_T	reglnum;	/* line number, relative to first line */
-static char_u	*regline;	/* start of current line */
-static char_u	*reginput;	/* current input, points into "regline" */
-
-static int	need_clear_subexpr;	/* subexpressions still need to be
-					 * cleared */
-#ifdef FEAT_SYN_HL
-static int	need_clear_zsubexpr = FALSE;	/* extmatch subexpressions
-						 * still need to be cleared */
-#endif
-
 /*
  * Structure used to save the current input state, when it needs to be
  * restored after trying a match.  Used by reg_save() and reg_restore().
@@ -3486,8 +3498,8 @@ typedef struct
 {
     union
     {
-	char_u	*ptr;	/* reginput pointer, for single-line regexp */
-	lpos_T	pos;	/* reginput pos, for multi-line regexp */
+	char_u	*ptr;	/* rex->input, for single-line regexp */
+	lpos_T	pos;	/* rex->input pos, for multi-line regexp */
     } rs_u;
     int		rs_len;
 } regsave_T;
@@ -3512,75 +3524,48 @@ typedef struct regbehind_S
     save_se_T   save_end[NSUBEXP];
 } regbehind_T;
 
-static char_u	*reg_getline __ARGS((linenr_T lnum));
-static long	bt_regexec_both __ARGS((char_u *line, colnr_T col, proftime_T *tm));
-static long	regtry __ARGS((bt_regprog_T *prog, colnr_T col));
-static void	cleanup_subexpr __ARGS((void));
-#ifdef FEAT_SYN_HL
-static void	cleanup_zsubexpr __ARGS((void));
-#endif
-static void	save_subexpr __ARGS((regbehind_T *bp));
-static void	restore_subexpr __ARGS((regbehind_T *bp));
-static void	reg_nextline __ARGS((void));
-static void	reg_save __ARGS((regsave_T *save, garray_T *gap));
-static void	reg_restore __ARGS((regsave_T *save, garray_T *gap));
-static int	reg_save_equal __ARGS((regsave_T *save));
-static void	save_se_multi __ARGS((save_se_T *savep, lpos_T *posp));
-static void	save_se_one __ARGS((save_se_T *savep, char_u **pp));
-
-/* Save the sub-expressions before attempting a match. */
-#define save_se(savep, posp, pp) \
-    REG_MULTI ? save_se_multi((savep), (posp)) : save_se_one((savep), (pp))
-
-/* After a failed match restore the sub-expressions. */
-#define restore_se(savep, posp, pp) { \
-    if (REG_MULTI) \
-	*(posp) = (savep)->se_u.pos; \
-    else \
-	*(pp) = (savep)->se_u.ptr; }
-
-static int	re_num_cmp __ARGS((long_u val, char_u *scan));
-static int	match_with_backref __ARGS((linenr_T start_lnum, colnr_T start_col, linenr_T end_lnum, colnr_T end_col, int *bytelen));
-static int	regmatch __ARGS((char_u *prog));
-static int	regrepeat __ARGS((char_u *p, long maxcount));
-
-#ifdef DEBUG
-int		regnarrate = 0;
-#endif
+/* Sub-matches of the NFA engine, see regexp_nfa.c. */
+typedef struct
+{
+    int	    in_use; /* number of subexpr with useful info */
 
-/*
- * Internal copy of 'ignorecase'.  It is set at each call to vim_regexec().
- * Normally it gets the value of "rm_ic" or "rmm_ic", but when the pattern
- * contains '\c' or '\C' the value is overruled.
- */
-static int	ireg_ic;
+    /* When REG_MULTI is TRUE list.multi is used, otherwise list.line. */
+    union
+    {
+	struct multipos
+	{
+	    linenr_T	start_lnum;
+	    linenr_T	end_lnum;
+	    colnr_T	start_col;
+	    colnr_T	end_col;
+	} multi[NSUBEXP];
+	struct linepos
+	{
+	    char_u	*start;
+	    char_u	*end;
+	} line[NSUBEXP];
+    } list;
+} regsub_T;
 
-#ifdef FEAT_MBYTE
-/*
- * Similar to ireg_ic, but only for 'combining' characters.  Set with \Z flag
- * in the regexp.  Defaults to false, always.
- */
-static int	ireg_icombine;
+typedef struct
+{
+    regsub_T	norm; /* \( .. \) matches */
+#ifdef FEAT_SYN_HL
+    regsub_T	synt; /* \z( .. \) matches */
 #endif
+} regsubs_T;
 
 /*
- * Copy of "rmm_maxcol": maximum column to search for a match.  Zero when
- * there is no maximum.
- */
-static colnr_T	ireg_maxcol;
-
-/*
- * Sometimes need to save a copy of a line.  Since alloc()/free() is very
- * slow, we keep one allocated piece of memory and only re-allocate it when
- * it's too small.  It's freed in bt_regexec_both() when finished.
- */
-static char_u	*reg_tofree = NULL;
-static unsigned	reg_tofreelen;
-
-/*
- * These variables are set when executing a regexp to speed up the execution.
- * Which ones are set depends on whether a single-line or multi-line match is
- * done:
+ * Work variables for vim_regexec().
+ * All the state of executing a regexp is kept in a regexec_T, which
+ * vim_regexec_both() and vim_regexec_multi() create and pass down as "rex".
+ * Thus a regexp can be executed while another one is being used, and
+ * different threads can execute regexps at the same time, each with their own
+ * regprog_T.
+ *
+ * Some of the variables are set when executing a regexp to speed up the
+ * execution.  Which ones are set depends on whether a single-line or
+ * multi-line match is done:
  *			single-line		multi-line
  * reg_match		&regmatch_T		NULL
  * reg_mmatch		NULL			&regmmatch_T
@@ -3594,17 +3579,136 @@ static unsigned	reg_tofreelen;
  * reg_maxline		0			last line nr
  * reg_line_lbr		FALSE or TRUE		FALSE
  */
-static regmatch_T	*reg_match;
-static regmmatch_T	*reg_mmatch;
-static char_u		**reg_startp = NULL;
-static char_u		**reg_endp = NULL;
-static lpos_T		*reg_startpos = NULL;
-static lpos_T		*reg_endpos = NULL;
-static win_T		*reg_win;
-static buf_T		*reg_buf;
-static linenr_T		reg_firstlnum;
-static linenr_T		reg_maxline;
-static int		reg_line_lbr;	    /* "\n" in string is line break */
+struct regexec_S
+{
+    regmatch_T		*reg_match;
+    regmmatch_T		*reg_mmatch;
+    char_u		**reg_startp;
+    char_u		**reg_endp;
+    lpos_T		*reg_startpos;
+    lpos_T		*reg_endpos;
+    win_T		*reg_win;
+    buf_T		*reg_buf;
+    linenr_T		reg_firstlnum;
+    linenr_T		reg_maxline;
+    int			reg_line_lbr;	/* "\n" in string is line break */
+
+    /* Executing in a thread other than the main thread: don't check for
+     * CTRL-C and don't give messages, set "reg_failed" instead. */
+    int			reg_thread;
+    int			reg_failed;
+
+    /* The current match-position is remembered with these variables: */
+    linenr_T		lnum;		/* line number, relative to first line */
+    char_u		*line;		/* start of current line */
+    char_u		*input;		/* current input, points into "line" */
+
+    int			need_clear_subexpr;	/* subexpressions still need
+						 * to be cleared */
+#ifdef FEAT_SYN_HL
+    int			need_clear_zsubexpr;	/* extmatch subexpressions
+						 * still need to be cleared */
+#endif
+
+    /* Internal copy of 'ignorecase'.  It is set at each call to
+     * vim_regexec().  Normally it gets the value of "rm_ic" or "rmm_ic", but
+     * when the pattern contains '\c' or '\C' the value is overruled. */
+    int			reg_ic;
+
+#ifdef FEAT_MBYTE
+    /* Similar to "reg_ic", but only for 'combining' characters.  Set with \Z
+     * flag in the regexp.  Defaults to false, always. */
+    int			reg_icombine;
+#endif
+
+    /* Copy of "rmm_maxcol": maximum column to search for a match.  Zero when
+     * there is no maximum. */
+    colnr_T		reg_maxcol;
+
+    /* State of the NFA engine, see regexp_nfa.c. */
+    int			nfa_has_zend;	/* regexp \ze operator encountered */
+    int			nfa_has_backref; /* regexp \1 .. \9 encountered */
+#ifdef FEAT_SYN_HL
+    int			nfa_has_zsubexpr; /* regexp has \z( ) */
+#endif
+    /* Number of sub expressions actually being used during execution. 1 if
+     * only the whole match (subexpr 0) is used. */
+    int			nfa_nsubexpr;
+    /* The listid is kept over recursive calls to nfa_regmatch(), so that it
+     * increases and the lastlist field of the states need not be cleared. */
+    int			nfa_listid;
+    int			nfa_alt_listid;
+    save_se_T		*nfa_endp;	/* if not NULL match must end here */
+    int			nfa_match;	/* whether a match has been found */
+#ifdef FEAT_RELTIME
+    proftime_T		*nfa_time_limit;
+    int			nfa_time_count;
+#endif
+    /* 0 for first call to nfa_regmatch(), 1 for recursive call. */
+    int			nfa_ll_index;
+    regsubs_T		nfa_temp_subs;	/* used by addstate() */
+
+    /* Sometimes need to save a copy of a line.  Only re-allocated when it's
+     * too small, freed when the match is done. */
+    char_u		*reg_tofree;
+    unsigned		reg_tofreelen;
+
+    garray_T		regstack;	/* used by regmatch() */
+    garray_T		backpos;	/* used by regmatch() */
+    regsave_T		behind_pos;
+
+    /* The arguments from BRACE_LIMITS.  They are actually local to
+     * regmatch(), but they are here to reduce the amount of stack space used
+     * (it can be called recursively many times). */
+    long		bl_minval;
+    long		bl_maxval;
+
+#ifdef FEAT_SYN_HL
+    /* Workspace to mark beginning and end of \z(...\) matches, and their
+     * positions. */
+    char_u		*reg_startzp[NSUBEXP];
+    char_u		*reg_endzp[NSUBEXP];
+    lpos_T		reg_startzpos[NSUBEXP];
+    lpos_T		reg_endzpos[NSUBEXP];
+#endif
+};
+
+static char_u	*reg_getline __ARGS((regexec_T *rex, linenr_T lnum));
+static long	bt_regexec_both __ARGS((regexec_T *rex, char_u *line, colnr_T col, proftime_T *tm));
+static long	regtry __ARGS((regexec_T *rex, bt_regprog_T *prog, colnr_T col));
+static void	cleanup_subexpr __ARGS((regexec_T *rex));
+#ifdef FEAT_SYN_HL
+static void	cleanup_zsubexpr __ARGS((regexec_T *rex));
+#endif
+static void	save_subexpr __ARGS((regexec_T *rex, regbehind_T *bp));
+static void	restore_subexpr __ARGS((regexec_T *rex, regbehind_T *bp));
+static void	reg_nextline __ARGS((regexec_T *rex));
+static void	reg_save __ARGS((regexec_T *rex, regsave_T *save, garray_T *gap));
+static void	reg_restore __ARGS((regexec_T *rex, regsave_T *save, garray_T *gap));
+static int	reg_save_equal __ARGS((regexec_T *rex, regsave_T *save));
+static void	save_se_multi __ARGS((regexec_T *rex, save_se_T *savep, lpos_T *posp));
+static void	save_se_one __ARGS((regexec_T *rex, save_se_T *savep, char_u **pp));
+
+/* Save the sub-expressions before attempting a match. */
+#define save_se(savep, posp, pp) \
+    REG_MULTI ? save_se_multi(rex, (savep), (posp)) \
+	      : save_se_one(rex, (savep), (pp))
+
+/* After a failed match restore the sub-expressions. */
+#define restore_se(savep, posp, pp) { \
+    if (REG_MULTI) \
+	*(posp) = (savep)->se_u.pos; \
+    else \
+	*(pp) = (savep)->se_u.ptr; }
+
+static int	re_num_cmp __ARGS((long_u val, char_u *scan));
+static int	match_with_backref __ARGS((regexec_T *rex, linenr_T start_lnum, colnr_T start_col, linenr_T end_lnum, colnr_T end_col, int *bytelen));
+static int	regmatch __ARGS((regexec_T *rex, char_u *prog));
+static int	regrepeat __ARGS((regexec_T *rex, char_u *p, long maxcount));
+
+#ifdef DEBUG
+int		regnarrate = 0;
+#endif
 
 /* Values for rs_state in regitem_T. */
 typedef enum regstate_E
@@ -3641,12 +3745,12 @@ typedef struct regitem_S
     {
 	save_se_T  sesave;
 	regsave_T  regsave;
-    } rs_un;			/* room for saving reginput */
+    } rs_un;			/* room for saving rex->input */
     short	rs_no;		/* submatch nr or BEHIND/NOBEHIND */
 } regitem_T;
 
-static regitem_T *regstack_push __ARGS((regstate_T state, char_u *scan));
-static void regstack_pop __ARGS((char_u **scan));
+static regitem_T *regstack_push __ARGS((regexec_T *rex, regstate_T state, char_u *scan));
+static void regstack_pop __ARGS((regexec_T *rex, char_u **scan));
 
 /* used for STAR, PLUS and BRACE_SIMPLE matching */
 typedef struct regstar_S
@@ -3667,70 +3771,114 @@ typedef struct backpos_S
 } backpos_T;
 
 /*
- * "regstack" and "backpos" are used by regmatch().  They are kept over calls
- * to avoid invoking malloc() and free() often.
+ * "regstack" and "backpos" in regexec_T are used by regmatch().
  * "regstack" is a stack with regitem_T items, sometimes preceded by regstar_T
  * or regbehind_T.
- * "backpos_T" is a table with backpos_T for BACK
- */
-static garray_T	regstack = {0, 0, 0, 0, NULL};
-static garray_T	backpos = {0, 0, 0, 0, NULL};
-
-/*
- * Both for regstack and backpos tables we use the following strategy of
- * allocation (to reduce malloc/free calls):
- * - Initial size is fairly small.
- * - When needed, the tables are grown bigger (8 times at first, double after
- *   that).
- * - After executing the match we free the memory only if the array has grown.
- *   Thus the memory is kept allocated when it's at the initial size.
- * This makes it fast while not keeping a lot of memory allocated.
- * A three times speed increase was observed when using many simple patterns.
+ * "backpos" is a table with backpos_T for BACK.
+ * They are only allocated when needed, many simple patterns don't use them.
+ * A big grow size avoids many malloc calls in case of deep regular
+ * expressions.  They are freed in bt_regexec_both() when finished.
  */
-#define REGSTACK_INITIAL	2048
-#define BACKPOS_INITIAL		64
+#define REGSTACK_GROWSIZE	16384
+#define BACKPOS_GROWSIZE	512
 
 #if defined(EXITFREE) || defined(PROTO)
     void
 free_regexp_stuff()
 {
-    ga_clear(&regstack);
-    ga_clear(&backpos);
-    vim_free(reg_tofree);
     vim_free(reg_prev_sub);
+# ifdef FEAT_RE_CACHE
+    re_cache_clear();
+# endif
 }
 #endif
 
 /*
- * Get pointer to the line "lnum", which is relative to "reg_firstlnum".
+ * Get pointer to the line "lnum", which is relative to "rex->reg_firstlnum".
  */
     static char_u *
-reg_getline(lnum)
+reg_getline(rex, lnum)
+    regexec_T	*rex;
     linenr_T	lnum;
 {
     /* when looking behind for a match/no-match lnum is negative.  But we
      * can't go before line 1 */
-    if (reg_firstlnum + lnum < 1)
+    if (rex->reg_firstlnum + lnum < 1)
 	return NULL;
-    if (lnum > reg_maxline)
+    if (lnum > rex->reg_maxline)
 	/* Must have matched the "\n" in the last line. */
 	return (char_u *)"";
-    return ml_get_buf(reg_buf, reg_firstlnum + lnum, FALSE);
+    return ml_get_buf(rex->reg_buf, rex->reg_firstlnum + lnum, FALSE);
 }
 
-static regsave_T behind_pos;
+/* TRUE if using multi-line regexp. */
+#define REG_MULTI	(rex->reg_match == NULL)
 
-#ifdef FEAT_SYN_HL
-static char_u	*reg_startzp[NSUBEXP];	/* Workspace to mark beginning */
-static char_u	*reg_endzp[NSUBEXP];	/*   and end of \z(...\) matches */
-static lpos_T	reg_startzpos[NSUBEXP];	/* idem, beginning pos */
-static lpos_T	reg_endzpos[NSUBEXP];	/* idem, end pos */
-#endif
+/* Give error message "s" for executing a regexp.  In another thread only
+ * remember that it failed, see vim_regexec_thread(). */
+#define REX_EMSG(s) \
+    (rex->reg_thread ? (void)(rex->reg_failed = TRUE) : (void)EMSG(s))
 
-/* TRUE if using multi-line regexp. */
-#define REG_MULTI	(reg_match == NULL)
+static char_u *rex_alloc __ARGS((regexec_T *rex, long_u size));
+static int rex_ga_grow __ARGS((regexec_T *rex, garray_T *gap, int n));
 
-static int  bt_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col, int line_lbr));
+/*
+ * Allocate "size" bytes of memory for executing a regexp.
+ * In another thread lalloc() can't be used, it may release memory and give
+ * an error message.  Use malloc() and set "reg_failed" when it fails.
+ */
+    static char_u *
+rex_alloc(rex, size)
+    regexec_T	*rex;
+    long_u	size;
+{
+    char_u	*p;
+
+    if (!rex->reg_thread)
+	return lalloc(size, TRUE);
+    p = (char_u *)malloc((size_t)size);
+    if (p == NULL)
+	rex->reg_failed = TRUE;
+    return p;
+}
+
+/*
+ * Like ga_grow(), using rex_alloc().
+ */
+    static int
+rex_ga_grow(rex, gap, n)
+    regexec_T	*rex;
+    garray_T	*gap;
+    int		n;
+{
+    size_t	old_len;
+    size_t	new_len;
+    char_u	*pp;
+
+    if (!rex->reg_thread)
+	return ga_grow(gap, n);
+    if (gap->ga_maxlen - gap->ga_len < n)
+    {
+	if (n < gap->ga_growsize)
+	    n = gap->ga_growsize;
+	new_len = gap->ga_itemsize * (gap->ga_len + n);
+	pp = (gap->ga_data == NULL)
+	      ? rex_alloc(rex, (long_u)new_len)
+	      : vim_realloc(gap->ga_data, new_len);
+	if (pp == NULL)
+	{
+	    rex->reg_failed = TRUE;
+	    return FAIL;
+	}
+	old_len = gap->ga_itemsize * gap->ga_maxlen;
+	vim_memset(pp + old_len, 0, new_len - old_len);
+	gap->ga_maxlen = gap->ga_len + n;
+	gap->ga_data = pp;
+    }
+    return OK;
+}
+
+static int  bt_regexec_nl __ARGS((regexec_T *rex, regmatch_T *rmp, char_u *line, colnr_T col, int line_lbr));
 
 
 /*
@@ -3742,28 +3890,29 @@ static int  bt_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col, in
  * Returns 0 for failure, number of lines contained in the match otherwise.
  */
     static int
-bt_regexec_nl(rmp, line, col, line_lbr)
+bt_regexec_nl(rex, rmp, line, col, line_lbr)
+    regexec_T	*rex;
     regmatch_T	*rmp;
     char_u	*line;	/* string to match against */
     colnr_T	col;	/* column to start looking for match */
     int		line_lbr;
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    reg_line_lbr = line_lbr;
-    reg_buf = curbuf;
-    reg_win = NULL;
-    ireg_ic = rmp->rm_ic;
+    rex->reg_match = rmp;
+    rex->reg_mmatch = NULL;
+    rex->reg_maxline = 0;
+    rex->reg_line_lbr = line_lbr;
+    rex->reg_buf = curbuf;
+    rex->reg_win = NULL;
+    rex->reg_ic = rmp->rm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex->reg_icombine = FALSE;
 #endif
-    ireg_maxcol = 0;
+    rex->reg_maxcol = 0;
 
-    return bt_regexec_both(line, col, NULL);
+    return bt_regexec_both(rex, line, col, NULL);
 }
 
-static long bt_regexec_multi __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T lnum, colnr_T col, proftime_T *tm));
+static long bt_regexec_multi __ARGS((regexec_T *rex, regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T lnum, colnr_T col, proftime_T *tm));
 
 /*
  * Match a regexp against multiple lines.
@@ -3774,7 +3923,8 @@ static long bt_regexec_multi __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, l
  * match otherwise.
  */
     static long
-bt_regexec_multi(rmp, win, buf, lnum, col, tm)
+bt_regexec_multi(rex, rmp, win, buf, lnum, col, tm)
+    regexec_T	*rex;
     regmmatch_T	*rmp;
     win_T	*win;		/* window in which to search or NULL */
     buf_T	*buf;		/* buffer in which to search */
@@ -3782,20 +3932,20 @@ bt_regexec_multi(rmp, win, buf, lnum, col, tm)
     colnr_T	col;		/* column to start looking for match */
     proftime_T	*tm;		/* timeout limit or NULL */
 {
-    reg_match = NULL;
-    reg_mmatch = rmp;
-    reg_buf = buf;
-    reg_win = win;
-    reg_firstlnum = lnum;
-    reg_maxline = reg_buf->b_ml.ml_line_count - lnum;
-    reg_line_lbr = FALSE;
-    ireg_ic = rmp->rmm_ic;
+    rex->reg_match = NULL;
+    rex->reg_mmatch = rmp;
+    rex->reg_buf = buf;
+    rex->reg_win = win;
+    rex->reg_firstlnum = lnum;
+    rex->reg_maxline = rex->reg_buf->b_ml.ml_line_count - lnum;
+    rex->reg_line_lbr = FALSE;
+    rex->reg_ic = rmp->rmm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex->reg_icombine = FALSE;
 #endif
-    ireg_maxcol = rmp->rmm_maxcol;
+    rex->reg_maxcol = rmp->rmm_maxcol;
 
-    return bt_regexec_both(NULL, col, tm);
+    return bt_regexec_both(rex, NULL, col, tm);
 }
 
 /*
@@ -3804,7 +3954,8 @@ bt_regexec_multi(rmp, win, buf, lnum, col, tm)
  * Returns 0 for failure, number of lines contained in the match otherwise.
  */
     static long
-bt_regexec_both(line, col, tm)
+bt_regexec_both(rex, line, col, tm)
+    regexec_T	*rex;
     char_u	*line;
     colnr_T	col;		/* column to start looking for match */
     proftime_T	*tm UNUSED;	/* timeout limit or NULL */
@@ -3813,65 +3964,50 @@ bt_regexec_both(line, col, tm)
     char_u	    *s;
     long	    retval = 0L;
 
-    /* Create "regstack" and "backpos" if they are not allocated yet.
-     * We allocate *_INITIAL amount of bytes first and then set the grow size
-     * to much bigger value to avoid many malloc calls in case of deep regular
-     * expressions.  */
-    if (regstack.ga_data == NULL)
-    {
-	/* Use an item size of 1 byte, since we push different things
-	 * onto the regstack. */
-	ga_init2(&regstack, 1, REGSTACK_INITIAL);
-	ga_grow(&regstack, REGSTACK_INITIAL);
-	regstack.ga_growsize = REGSTACK_INITIAL * 8;
-    }
-
-    if (backpos.ga_data == NULL)
-    {
-	ga_init2(&backpos, sizeof(backpos_T), BACKPOS_INITIAL);
-	ga_grow(&backpos, BACKPOS_INITIAL);
-	backpos.ga_growsize = BACKPOS_INITIAL * 8;
-    }
+    /* Use an item size of 1 byte for "regstack", since we push different
+     * things onto it. */
+    ga_init2(&rex->regstack, 1, REGSTACK_GROWSIZE);
+    ga_init2(&rex->backpos, sizeof(backpos_T), BACKPOS_GROWSIZE);
 
     if (REG_MULTI)
     {
-	prog = (bt_regprog_T *)reg_mmatch->regprog;
-	line = reg_getline((linenr_T)0);
-	reg_startpos = reg_mmatch->startpos;
-	reg_endpos = reg_mmatch->endpos;
+	prog = (bt_regprog_T *)rex->reg_mmatch->regprog;
+	line = reg_getline(rex, (linenr_T)0);
+	rex->reg_startpos = rex->reg_mmatch->startpos;
+	rex->reg_endpos = rex->reg_mmatch->endpos;
     }
     else
     {
-	prog = (bt_regprog_T *)reg_match->regprog;
-	reg_startp = reg_match->startp;
-	reg_endp = reg_match->endp;
+	prog = (bt_regprog_T *)rex->reg_match->regprog;
+	rex->reg_startp = rex->reg_match->startp;
+	rex->reg_endp = rex->reg_match->endp;
     }
 
     /* Be paranoid... */
     if (prog == NULL || line == NULL)
     {
-	EMSG(_(e_null));
+	REX_EMSG(_(e_null));
 	goto theend;
     }
 
     /* Check validity of program. */
-    if (prog_magic_wrong())
+    if (prog_magic_wrong(rex))
 	goto theend;
 
     /* If the start column is past the maximum column: no need to try. */
-    if (ireg_maxcol > 0 && col >= ireg_maxcol)
+    if (rex->reg_maxcol > 0 && col >= rex->reg_maxcol)
 	goto theend;
 
-    /* If pattern contains "\c" or "\C": overrule value of ireg_ic */
+    /* If pattern contains "\c" or "\C": overrule value of rex->reg_ic */
     if (prog->regflags & RF_ICASE)
-	ireg_ic = TRUE;
+	rex->reg_ic = TRUE;
     else if (prog->regflags & RF_NOICASE)
-	ireg_ic = FALSE;
+	rex->reg_ic = FALSE;
 
 #ifdef FEAT_MBYTE
-    /* If pattern contains "\Z" overrule value of ireg_icombine */
+    /* If pattern contains "\Z" overrule value of rex->reg_icombine */
     if (prog->regflags & RF_ICOMBINE)
-	ireg_icombine = TRUE;
+	rex->reg_icombine = TRUE;
 #endif
 
     /* If there is a "must appear" string, look for it. */
@@ -3891,30 +4027,29 @@ bt_regexec_both(line, col, tm)
 	 * This is used very often, esp. for ":global".  Use three versions of
 	 * the loop to avoid overhead of conditions.
 	 */
-	if (!ireg_ic
+	if (!rex->reg_ic
 #ifdef FEAT_MBYTE
-		&& !has_mbyte
+		&& (!has_mbyte || enc_utf8)
 #endif
 		)
-	    while ((s = vim_strbyte(s, c)) != NULL)
-	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-		    break;		/* Found it. */
-		++s;
-	    }
+	    /* Let the library find the whole string, it is much faster than
+	     * checking each occurrence of the first character.  In UTF-8 the
+	     * first byte of a character does not appear inside another
+	     * character. */
+	    s = (char_u *)strstr((char *)s, (char *)prog->regmust);
 #ifdef FEAT_MBYTE
-	else if (!ireg_ic || (!enc_utf8 && mb_char2len(c) > 1))
+	else if (!rex->reg_ic || (!enc_utf8 && mb_char2len(c) > 1))
 	    while ((s = vim_strchr(s, c)) != NULL)
 	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
+		if (cstrncmp(rex, s, prog->regmust, &prog->regmlen) == 0)
 		    break;		/* Found it. */
 		mb_ptr_adv(s);
 	    }
 #endif
 	else
-	    while ((s = cstrchr(s, c)) != NULL)
+	    while ((s = cstrchr(rex, s, c)) != NULL)
 	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
+		if (cstrncmp(rex, s, prog->regmust, &prog->regmlen) == 0)
 		    break;		/* Found it. */
 		mb_ptr_adv(s);
 	    }
@@ -3922,8 +4057,8 @@ bt_regexec_both(line, col, tm)
 	    goto theend;
     }
 
-    regline = line;
-    reglnum = 0;
+    rex->line = line;
+    rex->lnum = 0;
     reg_toolong = FALSE;
 
     /* Simplest case: Anchored match need be tried only once. */
@@ -3933,19 +4068,19 @@ bt_regexec_both(line, col, tm)
 
 #ifdef FEAT_MBYTE
 	if (has_mbyte)
-	    c = (*mb_ptr2char)(regline + col);
+	    c = (*mb_ptr2char)(rex->line + col);
 	else
 #endif
-	    c = regline[col];
+	    c = rex->line[col];
 	if (prog->regstart == NUL
 		|| prog->regstart == c
-		|| (ireg_ic && ((
+		|| (rex->reg_ic && ((
 #ifdef FEAT_MBYTE
 			(enc_utf8 && utf_fold(prog->regstart) == utf_fold(c)))
 			|| (c < 255 && prog->regstart < 255 &&
 #endif
 			    MB_TOLOWER(prog->regstart) == MB_TOLOWER(c)))))
-	    retval = regtry(prog, col);
+	    retval = regtry(rex, prog, col);
 	else
 	    retval = 0;
     }
@@ -3961,44 +4096,44 @@ bt_regexec_both(line, col, tm)
 	    {
 		/* Skip until the char we know it must start with.
 		 * Used often, do some work to avoid call overhead. */
-		if (!ireg_ic
+		if (!rex->reg_ic
 #ifdef FEAT_MBYTE
 			    && !has_mbyte
 #endif
 			    )
-		    s = vim_strbyte(regline + col, prog->regstart);
+		    s = vim_strbyte(rex->line + col, prog->regstart);
 		else
-		    s = cstrchr(regline + col, prog->regstart);
+		    s = cstrchr(rex, rex->line + col, prog->regstart);
 		if (s == NULL)
 		{
 		    retval = 0;
 		    break;
 		}
-		col = (int)(s - regline);
+		col = (int)(s - rex->line);
 	    }
 
 	    /* Check for maximum column to try. */
-	    if (ireg_maxcol > 0 && col >= ireg_maxcol)
+	    if (rex->reg_maxcol > 0 && col >= rex->reg_maxcol)
 	    {
 		retval = 0;
 		break;
 	    }
 
-	    retval = regtry(prog, col);
+	    retval = regtry(rex, prog, col);
 	    if (retval > 0)
 		break;
 
 	    /* if not currently on the first line, get it again */
-	    if (reglnum != 0)
+	    if (rex->lnum != 0)
 	    {
-		reglnum = 0;
-		regline = reg_getline((linenr_T)0);
+		rex->lnum = 0;
+		rex->line = reg_getline(rex, (linenr_T)0);
 	    }
-	    if (regline[col] == NUL)
+	    if (rex->line[col] == NUL)
 		break;
 #ifdef FEAT_MBYTE
 	    if (has_mbyte)
-		col += (*mb_ptr2len)(regline + col);
+		col += (*mb_ptr2len)(rex->line + col);
 	    else
 #endif
 		++col;
@@ -4015,17 +4150,10 @@ bt_regexec_both(line, col, tm)
     }
 
 theend:
-    /* Free "reg_tofree" when it's a bit big.
-     * Free regstack and backpos if they are bigger than their initial size. */
-    if (reg_tofreelen > 400)
-    {
-	vim_free(reg_tofree);
-	reg_tofree = NULL;
-    }
-    if (regstack.ga_maxlen > REGSTACK_INITIAL)
-	ga_clear(&regstack);
-    if (backpos.ga_maxlen > BACKPOS_INITIAL)
-	ga_clear(&backpos);
+    vim_free(rex->reg_tofree);
+    rex->reg_tofree = NULL;
+    ga_clear(&rex->regstack);
+    ga_clear(&rex->backpos);
 
     return retval;
 }
@@ -4079,121 +4207,129 @@ unref_extmatch(em)
 #endif
 
 /*
- * regtry - try match of "prog" with at regline["col"].
+ * regtry - try match of "prog" with at rex->line["col"].
  * Returns 0 for failure, number of lines contained in the match otherwise.
  */
     static long
-regtry(prog, col)
+regtry(rex, prog, col)
+    regexec_T	    *rex;
     bt_regprog_T    *prog;
     colnr_T	col;
 {
-    reginput = regline + col;
-    need_clear_subexpr = TRUE;
+    rex->input = rex->line + col;
+    rex->need_clear_subexpr = TRUE;
 #ifdef FEAT_SYN_HL
     /* Clear the external match subpointers if necessary. */
     if (prog->reghasz == REX_SET)
-	need_clear_zsubexpr = TRUE;
+	rex->need_clear_zsubexpr = TRUE;
 #endif
 
-    if (regmatch(prog->program + 1) == 0)
+    if (regmatch(rex, prog->program + 1) == 0)
 	return 0;
 
-    cleanup_subexpr();
+    cleanup_subexpr(rex);
     if (REG_MULTI)
     {
-	if (reg_startpos[0].lnum < 0)
+	if (rex->reg_startpos[0].lnum < 0)
 	{
-	    reg_startpos[0].lnum = 0;
-	    reg_startpos[0].col = col;
+	    rex->reg_startpos[0].lnum = 0;
+	    rex->reg_startpos[0].col = col;
 	}
-	if (reg_endpos[0].lnum < 0)
+	if (rex->reg_endpos[0].lnum < 0)
 	{
-	    reg_endpos[0].lnum = reglnum;
-	    reg_endpos[0].col = (int)(reginput - regline);
+	    rex->reg_endpos[0].lnum = rex->lnum;
+	    rex->reg_endpos[0].col = (int)(rex->input - rex->line);
 	}
 	else
 	    /* Use line number of "\ze". */
-	    reglnum = reg_endpos[0].lnum;
+	    rex->lnum = rex->reg_endpos[0].lnum;
     }
     else
     {
-	if (reg_startp[0] == NULL)
-	    reg_startp[0] = regline + col;
-	if (reg_endp[0] == NULL)
-	    reg_endp[0] = reginput;
+	if (rex->reg_startp[0] == NULL)
+	    rex->reg_startp[0] = rex->line + col;
+	if (rex->reg_endp[0] == NULL)
+	    rex->reg_endp[0] = rex->input;
     }
 #ifdef FEAT_SYN_HL
-    /* Package any found \z(...\) matches for export. Default is none. */
-    unref_extmatch(re_extmatch_out);
-    re_extmatch_out = NULL;
+    /* Package any found \z(...\) matches for export. Default is none.
+     * A pattern executed in a thread can't have them, leave the global
+     * alone. */
+    if (!rex->reg_thread)
+    {
+	unref_extmatch(re_extmatch_out);
+	re_extmatch_out = NULL;
+    }
 
     if (prog->reghasz == REX_SET)
     {
 	int		i;
 
-	cleanup_zsubexpr();
+	cleanup_zsubexpr(rex);
 	re_extmatch_out = make_extmatch();
 	for (i = 0; i < NSUBEXP; i++)
 	{
 	    if (REG_MULTI)
 	    {
 		/* Only accept single line matches. */
-		if (reg_startzpos[i].lnum >= 0
-			&& reg_endzpos[i].lnum == reg_startzpos[i].lnum
-			&& reg_endzpos[i].col >= reg_startzpos[i].col)
-		    re_extmatch_out->matches[i] =
-			vim_strnsave(reg_getline(reg_startzpos[i].lnum)
-						       + reg_startzpos[i].col,
-				   reg_endzpos[i].col - reg_startzpos[i].col);
+		if (rex->reg_startzpos[i].lnum >= 0
+		     && rex->reg_endzpos[i].lnum == rex->reg_startzpos[i].lnum
+		     && rex->reg_endzpos[i].col >= rex->reg_startzpos[i].col)
+		    re_extmatch_out->matches[i] = vim_strnsave(
+			    reg_getline(rex, rex->reg_startzpos[i].lnum)
+						   + rex->reg_startzpos[i].col,
+			 rex->reg_endzpos[i].col - rex->reg_startzpos[i].col);
 	    }
 	    else
 	    {
-		if (reg_startzp[i] != NULL && reg_endzp[i] != NULL)
+		if (rex->reg_startzp[i] != NULL && rex->reg_endzp[i] != NULL)
 		    re_extmatch_out->matches[i] =
-			    vim_strnsave(reg_startzp[i],
-					(int)(reg_endzp[i] - reg_startzp[i]));
+			    vim_strnsave(rex->reg_startzp[i],
+			       (int)(rex->reg_endzp[i] - rex->reg_startzp[i]));
 	    }
 	}
     }
 #endif
-    return 1 + reglnum;
+    return 1 + rex->lnum;
 }
 
 #ifdef FEAT_MBYTE
-static int reg_prev_class __ARGS((void));
+static int reg_prev_class __ARGS((regexec_T *rex));
 
 /*
  * Get class of previous character.
  */
     static int
-reg_prev_class()
+reg_prev_class(rex)
+    regexec_T	*rex;
 {
-    if (reginput > regline)
-	return mb_get_class_buf(reginput - 1
-			    - (*mb_head_off)(regline, reginput - 1), reg_buf);
+    if (rex->input > rex->line)
+	return mb_get_class_buf(rex->input - 1
+		    - (*mb_head_off)(rex->line, rex->input - 1), rex->reg_buf);
     return -1;
 }
 #endif
 
-static int reg_match_visual __ARGS((void));
+static int reg_match_visual __ARGS((regexec_T *rex));
 
 /*
- * Return TRUE if the current reginput position matches the Visual area.
+ * Return TRUE if the current rex->input position matches the Visual area.
  */
     static int
-reg_match_visual()
+reg_match_visual(rex)
+    regexec_T	*rex;
 {
     pos_T	top, bot;
     linenr_T    lnum;
     colnr_T	col;
-    win_T	*wp = reg_win == NULL ? curwin : reg_win;
+    win_T	*wp = rex->reg_win == NULL ? curwin : rex->reg_win;
     int		mode;
     colnr_T	start, end;
     colnr_T	start2, end2;
     colnr_T	cols;
 
     /* Check if the buffer is the current buffer. */
-    if (reg_buf != curbuf || VIsual.lnum == 0)
+    if (rex->reg_buf != curbuf || VIsual.lnum == 0)
 	return FALSE;
 
     if (VIsual_active)
@@ -4224,13 +4360,13 @@ reg_match_visual()
 	}
 	mode = curbuf->b_visual.vi_mode;
     }
-    lnum = reglnum + reg_firstlnum;
+    lnum = rex->lnum + rex->reg_firstlnum;
     if (lnum < top.lnum || lnum > bot.lnum)
 	return FALSE;
 
     if (mode == 'v')
     {
-	col = (colnr_T)(reginput - regline);
+	col = (colnr_T)(rex->input - rex->line);
 	if ((lnum == top.lnum && col < top.col)
 		|| (lnum == bot.lnum && col >= bot.col + (*p_sel != 'e')))
 	    return FALSE;
@@ -4245,22 +4381,15 @@ reg_match_visual()
 	    end = end2;
 	if (top.col == MAXCOL || bot.col == MAXCOL)
 	    end = MAXCOL;
-	cols = win_linetabsize(wp, regline, (colnr_T)(reginput - regline));
+	cols = win_linetabsize(wp, rex->line,
+					   (colnr_T)(rex->input - rex->line));
 	if (cols < start || cols > end - (*p_sel == 'e'))
 	    return FALSE;
     }
     return TRUE;
 }
 
-#define ADVANCE_REGINPUT() mb_ptr_adv(reginput)
-
-/*
- * The arguments from BRACE_LIMITS are stored here.  They are actually local
- * to regmatch(), but they are here to reduce the amount of stack space used
- * (it can be called recursively many times).
- */
-static long	bl_minval;
-static long	bl_maxval;
+#define ADVANCE_REGINPUT() mb_ptr_adv(rex->input)
 
 /*
  * regmatch - main matching routine
@@ -4272,13 +4401,14 @@ static long	bl_maxval;
  * (that don't need to know whether the rest of the match failed) by a nested
  * loop.
  *
- * Returns TRUE when there is a match.  Leaves reginput and reglnum just after
- * the last matched character.
- * Returns FALSE when there is no match.  Leaves reginput and reglnum in an
+ * Returns TRUE when there is a match.  Leaves rex->input and rex->lnum just
+ * after the last matched character.
+ * Returns FALSE when there is no match.  Leaves rex->input and rex->lnum in an
  * undefined state!
  */
     static int
-regmatch(scan)
+regmatch(rex, scan)
+    regexec_T	*rex;
     char_u	*scan;		/* Current node. */
 {
   char_u	*next;		/* Next node. */
@@ -4293,10 +4423,10 @@ regmatch(scan)
 #define RA_MATCH	4	/* successful match */
 #define RA_NOMATCH	5	/* didn't match */
 
-  /* Make "regstack" and "backpos" empty.  They are allocated and freed in
-   * bt_regexec_both() to reduce malloc()/free() calls. */
-  regstack.ga_len = 0;
-  backpos.ga_len = 0;
+  /* Make "regstack" and "backpos" empty.  They are allocated when needed and
+   * freed in bt_regexec_both(). */
+  rex->regstack.ga_len = 0;
+  rex->backpos.ga_len = 0;
 
   /*
    * Repeat until "regstack" is empty.
@@ -4305,7 +4435,8 @@ regmatch(scan)
   {
     /* Some patterns may take a long time to match, e.g., "\([a-z]\+\)\+Q".
      * Allow interrupting them with CTRL-C. */
-    fast_breakcheck();
+    if (!rex->reg_thread)
+	fast_breakcheck();
 
 #ifdef DEBUG
     if (scan != NULL && regnarrate)
@@ -4354,12 +4485,12 @@ regmatch(scan)
 
 	op = OP(scan);
 	/* Check for character class with NL added. */
-	if (!reg_line_lbr && WITH_NL(op) && REG_MULTI
-				&& *reginput == NUL && reglnum <= reg_maxline)
+	if (!rex->reg_line_lbr && WITH_NL(op) && REG_MULTI
+			&& *rex->input == NUL && rex->lnum <= rex->reg_maxline)
 	{
-	    reg_nextline();
+	    reg_nextline(rex);
 	}
-	else if (reg_line_lbr && WITH_NL(op) && *reginput == '\n')
+	else if (rex->reg_line_lbr && WITH_NL(op) && *rex->input == '\n')
 	{
 	    ADVANCE_REGINPUT();
 	}
@@ -4369,14 +4500,14 @@ regmatch(scan)
 	      op -= ADD_NL;
 #ifdef FEAT_MBYTE
 	  if (has_mbyte)
-	      c = (*mb_ptr2char)(reginput);
+	      c = (*mb_ptr2char)(rex->input);
 	  else
 #endif
-	      c = *reginput;
+	      c = *rex->input;
 	  switch (op)
 	  {
 	  case BOL:
-	    if (reginput != regline)
+	    if (rex->input != rex->line)
 		status = RA_NOMATCH;
 	    break;
 
@@ -4389,22 +4520,24 @@ regmatch(scan)
 	    /* We're not at the beginning of the file when below the first
 	     * line where we started, not at the start of the line or we
 	     * didn't start at the first line of the buffer. */
-	    if (reglnum != 0 || reginput != regline
-					  || (REG_MULTI && reg_firstlnum > 1))
+	    if (rex->lnum != 0 || rex->input != rex->line
+				      || (REG_MULTI && rex->reg_firstlnum > 1))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_EOF:
-	    if (reglnum != reg_maxline || c != NUL)
+	    if (rex->lnum != rex->reg_maxline || c != NUL)
 		status = RA_NOMATCH;
 	    break;
 
 	  case CURSOR:
 	    /* Check if the buffer is in a window and compare the
-	     * reg_win->w_cursor position to the match position. */
-	    if (reg_win == NULL
-		    || (reglnum + reg_firstlnum != reg_win->w_cursor.lnum)
-		    || ((colnr_T)(reginput - regline) != reg_win->w_cursor.col))
+	     * rex->reg_win->w_cursor position to the match position. */
+	    if (rex->reg_win == NULL
+		    || (rex->lnum + rex->reg_firstlnum
+					       != rex->reg_win->w_cursor.lnum)
+		    || ((colnr_T)(rex->input - rex->line)
+						!= rex->reg_win->w_cursor.col))
 		status = RA_NOMATCH;
 	    break;
 
@@ -4415,16 +4548,17 @@ regmatch(scan)
 		int	cmp = OPERAND(scan)[1];
 		pos_T	*pos;
 
-		pos = getmark_buf(reg_buf, mark, FALSE);
+		pos = getmark_buf(rex->reg_buf, mark, FALSE);
 		if (pos == NULL		     /* mark doesn't exist */
 			|| pos->lnum <= 0    /* mark isn't set in reg_buf */
-			|| (pos->lnum == reglnum + reg_firstlnum
-				? (pos->col == (colnr_T)(reginput - regline)
+			|| (pos->lnum == rex->lnum + rex->reg_firstlnum
+			       ? (pos->col == (colnr_T)(rex->input - rex->line)
 				    ? (cmp == '<' || cmp == '>')
-				    : (pos->col < (colnr_T)(reginput - regline)
+				    : (pos->col
+					    < (colnr_T)(rex->input - rex->line)
 					? cmp != '>'
 					: cmp != '<'))
-				: (pos->lnum < reglnum + reg_firstlnum
+				: (pos->lnum < rex->lnum + rex->reg_firstlnum
 				    ? cmp != '>'
 				    : cmp != '<')))
 		    status = RA_NOMATCH;
@@ -4432,29 +4566,30 @@ regmatch(scan)
 	    break;
 
 	  case RE_VISUAL:
-	    if (!reg_match_visual())
+	    if (!reg_match_visual(rex))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_LNUM:
-	    if (!REG_MULTI || !re_num_cmp((long_u)(reglnum + reg_firstlnum),
-									scan))
+	    if (!REG_MULTI || !re_num_cmp(
+			       (long_u)(rex->lnum + rex->reg_firstlnum), scan))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_COL:
-	    if (!re_num_cmp((long_u)(reginput - regline) + 1, scan))
+	    if (!re_num_cmp((long_u)(rex->input - rex->line) + 1, scan))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_VCOL:
 	    if (!re_num_cmp((long_u)win_linetabsize(
-			    reg_win == NULL ? curwin : reg_win,
-			    regline, (colnr_T)(reginput - regline)) + 1, scan))
+			    rex->reg_win == NULL ? curwin : rex->reg_win,
+			    rex->line, (colnr_T)(rex->input - rex->line)) + 1,
+									scan))
 		status = RA_NOMATCH;
 	    break;
 
-	  case BOW:	/* \<word; reginput points to w */
+	  case BOW:	/* \<word; rex->input points to w */
 	    if (c == NUL)	/* Can't match at end of line */
 		status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
@@ -4463,23 +4598,24 @@ regmatch(scan)
 		int this_class;
 
 		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class_buf(reginput, reg_buf);
+		this_class = mb_get_class_buf(rex->input, rex->reg_buf);
 		if (this_class <= 1)
 		    status = RA_NOMATCH;  /* not on a word at all */
-		else if (reg_prev_class() == this_class)
+		else if (reg_prev_class(rex) == this_class)
 		    status = RA_NOMATCH;  /* previous char is in same word */
 	    }
 #endif
 	    else
 	    {
-		if (!vim_iswordc_buf(c, reg_buf) || (reginput > regline
-				   && vim_iswordc_buf(reginput[-1], reg_buf)))
+		if (!vim_iswordc_buf(c, rex->reg_buf)
+			|| (rex->input > rex->line
+			     && vim_iswordc_buf(rex->input[-1], rex->reg_buf)))
 		    status = RA_NOMATCH;
 	    }
 	    break;
 
-	  case EOW:	/* word\>; reginput points after d */
-	    if (reginput == regline)    /* Can't match at start of line */
+	  case EOW:	/* word\>; rex->input points after d */
+	    if (rex->input == rex->line)    /* Can't match at start of line */
 		status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
 	    else if (has_mbyte)
@@ -4487,8 +4623,8 @@ regmatch(scan)
 		int this_class, prev_class;
 
 		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class_buf(reginput, reg_buf);
-		prev_class = reg_prev_class();
+		this_class = mb_get_class_buf(rex->input, rex->reg_buf);
+		prev_class = reg_prev_class(rex);
 		if (this_class == prev_class
 			|| prev_class == 0 || prev_class == 1)
 		    status = RA_NOMATCH;
@@ -4496,8 +4632,9 @@ regmatch(scan)
 #endif
 	    else
 	    {
-		if (!vim_iswordc_buf(reginput[-1], reg_buf)
-			|| (reginput[0] != NUL && vim_iswordc_buf(c, reg_buf)))
+		if (!vim_iswordc_buf(rex->input[-1], rex->reg_buf)
+			|| (rex->input[0] != NUL
+					  && vim_iswordc_buf(c, rex->reg_buf)))
 		    status = RA_NOMATCH;
 	    }
 	    break; /* Matched with EOW */
@@ -4518,21 +4655,22 @@ regmatch(scan)
 	    break;
 
 	  case SIDENT:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isIDc(c))
+	    if (VIM_ISDIGIT(*rex->input) || !vim_isIDc(c))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case KWORD:
-	    if (!vim_iswordp_buf(reginput, reg_buf))
+	    if (!vim_iswordp_buf(rex->input, rex->reg_buf))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case SKWORD:
-	    if (VIM_ISDIGIT(*reginput) || !vim_iswordp_buf(reginput, reg_buf))
+	    if (VIM_ISDIGIT(*rex->input)
+				 || !vim_iswordp_buf(rex->input, rex->reg_buf))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4546,21 +4684,22 @@ regmatch(scan)
 	    break;
 
 	  case SFNAME:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isfilec(c))
+	    if (VIM_ISDIGIT(*rex->input) || !vim_isfilec(c))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case PRINT:
-	    if (!vim_isprintc(PTR2CHAR(reginput)))
+	    if (!vim_isprintc(PTR2CHAR(rex->input)))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case SPRINT:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isprintc(PTR2CHAR(reginput)))
+	    if (VIM_ISDIGIT(*rex->input)
+				     || !vim_isprintc(PTR2CHAR(rex->input)))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4699,12 +4838,12 @@ regmatch(scan)
 
 		opnd = OPERAND(scan);
 		/* Inline the first byte, for speed. */
-		if (*opnd != *reginput
-			&& (!ireg_ic || (
+		if (*opnd != *rex->input
+			&& (!rex->reg_ic || (
 #ifdef FEAT_MBYTE
 			    !enc_utf8 &&
 #endif
-			    MB_TOLOWER(*opnd) != MB_TOLOWER(*reginput))))
+			    MB_TOLOWER(*opnd) != MB_TOLOWER(*rex->input))))
 		    status = RA_NOMATCH;
 		else if (*opnd == NUL)
 		{
@@ -4715,7 +4854,7 @@ regmatch(scan)
 		{
 		    if (opnd[1] == NUL
 #ifdef FEAT_MBYTE
-			    && !(enc_utf8 && ireg_ic)
+			    && !(enc_utf8 && rex->reg_ic)
 #endif
 			)
 		    {
@@ -4725,7 +4864,7 @@ regmatch(scan)
 		    {
 			/* Need to match first byte again for multi-byte. */
 			len = (int)STRLEN(opnd);
-			if (cstrncmp(opnd, reginput, &len) != 0)
+			if (cstrncmp(rex, opnd, rex->input, &len) != 0)
 			    status = RA_NOMATCH;
 		    }
 #ifdef FEAT_MBYTE
@@ -4733,8 +4872,8 @@ regmatch(scan)
 		     * follows (skips over all composing chars). */
 		    if (status != RA_NOMATCH
 			    && enc_utf8
-			    && UTF_COMPOSINGLIKE(reginput, reginput + len)
-			    && !ireg_icombine
+			    && UTF_COMPOSINGLIKE(rex->input, rex->input + len)
+			    && !rex->reg_icombine
 			    && OP(next) != RE_COMPOSING)
 		    {
 			/* raaron: This code makes a composing character get
@@ -4744,7 +4883,7 @@ regmatch(scan)
 		    }
 #endif
 		    if (status != RA_NOMATCH)
-			reginput += len;
+			rex->input += len;
 		}
 	    }
 	    break;
@@ -4753,7 +4892,7 @@ regmatch(scan)
 	  case ANYBUT:
 	    if (c == NUL)
 		status = RA_NOMATCH;
-	    else if ((cstrchr(OPERAND(scan), c) == NULL) == (op == ANYOF))
+	    else if ((cstrchr(rex, OPERAND(scan), c) == NULL) == (op == ANYOF))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4782,9 +4921,9 @@ regmatch(scan)
 		    /* When only a composing char is given match at any
 		     * position where that composing char appears. */
 		    status = RA_NOMATCH;
-		    for (i = 0; reginput[i] != NUL; i += utf_char2len(inpc))
+		    for (i = 0; rex->input[i] != NUL; i += utf_char2len(inpc))
 		    {
-			inpc = mb_ptr2char(reginput + i);
+			inpc = mb_ptr2char(rex->input + i);
 			if (!utf_iscomposing(inpc))
 			{
 			    if (i > 0)
@@ -4793,7 +4932,7 @@ regmatch(scan)
 			else if (opndc == inpc)
 			{
 			    /* Include all following composing chars. */
-			    len = i + mb_ptr2len(reginput + i);
+			    len = i + mb_ptr2len(rex->input + i);
 			    status = RA_MATCH;
 			    break;
 			}
@@ -4801,12 +4940,12 @@ regmatch(scan)
 		}
 		else
 		    for (i = 0; i < len; ++i)
-			if (opnd[i] != reginput[i])
+			if (opnd[i] != rex->input[i])
 			{
 			    status = RA_NOMATCH;
 			    break;
 			}
-		reginput += len;
+		rex->input += len;
 	    }
 	    else
 		status = RA_NOMATCH;
@@ -4817,8 +4956,8 @@ regmatch(scan)
 	    if (enc_utf8)
 	    {
 		/* Skip composing characters. */
-		while (utf_iscomposing(utf_ptr2char(reginput)))
-		    mb_cptr_adv(reginput);
+		while (utf_iscomposing(utf_ptr2char(rex->input)))
+		    mb_cptr_adv(rex->input);
 	    }
 #endif
 	    break;
@@ -4839,29 +4978,29 @@ regmatch(scan)
 		 * The positions are stored in "backpos" and found by the
 		 * current value of "scan", the position in the RE program.
 		 */
-		bp = (backpos_T *)backpos.ga_data;
-		for (i = 0; i < backpos.ga_len; ++i)
+		bp = (backpos_T *)rex->backpos.ga_data;
+		for (i = 0; i < rex->backpos.ga_len; ++i)
 		    if (bp[i].bp_scan == scan)
 			break;
-		if (i == backpos.ga_len)
+		if (i == rex->backpos.ga_len)
 		{
 		    /* First time at this BACK, make room to store the pos. */
-		    if (ga_grow(&backpos, 1) == FAIL)
+		    if (rex_ga_grow(rex, &rex->backpos, 1) == FAIL)
 			status = RA_FAIL;
 		    else
 		    {
 			/* get "ga_data" again, it may have changed */
-			bp = (backpos_T *)backpos.ga_data;
+			bp = (backpos_T *)rex->backpos.ga_data;
 			bp[i].bp_scan = scan;
-			++backpos.ga_len;
+			++rex->backpos.ga_len;
 		    }
 		}
-		else if (reg_save_equal(&bp[i].bp_pos))
+		else if (reg_save_equal(rex, &bp[i].bp_pos))
 		    /* Still at same position as last time, fail. */
 		    status = RA_NOMATCH;
 
 		if (status != RA_FAIL && status != RA_NOMATCH)
-		    reg_save(&bp[i].bp_pos, &backpos);
+		    reg_save(rex, &bp[i].bp_pos, &rex->backpos);
 	    }
 	    break;
 
@@ -4877,15 +5016,15 @@ regmatch(scan)
 	  case MOPEN + 9:
 	    {
 		no = op - MOPEN;
-		cleanup_subexpr();
-		rp = regstack_push(RS_MOPEN, scan);
+		cleanup_subexpr(rex);
+		rp = regstack_push(rex, RS_MOPEN, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_startpos[no],
-							     &reg_startp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_startpos[no],
+							 &rex->reg_startp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4893,7 +5032,7 @@ regmatch(scan)
 
 	  case NOPEN:	    /* \%( */
 	  case NCLOSE:	    /* \) after \%( */
-		if (regstack_push(RS_NOPEN, scan) == NULL)
+		if (regstack_push(rex, RS_NOPEN, scan) == NULL)
 		    status = RA_FAIL;
 		/* We simply continue and handle the result when done. */
 		break;
@@ -4910,15 +5049,15 @@ regmatch(scan)
 	  case ZOPEN + 9:
 	    {
 		no = op - ZOPEN;
-		cleanup_zsubexpr();
-		rp = regstack_push(RS_ZOPEN, scan);
+		cleanup_zsubexpr(rex);
+		rp = regstack_push(rex, RS_ZOPEN, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_startzpos[no],
-							     &reg_startzp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_startzpos[no],
+							&rex->reg_startzp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4937,14 +5076,15 @@ regmatch(scan)
 	  case MCLOSE + 9:
 	    {
 		no = op - MCLOSE;
-		cleanup_subexpr();
-		rp = regstack_push(RS_MCLOSE, scan);
+		cleanup_subexpr(rex);
+		rp = regstack_push(rex, RS_MCLOSE, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_endpos[no], &reg_endp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_endpos[no],
+							   &rex->reg_endp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4962,15 +5102,15 @@ regmatch(scan)
 	  case ZCLOSE + 9:
 	    {
 		no = op - ZCLOSE;
-		cleanup_zsubexpr();
-		rp = regstack_push(RS_ZCLOSE, scan);
+		cleanup_zsubexpr(rex);
+		rp = regstack_push(rex, RS_ZCLOSE, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_endzpos[no],
-							      &reg_endzp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_endzpos[no],
+							  &rex->reg_endzp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4990,10 +5130,11 @@ regmatch(scan)
 		int		len;
 
 		no = op - BACKREF;
-		cleanup_subexpr();
+		cleanup_subexpr(rex);
 		if (!REG_MULTI)		/* Single-line regexp */
 		{
-		    if (reg_startp[no] == NULL || reg_endp[no] == NULL)
+		    if (rex->reg_startp[no] == NULL
+						  || rex->reg_endp[no] == NULL)
 		    {
 			/* Backref was not set: Match an empty string. */
 			len = 0;
@@ -5002,38 +5143,42 @@ regmatch(scan)
 		    {
 			/* Compare current input with back-ref in the same
 			 * line. */
-			len = (int)(reg_endp[no] - reg_startp[no]);
-			if (cstrncmp(reg_startp[no], reginput, &len) != 0)
+			len = (int)(rex->reg_endp[no] - rex->reg_startp[no]);
+			if (cstrncmp(rex, rex->reg_startp[no], rex->input,
+								   &len) != 0)
 			    status = RA_NOMATCH;
 		    }
 		}
 		else				/* Multi-line regexp */
 		{
-		    if (reg_startpos[no].lnum < 0 || reg_endpos[no].lnum < 0)
+		    if (rex->reg_startpos[no].lnum < 0
+					       || rex->reg_endpos[no].lnum < 0)
 		    {
 			/* Backref was not set: Match an empty string. */
 			len = 0;
 		    }
 		    else
 		    {
-			if (reg_startpos[no].lnum == reglnum
-				&& reg_endpos[no].lnum == reglnum)
+			if (rex->reg_startpos[no].lnum == rex->lnum
+				&& rex->reg_endpos[no].lnum == rex->lnum)
 			{
 			    /* Compare back-ref within the current line. */
-			    len = reg_endpos[no].col - reg_startpos[no].col;
-			    if (cstrncmp(regline + reg_startpos[no].col,
-							  reginput, &len) != 0)
+			    len = rex->reg_endpos[no].col
+						   - rex->reg_startpos[no].col;
+			    if (cstrncmp(rex,
+				       rex->line + rex->reg_startpos[no].col,
+							rex->input, &len) != 0)
 				status = RA_NOMATCH;
 			}
 			else
 			{
 			    /* Messy situation: Need to compare between two
 			     * lines. */
-			    int r = match_with_backref(
-					    reg_startpos[no].lnum,
-					    reg_startpos[no].col,
-					    reg_endpos[no].lnum,
-					    reg_endpos[no].col,
+			    int r = match_with_backref(rex, 
+					    rex->reg_startpos[no].lnum,
+					    rex->reg_startpos[no].col,
+					    rex->reg_endpos[no].lnum,
+					    rex->reg_endpos[no].col,
 					    &len);
 
 			    if (r != RA_MATCH)
@@ -5043,7 +5188,7 @@ regmatch(scan)
 		}
 
 		/* Matched the backref, skip over it. */
-		reginput += len;
+		rex->input += len;
 	    }
 	    break;
 
@@ -5060,17 +5205,17 @@ regmatch(scan)
 	    {
 		int	len;
 
-		cleanup_zsubexpr();
+		cleanup_zsubexpr(rex);
 		no = op - ZREF;
 		if (re_extmatch_in != NULL
 			&& re_extmatch_in->matches[no] != NULL)
 		{
 		    len = (int)STRLEN(re_extmatch_in->matches[no]);
-		    if (cstrncmp(re_extmatch_in->matches[no],
-							  reginput, &len) != 0)
+		    if (cstrncmp(rex, re_extmatch_in->matches[no],
+							rex->input, &len) != 0)
 			status = RA_NOMATCH;
 		    else
-			reginput += len;
+			rex->input += len;
 		}
 		else
 		{
@@ -5086,7 +5231,7 @@ regmatch(scan)
 		    next = OPERAND(scan);	/* Avoid recursion. */
 		else
 		{
-		    rp = regstack_push(RS_BRANCH, scan);
+		    rp = regstack_push(rex, RS_BRANCH, scan);
 		    if (rp == NULL)
 			status = RA_FAIL;
 		    else
@@ -5099,8 +5244,8 @@ regmatch(scan)
 	    {
 		if (OP(next) == BRACE_SIMPLE)
 		{
-		    bl_minval = OPERAND_MIN(scan);
-		    bl_maxval = OPERAND_MAX(scan);
+		    rex->bl_minval = OPERAND_MIN(scan);
+		    rex->bl_maxval = OPERAND_MAX(scan);
 		}
 		else if (OP(next) >= BRACE_COMPLEX
 			&& OP(next) < BRACE_COMPLEX + 10)
@@ -5112,7 +5257,7 @@ regmatch(scan)
 		}
 		else
 		{
-		    EMSG(_(e_internal));	    /* Shouldn't happen */
+		    REX_EMSG(_(e_internal));	    /* Shouldn't happen */
 		    status = RA_FAIL;
 		}
 	    }
@@ -5136,13 +5281,13 @@ regmatch(scan)
 		if (brace_count[no] <= (brace_min[no] <= brace_max[no]
 					     ? brace_min[no] : brace_max[no]))
 		{
-		    rp = regstack_push(RS_BRCPLX_MORE, scan);
+		    rp = regstack_push(rex, RS_BRCPLX_MORE, scan);
 		    if (rp == NULL)
 			status = RA_FAIL;
 		    else
 		    {
 			rp->rs_no = no;
-			reg_save(&rp->rs_un.regsave, &backpos);
+			reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			next = OPERAND(scan);
 			/* We continue and handle the result when done. */
 		    }
@@ -5155,13 +5300,13 @@ regmatch(scan)
 		    /* Range is the normal way around, use longest match */
 		    if (brace_count[no] <= brace_max[no])
 		    {
-			rp = regstack_push(RS_BRCPLX_LONG, scan);
+			rp = regstack_push(rex, RS_BRCPLX_LONG, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
 			else
 			{
 			    rp->rs_no = no;
-			    reg_save(&rp->rs_un.regsave, &backpos);
+			    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			    next = OPERAND(scan);
 			    /* We continue and handle the result when done. */
 			}
@@ -5172,12 +5317,12 @@ regmatch(scan)
 		    /* Range is backwards, use shortest match first */
 		    if (brace_count[no] <= brace_min[no])
 		    {
-			rp = regstack_push(RS_BRCPLX_SHORT, scan);
+			rp = regstack_push(rex, RS_BRCPLX_SHORT, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
 			else
 			{
-			    reg_save(&rp->rs_un.regsave, &backpos);
+			    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			    /* We continue and handle the result when done. */
 			}
 		    }
@@ -5198,7 +5343,7 @@ regmatch(scan)
 		if (OP(next) == EXACTLY)
 		{
 		    rst.nextb = *OPERAND(next);
-		    if (ireg_ic)
+		    if (rex->reg_ic)
 		    {
 			if (MB_ISUPPER(rst.nextb))
 			    rst.nextb_ic = MB_TOLOWER(rst.nextb);
@@ -5220,8 +5365,8 @@ regmatch(scan)
 		}
 		else
 		{
-		    rst.minval = bl_minval;
-		    rst.maxval = bl_maxval;
+		    rst.minval = rex->bl_minval;
+		    rst.maxval = rex->bl_maxval;
 		}
 
 		/*
@@ -5230,7 +5375,7 @@ regmatch(scan)
 		 * minimal number (since the range is backwards, that's also
 		 * maxval!).
 		 */
-		rst.count = regrepeat(OPERAND(scan), rst.maxval);
+		rst.count = regrepeat(rex, OPERAND(scan), rst.maxval);
 		if (got_int)
 		{
 		    status = RA_FAIL;
@@ -5242,17 +5387,18 @@ regmatch(scan)
 		    /* It could match.  Prepare for trying to match what
 		     * follows.  The code is below.  Parameters are stored in
 		     * a regstar_T on the regstack. */
-		    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+		    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
 		    {
-			EMSG(_(e_maxmempat));
+			REX_EMSG(_(e_maxmempat));
 			status = RA_FAIL;
 		    }
-		    else if (ga_grow(&regstack, sizeof(regstar_T)) == FAIL)
+		    else if (rex_ga_grow(rex, &rex->regstack, sizeof(regstar_T))
+								      == FAIL)
 			status = RA_FAIL;
 		    else
 		    {
-			regstack.ga_len += sizeof(regstar_T);
-			rp = regstack_push(rst.minval <= rst.maxval
+			rex->regstack.ga_len += sizeof(regstar_T);
+			rp = regstack_push(rex, rst.minval <= rst.maxval
 					? RS_STAR_LONG : RS_STAR_SHORT, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
@@ -5272,13 +5418,13 @@ regmatch(scan)
 	  case NOMATCH:
 	  case MATCH:
 	  case SUBPAT:
-	    rp = regstack_push(RS_NOMATCH, scan);
+	    rp = regstack_push(rex, RS_NOMATCH, scan);
 	    if (rp == NULL)
 		status = RA_FAIL;
 	    else
 	    {
 		rp->rs_no = op;
-		reg_save(&rp->rs_un.regsave, &backpos);
+		reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		next = OPERAND(scan);
 		/* We continue and handle the result when done. */
 	    }
@@ -5287,27 +5433,28 @@ regmatch(scan)
 	  case BEHIND:
 	  case NOBEHIND:
 	    /* Need a bit of room to store extra positions. */
-	    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+	    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
 	    {
-		EMSG(_(e_maxmempat));
+		REX_EMSG(_(e_maxmempat));
 		status = RA_FAIL;
 	    }
-	    else if (ga_grow(&regstack, sizeof(regbehind_T)) == FAIL)
+	    else if (rex_ga_grow(rex, &rex->regstack, sizeof(regbehind_T))
+								      == FAIL)
 		status = RA_FAIL;
 	    else
 	    {
-		regstack.ga_len += sizeof(regbehind_T);
-		rp = regstack_push(RS_BEHIND1, scan);
+		rex->regstack.ga_len += sizeof(regbehind_T);
+		rp = regstack_push(rex, RS_BEHIND1, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    /* Need to save the subexpr to be able to restore them
 		     * when there is a match but we don't use it. */
-		    save_subexpr(((regbehind_T *)rp) - 1);
+		    save_subexpr(rex, ((regbehind_T *)rp) - 1);
 
 		    rp->rs_no = op;
-		    reg_save(&rp->rs_un.regsave, &backpos);
+		    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		    /* First try if what follows matches.  If it does then we
 		     * check the behind match by looping. */
 		}
@@ -5317,22 +5464,23 @@ regmatch(scan)
 	  case BHPOS:
 	    if (REG_MULTI)
 	    {
-		if (behind_pos.rs_u.pos.col != (colnr_T)(reginput - regline)
-			|| behind_pos.rs_u.pos.lnum != reglnum)
+		if (rex->behind_pos.rs_u.pos.col
+					 != (colnr_T)(rex->input - rex->line)
+			|| rex->behind_pos.rs_u.pos.lnum != rex->lnum)
 		    status = RA_NOMATCH;
 	    }
-	    else if (behind_pos.rs_u.ptr != reginput)
+	    else if (rex->behind_pos.rs_u.ptr != rex->input)
 		status = RA_NOMATCH;
 	    break;
 
 	  case NEWL:
-	    if ((c != NUL || !REG_MULTI || reglnum > reg_maxline
-			     || reg_line_lbr) && (c != '\n' || !reg_line_lbr))
+	    if ((c != NUL || !REG_MULTI || rex->lnum > rex->reg_maxline
+		    || rex->reg_line_lbr) && (c != '\n' || !rex->reg_line_lbr))
 		status = RA_NOMATCH;
-	    else if (reg_line_lbr)
+	    else if (rex->reg_line_lbr)
 		ADVANCE_REGINPUT();
 	    else
-		reg_nextline();
+		reg_nextline(rex);
 	    break;
 
 	  case END:
@@ -5340,7 +5488,7 @@ regmatch(scan)
 	    break;
 
 	  default:
-	    EMSG(_(e_re_corr));
+	    REX_EMSG(_(e_re_corr));
 #ifdef DEBUG
 	    printf("Illegal op code %d\n", op);
 #endif
@@ -5362,75 +5510,76 @@ regmatch(scan)
      * If there is something on the regstack execute the code for the state.
      * If the state is popped then loop and use the older state.
      */
-    while (regstack.ga_len > 0 && status != RA_FAIL)
+    while (rex->regstack.ga_len > 0 && status != RA_FAIL)
     {
-	rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len) - 1;
+	rp = (regitem_T *)((char *)rex->regstack.ga_data
+						   + rex->regstack.ga_len) - 1;
 	switch (rp->rs_state)
 	{
 	  case RS_NOPEN:
 	    /* Result is passed on as-is, simply pop the state. */
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    break;
 
 	  case RS_MOPEN:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_startpos[rp->rs_no],
-						  &reg_startp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_startpos[rp->rs_no],
+						  &rex->reg_startp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 
 #ifdef FEAT_SYN_HL
 	  case RS_ZOPEN:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_startzpos[rp->rs_no],
-						 &reg_startzp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_startzpos[rp->rs_no],
+						 &rex->reg_startzp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 #endif
 
 	  case RS_MCLOSE:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_endpos[rp->rs_no],
-						    &reg_endp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_endpos[rp->rs_no],
+						    &rex->reg_endp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 
 #ifdef FEAT_SYN_HL
 	  case RS_ZCLOSE:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_endzpos[rp->rs_no],
-						   &reg_endzp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_endzpos[rp->rs_no],
+						   &rex->reg_endzp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 #endif
 
 	  case RS_BRANCH:
 	    if (status == RA_MATCH)
 		/* this branch matched, use it */
-		regstack_pop(&scan);
+		regstack_pop(rex, &scan);
 	    else
 	    {
 		if (status != RA_BREAK)
 		{
 		    /* After a non-matching branch: try next one. */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = rp->rs_scan;
 		}
 		if (scan == NULL || OP(scan) != BRANCH)
 		{
 		    /* no more branches, didn't find a match */
 		    status = RA_NOMATCH;
-		    regstack_pop(&scan);
+		    regstack_pop(rex, &scan);
 		}
 		else
 		{
 		    /* Prepare to try a branch. */
 		    rp->rs_scan = regnext(scan);
-		    reg_save(&rp->rs_un.regsave, &backpos);
+		    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = OPERAND(scan);
 		}
 	    }
@@ -5440,10 +5589,10 @@ regmatch(scan)
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
 	    {
-		reg_restore(&rp->rs_un.regsave, &backpos);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		--brace_count[rp->rs_no];	/* decrement match count */
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    break;
 
 	  case RS_BRCPLX_LONG:
@@ -5451,12 +5600,12 @@ regmatch(scan)
 	    if (status == RA_NOMATCH)
 	    {
 		/* There was no match, but we did find enough matches. */
-		reg_restore(&rp->rs_un.regsave, &backpos);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		--brace_count[rp->rs_no];
 		/* continue with the items after "\{}" */
 		status = RA_CONT;
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_CONT)
 		scan = regnext(scan);
 	    break;
@@ -5465,8 +5614,8 @@ regmatch(scan)
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
 		/* There was no match, try to match one more item. */
-		reg_restore(&rp->rs_un.regsave, &backpos);
-	    regstack_pop(&scan);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_NOMATCH)
 	    {
 		scan = OPERAND(scan);
@@ -5484,9 +5633,9 @@ regmatch(scan)
 	    {
 		status = RA_CONT;
 		if (rp->rs_no != SUBPAT)	/* zero-width */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_CONT)
 		scan = regnext(scan);
 	    break;
@@ -5494,8 +5643,8 @@ regmatch(scan)
 	  case RS_BEHIND1:
 	    if (status == RA_NOMATCH)
 	    {
-		regstack_pop(&scan);
-		regstack.ga_len -= sizeof(regbehind_T);
+		regstack_pop(rex, &scan);
+		rex->regstack.ga_len -= sizeof(regbehind_T);
 	    }
 	    else
 	    {
@@ -5506,7 +5655,8 @@ regmatch(scan)
 		 * the current position. */
 
 		/* save the position after the found match for next */
-		reg_save(&(((regbehind_T *)rp) - 1)->save_after, &backpos);
+		reg_save(rex, &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 
 		/* Start looking for a match with operand at the current
 		 * position.  Go back one character until we find the
@@ -5514,12 +5664,12 @@ regmatch(scan)
 		 * line (for multi-line matching).
 		 * Set behind_pos to where the match should end, BHPOS
 		 * will match it.  Save the current value. */
-		(((regbehind_T *)rp) - 1)->save_behind = behind_pos;
-		behind_pos = rp->rs_un.regsave;
+		(((regbehind_T *)rp) - 1)->save_behind = rex->behind_pos;
+		rex->behind_pos = rp->rs_un.regsave;
 
 		rp->rs_state = RS_BEHIND2;
 
-		reg_restore(&rp->rs_un.regsave, &backpos);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		scan = OPERAND(rp->rs_scan) + 4;
 	    }
 	    break;
@@ -5528,23 +5678,23 @@ regmatch(scan)
 	    /*
 	     * Looping for BEHIND / NOBEHIND match.
 	     */
-	    if (status == RA_MATCH && reg_save_equal(&behind_pos))
+	    if (status == RA_MATCH && reg_save_equal(rex, &rex->behind_pos))
 	    {
 		/* found a match that ends where "next" started */
-		behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
+		rex->behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
 		if (rp->rs_no == BEHIND)
-		    reg_restore(&(((regbehind_T *)rp) - 1)->save_after,
-								    &backpos);
+		    reg_restore(rex, &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 		else
 		{
 		    /* But we didn't want a match.  Need to restore the
 		     * subexpr, because what follows matched, so they have
 		     * been set. */
 		    status = RA_NOMATCH;
-		    restore_subexpr(((regbehind_T *)rp) - 1);
+		    restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 		}
-		regstack_pop(&scan);
-		regstack.ga_len -= sizeof(regbehind_T);
+		regstack_pop(rex, &scan);
+		rex->regstack.ga_len -= sizeof(regbehind_T);
 	    }
 	    else
 	    {
@@ -5558,24 +5708,25 @@ regmatch(scan)
 		{
 		    if (limit > 0
 			    && ((rp->rs_un.regsave.rs_u.pos.lnum
-						    < behind_pos.rs_u.pos.lnum
-				    ? (colnr_T)STRLEN(regline)
-				    : behind_pos.rs_u.pos.col)
+						< rex->behind_pos.rs_u.pos.lnum
+				    ? (colnr_T)STRLEN(rex->line)
+				    : rex->behind_pos.rs_u.pos.col)
 				- rp->rs_un.regsave.rs_u.pos.col >= limit))
 			no = FAIL;
 		    else if (rp->rs_un.regsave.rs_u.pos.col == 0)
 		    {
 			if (rp->rs_un.regsave.rs_u.pos.lnum
-					< behind_pos.rs_u.pos.lnum
-				|| reg_getline(
+					< rex->behind_pos.rs_u.pos.lnum
+				|| reg_getline(rex, 
 					--rp->rs_un.regsave.rs_u.pos.lnum)
 								  == NULL)
 			    no = FAIL;
 			else
 			{
-			    reg_restore(&rp->rs_un.regsave, &backpos);
+			    reg_restore(rex, &rp->rs_un.regsave,
+								&rex->backpos);
 			    rp->rs_un.regsave.rs_u.pos.col =
-						 (colnr_T)STRLEN(regline);
+						 (colnr_T)STRLEN(rex->line);
 			}
 		    }
 		    else
@@ -5583,7 +5734,7 @@ regmatch(scan)
 #ifdef FEAT_MBYTE
 			if (has_mbyte)
 			    rp->rs_un.regsave.rs_u.pos.col -=
-				(*mb_head_off)(regline, regline
+				(*mb_head_off)(rex->line, rex->line
 				    + rp->rs_un.regsave.rs_u.pos.col - 1) + 1;
 			else
 #endif
@@ -5592,12 +5743,12 @@ regmatch(scan)
 		}
 		else
 		{
-		    if (rp->rs_un.regsave.rs_u.ptr == regline)
+		    if (rp->rs_un.regsave.rs_u.ptr == rex->line)
 			no = FAIL;
 		    else
 		    {
-			mb_ptr_back(regline, rp->rs_un.regsave.rs_u.ptr);
-			if (limit > 0 && (long)(behind_pos.rs_u.ptr
+			mb_ptr_back(rex->line, rp->rs_un.regsave.rs_u.ptr);
+			if (limit > 0 && (long)(rex->behind_pos.rs_u.ptr
 				     - rp->rs_un.regsave.rs_u.ptr) > limit)
 			    no = FAIL;
 		    }
@@ -5605,24 +5756,25 @@ regmatch(scan)
 		if (no == OK)
 		{
 		    /* Advanced, prepare for finding match again. */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = OPERAND(rp->rs_scan) + 4;
 		    if (status == RA_MATCH)
 		    {
 			/* We did match, so subexpr may have been changed,
 			 * need to restore them for the next try. */
 			status = RA_NOMATCH;
-			restore_subexpr(((regbehind_T *)rp) - 1);
+			restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 		    }
 		}
 		else
 		{
 		    /* Can't advance.  For NOBEHIND that's a match. */
-		    behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
+		    rex->behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
 		    if (rp->rs_no == NOBEHIND)
 		    {
-			reg_restore(&(((regbehind_T *)rp) - 1)->save_after,
-								    &backpos);
+			reg_restore(rex,
+				    &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 			status = RA_MATCH;
 		    }
 		    else
@@ -5633,11 +5785,11 @@ regmatch(scan)
 			if (status == RA_MATCH)
 			{
 			    status = RA_NOMATCH;
-			    restore_subexpr(((regbehind_T *)rp) - 1);
+			    restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 			}
 		    }
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regbehind_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regbehind_T);
 		}
 	    }
 	    break;
@@ -5649,14 +5801,14 @@ regmatch(scan)
 
 		if (status == RA_MATCH)
 		{
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regstar_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regstar_T);
 		    break;
 		}
 
 		/* Tried once already, restore input pointers. */
 		if (status != RA_BREAK)
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 
 		/* Repeat until we found a position where it could match. */
 		for (;;)
@@ -5670,20 +5822,21 @@ regmatch(scan)
 			     * didn't match -- back up one char. */
 			    if (--rst->count < rst->minval)
 				break;
-			    if (reginput == regline)
+			    if (rex->input == rex->line)
 			    {
 				/* backup to last char of previous line */
-				--reglnum;
-				regline = reg_getline(reglnum);
+				--rex->lnum;
+				rex->line = reg_getline(rex, rex->lnum);
 				/* Just in case regrepeat() didn't count
 				 * right. */
-				if (regline == NULL)
+				if (rex->line == NULL)
 				    break;
-				reginput = regline + STRLEN(regline);
-				fast_breakcheck();
+				rex->input = rex->line + STRLEN(rex->line);
+				if (!rex->reg_thread)
+				    fast_breakcheck();
 			    }
 			    else
-				mb_ptr_back(regline, reginput);
+				mb_ptr_back(rex->line, rex->input);
 			}
 			else
 			{
@@ -5692,7 +5845,8 @@ regmatch(scan)
 			     * Couldn't or didn't match: try advancing one
 			     * char. */
 			    if (rst->count == rst->minval
-				  || regrepeat(OPERAND(rp->rs_scan), 1L) == 0)
+				    || regrepeat(rex, OPERAND(rp->rs_scan),
+								     1L) == 0)
 				break;
 			    ++rst->count;
 			}
@@ -5703,10 +5857,10 @@ regmatch(scan)
 			status = RA_NOMATCH;
 
 		    /* If it could match, try it. */
-		    if (rst->nextb == NUL || *reginput == rst->nextb
-					     || *reginput == rst->nextb_ic)
+		    if (rst->nextb == NUL || *rex->input == rst->nextb
+					     || *rex->input == rst->nextb_ic)
 		    {
-			reg_save(&rp->rs_un.regsave, &backpos);
+			reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			scan = regnext(rp->rs_scan);
 			status = RA_CONT;
 			break;
@@ -5715,8 +5869,8 @@ regmatch(scan)
 		if (status != RA_CONT)
 		{
 		    /* Failed. */
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regstar_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regstar_T);
 		    status = RA_NOMATCH;
 		}
 	    }
@@ -5726,7 +5880,7 @@ regmatch(scan)
 	/* If we want to continue the inner loop or didn't pop a state
 	 * continue matching loop */
 	if (status == RA_CONT || rp == (regitem_T *)
-			     ((char *)regstack.ga_data + regstack.ga_len) - 1)
+		    ((char *)rex->regstack.ga_data + rex->regstack.ga_len) - 1)
 	    break;
     }
 
@@ -5737,7 +5891,7 @@ regmatch(scan)
     /*
      * If the regstack is empty or something failed we are done.
      */
-    if (regstack.ga_len == 0 || status == RA_FAIL)
+    if (rex->regstack.ga_len == 0 || status == RA_FAIL)
     {
 	if (scan == NULL)
 	{
@@ -5745,13 +5899,18 @@ regmatch(scan)
 	     * We get here only if there's trouble -- normally "case END" is
 	     * the terminating point.
 	     */
-	    EMSG(_(e_re_corr));
+	    REX_EMSG(_(e_re_corr));
 #ifdef DEBUG
 	    printf("Premature EOL\n");
 #endif
 	}
 	if (status == RA_FAIL)
-	    got_int = TRUE;
+	{
+	    if (rex->reg_thread)
+		rex->reg_failed = TRUE;
+	    else
+		got_int = TRUE;
+	}
 	return (status == RA_MATCH);
     }
 
@@ -5765,25 +5924,26 @@ regmatch(scan)
  * Returns pointer to new item.  Returns NULL when out of memory.
  */
     static regitem_T *
-regstack_push(state, scan)
+regstack_push(rex, state, scan)
+    regexec_T	*rex;
     regstate_T	state;
     char_u	*scan;
 {
     regitem_T	*rp;
 
-    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
     {
-	EMSG(_(e_maxmempat));
+	REX_EMSG(_(e_maxmempat));
 	return NULL;
     }
-    if (ga_grow(&regstack, sizeof(regitem_T)) == FAIL)
+    if (rex_ga_grow(rex, &rex->regstack, sizeof(regitem_T)) == FAIL)
 	return NULL;
 
-    rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len);
+    rp = (regitem_T *)((char *)rex->regstack.ga_data + rex->regstack.ga_len);
     rp->rs_state = state;
     rp->rs_scan = scan;
 
-    regstack.ga_len += sizeof(regitem_T);
+    rex->regstack.ga_len += sizeof(regitem_T);
     return rp;
 }
 
@@ -5791,23 +5951,26 @@ regstack_push(state, scan)
  * Pop an item from the regstack.
  */
     static void
-regstack_pop(scan)
+regstack_pop(rex, scan)
+    regexec_T	*rex;
     char_u	**scan;
 {
     regitem_T	*rp;
 
-    rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len) - 1;
+    rp = (regitem_T *)((char *)rex->regstack.ga_data
+						   + rex->regstack.ga_len) - 1;
     *scan = rp->rs_scan;
 
-    regstack.ga_len -= sizeof(regitem_T);
+    rex->regstack.ga_len -= sizeof(regitem_T);
 }
 
 /*
  * regrepeat - repeatedly match something simple, return how many.
- * Advances reginput (and reglnum) to just after the matched chars.
+ * Advances rex->input (and rex->lnum) to just after the matched chars.
  */
     static int
-regrepeat(p, maxcount)
+regrepeat(rex, p, maxcount)
+    regexec_T	*rex;
     char_u	*p;
     long	maxcount;   /* maximum number of matches allowed */
 {
@@ -5817,7 +5980,7 @@ regrepeat(p, maxcount)
     int		mask;
     int		testval = 0;
 
-    scan = reginput;	    /* Make local copy of reginput for speed. */
+    scan = rex->input;  /* Make local copy of rex->input for speed. */
     opnd = OPERAND(p);
     switch (OP(p))
     {
@@ -5832,12 +5995,12 @@ regrepeat(p, maxcount)
 		++count;
 		mb_ptr_adv(scan);
 	    }
-	    if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-					 || reg_line_lbr || count == maxcount)
+	    if (!REG_MULTI || !WITH_NL(OP(p)) || rex->lnum > rex->reg_maxline
+				     || rex->reg_line_lbr || count == maxcount)
 		break;
 	    ++count;		/* count the line-break */
-	    reg_nextline();
-	    scan = reginput;
+	    reg_nextline(rex);
+	    scan = rex->input;
 	    if (got_int)
 		break;
 	}
@@ -5857,15 +6020,16 @@ regrepeat(p, maxcount)
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5881,22 +6045,23 @@ regrepeat(p, maxcount)
       case SKWORD + ADD_NL:
 	while (count < maxcount)
 	{
-	    if (vim_iswordp_buf(scan, reg_buf)
+	    if (vim_iswordp_buf(scan, rex->reg_buf)
 					  && (testval || !VIM_ISDIGIT(*scan)))
 	    {
 		mb_ptr_adv(scan);
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5918,15 +6083,16 @@ regrepeat(p, maxcount)
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5944,11 +6110,12 @@ regrepeat(p, maxcount)
 	{
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
@@ -5957,7 +6124,7 @@ regrepeat(p, maxcount)
 	    {
 		mb_ptr_adv(scan);
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5976,11 +6143,12 @@ do_class:
 #endif
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
@@ -5994,7 +6162,7 @@ do_class:
 #endif
 	    else if ((class_tab[*scan] & mask) == testval)
 		++scan;
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -6078,7 +6246,7 @@ do_class:
 	    /* This doesn't do a multi-byte character, because a MULTIBYTECODE
 	     * would have been used for it.  It does handle single-byte
 	     * characters, such as latin1. */
-	    if (ireg_ic)
+	    if (rex->reg_ic)
 	    {
 		cu = MB_TOUPPER(*opnd);
 		cl = MB_TOLOWER(*opnd);
@@ -6109,14 +6277,14 @@ do_class:
 	     * compiling the program). */
 	    if ((len = (*mb_ptr2len)(opnd)) > 1)
 	    {
-		if (ireg_ic && enc_utf8)
+		if (rex->reg_ic && enc_utf8)
 		    cf = utf_fold(utf_ptr2char(opnd));
 		while (count < maxcount)
 		{
 		    for (i = 0; i < len; ++i)
 			if (opnd[i] != scan[i])
 			    break;
-		    if (i < len && (!ireg_ic || !enc_utf8
+		    if (i < len && (!rex->reg_ic || !enc_utf8
 					|| utf_fold(utf_ptr2char(scan)) != cf))
 			break;
 		    scan += len;
@@ -6141,27 +6309,29 @@ do_class:
 #endif
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+					       || rex->lnum > rex->reg_maxline
+							  || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->input;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 #ifdef FEAT_MBYTE
 	    else if (has_mbyte && (len = (*mb_ptr2len)(scan)) > 1)
 	    {
-		if ((cstrchr(opnd, (*mb_ptr2char)(scan)) == NULL) == testval)
+		if ((cstrchr(rex, opnd, (*mb_ptr2char)(scan)) == NULL)
+								   == testval)
 		    break;
 		scan += len;
 	    }
 #endif
 	    else
 	    {
-		if ((cstrchr(opnd, *scan) == NULL) == testval)
+		if ((cstrchr(rex, opnd, *scan) == NULL) == testval)
 		    break;
 		++scan;
 	    }
@@ -6171,29 +6341,30 @@ do_class:
 
       case NEWL:
 	while (count < maxcount
-		&& ((*scan == NUL && reglnum <= reg_maxline && !reg_line_lbr
-			    && REG_MULTI) || (*scan == '\n' && reg_line_lbr)))
+		&& ((*scan == NUL && rex->lnum <= rex->reg_maxline
+				       && !rex->reg_line_lbr && REG_MULTI)
+		    || (*scan == '\n' && rex->reg_line_lbr)))
 	{
 	    count++;
-	    if (reg_line_lbr)
+	    if (rex->reg_line_lbr)
 		ADVANCE_REGINPUT();
 	    else
-		reg_nextline();
-	    scan = reginput;
+		reg_nextline(rex);
+	    scan = rex->input;
 	    if (got_int)
 		break;
 	}
 	break;
 
       default:			/* Oh dear.  Called inappropriately. */
-	EMSG(_(e_re_corr));
+	REX_EMSG(_(e_re_corr));
 #ifdef DEBUG
 	printf("Called regrepeat with op code %d\n", OP(p));
 #endif
 	break;
     }
 
-    reginput = scan;
+    rex->input = scan;
 
     return (int)count;
 }
@@ -6227,18 +6398,19 @@ regnext(p)
  * Return TRUE if it's wrong.
  */
     static int
-prog_magic_wrong()
+prog_magic_wrong(rex)
+    regexec_T	*rex;
 {
     regprog_T	*prog;
 
-    prog = REG_MULTI ? reg_mmatch->regprog : reg_match->regprog;
+    prog = REG_MULTI ? rex->reg_mmatch->regprog : rex->reg_match->regprog;
     if (prog->engine == &nfa_regengine)
 	/* For NFA matcher we don't check the magic */
 	return FALSE;
 
     if (UCHARAT(((bt_regprog_T *)prog)->program) != REGMAGIC)
     {
-	EMSG(_(e_re_corr));
+	REX_EMSG(_(e_re_corr));
 	return TRUE;
     }
     return FALSE;
@@ -6250,43 +6422,45 @@ prog_magic_wrong()
  * used (to increase speed).
  */
     static void
-cleanup_subexpr()
+cleanup_subexpr(rex)
+    regexec_T	*rex;
 {
-    if (need_clear_subexpr)
+    if (rex->need_clear_subexpr)
     {
 	if (REG_MULTI)
 	{
 	    /* Use 0xff to set lnum to -1 */
-	    vim_memset(reg_startpos, 0xff, sizeof(lpos_T) * NSUBEXP);
-	    vim_memset(reg_endpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_startpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_endpos, 0xff, sizeof(lpos_T) * NSUBEXP);
 	}
 	else
 	{
-	    vim_memset(reg_startp, 0, sizeof(char_u *) * NSUBEXP);
-	    vim_memset(reg_endp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_startp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_endp, 0, sizeof(char_u *) * NSUBEXP);
 	}
-	need_clear_subexpr = FALSE;
+	rex->need_clear_subexpr = FALSE;
     }
 }
 
 #ifdef FEAT_SYN_HL
     static void
-cleanup_zsubexpr()
+cleanup_zsubexpr(rex)
+    regexec_T	*rex;
 {
-    if (need_clear_zsubexpr)
+    if (rex->need_clear_zsubexpr)
     {
 	if (REG_MULTI)
 	{
 	    /* Use 0xff to set lnum to -1 */
-	    vim_memset(reg_startzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
-	    vim_memset(reg_endzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_startzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_endzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
 	}
 	else
 	{
-	    vim_memset(reg_startzp, 0, sizeof(char_u *) * NSUBEXP);
-	    vim_memset(reg_endzp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_startzp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_endzp, 0, sizeof(char_u *) * NSUBEXP);
 	}
-	need_clear_zsubexpr = FALSE;
+	rex->need_clear_zsubexpr = FALSE;
     }
 }
 #endif
@@ -6296,27 +6470,28 @@ cleanup_zsubexpr()
  * later by restore_subexpr().
  */
     static void
-save_subexpr(bp)
+save_subexpr(rex, bp)
+    regexec_T	*rex;
     regbehind_T *bp;
 {
     int i;
 
-    /* When "need_clear_subexpr" is set we don't need to save the values, only
-     * remember that this flag needs to be set again when restoring. */
-    bp->save_need_clear_subexpr = need_clear_subexpr;
-    if (!need_clear_subexpr)
+    /* When "rex->need_clear_subexpr" is set we don't need to save the values,
+     * only remember that this flag needs to be set again when restoring. */
+    bp->save_need_clear_subexpr = rex->need_clear_subexpr;
+    if (!rex->need_clear_subexpr)
     {
 	for (i = 0; i < NSUBEXP; ++i)
 	{
 	    if (REG_MULTI)
 	    {
-		bp->save_start[i].se_u.pos = reg_startpos[i];
-		bp->save_end[i].se_u.pos = reg_endpos[i];
+		bp->save_start[i].se_u.pos = rex->reg_startpos[i];
+		bp->save_end[i].se_u.pos = rex->reg_endpos[i];
 	    }
 	    else
 	    {
-		bp->save_start[i].se_u.ptr = reg_startp[i];
-		bp->save_end[i].se_u.ptr = reg_endp[i];
+		bp->save_start[i].se_u.ptr = rex->reg_startp[i];
+		bp->save_end[i].se_u.ptr = rex->reg_endp[i];
 	    }
 	}
     }
@@ -6326,57 +6501,61 @@ save_subexpr(bp)
  * Restore the subexpr from "bp".
  */
     static void
-restore_subexpr(bp)
+restore_subexpr(rex, bp)
+    regexec_T	*rex;
     regbehind_T *bp;
 {
     int i;
 
     /* Only need to restore saved values when they are not to be cleared. */
-    need_clear_subexpr = bp->save_need_clear_subexpr;
-    if (!need_clear_subexpr)
+    rex->need_clear_subexpr = bp->save_need_clear_subexpr;
+    if (!rex->need_clear_subexpr)
     {
 	for (i = 0; i < NSUBEXP; ++i)
 	{
 	    if (REG_MULTI)
 	    {
-		reg_startpos[i] = bp->save_start[i].se_u.pos;
-		reg_endpos[i] = bp->save_end[i].se_u.pos;
+		rex->reg_startpos[i] = bp->save_start[i].se_u.pos;
+		rex->reg_endpos[i] = bp->save_end[i].se_u.pos;
 	    }
 	    else
 	    {
-		reg_startp[i] = bp->save_start[i].se_u.ptr;
-		reg_endp[i] = bp->save_end[i].se_u.ptr;
+		rex->reg_startp[i] = bp->save_start[i].se_u.ptr;
+		rex->reg_endp[i] = bp->save_end[i].se_u.ptr;
 	    }
 	}
     }
 }
 
 /*
- * Advance reglnum, regline and reginput to the next line.
+ * Advance rex->lnum, rex->line and rex->input to the next line.
  */
     static void
-reg_nextline()
+reg_nextline(rex)
+    regexec_T	*rex;
 {
-    regline = reg_getline(++reglnum);
-    reginput = regline;
-    fast_breakcheck();
+    rex->line = reg_getline(rex, ++rex->lnum);
+    rex->input = rex->line;
+    if (!rex->reg_thread)
+	fast_breakcheck();
 }
 
 /*
  * Save the input line and position in a regsave_T.
  */
     static void
-reg_save(save, gap)
+reg_save(rex, save, gap)
+    regexec_T	*rex;
     regsave_T	*save;
     garray_T	*gap;
 {
     if (REG_MULTI)
     {
-	save->rs_u.pos.col = (colnr_T)(reginput - regline);
-	save->rs_u.pos.lnum = reglnum;
+	save->rs_u.pos.col = (colnr_T)(rex->input - rex->line);
+	save->rs_u.pos.lnum = rex->lnum;
     }
     else
-	save->rs_u.ptr = reginput;
+	save->rs_u.ptr = rex->input;
     save->rs_len = gap->ga_len;
 }
 
@@ -6384,23 +6563,24 @@ reg_save(save, gap)
  * Restore the input line and position from a regsave_T.
  */
     static void
-reg_restore(save, gap)
+reg_restore(rex, save, gap)
+    regexec_T	*rex;
     regsave_T	*save;
     garray_T	*gap;
 {
     if (REG_MULTI)
     {
-	if (reglnum != save->rs_u.pos.lnum)
+	if (rex->lnum != save->rs_u.pos.lnum)
 	{
 	    /* only call reg_getline() when the line number changed to save
 	     * a bit of time */
-	    reglnum = save->rs_u.pos.lnum;
-	    regline = reg_getline(reglnum);
+	    rex->lnum = save->rs_u.pos.lnum;
+	    rex->line = reg_getline(rex, rex->lnum);
 	}
-	reginput = regline + save->rs_u.pos.col;
+	rex->input = rex->line + save->rs_u.pos.col;
     }
     else
-	reginput = save->rs_u.ptr;
+	rex->input = save->rs_u.ptr;
     gap->ga_len = save->rs_len;
 }
 
@@ -6408,13 +6588,14 @@ reg_restore(save, gap)
  * Return TRUE if current position is equal to saved position.
  */
     static int
-reg_save_equal(save)
+reg_save_equal(rex, save)
+    regexec_T	*rex;
     regsave_T	*save;
 {
     if (REG_MULTI)
-	return reglnum == save->rs_u.pos.lnum
-				  && reginput == regline + save->rs_u.pos.col;
-    return reginput == save->rs_u.ptr;
+	return rex->lnum == save->rs_u.pos.lnum
+			       && rex->input == rex->line + save->rs_u.pos.col;
+    return rex->input == save->rs_u.ptr;
 }
 
 /*
@@ -6425,22 +6606,24 @@ reg_save_equal(save)
  * depending on REG_MULTI.
  */
     static void
-save_se_multi(savep, posp)
+save_se_multi(rex, savep, posp)
+    regexec_T	*rex;
     save_se_T	*savep;
     lpos_T	*posp;
 {
     savep->se_u.pos = *posp;
-    posp->lnum = reglnum;
-    posp->col = (colnr_T)(reginput - regline);
+    posp->lnum = rex->lnum;
+    posp->col = (colnr_T)(rex->input - rex->line);
 }
 
     static void
-save_se_one(savep, pp)
+save_se_one(rex, savep, pp)
+    regexec_T	*rex;
     save_se_T	*savep;
     char_u	**pp;
 {
     savep->se_u.ptr = *pp;
-    *pp = reginput;
+    *pp = rex->input;
 }
 
 /*
@@ -6467,7 +6650,8 @@ re_num_cmp(val, scan)
  * last line.
  */
     static int
-match_with_backref(start_lnum, start_col, end_lnum, end_col, bytelen)
+match_with_backref(rex, start_lnum, start_col, end_lnum, end_col, bytelen)
+    regexec_T	*rex;
     linenr_T start_lnum;
     colnr_T  start_col;
     linenr_T end_lnum;
@@ -6485,41 +6669,41 @@ match_with_backref(start_lnum, start_col, end_lnum, end_col, bytelen)
     {
 	/* Since getting one line may invalidate the other, need to make copy.
 	 * Slow! */
-	if (regline != reg_tofree)
+	if (rex->line != rex->reg_tofree)
 	{
-	    len = (int)STRLEN(regline);
-	    if (reg_tofree == NULL || len >= (int)reg_tofreelen)
+	    len = (int)STRLEN(rex->line);
+	    if (rex->reg_tofree == NULL || len >= (int)rex->reg_tofreelen)
 	    {
 		len += 50;	/* get some extra */
-		vim_free(reg_tofree);
-		reg_tofree = alloc(len);
-		if (reg_tofree == NULL)
+		vim_free(rex->reg_tofree);
+		rex->reg_tofree = rex_alloc(rex, (long_u)len);
+		if (rex->reg_tofree == NULL)
 		    return RA_FAIL; /* out of memory!*/
-		reg_tofreelen = len;
+		rex->reg_tofreelen = len;
 	    }
-	    STRCPY(reg_tofree, regline);
-	    reginput = reg_tofree + (reginput - regline);
-	    regline = reg_tofree;
+	    STRCPY(rex->reg_tofree, rex->line);
+	    rex->input = rex->reg_tofree + (rex->input - rex->line);
+	    rex->line = rex->reg_tofree;
 	}
 
 	/* Get the line to compare with. */
-	p = reg_getline(clnum);
+	p = reg_getline(rex, clnum);
 	if (clnum == end_lnum)
 	    len = end_col - ccol;
 	else
 	    len = (int)STRLEN(p + ccol);
 
-	if (cstrncmp(p + ccol, reginput, &len) != 0)
+	if (cstrncmp(rex, p + ccol, rex->input, &len) != 0)
 	    return RA_NOMATCH;  /* doesn't match */
 	if (bytelen != NULL)
 	    *bytelen += len;
 	if (clnum == end_lnum)
 	    break;		/* match and at end! */
-	if (reglnum >= reg_maxline)
+	if (rex->lnum >= rex->reg_maxline)
 	    return RA_NOMATCH;  /* text too short */
 
 	/* Advance to next line. */
-	reg_nextline();
+	reg_nextline(rex);
 	if (bytelen != NULL)
 	    *bytelen = 0;
 	++clnum;
@@ -6528,7 +6712,7 @@ match_with_backref(start_lnum, start_col, end_lnum, end_col, bytelen)
 	    return RA_FAIL;
     }
 
-    /* found a match!  Note that regline may now point to a copy of the line,
+    /* found a match!  Note that rex->line may now point to a copy of the line,
      * that should not matter. */
     return RA_MATCH;
 }
@@ -7105,25 +7289,26 @@ mb_decompose(c, c1, c2, c3)
 #endif
 
 /*
- * Compare two strings, ignore case if ireg_ic set.
+ * Compare two strings, ignore case if rex->reg_ic set.
  * Return 0 if strings match, non-zero otherwise.
  * Correct the length "*n" when composing characters are ignored.
  */
     static int
-cstrncmp(s1, s2, n)
+cstrncmp(rex, s1, s2, n)
+    regexec_T	*rex;
     char_u	*s1, *s2;
     int		*n;
 {
     int		result;
 
-    if (!ireg_ic)
+    if (!rex->reg_ic)
 	result = STRNCMP(s1, s2, *n);
     else
 	result = MB_STRNICMP(s1, s2, *n);
 
 #ifdef FEAT_MBYTE
     /* if it failed and it's utf8 and we want to combineignore: */
-    if (result != 0 && enc_utf8 && ireg_icombine)
+    if (result != 0 && enc_utf8 && rex->reg_icombine)
     {
 	char_u	*str1, *str2;
 	int	c1, c2, c11, c12;
@@ -7142,14 +7327,15 @@ cstrncmp(s1, s2, n)
 	    /* decompose the character if necessary, into 'base' characters
 	     * because I don't care about Arabic, I will hard-code the Hebrew
 	     * which I *do* care about!  So sue me... */
-	    if (c1 != c2 && (!ireg_ic || utf_fold(c1) != utf_fold(c2)))
+	    if (c1 != c2 && (!rex->reg_ic || utf_fold(c1) != utf_fold(c2)))
 	    {
 		/* decomposition necessary? */
 		mb_decompose(c1, &c11, &junk, &junk);
 		mb_decompose(c2, &c12, &junk, &junk);
 		c1 = c11;
 		c2 = c12;
-		if (c11 != c12 && (!ireg_ic || utf_fold(c11) != utf_fold(c12)))
+		if (c11 != c12
+			   && (!rex->reg_ic || utf_fold(c11) != utf_fold(c12)))
 		    break;
 	    }
 	}
@@ -7166,14 +7352,15 @@ cstrncmp(s1, s2, n)
  * cstrchr: This function is used a lot for simple searches, keep it fast!
  */
     static char_u *
-cstrchr(s, c)
+cstrchr(rex, s, c)
+    regexec_T	*rex;
     char_u	*s;
     int		c;
 {
     char_u	*p;
     int		cc;
 
-    if (!ireg_ic
+    if (!rex->reg_ic
 #ifdef FEAT_MBYTE
 	    || (!enc_utf8 && mb_char2len(c) > 1)
 #endif
@@ -7195,6 +7382,23 @@ cstrchr(s, c)
     else
 	return vim_strchr(s, c);
 
+    /* Without multi-byte characters, or for ASCII in UTF-8, which never
+     * appears inside a multi-byte character, let the library look for
+     * either byte, that is faster than a loop. */
+    if (
+#ifdef FEAT_MBYTE
+	    (!has_mbyte || (enc_utf8 && c < 0x80 && cc < 0x80)) &&
+#endif
+	    cc > 0 && cc < 256)
+    {
+	char_u	set[3];
+
+	set[0] = c;
+	set[1] = cc;
+	set[2] = NUL;
+	return vim_strpbrk(s, set);
+    }
+
 #ifdef FEAT_MBYTE
     if (has_mbyte)
     {
@@ -7242,7 +7446,7 @@ static fptr_T do_Upper __ARGS((int *, int));
 static fptr_T do_lower __ARGS((int *, int));
 static fptr_T do_Lower __ARGS((int *, int));
 
-static int vim_regsub_both __ARGS((char_u *source, char_u *dest, int copy, int magic, int backslash));
+static int vim_regsub_both __ARGS((regexec_T *rex, char_u *source, char_u *dest, int copy, int magic, int backslash));
 
     static fptr_T
 do_upper(d, c)
@@ -7362,14 +7566,13 @@ regtilde(source, magic)
 #ifdef FEAT_EVAL
 static int can_f_submatch = FALSE;	/* TRUE when submatch() can be used */
 
-/* These pointers are used instead of reg_match and reg_mmatch for
+/* These pointers are used instead of rex->reg_match and rex->reg_mmatch for
  * reg_submatch().  Needed for when the substitution string is an expression
  * that contains a call to substitute() and submatch(). */
 static regmatch_T	*submatch_match;
 static regmmatch_T	*submatch_mmatch;
 static linenr_T		submatch_firstlnum;
 static linenr_T		submatch_maxline;
-static int		submatch_line_lbr;
 #endif
 
 #if defined(FEAT_MODIFY_FNAME) || defined(FEAT_EVAL) || defined(PROTO)
@@ -7400,12 +7603,15 @@ vim_regsub(rmp, source, dest, copy, magic, backslash)
     int		magic;
     int		backslash;
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    reg_buf = curbuf;
-    reg_line_lbr = TRUE;
-    return vim_regsub_both(source, dest, copy, magic, backslash);
+    regexec_T	rex;
+
+    vim_memset(&rex, 0, sizeof(rex));
+    rex.reg_match = rmp;
+    rex.reg_mmatch = NULL;
+    rex.reg_maxline = 0;
+    rex.reg_buf = curbuf;
+    rex.reg_line_lbr = TRUE;
+    return vim_regsub_both(&rex, source, dest, copy, magic, backslash);
 }
 #endif
 
@@ -7419,17 +7625,21 @@ vim_regsub_multi(rmp, lnum, source, dest, copy, magic, backslash)
     int		magic;
     int		backslash;
 {
-    reg_match = NULL;
-    reg_mmatch = rmp;
-    reg_buf = curbuf;		/* always works on the current buffer! */
-    reg_firstlnum = lnum;
-    reg_maxline = curbuf->b_ml.ml_line_count - lnum;
-    reg_line_lbr = FALSE;
-    return vim_regsub_both(source, dest, copy, magic, backslash);
+    regexec_T	rex;
+
+    vim_memset(&rex, 0, sizeof(rex));
+    rex.reg_match = NULL;
+    rex.reg_mmatch = rmp;
+    rex.reg_buf = curbuf;	/* always works on the current buffer! */
+    rex.reg_firstlnum = lnum;
+    rex.reg_maxline = curbuf->b_ml.ml_line_count - lnum;
+    rex.reg_line_lbr = FALSE;
+    return vim_regsub_both(&rex, source, dest, copy, magic, backslash);
 }
 
     static int
-vim_regsub_both(source, dest, copy, magic, backslash)
+vim_regsub_both(rex, source, dest, copy, magic, backslash)
+    regexec_T	*rex;
     char_u	*source;
     char_u	*dest;
     int		copy;
@@ -7453,10 +7663,10 @@ vim_regsub_both(source, dest, copy, magic, backslash)
     /* Be paranoid... */
     if (source == NULL || dest == NULL)
     {
-	EMSG(_(e_null));
+	REX_EMSG(_(e_null));
 	return 0;
     }
-    if (prog_magic_wrong())
+    if (prog_magic_wrong(rex))
 	return 0;
     src = source;
     dst = dest;
@@ -7487,22 +7697,15 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 	}
 	else
 	{
-	    win_T	*save_reg_win;
-	    int		save_ireg_ic;
-
 	    vim_free(eval_result);
 
 	    /* The expression may contain substitute(), which calls us
-	     * recursively.  Make sure submatch() gets the text from the first
-	     * level.  Don't need to save "reg_buf", because
-	     * vim_regexec_multi() can't be called recursively. */
-	    submatch_match = reg_match;
-	    submatch_mmatch = reg_mmatch;
-	    submatch_firstlnum = reg_firstlnum;
-	    submatch_maxline = reg_maxline;
-	    submatch_line_lbr = reg_line_lbr;
-	    save_reg_win = reg_win;
-	    save_ireg_ic = ireg_ic;
+	     * recursively with its own state in "rex".  Make sure submatch()
+	     * gets the text from the first level. */
+	    submatch_match = rex->reg_match;
+	    submatch_mmatch = rex->reg_mmatch;
+	    submatch_firstlnum = rex->reg_firstlnum;
+	    submatch_maxline = rex->reg_maxline;
 	    can_f_submatch = TRUE;
 
 	    eval_result = eval_to_string(source + 2, NULL, TRUE);
@@ -7515,7 +7718,7 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 		    /* Change NL to CR, so that it becomes a line break,
 		     * unless called from vim_regexec_nl().
 		     * Skip over a backslashed character. */
-		    if (*s == NL && !submatch_line_lbr)
+		    if (*s == NL && !rex->reg_line_lbr)
 			*s = CAR;
 		    else if (*s == '\\' && s[1] != NUL)
 		    {
@@ -7526,7 +7729,7 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 			 *   def
 			 * Not when called from vim_regexec_nl().
 			 */
-			if (*s == NL && !submatch_line_lbr)
+			if (*s == NL && !rex->reg_line_lbr)
 			    *s = CAR;
 			had_backslash = TRUE;
 		    }
@@ -7545,13 +7748,6 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 		dst += STRLEN(eval_result);
 	    }
 
-	    reg_match = submatch_match;
-	    reg_mmatch = submatch_mmatch;
-	    reg_firstlnum = submatch_firstlnum;
-	    reg_maxline = submatch_maxline;
-	    reg_line_lbr = submatch_line_lbr;
-	    reg_win = save_reg_win;
-	    ireg_ic = save_ireg_ic;
 	    can_f_submatch = FALSE;
 	}
 #endif
@@ -7681,26 +7877,27 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 	{
 	    if (REG_MULTI)
 	    {
-		clnum = reg_mmatch->startpos[no].lnum;
-		if (clnum < 0 || reg_mmatch->endpos[no].lnum < 0)
+		clnum = rex->reg_mmatch->startpos[no].lnum;
+		if (clnum < 0 || rex->reg_mmatch->endpos[no].lnum < 0)
 		    s = NULL;
 		else
 		{
-		    s = reg_getline(clnum) + reg_mmatch->startpos[no].col;
-		    if (reg_mmatch->endpos[no].lnum == clnum)
-			len = reg_mmatch->endpos[no].col
-					       - reg_mmatch->startpos[no].col;
+		    s = reg_getline(rex, clnum)
+					  + rex->reg_mmatch->startpos[no].col;
+		    if (rex->reg_mmatch->endpos[no].lnum == clnum)
+			len = rex->reg_mmatch->endpos[no].col
+					   - rex->reg_mmatch->startpos[no].col;
 		    else
 			len = (int)STRLEN(s);
 		}
 	    }
 	    else
 	    {
-		s = reg_match->startp[no];
-		if (reg_match->endp[no] == NULL)
+		s = rex->reg_match->startp[no];
+		if (rex->reg_match->endp[no] == NULL)
 		    s = NULL;
 		else
-		    len = (int)(reg_match->endp[no] - s);
+		    len = (int)(rex->reg_match->endp[no] - s);
 	    }
 	    if (s != NULL)
 	    {
@@ -7710,14 +7907,14 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 		    {
 			if (REG_MULTI)
 			{
-			    if (reg_mmatch->endpos[no].lnum == clnum)
+			    if (rex->reg_mmatch->endpos[no].lnum == clnum)
 				break;
 			    if (copy)
 				*dst = CAR;
 			    ++dst;
-			    s = reg_getline(++clnum);
-			    if (reg_mmatch->endpos[no].lnum == clnum)
-				len = reg_mmatch->endpos[no].col;
+			    s = reg_getline(rex, ++clnum);
+			    if (rex->reg_mmatch->endpos[no].lnum == clnum)
+				len = rex->reg_mmatch->endpos[no].col;
 			    else
 				len = (int)STRLEN(s);
 			}
@@ -7809,26 +8006,18 @@ exit:
 static char_u *reg_getline_submatch __ARGS((linenr_T lnum));
 
 /*
- * Call reg_getline() with the line numbers from the submatch.  If a
- * substitute() was used the reg_maxline and other values have been
- * overwritten.
+ * Call reg_getline() with the line numbers from the submatch.
  */
     static char_u *
 reg_getline_submatch(lnum)
     linenr_T	lnum;
 {
-    char_u *s;
-    linenr_T save_first = reg_firstlnum;
-    linenr_T save_max = reg_maxline;
+    regexec_T	rex;
 
-    reg_firstlnum = submatch_firstlnum;
-    reg_maxline = submatch_maxline;
-
-    s = reg_getline(lnum);
-
-    reg_firstlnum = save_first;
-    reg_maxline = save_max;
-    return s;
+    rex.reg_buf = curbuf;
+    rex.reg_firstlnum = submatch_firstlnum;
+    rex.reg_maxline = submatch_maxline;
+    return reg_getline(&rex, lnum);
 }
 
 /*
@@ -8036,11 +8225,327 @@ static char_u regname[][30] = {
 			    };
 #endif
 
+#ifdef FEAT_RE_CACHE
+/*
+ * Cache of compiled programs.  Syntax files, autocommand patterns and
+ * 'hlsearch' compile the same patterns over and over again.  A program is
+ * found by a key made of the pattern and everything else that influences
+ * compiling it.  The program is shared: "re_refcount" counts the users,
+ * including the cache itself.  The least recently used entries are dropped
+ * when there are more than RE_CACHE_MAX.
+ * A program that is being executed is not returned, the pattern is then
+ * compiled again.  A shared program that is executed recursively is replaced
+ * with a copy for that execution, see re_use_copy().
+ */
+typedef struct recache_S recache_T;
+struct recache_S
+{
+    recache_T	*rc_next;	/* next in LRU list, less recently used */
+    recache_T	*rc_prev;	/* previous in LRU list */
+    regprog_T	*rc_prog;	/* the compiled program */
+    int		rc_had_eol;	/* value of had_eol after compiling */
+    char_u	rc_key[1];	/* key, actually longer */
+};
+
+static recache_T dumrc;
+#define HIKEY2RC(p)   ((recache_T *)((p) - (dumrc.rc_key - (char_u *)&dumrc)))
+#define HI2RC(hi)      HIKEY2RC((hi)->hi_key)
+
+#define RE_CACHE_MAX	2000	/* max nr of cached programs */
+#define RE_KEY_LEN	40	/* max length of the key without the pattern */
+
+static hashtab_T	re_cache_ht;
+static int		re_cache_ht_init = FALSE;
+static recache_T	*re_cache_first = NULL;	/* most recently used */
+static recache_T	*re_cache_last = NULL;	/* least recently used */
+static long		re_cache_count = 0;
+static long		re_cache_hits = 0;
+static long		re_cache_misses = 0;
+static int		re_cache_skip = FALSE;	/* compile an unshared prog */
+
+static char_u *re_cache_key __ARGS((char_u *expr, int re_flags));
+static regprog_T *re_cache_lookup __ARGS((char_u *key));
+static void re_cache_add __ARGS((char_u *key, regprog_T *prog));
+static void re_cache_unlink __ARGS((recache_T *rc));
+static void re_cache_remove __ARGS((recache_T *rc));
+static void re_cache_replace __ARGS((regprog_T *old, regprog_T *prog));
+static regprog_T *re_use_copy __ARGS((regprog_T **progp));
+static void re_done_copy __ARGS((regprog_T **progp, regprog_T *orig));
+
+/*
+ * Make the cache key for compiling "expr" with "re_flags" and the current
+ * 'regexpengine', 'cpoptions', 'encoding' and syntax "\z" state.
+ * Returns NULL when the program must not be cached: a "~" in the pattern
+ * depends on the previous substitute string.
+ * Returns allocated memory.
+ */
+    static char_u *
+re_cache_key(expr, re_flags)
+    char_u	*expr;
+    int		re_flags;
+{
+    char_u	*key;
+
+    if (vim_strchr(expr, '~') != NULL)
+	return NULL;
+    key = alloc((unsigned)(STRLEN(expr) + RE_KEY_LEN));
+    if (key == NULL)
+	return NULL;
+    get_cpo_flags();
+    sprintf((char *)key, "%d %x %d%d %d %d %d:",
+	    regexp_engine, re_flags, reg_cpo_lit, reg_cpo_bsl,
+#ifdef FEAT_SYN_HL
+	    reg_do_extmatch,
+#else
+	    0,
+#endif
+#ifdef FEAT_MBYTE
+	    enc_utf8 ? -1 : enc_dbcs, has_mbyte
+#else
+	    0, 0
+#endif
+	    );
+    STRCAT(key, expr);
+    return key;
+}
+
+/*
+ * Remove "rc" from the LRU list.
+ */
+    static void
+re_cache_unlink(rc)
+    recache_T	*rc;
+{
+    if (rc->rc_prev == NULL)
+	re_cache_first = rc->rc_next;
+    else
+	rc->rc_prev->rc_next = rc->rc_next;
+    if (rc->rc_next == NULL)
+	re_cache_last = rc->rc_prev;
+    else
+	rc->rc_next->rc_prev = rc->rc_prev;
+}
+
+/*
+ * Find the program for "key" in the cache.  When found it is moved to the
+ * front of the LRU list and its reference count is incremented.
+ * Returns NULL when not found or when the program is being executed.
+ */
+    static regprog_T *
+re_cache_lookup(key)
+    char_u	*key;
+{
+    hashitem_T	*hi;
+    recache_T	*rc;
+
+    if (!re_cache_ht_init)
+	return NULL;
+    hi = hash_find(&re_cache_ht, key);
+    if (HASHITEM_EMPTY(hi))
+	return NULL;
+    rc = HI2RC(hi);
+    if (rc->rc_prog->re_in_use)
+	return NULL;
+    if (rc != re_cache_first)
+    {
+	re_cache_unlink(rc);
+	rc->rc_prev = NULL;
+	rc->rc_next = re_cache_first;
+	re_cache_first->rc_prev = rc;
+	re_cache_first = rc;
+    }
+#ifdef FEAT_SYN_HL
+    had_eol = rc->rc_had_eol;
+#endif
+    ++rc->rc_prog->re_refcount;
+    return rc->rc_prog;
+}
+
+/*
+ * Add "prog", just compiled, to the cache under "key".
+ * Nothing happens when there already is a program for "key", it was compiled
+ * again because the cached one is being executed.
+ */
+    static void
+re_cache_add(key, prog)
+    char_u	*key;
+    regprog_T	*prog;
+{
+    recache_T	*rc;
+    hashitem_T	*hi;
+    hash_T	hash;
+
+    if (!re_cache_ht_init)
+    {
+	hash_init(&re_cache_ht);
+	re_cache_ht_init = TRUE;
+    }
+    hash = hash_hash(key);
+    hi = hash_lookup(&re_cache_ht, key, hash);
+    if (!HASHITEM_EMPTY(hi))
+	return;
+    rc = (recache_T *)alloc((unsigned)(sizeof(recache_T) + STRLEN(key)));
+    if (rc == NULL)
+	return;
+    STRCPY(rc->rc_key, key);
+    if (hash_add_item(&re_cache_ht, hi, rc->rc_key, hash) == FAIL)
+    {
+	vim_free(rc);
+	return;
+    }
+    rc->rc_prog = prog;
+#ifdef FEAT_SYN_HL
+    rc->rc_had_eol = had_eol;
+#else
+    rc->rc_had_eol = FALSE;
+#endif
+    ++prog->re_refcount;
+    rc->rc_prev = NULL;
+    rc->rc_next = re_cache_first;
+    if (re_cache_first == NULL)
+	re_cache_last = rc;
+    else
+	re_cache_first->rc_prev = rc;
+    re_cache_first = rc;
+
+    if (++re_cache_count > RE_CACHE_MAX)
+	re_cache_remove(re_cache_last);
+}
+
+/*
+ * Remove "rc" from the cache.  The program is freed when nobody else is
+ * using it.
+ */
+    static void
+re_cache_remove(rc)
+    recache_T	*rc;
+{
+    hashitem_T	*hi;
+
+    hi = hash_find(&re_cache_ht, rc->rc_key);
+    if (!HASHITEM_EMPTY(hi))
+	hash_remove(&re_cache_ht, hi);
+    re_cache_unlink(rc);
+    --re_cache_count;
+    vim_regfree(rc->rc_prog);
+    vim_free(rc);
+}
+
+/*
+ * The automatic engine switched from the NFA program "old" to the
+ * backtracking program "prog".  Let the cache entry for "old" use "prog", so
+ * that the NFA engine isn't tried again for the pattern.
+ */
+    static void
+re_cache_replace(old, prog)
+    regprog_T	*old;
+    regprog_T	*prog;
+{
+    recache_T	*rc;
+
+    for (rc = re_cache_first; rc != NULL; rc = rc->rc_next)
+	if (rc->rc_prog == old)
+	{
+	    rc->rc_prog = prog;
+	    ++prog->re_refcount;
+	    vim_regfree(old);
+	    break;
+	}
+}
+
+/*
+ * "*progp" is shared and is already being executed.  Replace it with a copy
+ * that is not shared, so that executing it recursively does not mess up the
+ * state of the outer execution.  re_done_copy() must be called when done.
+ * Returns the original program, NULL when compiling fails and nothing
+ * changed.
+ */
+    static regprog_T *
+re_use_copy(progp)
+    regprog_T	**progp;
+{
+    regprog_T	*prog = *progp;
+    regprog_T	*copy;
+    char_u	*pat;
+    int		save_p_re = p_re;
+
+    if (prog->engine == &bt_regengine)
+	pat = ((bt_regprog_T *)prog)->pattern;
+    else
+	pat = ((nfa_regprog_T *)prog)->pattern;
+    if (pat == NULL)
+	return NULL;
+    /* The cache doesn't return "prog" while it is in use. */
+    p_re = prog->re_engine;
+    copy = vim_regcomp(pat, prog->re_flags);
+    p_re = save_p_re;
+    if (copy == NULL)
+	return NULL;
+    *progp = copy;
+    return prog;
+}
+
+/*
+ * Free the copy that re_use_copy() put in "*progp", or the program that
+ * replaced it, and put back the original program "orig".  The outer
+ * execution still uses it and resets its "re_in_use" flag.
+ */
+    static void
+re_done_copy(progp, orig)
+    regprog_T	**progp;
+    regprog_T	*orig;
+{
+    vim_regfree(*progp);
+    *progp = orig;
+}
+
+/*
+ * Remove all programs from the cache and reset the counters.
+ */
+    void
+re_cache_clear()
+{
+    while (re_cache_first != NULL)
+	re_cache_remove(re_cache_first);
+    if (re_cache_ht_init)
+    {
+	hash_clear(&re_cache_ht);
+	re_cache_ht_init = FALSE;
+    }
+    re_cache_hits = 0;
+    re_cache_misses = 0;
+}
+
+/*
+ * ":regexpcache": Show the number of cached programs and how often the
+ * cache was used.
+ * ":regexpcache clear": Empty the cache.
+ */
+    void
+ex_regexpcache(eap)
+    exarg_T	*eap;
+{
+    if (STRCMP(eap->arg, "clear") == 0)
+	re_cache_clear();
+    else if (*eap->arg == NUL)
+    {
+	smsg((char_u *)_("%ld compiled patterns cached (max %d)"),
+						 re_cache_count, RE_CACHE_MAX);
+	smsg((char_u *)_("%ld hits, %ld misses"),
+					       re_cache_hits, re_cache_misses);
+    }
+    else
+	EMSG2(_(e_invarg2), eap->arg);
+}
+#endif
+
 /*
  * Compile a regular expression into internal code.
  * Returns the program in allocated memory.
  * Use vim_regfree() to free the memory.
  * Returns NULL for an error.
+ * When the same pattern was compiled before in the same circumstances, the
+ * program may be shared with other users.
  */
     regprog_T *
 vim_regcomp(expr_arg, re_flags)
@@ -8049,6 +8554,9 @@ vim_regcomp(expr_arg, re_flags)
 {
     regprog_T   *prog = NULL;
     char_u	*expr = expr_arg;
+#ifdef FEAT_RE_CACHE
+    char_u	*key;
+#endif
 
     regexp_engine = p_re;
 
@@ -8074,6 +8582,21 @@ vim_regcomp(expr_arg, re_flags)
 	    regexp_engine = AUTOMATIC_ENGINE;
 	}
     }
+#ifdef FEAT_RE_CACHE
+    key = re_cache_skip ? NULL : re_cache_key(expr, re_flags);
+    if (key != NULL)
+    {
+	prog = re_cache_lookup(key);
+	if (prog != NULL)
+	{
+	    ++re_cache_hits;
+	    vim_free(key);
+	    return prog;
+	}
+	++re_cache_misses;
+    }
+#endif
+
     bt_regengine.expr = expr;
     nfa_regengine.expr = expr;
 
@@ -8122,19 +8645,53 @@ vim_regcomp(expr_arg, re_flags)
 	 * out to be very slow when executing it. */
 	prog->re_engine = regexp_engine;
 	prog->re_flags  = re_flags;
+	prog->re_refcount = 1;
+	prog->re_in_use = FALSE;
+#ifdef FEAT_RE_CACHE
+	if (key != NULL)
+	    re_cache_add(key, prog);
+#endif
     }
+#ifdef FEAT_RE_CACHE
+    vim_free(key);
+#endif
+
+    return prog;
+}
+
+#if defined(FEAT_VIMGREP_THREAD) || defined(PROTO)
+/*
+ * Like vim_regcomp(), but the program is never shared with other users, so
+ * that it can be executed in another thread with vim_regexec_thread().
+ */
+    regprog_T *
+vim_regcomp_unshared(expr, re_flags)
+    char_u	*expr;
+    int		re_flags;
+{
+    regprog_T   *prog;
+# ifdef FEAT_RE_CACHE
+    int		save_skip = re_cache_skip;
 
+    re_cache_skip = TRUE;
+# endif
+    prog = vim_regcomp(expr, re_flags);
+# ifdef FEAT_RE_CACHE
+    re_cache_skip = save_skip;
+# endif
     return prog;
 }
+#endif
 
 /*
  * Free a compiled regexp program, returned by vim_regcomp().
+ * The memory is only freed when there are no other users.
  */
     void
 vim_regfree(prog)
     regprog_T   *prog;
 {
-    if (prog != NULL)
+    if (prog != NULL && --prog->re_refcount <= 0)
 	prog->engine->regfree(prog);
 }
 
@@ -8173,18 +8730,36 @@ vim_regexec_both(rmp, line, col, nl)
     colnr_T	col;    /* column to start looking for match */
     int		nl;
 {
-    int result = rmp->regprog->engine->regexec_nl(rmp, line, col, nl);
+    int		result;
+    regexec_T	rex;
+    int		in_use_save;
+#ifdef FEAT_RE_CACHE
+    regprog_T	*orig = NULL;
+#endif
+
+    /* The state is local, a regexp may be executed while another one is
+     * being used, e.g. from an autocommand or an expression. */
+    vim_memset(&rex, 0, sizeof(rex));
+
+#ifdef FEAT_RE_CACHE
+    if (rmp->regprog->re_in_use && rmp->regprog->re_refcount > 1)
+	orig = re_use_copy(&rmp->regprog);
+#endif
+    in_use_save = rmp->regprog->re_in_use;
+    rmp->regprog->re_in_use = TRUE;
+    result = rmp->regprog->engine->regexec_nl(&rex, rmp, line, col, nl);
+    rmp->regprog->re_in_use = in_use_save;
 
     /* NFA engine aborted because it's very slow. */
     if (rmp->regprog->re_engine == AUTOMATIC_ENGINE
 					       && result == NFA_TOO_EXPENSIVE)
     {
-	int    save_p_re = p_re;
-	int    re_flags = rmp->regprog->re_flags;
-	char_u *pat = vim_strsave(((nfa_regprog_T *)rmp->regprog)->pattern);
+	int	    save_p_re = p_re;
+	int	    re_flags = rmp->regprog->re_flags;
+	char_u	    *pat = vim_strsave(((nfa_regprog_T *)rmp->regprog)->pattern);
+	regprog_T   *prev = rmp->regprog;
 
 	p_re = BACKTRACKING_ENGINE;
-	vim_regfree(rmp->regprog);
 	if (pat != NULL)
 	{
 #ifdef FEAT_EVAL
@@ -8192,12 +8767,28 @@ vim_regexec_both(rmp, line, col, nl)
 #endif
 	    rmp->regprog = vim_regcomp(pat, re_flags);
 	    if (rmp->regprog != NULL)
-		result = rmp->regprog->engine->regexec_nl(rmp, line, col, nl);
+	    {
+#ifdef FEAT_RE_CACHE
+		re_cache_replace(prev, rmp->regprog);
+#endif
+		in_use_save = rmp->regprog->re_in_use;
+		rmp->regprog->re_in_use = TRUE;
+		vim_memset(&rex, 0, sizeof(rex));
+		result = rmp->regprog->engine->regexec_nl(&rex, rmp, line, col,
+									  nl);
+		rmp->regprog->re_in_use = in_use_save;
+	    }
 	    vim_free(pat);
 	}
+	vim_regfree(prev);
 
 	p_re = save_p_re;
     }
+#ifdef FEAT_RE_CACHE
+    if (orig != NULL)
+	re_done_copy(&rmp->regprog, orig);
+#endif
+
     return result > 0;
 }
 
@@ -8235,6 +8826,35 @@ vim_regexec(rmp, line, col)
     return vim_regexec_both(rmp, line, col, FALSE);
 }
 
+#if defined(FEAT_VIMGREP_THREAD) || defined(PROTO)
+/*
+ * Like vim_regexec(), but may be called in a thread other than the main
+ * thread.  "rmp->regprog" must have been returned by vim_regcomp_unshared()
+ * and is not used by any other thread.  Does not check for CTRL-C and does
+ * not give messages.
+ * Return TRUE if there is a match, FALSE if not.
+ * Return RE_NEED_MAIN if the main thread must do it with vim_regexec(): an
+ * error was encountered or the engine needs to be switched.
+ */
+    int
+vim_regexec_thread(rmp, line, col)
+    regmatch_T	*rmp;
+    char_u	*line;
+    colnr_T	col;
+{
+    int		result;
+    regexec_T	rex;
+
+    vim_memset(&rex, 0, sizeof(rex));
+    rex.reg_thread = TRUE;
+    result = rmp->regprog->engine->regexec_nl(&rex, rmp, line, col, FALSE);
+    if (rex.reg_failed || (rmp->regprog->re_engine == AUTOMATIC_ENGINE
+					      && result == NFA_TOO_EXPENSIVE))
+	return RE_NEED_MAIN;
+    return result > 0;
+}
+#endif
+
 #if defined(FEAT_MODIFY_FNAME) || defined(FEAT_EVAL) \
 	|| defined(FIND_REPLACE_DIALOG) || defined(PROTO)
 /*
@@ -8270,19 +8890,36 @@ vim_regexec_multi(rmp, win, buf, lnum, col, tm)
     colnr_T     col;            /* column to start looking for match */
     proftime_T	*tm;		/* timeout limit or NULL */
 {
-    int result = rmp->regprog->engine->regexec_multi(
-						rmp, win, buf, lnum, col, tm);
+    int		result;
+    regexec_T	rex;
+    int		in_use_save;
+#ifdef FEAT_RE_CACHE
+    regprog_T	*orig = NULL;
+#endif
+
+    /* See vim_regexec_both(). */
+    vim_memset(&rex, 0, sizeof(rex));
+
+#ifdef FEAT_RE_CACHE
+    if (rmp->regprog->re_in_use && rmp->regprog->re_refcount > 1)
+	orig = re_use_copy(&rmp->regprog);
+#endif
+    in_use_save = rmp->regprog->re_in_use;
+    rmp->regprog->re_in_use = TRUE;
+    result = rmp->regprog->engine->regexec_multi(
+					  &rex, rmp, win, buf, lnum, col, tm);
+    rmp->regprog->re_in_use = in_use_save;
 
     /* NFA engine aborted because it's very slow. */
     if (rmp->regprog->re_engine == AUTOMATIC_ENGINE
 					       && result == NFA_TOO_EXPENSIVE)
     {
-	int    save_p_re = p_re;
-	int    re_flags = rmp->regprog->re_flags;
-	char_u *pat = vim_strsave(((nfa_regprog_T *)rmp->regprog)->pattern);
+	int	    save_p_re = p_re;
+	int	    re_flags = rmp->regprog->re_flags;
+	char_u	    *pat = vim_strsave(((nfa_regprog_T *)rmp->regprog)->pattern);
+	regprog_T   *prev = rmp->regprog;
 
 	p_re = BACKTRACKING_ENGINE;
-	vim_regfree(rmp->regprog);
 	if (pat != NULL)
 	{
 #ifdef FEAT_EVAL
@@ -8290,12 +8927,26 @@ vim_regexec_multi(rmp, win, buf, lnum, col, tm)
 #endif
 	    rmp->regprog = vim_regcomp(pat, re_flags);
 	    if (rmp->regprog != NULL)
+	    {
+#ifdef FEAT_RE_CACHE
+		re_cache_replace(prev, rmp->regprog);
+#endif
+		in_use_save = rmp->regprog->re_in_use;
+		rmp->regprog->re_in_use = TRUE;
+		vim_memset(&rex, 0, sizeof(rex));
 		result = rmp->regprog->engine->regexec_multi(
-						rmp, win, buf, lnum, col, tm);
+					  &rex, rmp, win, buf, lnum, col, tm);
+		rmp->regprog->re_in_use = in_use_save;
+	    }
 	    vim_free(pat);
 	}
+	vim_regfree(prev);
 	p_re = save_p_re;
     }
+#ifdef FEAT_RE_CACHE
+    if (orig != NULL)
+	re_done_copy(&rmp->regprog, orig);
+#endif
 
     return result <= 0 ? 0 : result;
 }
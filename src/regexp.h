@@ -33,6 +33,9 @@
 #define NFA_MAX_STATES 100000
 #define NFA_TOO_EXPENSIVE -1
 
+/* Returned by vim_regexec_thread() when the main thread must do it. */
+#define RE_NEED_MAIN -2
+
 /* Which regexp engine to use? Needed for vim_regcomp().
  * Must match with 'regexpengine'. */
 #define	    AUTOMATIC_ENGINE	0
@@ -52,6 +55,8 @@ typedef struct regprog
     unsigned		regflags;
     unsigned		re_engine;   /* automatic, backtracking or nfa engine */
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount; /* nr of users, including the cache */
+    int			re_in_use;   /* TRUE while being executed */
 } regprog_T;
 
 /*
@@ -61,11 +66,13 @@ typedef struct regprog
  */
 typedef struct
 {
-    /* These four members implement regprog_T */
+    /* These six members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
     unsigned		re_engine;
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount;
+    int			re_in_use;
 
     int			regstart;
     char_u		reganch;
@@ -73,6 +80,10 @@ typedef struct
     int			regmlen;
 #ifdef FEAT_SYN_HL
     char_u		reghasz;
+#endif
+#ifdef FEAT_RE_CACHE
+    char_u		*pattern;	/* for compiling a copy, see
+					   vim_regexec_both() */
 #endif
     char_u		program[1];	/* actually longer.. */
 } bt_regprog_T;
@@ -97,11 +108,13 @@ struct nfa_state
  */
 typedef struct
 {
-    /* These three members implement regprog_T */
+    /* These six members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
     unsigned		re_engine;
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount;
+    int			re_in_use;
 
     nfa_state_T		*start;		/* points into state[] */
 
@@ -116,6 +129,10 @@ typedef struct
 #endif
     char_u		*pattern;
     int			nsubexp;	/* number of () */
+    int			dfa_flags;	/* NFA_DFA_ flags, zero if the DFA
+					   can't be used */
+    struct nfa_dfa_S	*dfa[2];	/* DFA built while matching, for
+					   matching case and ignoring case */
     int			nstate;
     nfa_state_T		state[1];	/* actually longer.. */
 } nfa_regprog_T;
@@ -161,12 +178,18 @@ typedef struct
     char_u		*matches[NSUBEXP];
 } reg_extmatch_T;
 
+/*
+ * State of executing a regexp, see regexp.c.  Kept by the caller, so that
+ * executing a regexp does not use any global variables.
+ */
+typedef struct regexec_S regexec_T;
+
 struct regengine
 {
     regprog_T	*(*regcomp)(char_u*, int);
     void	(*regfree)(regprog_T *);
-    int		(*regexec_nl)(regmatch_T*, char_u*, colnr_T, int);
-    long	(*regexec_multi)(regmmatch_T*, win_T*, buf_T*, linenr_T, colnr_T, proftime_T*);
+    int		(*regexec_nl)(regexec_T*, regmatch_T*, char_u*, colnr_T, int);
+    long	(*regexec_multi)(regexec_T*, regmmatch_T*, win_T*, buf_T*, linenr_T, colnr_T, proftime_T*);
     char_u	*expr;
 };
 
@@ -247,21 +247,6 @@ static char_u e_ill_char_class[] = N_("E877: (NFA regexp) Invalid character clas
 /* re_flags passed to nfa_regcomp() */
 static int nfa_re_flags;
 
-/* NFA regexp \ze operator encountered. */
-static int nfa_has_zend;
-
-/* NFA regexp \1 .. \9 encountered. */
-static int nfa_has_backref;
-
-#ifdef FEAT_SYN_HL
-/* NFA regexp has \z( ), set zsubexpr. */
-static int nfa_has_zsubexpr;
-#endif
-
-/* Number of sub expressions actually being used during execution. 1 if only
- * the whole match (subexpr 0) is used. */
-static int nfa_nsubexpr;
-
 static int *post_start;  /* holds the postfix form of r.e. */
 static int *post_end;
 static int *post_ptr;
@@ -270,17 +255,9 @@ static int nstate;	/* Number of states in the NFA. Also used when
 			 * executing. */
 static int istate;	/* Index in the state vector, used in alloc_state() */
 
-/* If not NULL match must end at this position */
-static save_se_T *nfa_endp = NULL;
-
-/* listid is global, so that it increases on recursive calls to
- * nfa_regmatch(), which means we don't have to clear the lastlist field of
- * all the states. */
-static int nfa_listid;
-static int nfa_alt_listid;
-
-/* 0 for first call to nfa_regmatch(), 1 for recursive call. */
-static int nfa_ll_index = 0;
+/* Set while compiling, stored in the program. */
+static int nfa_has_zend;	/* regexp \ze operator encountered */
+static int nfa_has_backref;	/* regexp \1 .. \9 encountered */
 
 static int nfa_regcomp_start __ARGS((char_u *expr, int re_flags));
 static int nfa_get_reganch __ARGS((nfa_state_T *start, int depth));
@@ -311,12 +288,12 @@ static int check_char_class __ARGS((int class, int c));
 static void nfa_save_listids __ARGS((nfa_regprog_T *prog, int *list));
 static void nfa_restore_listids __ARGS((nfa_regprog_T *prog, int *list));
 static int nfa_re_num_cmp __ARGS((long_u val, int op, long_u pos));
-static long nfa_regtry __ARGS((nfa_regprog_T *prog, colnr_T col, proftime_T *tm));
-static long nfa_regexec_both __ARGS((char_u *line, colnr_T col, proftime_T *tm));
+static long nfa_regtry __ARGS((regexec_T *rex, nfa_regprog_T *prog, colnr_T col, proftime_T *tm));
+static long nfa_regexec_both __ARGS((regexec_T *rex, char_u *line, colnr_T col, proftime_T *tm));
 static regprog_T *nfa_regcomp __ARGS((char_u *expr, int re_flags));
 static void nfa_regfree __ARGS((regprog_T *prog));
-static int  nfa_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col, int line_lbr));
-static long nfa_regexec_multi __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T lnum, colnr_T col, proftime_T *tm));
+static int  nfa_regexec_nl __ARGS((regexec_T *rex, regmatch_T *rmp, char_u *line, colnr_T col, int line_lbr));
+static long nfa_regexec_multi __ARGS((regexec_T *rex, regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T lnum, colnr_T col, proftime_T *tm));
 static int match_follows __ARGS((nfa_state_T *startstate, int depth));
 static int failure_chance __ARGS((nfa_state_T *state, int depth));
 
@@ -1349,8 +1326,8 @@ nfa_regatom()
 		    if (reg_do_extmatch != REX_USE)
 			EMSG_RET_FAIL(_(e_z1_not_allowed));
 		    EMIT(NFA_ZREF1 + (no_Magic(c) - '1'));
-		    /* No need to set nfa_has_backref, the sub-matches don't
-		     * change when \z1 .. \z9 matches or not. */
+		    /* No need to set nfa_has_backref, the sub-matches
+		     * don't change when \z1 .. \z9 matches or not. */
 		    re_has_z = REX_USE;
 		    break;
 		case '(':
@@ -1412,18 +1389,22 @@ nfa_regatom()
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    EMIT(NFA_BOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '$':
 		    EMIT(NFA_EOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '#':
 		    EMIT(NFA_CURSOR);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'V':
 		    EMIT(NFA_VISUAL);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'C':
@@ -1477,9 +1458,12 @@ nfa_regatom()
 			if (c == 'l' || c == 'c' || c == 'v')
 			{
 			    if (c == 'l')
+			    {
 				/* \%{n}l  \%{n}<l  \%{n}>l  */
 				EMIT(cmp == '<' ? NFA_LNUM_LT :
 				     cmp == '>' ? NFA_LNUM_GT : NFA_LNUM);
+				regflags |= RF_BUFPOS;
+			    }
 			    else if (c == 'c')
 				/* \%{n}c  \%{n}<c  \%{n}>c  */
 				EMIT(cmp == '<' ? NFA_COL_LT :
@@ -1497,6 +1481,7 @@ nfa_regatom()
 			    EMIT(cmp == '<' ? NFA_MARK_LT :
 				 cmp == '>' ? NFA_MARK_GT : NFA_MARK);
 			    EMIT(getchr());
+			    regflags |= RF_BUFPOS;
 			    break;
 			}
 		    }
@@ -1536,6 +1521,7 @@ collection:
 			EMIT(result - NFA_ADD_NL);
 			EMIT(NFA_NEWL);
 			EMIT(NFA_OR);
+			regflags |= RF_HASNL;
 		    }
 		    else
 			EMIT(result);
@@ -1825,6 +1811,8 @@ collection:
 		{
 		    EMIT(reg_string ? NL : NFA_NEWL);
 		    EMIT(NFA_OR);
+		    if (!reg_string)
+			regflags |= RF_HASNL;
 		}
 
 		return OK;
@@ -3718,36 +3706,6 @@ nfa_postprocess(prog)
  * NFA execution code.
  ****************************************************************/
 
-typedef struct
-{
-    int	    in_use; /* number of subexpr with useful info */
-
-    /* When REG_MULTI is TRUE list.multi is used, otherwise list.line. */
-    union
-    {
-	struct multipos
-	{
-	    linenr_T	start_lnum;
-	    linenr_T	end_lnum;
-	    colnr_T	start_col;
-	    colnr_T	end_col;
-	} multi[NSUBEXP];
-	struct linepos
-	{
-	    char_u	*start;
-	    char_u	*end;
-	} line[NSUBEXP];
-    } list;
-} regsub_T;
-
-typedef struct
-{
-    regsub_T	norm; /* \( .. \) matches */
-#ifdef FEAT_SYN_HL
-    regsub_T	synt; /* \z( .. \) matches */
-#endif
-} regsubs_T;
-
 /* nfa_pim_T stores a Postponed Invisible Match. */
 typedef struct nfa_pim_S nfa_pim_T;
 struct nfa_pim_S
@@ -3790,23 +3748,25 @@ typedef struct
 } nfa_list_T;
 
 #ifdef ENABLE_LOG
-static void log_subsexpr __ARGS((regsubs_T *subs));
-static void log_subexpr __ARGS((regsub_T *sub));
-static char *pim_info __ARGS((nfa_pim_T *pim));
+static void log_subsexpr __ARGS((regexec_T *rex, regsubs_T *subs));
+static void log_subexpr __ARGS((regexec_T *rex, regsub_T *sub));
+static char *pim_info __ARGS((regexec_T *rex, nfa_pim_T *pim));
 
     static void
-log_subsexpr(subs)
+log_subsexpr(rex, subs)
+    regexec_T	*rex;
     regsubs_T *subs;
 {
-    log_subexpr(&subs->norm);
+    log_subexpr(rex, &subs->norm);
 # ifdef FEAT_SYN_HL
-    if (nfa_has_zsubexpr)
-	log_subexpr(&subs->synt);
+    if (rex->nfa_has_zsubexpr)
+	log_subexpr(rex, &subs->synt);
 # endif
 }
 
     static void
-log_subexpr(sub)
+log_subexpr(rex, sub)
+    regexec_T	*rex;
     regsub_T *sub;
 {
     int j;
@@ -3832,7 +3792,8 @@ log_subexpr(sub)
 }
 
     static char *
-pim_info(pim)
+pim_info(rex, pim)
+    regexec_T	*rex;
     nfa_pim_T *pim;
 {
     static char buf[30];
@@ -3842,61 +3803,57 @@ pim_info(pim)
     else
     {
 	sprintf(buf, " PIM col %d", REG_MULTI ? (int)pim->end.pos.col
-		: (int)(pim->end.ptr - reginput));
+		: (int)(pim->end.ptr - rex->input));
     }
     return buf;
 }
 
 #endif
 
-/* Used during execution: whether a match has been found. */
-static int nfa_match;
-#ifdef FEAT_RELTIME
-static proftime_T  *nfa_time_limit;
-static int         nfa_time_count;
-#endif
-
-static void copy_pim __ARGS((nfa_pim_T *to, nfa_pim_T *from));
-static void clear_sub __ARGS((regsub_T *sub));
-static void copy_sub __ARGS((regsub_T *to, regsub_T *from));
-static void copy_sub_off __ARGS((regsub_T *to, regsub_T *from));
-static void copy_ze_off __ARGS((regsub_T *to, regsub_T *from));
-static int sub_equal __ARGS((regsub_T *sub1, regsub_T *sub2));
-static int match_backref __ARGS((regsub_T *sub, int subidx, int *bytelen));
-static int has_state_with_pos __ARGS((nfa_list_T *l, nfa_state_T *state, regsubs_T *subs, nfa_pim_T *pim));
-static int pim_equal __ARGS((nfa_pim_T *one, nfa_pim_T *two));
-static int state_in_list __ARGS((nfa_list_T *l, nfa_state_T *state, regsubs_T *subs));
-static regsubs_T *addstate __ARGS((nfa_list_T *l, nfa_state_T *state, regsubs_T *subs_arg, nfa_pim_T *pim, int off));
-static void addstate_here __ARGS((nfa_list_T *l, nfa_state_T *state, regsubs_T *subs, nfa_pim_T *pim, int *ip));
+static void copy_pim __ARGS((regexec_T *rex, nfa_pim_T *to, nfa_pim_T *from));
+static void clear_sub __ARGS((regexec_T *rex, regsub_T *sub));
+static void copy_sub __ARGS((regexec_T *rex, regsub_T *to, regsub_T *from));
+static void copy_sub_off __ARGS((regexec_T *rex, regsub_T *to, regsub_T *from));
+static void copy_ze_off __ARGS((regexec_T *rex, regsub_T *to, regsub_T *from));
+static int sub_equal __ARGS((regexec_T *rex, regsub_T *sub1, regsub_T *sub2));
+static int match_backref __ARGS((regexec_T *rex, regsub_T *sub, int subidx, int *bytelen));
+static int has_state_with_pos __ARGS((regexec_T *rex, nfa_list_T *l, nfa_state_T *state, regsubs_T *subs, nfa_pim_T *pim));
+static int pim_equal __ARGS((regexec_T *rex, nfa_pim_T *one, nfa_pim_T *two));
+static int state_in_list __ARGS((regexec_T *rex, nfa_list_T *l, nfa_state_T *state, regsubs_T *subs));
+static regsubs_T *addstate __ARGS((regexec_T *rex, nfa_list_T *l, nfa_state_T *state, regsubs_T *subs_arg, nfa_pim_T *pim, int off));
+static void addstate_here __ARGS((regexec_T *rex, nfa_list_T *l, nfa_state_T *state, regsubs_T *subs, nfa_pim_T *pim, int *ip));
 
 /*
  * Copy postponed invisible match info from "from" to "to".
  */
     static void
-copy_pim(to, from)
+copy_pim(rex, to, from)
+    regexec_T	*rex;
     nfa_pim_T *to;
     nfa_pim_T *from;
 {
     to->result = from->result;
     to->state = from->state;
-    copy_sub(&to->subs.norm, &from->subs.norm);
+    copy_sub(rex, &to->subs.norm, &from->subs.norm);
 #ifdef FEAT_SYN_HL
-    if (nfa_has_zsubexpr)
-	copy_sub(&to->subs.synt, &from->subs.synt);
+    if (rex->nfa_has_zsubexpr)
+	copy_sub(rex, &to->subs.synt, &from->subs.synt);
 #endif
     to->end = from->end;
 }
 
     static void
-clear_sub(sub)
+clear_sub(rex, sub)
+    regexec_T	*rex;
     regsub_T *sub;
 {
     if (REG_MULTI)
 	/* Use 0xff to set lnum to -1 */
 	vim_memset(sub->list.multi, 0xff,
-				      sizeof(struct multipos) * nfa_nsubexpr);
+				  sizeof(struct multipos) * rex->nfa_nsubexpr);
     else
-	vim_memset(sub->list.line, 0, sizeof(struct linepos) * nfa_nsubexpr);
+	vim_memset(sub->list.line, 0,
+				   sizeof(struct linepos) * rex->nfa_nsubexpr);
     sub->in_use = 0;
 }
 
@@ -3904,7 +3861,8 @@ clear_sub(sub)
  * Copy the submatches from "from" to "to".
  */
     static void
-copy_sub(to, from)
+copy_sub(rex, to, from)
+    regexec_T	*rex;
     regsub_T	*to;
     regsub_T	*from;
 {
@@ -3927,7 +3885,8 @@ copy_sub(to, from)
  * Like copy_sub() but exclude the main match.
  */
     static void
-copy_sub_off(to, from)
+copy_sub_off(rex, to, from)
+    regexec_T	*rex;
     regsub_T	*to;
     regsub_T	*from;
 {
@@ -3951,11 +3910,12 @@ copy_sub_off(to, from)
  * Like copy_sub() but only do the end of the main match if \ze is present.
  */
     static void
-copy_ze_off(to, from)
+copy_ze_off(rex, to, from)
+    regexec_T	*rex;
     regsub_T	*to;
     regsub_T	*from;
 {
-    if (nfa_has_zend)
+    if (rex->nfa_has_zend)
     {
 	if (REG_MULTI)
 	{
@@ -3978,7 +3938,8 @@ copy_ze_off(to, from)
  * When using back-references also check the end position.
  */
     static int
-sub_equal(sub1, sub2)
+sub_equal(rex, sub1, sub2)
+    regexec_T	*rex;
     regsub_T	*sub1;
     regsub_T	*sub2;
 {
@@ -4008,7 +3969,7 @@ sub_equal(sub1, sub2)
 					     != sub2->list.multi[i].start_col)
 		return FALSE;
 
-	    if (nfa_has_backref)
+	    if (rex->nfa_has_backref)
 	    {
 		if (i < sub1->in_use)
 		    s1 = sub1->list.multi[i].end_lnum;
@@ -4040,7 +4001,7 @@ sub_equal(sub1, sub2)
 		sp2 = NULL;
 	    if (sp1 != sp2)
 		return FALSE;
-	    if (nfa_has_backref)
+	    if (rex->nfa_has_backref)
 	    {
 		if (i < sub1->in_use)
 		    sp1 = sub1->list.line[i].end;
@@ -4061,11 +4022,12 @@ sub_equal(sub1, sub2)
 
 #ifdef ENABLE_LOG
     static void
-report_state(char *action,
+report_state(rex, char *action,
 	     regsub_T *sub,
 	     nfa_state_T *state,
 	     int lid,
 	     nfa_pim_T *pim)
+    regexec_T	*rex;
 {
     int col;
 
@@ -4074,11 +4036,11 @@ report_state(char *action,
     else if (REG_MULTI)
 	col = sub->list.multi[0].start_col;
     else
-	col = (int)(sub->list.line[0].start - regline);
+	col = (int)(sub->list.line[0].start - rex->line);
     nfa_set_code(state->c);
     fprintf(log_fd, "> %s state %d to list %d. char %d: %s (start col %d)%s\n",
 	    action, abs(state->id), lid, state->c, code, col,
-	    pim_info(pim));
+	    pim_info(rex, pim));
 }
 #endif
 
@@ -4087,7 +4049,8 @@ report_state(char *action,
  * positions as "subs".
  */
     static int
-has_state_with_pos(l, state, subs, pim)
+has_state_with_pos(rex, l, state, subs, pim)
+    regexec_T		*rex;
     nfa_list_T		*l;	/* runtime state list */
     nfa_state_T		*state;	/* state to update */
     regsubs_T		*subs;	/* pointers to subexpressions */
@@ -4100,12 +4063,12 @@ has_state_with_pos(l, state, subs, pim)
     {
 	thread = &l->t[i];
 	if (thread->state->id == state->id
-		&& sub_equal(&thread->subs.norm, &subs->norm)
+		&& sub_equal(rex, &thread->subs.norm, &subs->norm)
 #ifdef FEAT_SYN_HL
-		&& (!nfa_has_zsubexpr
-				|| sub_equal(&thread->subs.synt, &subs->synt))
+		&& (!rex->nfa_has_zsubexpr
+			    || sub_equal(rex, &thread->subs.synt, &subs->synt))
 #endif
-		&& pim_equal(&thread->pim, pim))
+		&& pim_equal(rex, &thread->pim, pim))
 	    return TRUE;
     }
     return FALSE;
@@ -4116,7 +4079,8 @@ has_state_with_pos(l, state, subs, pim)
  * set.
  */
     static int
-pim_equal(one, two)
+pim_equal(rex, one, two)
+    regexec_T	*rex;
     nfa_pim_T *one;
     nfa_pim_T *two;
 {
@@ -4238,14 +4202,16 @@ match_follows(startstate, depth)
  * Return TRUE if "state" is already in list "l".
  */
     static int
-state_in_list(l, state, subs)
+state_in_list(rex, l, state, subs)
+    regexec_T		*rex;
     nfa_list_T		*l;	/* runtime state list */
     nfa_state_T		*state;	/* state to update */
     regsubs_T		*subs;	/* pointers to subexpressions */
 {
-    if (state->lastlist[nfa_ll_index] == l->id)
+    if (state->lastlist[rex->nfa_ll_index] == l->id)
     {
-	if (!nfa_has_backref || has_state_with_pos(l, state, subs, NULL))
+	if (!rex->nfa_has_backref
+		      || has_state_with_pos(rex, l, state, subs, NULL))
 	    return TRUE;
     }
     return FALSE;
@@ -4253,10 +4219,11 @@ state_in_list(l, state, subs)
 
 /*
  * Add "state" and possibly what follows to state list ".".
- * Returns "subs_arg", possibly copied into temp_subs.
+ * Returns "subs_arg", possibly copied into "rex->nfa_temp_subs".
  */
     static regsubs_T *
-addstate(l, state, subs_arg, pim, off)
+addstate(rex, l, state, subs_arg, pim, off)
+    regexec_T		*rex;
     nfa_list_T		*l;	    /* runtime state list */
     nfa_state_T		*state;	    /* state to update */
     regsubs_T		*subs_arg;  /* pointers to subexpressions */
@@ -4271,7 +4238,6 @@ addstate(l, state, subs_arg, pim, off)
     int			i;
     regsub_T		*sub;
     regsubs_T		*subs = subs_arg;
-    static regsubs_T	temp_subs;
 #ifdef ENABLE_LOG
     int			did_print = FALSE;
 #endif
@@ -4314,11 +4280,11 @@ addstate(l, state, subs_arg, pim, off)
 	    /* "^" won't match past end-of-line, don't bother trying.
 	     * Except when at the end of the line, or when we are going to the
 	     * next line for a look-behind match. */
-	    if (reginput > regline
-		    && *reginput != NUL
-		    && (nfa_endp == NULL
+	    if (rex->input > rex->line
+		    && *rex->input != NUL
+		    && (rex->nfa_endp == NULL
 			|| !REG_MULTI
-			|| reglnum == nfa_endp->se_u.pos.lnum))
+			|| rex->lnum == rex->nfa_endp->se_u.pos.lnum))
 		goto skip_add;
 	    /* FALLTHROUGH */
 
@@ -4350,13 +4316,14 @@ addstate(l, state, subs_arg, pim, off)
 	     * endless loop for "\(\)*" */
 
 	default:
-	    if (state->lastlist[nfa_ll_index] == l->id && state->c != NFA_SKIP)
+	    if (state->lastlist[rex->nfa_ll_index] == l->id
+						     && state->c != NFA_SKIP)
 	    {
 		/* This state is already in the list, don't add it again,
 		 * unless it is an MOPEN that is used for a backreference or
 		 * when there is a PIM. For NFA_MATCH check the position,
 		 * lower position is preferred. */
-		if (!nfa_has_backref && pim == NULL && !l->has_pim
+		if (!rex->nfa_has_backref && pim == NULL && !l->has_pim
 						     && state->c != NFA_MATCH)
 		{
 skip_add:
@@ -4370,7 +4337,7 @@ skip_add:
 
 		/* Do not add the state again when it exists with the same
 		 * positions. */
-		if (has_state_with_pos(l, state, subs, pim))
+		if (has_state_with_pos(rex, l, state, subs, pim))
 		    goto skip_add;
 	    }
 
@@ -4380,16 +4347,16 @@ skip_add:
 	    {
 		int newlen = l->len * 3 / 2 + 50;
 
-		if (subs != &temp_subs)
+		if (subs != &rex->nfa_temp_subs)
 		{
 		    /* "subs" may point into the current array, need to make a
 		     * copy before it becomes invalid. */
-		    copy_sub(&temp_subs.norm, &subs->norm);
+		    copy_sub(rex, &rex->nfa_temp_subs.norm, &subs->norm);
 #ifdef FEAT_SYN_HL
-		    if (nfa_has_zsubexpr)
-			copy_sub(&temp_subs.synt, &subs->synt);
+		    if (rex->nfa_has_zsubexpr)
+			copy_sub(rex, &rex->nfa_temp_subs.synt, &subs->synt);
 #endif
-		    subs = &temp_subs;
+		    subs = &rex->nfa_temp_subs;
 		}
 
 		/* TODO: check for vim_realloc() returning NULL. */
@@ -4398,30 +4365,30 @@ skip_add:
 	    }
 
 	    /* add the state to the list */
-	    state->lastlist[nfa_ll_index] = l->id;
+	    state->lastlist[rex->nfa_ll_index] = l->id;
 	    thread = &l->t[l->n++];
 	    thread->state = state;
 	    if (pim == NULL)
 		thread->pim.result = NFA_PIM_UNUSED;
 	    else
 	    {
-		copy_pim(&thread->pim, pim);
+		copy_pim(rex, &thread->pim, pim);
 		l->has_pim = TRUE;
 	    }
-	    copy_sub(&thread->subs.norm, &subs->norm);
+	    copy_sub(rex, &thread->subs.norm, &subs->norm);
 #ifdef FEAT_SYN_HL
-	    if (nfa_has_zsubexpr)
-		copy_sub(&thread->subs.synt, &subs->synt);
+	    if (rex->nfa_has_zsubexpr)
+		copy_sub(rex, &thread->subs.synt, &subs->synt);
 #endif
 #ifdef ENABLE_LOG
-	    report_state("Adding", &thread->subs.norm, state, l->id, pim);
+	    report_state(rex, "Adding", &thread->subs.norm, state, l->id, pim);
 	    did_print = TRUE;
 #endif
     }
 
 #ifdef ENABLE_LOG
     if (!did_print)
-	report_state("Processing", &subs->norm, state, l->id, pim);
+	report_state(rex, "Processing", &subs->norm, state, l->id, pim);
 #endif
     switch (state->c)
     {
@@ -4430,14 +4397,14 @@ skip_add:
 
 	case NFA_SPLIT:
 	    /* order matters here */
-	    subs = addstate(l, state->out, subs, pim, off);
-	    subs = addstate(l, state->out1, subs, pim, off);
+	    subs = addstate(rex, l, state->out, subs, pim, off);
+	    subs = addstate(rex, l, state->out1, subs, pim, off);
 	    break;
 
 	case NFA_EMPTY:
 	case NFA_NOPEN:
 	case NFA_NCLOSE:
-	    subs = addstate(l, state->out, subs, pim, off);
+	    subs = addstate(rex, l, state->out, subs, pim, off);
 	    break;
 
 	case NFA_MOPEN:
@@ -4508,14 +4475,14 @@ skip_add:
 		}
 		if (off == -1)
 		{
-		    sub->list.multi[subidx].start_lnum = reglnum + 1;
+		    sub->list.multi[subidx].start_lnum = rex->lnum + 1;
 		    sub->list.multi[subidx].start_col = 0;
 		}
 		else
 		{
-		    sub->list.multi[subidx].start_lnum = reglnum;
+		    sub->list.multi[subidx].start_lnum = rex->lnum;
 		    sub->list.multi[subidx].start_col =
-					  (colnr_T)(reginput - regline + off);
+				       (colnr_T)(rex->input - rex->line + off);
 		}
 	    }
 	    else
@@ -4535,10 +4502,10 @@ skip_add:
 		    }
 		    sub->in_use = subidx + 1;
 		}
-		sub->list.line[subidx].start = reginput + off;
+		sub->list.line[subidx].start = rex->input + off;
 	    }
 
-	    subs = addstate(l, state->out, subs, pim, off);
+	    subs = addstate(rex, l, state->out, subs, pim, off);
 	    /* "subs" may have changed, need to set "sub" again */
 #ifdef FEAT_SYN_HL
 	    if (state->c >= NFA_ZOPEN && state->c <= NFA_ZOPEN9)
@@ -4562,12 +4529,12 @@ skip_add:
 	    break;
 
 	case NFA_MCLOSE:
-	    if (nfa_has_zend && (REG_MULTI
+	    if (rex->nfa_has_zend && (REG_MULTI
 			? subs->norm.list.multi[0].end_lnum >= 0
 			: subs->norm.list.line[0].end != NULL))
 	    {
 		/* Do not overwrite the position set by \ze. */
-		subs = addstate(l, state->out, subs, pim, off);
+		subs = addstate(rex, l, state->out, subs, pim, off);
 		break;
 	    }
 	case NFA_MCLOSE1:
@@ -4621,14 +4588,14 @@ skip_add:
 		save_lpos.col = sub->list.multi[subidx].end_col;
 		if (off == -1)
 		{
-		    sub->list.multi[subidx].end_lnum = reglnum + 1;
+		    sub->list.multi[subidx].end_lnum = rex->lnum + 1;
 		    sub->list.multi[subidx].end_col = 0;
 		}
 		else
 		{
-		    sub->list.multi[subidx].end_lnum = reglnum;
+		    sub->list.multi[subidx].end_lnum = rex->lnum;
 		    sub->list.multi[subidx].end_col =
-					  (colnr_T)(reginput - regline + off);
+				       (colnr_T)(rex->input - rex->line + off);
 		}
 		/* avoid compiler warnings */
 		save_ptr = NULL;
@@ -4636,13 +4603,13 @@ skip_add:
 	    else
 	    {
 		save_ptr = sub->list.line[subidx].end;
-		sub->list.line[subidx].end = reginput + off;
+		sub->list.line[subidx].end = rex->input + off;
 		/* avoid compiler warnings */
 		save_lpos.lnum = 0;
 		save_lpos.col = 0;
 	    }
 
-	    subs = addstate(l, state->out, subs, pim, off);
+	    subs = addstate(rex, l, state->out, subs, pim, off);
 	    /* "subs" may have changed, need to set "sub" again */
 #ifdef FEAT_SYN_HL
 	    if (state->c >= NFA_ZCLOSE && state->c <= NFA_ZCLOSE9)
@@ -4671,7 +4638,8 @@ skip_add:
  * matters for alternatives.
  */
     static void
-addstate_here(l, state, subs, pim, ip)
+addstate_here(rex, l, state, subs, pim, ip)
+    regexec_T		*rex;
     nfa_list_T		*l;	/* runtime state list */
     nfa_state_T		*state;	/* state to update */
     regsubs_T		*subs;	/* pointers to subexpressions */
@@ -4683,7 +4651,7 @@ addstate_here(l, state, subs, pim, ip)
     int listidx = *ip;
 
     /* first add the state(s) at the end, so that we know how many there are */
-    addstate(l, state, subs, pim, 0);
+    addstate(rex, l, state, subs, pim, 0);
 
     /* when "*ip" was at the end of the list, nothing to do */
     if (listidx + 1 == tlen)
@@ -4705,11 +4673,13 @@ addstate_here(l, state, subs, pim, ip)
 	    /* not enough space to move the new states, reallocate the list
 	     * and move the states to the right position */
 	    nfa_thread_T *newl;
+	    int		 newlen = l->len * 3 / 2 + 50;
 
-	    l->len = l->len * 3 / 2 + 50;
-	    newl = (nfa_thread_T *)alloc(l->len * sizeof(nfa_thread_T));
+	    newl = (nfa_thread_T *)rex_alloc(rex,
+				     (long_u)(newlen * sizeof(nfa_thread_T)));
 	    if (newl == NULL)
 		return;
+	    l->len = newlen;
 	    mch_memmove(&(newl[0]),
 		    &(l->t[0]),
 		    sizeof(nfa_thread_T) * listidx);
@@ -4826,7 +4796,8 @@ check_char_class(class, c)
  * Return TRUE if it matches.
  */
     static int
-match_backref(sub, subidx, bytelen)
+match_backref(rex, sub, subidx, bytelen)
+    regexec_T	*rex;
     regsub_T	*sub;	    /* pointers to subexpressions */
     int		subidx;
     int		*bytelen;   /* out: length of match in bytes */
@@ -4846,13 +4817,13 @@ retempty:
 	if (sub->list.multi[subidx].start_lnum < 0
 				       || sub->list.multi[subidx].end_lnum < 0)
 	    goto retempty;
-	if (sub->list.multi[subidx].start_lnum == reglnum
-			       && sub->list.multi[subidx].end_lnum == reglnum)
+	if (sub->list.multi[subidx].start_lnum == rex->lnum
+			      && sub->list.multi[subidx].end_lnum == rex->lnum)
 	{
 	    len = sub->list.multi[subidx].end_col
 					  - sub->list.multi[subidx].start_col;
-	    if (cstrncmp(regline + sub->list.multi[subidx].start_col,
-							 reginput, &len) == 0)
+	    if (cstrncmp(rex, rex->line + sub->list.multi[subidx].start_col,
+							rex->input, &len) == 0)
 	    {
 		*bytelen = len;
 		return TRUE;
@@ -4860,7 +4831,7 @@ retempty:
 	}
 	else
 	{
-	    if (match_with_backref(
+	    if (match_with_backref(rex, 
 			sub->list.multi[subidx].start_lnum,
 			sub->list.multi[subidx].start_col,
 			sub->list.multi[subidx].end_lnum,
@@ -4875,7 +4846,7 @@ retempty:
 					|| sub->list.line[subidx].end == NULL)
 	    goto retempty;
 	len = (int)(sub->list.line[subidx].end - sub->list.line[subidx].start);
-	if (cstrncmp(sub->list.line[subidx].start, reginput, &len) == 0)
+	if (cstrncmp(rex, sub->list.line[subidx].start, rex->input, &len) == 0)
 	{
 	    *bytelen = len;
 	    return TRUE;
@@ -4886,20 +4857,21 @@ retempty:
 
 #ifdef FEAT_SYN_HL
 
-static int match_zref __ARGS((int subidx, int *bytelen));
+static int match_zref __ARGS((regexec_T *rex, int subidx, int *bytelen));
 
 /*
  * Check for a match with \z subexpression "subidx".
  * Return TRUE if it matches.
  */
     static int
-match_zref(subidx, bytelen)
+match_zref(rex, subidx, bytelen)
+    regexec_T	*rex;
     int		subidx;
     int		*bytelen;   /* out: length of match in bytes */
 {
     int		len;
 
-    cleanup_zsubexpr();
+    cleanup_zsubexpr(rex);
     if (re_extmatch_in == NULL || re_extmatch_in->matches[subidx] == NULL)
     {
 	/* backref was not set, match an empty string */
@@ -4908,7 +4880,7 @@ match_zref(subidx, bytelen)
     }
 
     len = (int)STRLEN(re_extmatch_in->matches[subidx]);
-    if (cstrncmp(re_extmatch_in->matches[subidx], reginput, &len) == 0)
+    if (cstrncmp(rex, re_extmatch_in->matches[subidx], rex->input, &len) == 0)
     {
 	*bytelen = len;
 	return TRUE;
@@ -4970,8 +4942,8 @@ nfa_re_num_cmp(val, op, pos)
     return val == pos;
 }
 
-static int recursive_regmatch __ARGS((nfa_state_T *state, nfa_pim_T *pim, nfa_regprog_T *prog, regsubs_T *submatch, regsubs_T *m, int **listids));
-static int nfa_regmatch __ARGS((nfa_regprog_T *prog, nfa_state_T *start, regsubs_T *submatch, regsubs_T *m));
+static int recursive_regmatch __ARGS((regexec_T *rex, nfa_state_T *state, nfa_pim_T *pim, nfa_regprog_T *prog, regsubs_T *submatch, regsubs_T *m, int **listids));
+static int nfa_regmatch __ARGS((regexec_T *rex, nfa_regprog_T *prog, nfa_state_T *start, regsubs_T *submatch, regsubs_T *m));
 
 /*
  * Recursively call nfa_regmatch()
@@ -4979,7 +4951,8 @@ static int nfa_regmatch __ARGS((nfa_regprog_T *prog, nfa_state_T *start, regsubs
  * position).
  */
     static int
-recursive_regmatch(state, pim, prog, submatch, m, listids)
+recursive_regmatch(rex, state, pim, prog, submatch, m, listids)
+    regexec_T	    *rex;
     nfa_state_T	    *state;
     nfa_pim_T	    *pim;
     nfa_regprog_T   *prog;
@@ -4987,11 +4960,11 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
     regsubs_T	    *m;
     int		    **listids;
 {
-    int		save_reginput_col = (int)(reginput - regline);
-    int		save_reglnum = reglnum;
-    int		save_nfa_match = nfa_match;
-    int		save_nfa_listid = nfa_listid;
-    save_se_T   *save_nfa_endp = nfa_endp;
+    int		save_reginput_col = (int)(rex->input - rex->line);
+    int		save_reglnum = rex->lnum;
+    int		save_nfa_match = rex->nfa_match;
+    int		save_nfa_listid = rex->nfa_listid;
+    save_se_T   *save_nfa_endp = rex->nfa_endp;
     save_se_T   endpos;
     save_se_T   *endposp = NULL;
     int		result;
@@ -5001,9 +4974,9 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
     {
 	/* start at the position where the postponed match was */
 	if (REG_MULTI)
-	    reginput = regline + pim->end.pos.col;
+	    rex->input = rex->line + pim->end.pos.col;
 	else
-	    reginput = pim->end.ptr;
+	    rex->input = pim->end.ptr;
     }
 
     if (state->c == NFA_START_INVISIBLE_BEFORE
@@ -5018,8 +4991,8 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
 	{
 	    if (pim == NULL)
 	    {
-		endpos.se_u.pos.col = (int)(reginput - regline);
-		endpos.se_u.pos.lnum = reglnum;
+		endpos.se_u.pos.col = (int)(rex->input - rex->line);
+		endpos.se_u.pos.lnum = rex->lnum;
 	    }
 	    else
 		endpos.se_u.pos = pim->end.pos;
@@ -5027,7 +5000,7 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
 	else
 	{
 	    if (pim == NULL)
-		endpos.se_u.ptr = reginput;
+		endpos.se_u.ptr = rex->input;
 	    else
 		endpos.se_u.ptr = pim->end.ptr;
 	}
@@ -5040,39 +5013,39 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
 	{
 	    if (REG_MULTI)
 	    {
-		regline = reg_getline(--reglnum);
-		if (regline == NULL)
+		rex->line = reg_getline(rex, --rex->lnum);
+		if (rex->line == NULL)
 		    /* can't go before the first line */
-		    regline = reg_getline(++reglnum);
+		    rex->line = reg_getline(rex, ++rex->lnum);
 	    }
-	    reginput = regline;
+	    rex->input = rex->line;
 	}
 	else
 	{
-	    if (REG_MULTI && (int)(reginput - regline) < state->val)
+	    if (REG_MULTI && (int)(rex->input - rex->line) < state->val)
 	    {
 		/* Not enough bytes in this line, go to end of
 		 * previous line. */
-		regline = reg_getline(--reglnum);
-		if (regline == NULL)
+		rex->line = reg_getline(rex, --rex->lnum);
+		if (rex->line == NULL)
 		{
 		    /* can't go before the first line */
-		    regline = reg_getline(++reglnum);
-		    reginput = regline;
+		    rex->line = reg_getline(rex, ++rex->lnum);
+		    rex->input = rex->line;
 		}
 		else
-		    reginput = regline + STRLEN(regline);
+		    rex->input = rex->line + STRLEN(rex->line);
 	    }
-	    if ((int)(reginput - regline) >= state->val)
+	    if ((int)(rex->input - rex->line) >= state->val)
 	    {
-		reginput -= state->val;
+		rex->input -= state->val;
 #ifdef FEAT_MBYTE
 		if (has_mbyte)
-		    reginput -= mb_head_off(regline, reginput);
+		    rex->input -= mb_head_off(rex->line, rex->input);
 #endif
 	    }
 	    else
-		reginput = regline;
+		rex->input = rex->line;
 	}
     }
 
@@ -5083,54 +5056,54 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
 #endif
     /* Have to clear the lastlist field of the NFA nodes, so that
      * nfa_regmatch() and addstate() can run properly after recursion. */
-    if (nfa_ll_index == 1)
+    if (rex->nfa_ll_index == 1)
     {
 	/* Already calling nfa_regmatch() recursively.  Save the lastlist[1]
 	 * values and clear them. */
 	if (*listids == NULL)
 	{
-	    *listids = (int *)lalloc(sizeof(int) * nstate, TRUE);
+	    *listids = (int *)rex_alloc(rex, sizeof(int) * nstate);
 	    if (*listids == NULL)
 	    {
-		EMSG(_("E878: (NFA) Could not allocate memory for branch traversal!"));
+		REX_EMSG(_("E878: (NFA) Could not allocate memory for branch traversal!"));
 		return 0;
 	    }
 	}
 	nfa_save_listids(prog, *listids);
 	need_restore = TRUE;
-	/* any value of nfa_listid will do */
+	/* any value of rex->nfa_listid will do */
     }
     else
     {
 	/* First recursive nfa_regmatch() call, switch to the second lastlist
-	 * entry.  Make sure nfa_listid is different from a previous recursive
-	 * call, because some states may still have this ID. */
-	++nfa_ll_index;
-	if (nfa_listid <= nfa_alt_listid)
-	    nfa_listid = nfa_alt_listid;
+	 * entry.  Make sure rex->nfa_listid is different from a previous
+	 * recursive call, because some states may still have this ID. */
+	++rex->nfa_ll_index;
+	if (rex->nfa_listid <= rex->nfa_alt_listid)
+	    rex->nfa_listid = rex->nfa_alt_listid;
     }
 
     /* Call nfa_regmatch() to check if the current concat matches at this
      * position. The concat ends with the node NFA_END_INVISIBLE */
-    nfa_endp = endposp;
-    result = nfa_regmatch(prog, state->out, submatch, m);
+    rex->nfa_endp = endposp;
+    result = nfa_regmatch(rex, prog, state->out, submatch, m);
 
     if (need_restore)
 	nfa_restore_listids(prog, *listids);
     else
     {
-	--nfa_ll_index;
-	nfa_alt_listid = nfa_listid;
+	--rex->nfa_ll_index;
+	rex->nfa_alt_listid = rex->nfa_listid;
     }
 
     /* restore position in input text */
-    reglnum = save_reglnum;
+    rex->lnum = save_reglnum;
     if (REG_MULTI)
-	regline = reg_getline(reglnum);
-    reginput = regline + save_reginput_col;
-    nfa_match = save_nfa_match;
-    nfa_endp = save_nfa_endp;
-    nfa_listid = save_nfa_listid;
+	rex->line = reg_getline(rex, rex->lnum);
+    rex->input = rex->line + save_reginput_col;
+    rex->nfa_match = save_nfa_match;
+    rex->nfa_endp = save_nfa_endp;
+    rex->nfa_listid = save_nfa_listid;
 
 #ifdef ENABLE_LOG
     log_fd = fopen(NFA_REGEXP_RUN_LOG, "a");
@@ -5151,8 +5124,8 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
     return result;
 }
 
-static int skip_to_start __ARGS((int c, colnr_T *colp));
-static long find_match_text __ARGS((colnr_T startcol, int regstart, char_u *match_text));
+static int skip_to_start __ARGS((regexec_T *rex, int c, colnr_T *colp));
+static long find_match_text __ARGS((regexec_T *rex, colnr_T startcol, int regstart, char_u *match_text));
 
 /*
  * Estimate the chance of a match with "state" failing.
@@ -5323,24 +5296,25 @@ failure_chance(state, depth)
  * Skip until the char "c" we know a match must start with.
  */
     static int
-skip_to_start(c, colp)
+skip_to_start(rex, c, colp)
+    regexec_T	*rex;
     int		c;
     colnr_T	*colp;
 {
     char_u *s;
 
     /* Used often, do some work to avoid call overhead. */
-    if (!ireg_ic
+    if (!rex->reg_ic
 #ifdef FEAT_MBYTE
 		&& !has_mbyte
 #endif
 		)
-	s = vim_strbyte(regline + *colp, c);
+	s = vim_strbyte(rex->line + *colp, c);
     else
-	s = cstrchr(regline + *colp, c);
+	s = cstrchr(rex, rex->line + *colp, c);
     if (s == NULL)
 	return FAIL;
-    *colp = (int)(s - regline);
+    *colp = (int)(s - rex->line);
     return OK;
 }
 
@@ -5350,7 +5324,8 @@ skip_to_start(c, colp)
  * Returns zero for no match, 1 for a match.
  */
     static long
-find_match_text(startcol, regstart, match_text)
+find_match_text(rex, startcol, regstart, match_text)
+    regexec_T	*rex;
     colnr_T startcol;
     int	    regstart;
     char_u  *match_text;
@@ -5367,8 +5342,8 @@ find_match_text(startcol, regstart, match_text)
 	for (len1 = 0; match_text[len1] != NUL; len1 += MB_CHAR2LEN(c1))
 	{
 	    c1 = PTR2CHAR(match_text + len1);
-	    c2 = PTR2CHAR(regline + col + len2);
-	    if (c1 != c2 && (!ireg_ic || MB_TOLOWER(c1) != MB_TOLOWER(c2)))
+	    c2 = PTR2CHAR(rex->line + col + len2);
+	    if (c1 != c2 && (!rex->reg_ic || MB_TOLOWER(c1) != MB_TOLOWER(c2)))
 	    {
 		match = FALSE;
 		break;
@@ -5379,29 +5354,29 @@ find_match_text(startcol, regstart, match_text)
 #ifdef FEAT_MBYTE
 		/* check that no composing char follows */
 		&& !(enc_utf8
-			   && utf_iscomposing(PTR2CHAR(regline + col + len2)))
+			  && utf_iscomposing(PTR2CHAR(rex->line + col + len2)))
 #endif
 		)
 	{
-	    cleanup_subexpr();
+	    cleanup_subexpr(rex);
 	    if (REG_MULTI)
 	    {
-		reg_startpos[0].lnum = reglnum;
-		reg_startpos[0].col = col;
-		reg_endpos[0].lnum = reglnum;
-		reg_endpos[0].col = col + len2;
+		rex->reg_startpos[0].lnum = rex->lnum;
+		rex->reg_startpos[0].col = col;
+		rex->reg_endpos[0].lnum = rex->lnum;
+		rex->reg_endpos[0].col = col + len2;
 	    }
 	    else
 	    {
-		reg_startp[0] = regline + col;
-		reg_endp[0] = regline + col + len2;
+		rex->reg_startp[0] = rex->line + col;
+		rex->reg_endp[0] = rex->line + col + len2;
 	    }
 	    return 1L;
 	}
 
 	/* Try finding regstart after the current match. */
 	col += MB_CHAR2LEN(regstart); /* skip regstart */
-	if (skip_to_start(regstart, &col) == FAIL)
+	if (skip_to_start(rex, regstart, &col) == FAIL)
 	    break;
     }
     return 0L;
@@ -5410,16 +5385,17 @@ find_match_text(startcol, regstart, match_text)
 /*
  * Main matching routine.
  *
- * Run NFA to determine whether it matches reginput.
+ * Run NFA to determine whether it matches rex->input.
  *
- * When "nfa_endp" is not NULL it is a required end-of-match position.
+ * When "rex->nfa_endp" is not NULL it is a required end-of-match position.
  *
  * Return TRUE if there is a match, FALSE otherwise.
  * When there is a match "submatch" contains the positions.
  * Note: Caller must ensure that: start != NULL.
  */
     static int
-nfa_regmatch(prog, start, submatch, m)
+nfa_regmatch(rex, prog, start, submatch, m)
+    regexec_T		*rex;
     nfa_regprog_T	*prog;
     nfa_state_T		*start;
     regsubs_T		*submatch;
@@ -5451,22 +5427,24 @@ nfa_regmatch(prog, start, submatch, m)
 #endif
     /* Some patterns may take a long time to match, especially when using
      * recursive_regmatch(). Allow interrupting them with CTRL-C. */
-    fast_breakcheck();
+    if (!rex->reg_thread)
+	fast_breakcheck();
     if (got_int)
 	return FALSE;
 #ifdef FEAT_RELTIME
-    if (nfa_time_limit != NULL && profile_passed_limit(nfa_time_limit))
+    if (rex->nfa_time_limit != NULL
+				  && profile_passed_limit(rex->nfa_time_limit))
 	return FALSE;
 #endif
 
-    nfa_match = FALSE;
+    rex->nfa_match = FALSE;
 
     /* Allocate memory for the lists of nodes. */
     size = (nstate + 1) * sizeof(nfa_thread_T);
 
-    list[0].t = (nfa_thread_T *)lalloc(size, TRUE);
+    list[0].t = (nfa_thread_T *)rex_alloc(rex, size);
     list[0].len = nstate + 1;
-    list[1].t = (nfa_thread_T *)lalloc(size, TRUE);
+    list[1].t = (nfa_thread_T *)rex_alloc(rex, size);
     list[1].len = nstate + 1;
     if (list[0].t == NULL || list[1].t == NULL)
 	goto theend;
@@ -5497,7 +5475,7 @@ nfa_regmatch(prog, start, submatch, m)
 #ifdef ENABLE_LOG
     fprintf(log_fd, "(---) STARTSTATE first\n");
 #endif
-    thislist->id = nfa_listid + 1;
+    thislist->id = rex->nfa_listid + 1;
 
     /* Inline optimized code for addstate(thislist, start, m, 0) if we know
      * it's the first MOPEN. */
@@ -5505,16 +5483,17 @@ nfa_regmatch(prog, start, submatch, m)
     {
 	if (REG_MULTI)
 	{
-	    m->norm.list.multi[0].start_lnum = reglnum;
-	    m->norm.list.multi[0].start_col = (colnr_T)(reginput - regline);
+	    m->norm.list.multi[0].start_lnum = rex->lnum;
+	    m->norm.list.multi[0].start_col =
+					   (colnr_T)(rex->input - rex->line);
 	}
 	else
-	    m->norm.list.line[0].start = reginput;
+	    m->norm.list.line[0].start = rex->input;
 	m->norm.in_use = 1;
-	addstate(thislist, start->out, m, NULL, 0);
+	addstate(rex, thislist, start->out, m, NULL, 0);
     }
     else
-	addstate(thislist, start, m, NULL, 0);
+	addstate(rex, thislist, start, m, NULL, 0);
 
 #define	ADD_STATE_IF_MATCH(state)			\
     if (result) {					\
@@ -5533,13 +5512,13 @@ nfa_regmatch(prog, start, submatch, m)
 #ifdef FEAT_MBYTE
 	if (has_mbyte)
 	{
-	    curc = (*mb_ptr2char)(reginput);
-	    clen = (*mb_ptr2len)(reginput);
+	    curc = (*mb_ptr2char)(rex->input);
+	    clen = (*mb_ptr2len)(rex->input);
 	}
 	else
 #endif
 	{
-	    curc = *reginput;
+	    curc = *rex->input;
 	    clen = 1;
 	}
 	if (curc == NUL)
@@ -5553,20 +5532,21 @@ nfa_regmatch(prog, start, submatch, m)
 	nextlist = &list[flag ^= 1];
 	nextlist->n = 0;	    /* clear nextlist */
 	nextlist->has_pim = FALSE;
-	++nfa_listid;
-	if (prog->re_engine == AUTOMATIC_ENGINE && nfa_listid >= NFA_MAX_STATES)
+	++rex->nfa_listid;
+	if (prog->re_engine == AUTOMATIC_ENGINE
+					  && rex->nfa_listid >= NFA_MAX_STATES)
 	{
 	    /* too many states, retry with old engine */
-	    nfa_match = NFA_TOO_EXPENSIVE;
+	    rex->nfa_match = NFA_TOO_EXPENSIVE;
 	    goto theend;
 	}
 
-	thislist->id = nfa_listid;
-	nextlist->id = nfa_listid + 1;
+	thislist->id = rex->nfa_listid;
+	nextlist->id = rex->nfa_listid + 1;
 
 #ifdef ENABLE_LOG
 	fprintf(log_fd, "------------------------------------------\n");
-	fprintf(log_fd, ">>> Reginput is \"%s\"\n", reginput);
+	fprintf(log_fd, ">>> Reginput is \"%s\"\n", rex->input);
 	fprintf(log_fd, ">>> Advanced one character ... Current char is %c (code %d) \n", curc, (int)curc);
 	fprintf(log_fd, ">>> Thislist has %d states available: ", thislist->n);
 	{
@@ -5605,11 +5585,11 @@ nfa_regmatch(prog, start, submatch, m)
 		else if (REG_MULTI)
 		    col = t->subs.norm.list.multi[0].start_col;
 		else
-		    col = (int)(t->subs.norm.list.line[0].start - regline);
+		    col = (int)(t->subs.norm.list.line[0].start - rex->line);
 		nfa_set_code(t->state->c);
 		fprintf(log_fd, "(%d) char %d %s (start col %d)%s ... \n",
 			abs(t->state->id), (int)t->state->c, code, col,
-			pim_info(&t->pim));
+			pim_info(rex, &t->pim));
 	    }
 #endif
 
@@ -5626,22 +5606,22 @@ nfa_regmatch(prog, start, submatch, m)
 	      {
 #ifdef FEAT_MBYTE
 		/* If the match ends before a composing characters and
-		 * ireg_icombine is not set, that is not really a match. */
-		if (enc_utf8 && !ireg_icombine && utf_iscomposing(curc))
+		 * rex->reg_icombine is not set, that is not really a match. */
+		if (enc_utf8 && !rex->reg_icombine && utf_iscomposing(curc))
 		    break;
 #endif
-		nfa_match = TRUE;
-		copy_sub(&submatch->norm, &t->subs.norm);
+		rex->nfa_match = TRUE;
+		copy_sub(rex, &submatch->norm, &t->subs.norm);
 #ifdef FEAT_SYN_HL
-		if (nfa_has_zsubexpr)
-		    copy_sub(&submatch->synt, &t->subs.synt);
+		if (rex->nfa_has_zsubexpr)
+		    copy_sub(rex, &submatch->synt, &t->subs.synt);
 #endif
 #ifdef ENABLE_LOG
-		log_subsexpr(&t->subs);
+		log_subsexpr(rex, &t->subs);
 #endif
 		/* Found the left-most longest match, do not look at any other
 		 * states at this position.  When the list of states is going
-		 * to be empty quit without advancing, so that "reginput" is
+		 * to be empty quit without advancing, so that "rex->input" is
 		 * correct. */
 		if (nextlist->n == 0)
 		    clen = 0;
@@ -5659,47 +5639,47 @@ nfa_regmatch(prog, start, submatch, m)
 		 * If we got here, it means that the current "invisible" group
 		 * finished successfully, so return control to the parent
 		 * nfa_regmatch().  For a look-behind match only when it ends
-		 * in the position in "nfa_endp".
+		 * in the position in "rex->nfa_endp".
 		 * Submatches are stored in *m, and used in the parent call.
 		 */
 #ifdef ENABLE_LOG
-		if (nfa_endp != NULL)
+		if (rex->nfa_endp != NULL)
 		{
 		    if (REG_MULTI)
 			fprintf(log_fd, "Current lnum: %d, endp lnum: %d; current col: %d, endp col: %d\n",
-				(int)reglnum,
-				(int)nfa_endp->se_u.pos.lnum,
-				(int)(reginput - regline),
-				nfa_endp->se_u.pos.col);
+				(int)rex->lnum,
+				(int)rex->nfa_endp->se_u.pos.lnum,
+				(int)(rex->input - rex->line),
+				rex->nfa_endp->se_u.pos.col);
 		    else
 			fprintf(log_fd, "Current col: %d, endp col: %d\n",
-				(int)(reginput - regline),
-				(int)(nfa_endp->se_u.ptr - reginput));
+				(int)(rex->input - rex->line),
+				(int)(rex->nfa_endp->se_u.ptr - rex->input));
 		}
 #endif
-		/* If "nfa_endp" is set it's only a match if it ends at
-		 * "nfa_endp" */
-		if (nfa_endp != NULL && (REG_MULTI
-			? (reglnum != nfa_endp->se_u.pos.lnum
-			    || (int)(reginput - regline)
-						!= nfa_endp->se_u.pos.col)
-			: reginput != nfa_endp->se_u.ptr))
+		/* If "rex->nfa_endp" is set it's only a match if it ends at
+		 * "rex->nfa_endp" */
+		if (rex->nfa_endp != NULL && (REG_MULTI
+			? (rex->lnum != rex->nfa_endp->se_u.pos.lnum
+			    || (int)(rex->input - rex->line)
+						!= rex->nfa_endp->se_u.pos.col)
+			: rex->input != rex->nfa_endp->se_u.ptr))
 		    break;
 
 		/* do not set submatches for \@! */
 		if (t->state->c != NFA_END_INVISIBLE_NEG)
 		{
-		    copy_sub(&m->norm, &t->subs.norm);
+		    copy_sub(rex, &m->norm, &t->subs.norm);
 #ifdef FEAT_SYN_HL
-		    if (nfa_has_zsubexpr)
-			copy_sub(&m->synt, &t->subs.synt);
+		    if (rex->nfa_has_zsubexpr)
+			copy_sub(rex, &m->synt, &t->subs.synt);
 #endif
 		}
 #ifdef ENABLE_LOG
 		fprintf(log_fd, "Match found:\n");
-		log_subsexpr(m);
+		log_subsexpr(rex, m);
 #endif
-		nfa_match = TRUE;
+		rex->nfa_match = TRUE;
 		/* See comment above at "goto nextchar". */
 		if (nextlist->n == 0)
 		    clen = 0;
@@ -5731,21 +5711,21 @@ nfa_regmatch(prog, start, submatch, m)
 
 			/* Copy submatch info for the recursive call, opposite
 			 * of what happens on success below. */
-			copy_sub_off(&m->norm, &t->subs.norm);
+			copy_sub_off(rex, &m->norm, &t->subs.norm);
 #ifdef FEAT_SYN_HL
-			if (nfa_has_zsubexpr)
-			    copy_sub_off(&m->synt, &t->subs.synt);
+			if (rex->nfa_has_zsubexpr)
+			    copy_sub_off(rex, &m->synt, &t->subs.synt);
 #endif
 
 			/*
 			 * First try matching the invisible match, then what
 			 * follows.
 			 */
-			result = recursive_regmatch(t->state, NULL, prog,
+			result = recursive_regmatch(rex, t->state, NULL, prog,
 						       submatch, m, &listids);
 			if (result == NFA_TOO_EXPENSIVE)
 			{
-			    nfa_match = result;
+			    rex->nfa_match = result;
 			    goto theend;
 			}
 
@@ -5759,14 +5739,14 @@ nfa_regmatch(prog, start, submatch, m)
 				     == NFA_START_INVISIBLE_BEFORE_NEG_FIRST))
 			{
 			    /* Copy submatch info from the recursive call */
-			    copy_sub_off(&t->subs.norm, &m->norm);
+			    copy_sub_off(rex, &t->subs.norm, &m->norm);
 #ifdef FEAT_SYN_HL
-			    if (nfa_has_zsubexpr)
-				copy_sub_off(&t->subs.synt, &m->synt);
+			    if (rex->nfa_has_zsubexpr)
+				copy_sub_off(rex, &t->subs.synt, &m->synt);
 #endif
 			    /* If the pattern has \ze and it matched in the
 			     * sub pattern, use it. */
-			    copy_ze_off(&t->subs.norm, &m->norm);
+			    copy_ze_off(rex, &t->subs.norm, &m->norm);
 
 			    /* t->state->out1 is the corresponding
 			     * END_INVISIBLE node; Add its out to the current
@@ -5794,17 +5774,17 @@ nfa_regmatch(prog, start, submatch, m)
 #endif
 			if (REG_MULTI)
 			{
-			    pim.end.pos.col = (int)(reginput - regline);
-			    pim.end.pos.lnum = reglnum;
+			    pim.end.pos.col = (int)(rex->input - rex->line);
+			    pim.end.pos.lnum = rex->lnum;
 			}
 			else
-			    pim.end.ptr = reginput;
+			    pim.end.ptr = rex->input;
 
 			/* t->state->out1 is the corresponding END_INVISIBLE
 			 * node; Add its out to the current list (zero-width
 			 * match). */
-			addstate_here(thislist, t->state->out1->out, &t->subs,
-							       &pim, &listidx);
+			addstate_here(rex, thislist, t->state->out1->out,
+						     &t->subs, &pim, &listidx);
 		    }
 		}
 		break;
@@ -5818,14 +5798,15 @@ nfa_regmatch(prog, start, submatch, m)
 
 		/* There is no point in trying to match the pattern if the
 		 * output state is not going to be added to the list. */
-		if (state_in_list(nextlist, t->state->out1->out, &t->subs))
+		if (state_in_list(rex, nextlist, t->state->out1->out,
+								   &t->subs))
 		{
 		    skip = t->state->out1->out;
 #ifdef ENABLE_LOG
 		    skip_lid = nextlist->id;
 #endif
 		}
-		else if (state_in_list(nextlist,
+		else if (state_in_list(rex, nextlist,
 					  t->state->out1->out->out, &t->subs))
 		{
 		    skip = t->state->out1->out->out;
@@ -5833,7 +5814,7 @@ nfa_regmatch(prog, start, submatch, m)
 		    skip_lid = nextlist->id;
 #endif
 		}
-		else if (state_in_list(thislist,
+		else if (state_in_list(rex, thislist,
 					  t->state->out1->out->out, &t->subs))
 		{
 		    skip = t->state->out1->out->out;
@@ -5852,18 +5833,18 @@ nfa_regmatch(prog, start, submatch, m)
 		}
 		/* Copy submatch info to the recursive call, opposite of what
 		 * happens afterwards. */
-		copy_sub_off(&m->norm, &t->subs.norm);
+		copy_sub_off(rex, &m->norm, &t->subs.norm);
 #ifdef FEAT_SYN_HL
-		if (nfa_has_zsubexpr)
-		    copy_sub_off(&m->synt, &t->subs.synt);
+		if (rex->nfa_has_zsubexpr)
+		    copy_sub_off(rex, &m->synt, &t->subs.synt);
 #endif
 
 		/* First try matching the pattern. */
-		result = recursive_regmatch(t->state, NULL, prog,
+		result = recursive_regmatch(rex, t->state, NULL, prog,
 						       submatch, m, &listids);
 		if (result == NFA_TOO_EXPENSIVE)
 		{
-		    nfa_match = result;
+		    rex->nfa_match = result;
 		    goto theend;
 		}
 		if (result)
@@ -5872,22 +5853,22 @@ nfa_regmatch(prog, start, submatch, m)
 
 #ifdef ENABLE_LOG
 		    fprintf(log_fd, "NFA_START_PATTERN matches:\n");
-		    log_subsexpr(m);
+		    log_subsexpr(rex, m);
 #endif
 		    /* Copy submatch info from the recursive call */
-		    copy_sub_off(&t->subs.norm, &m->norm);
+		    copy_sub_off(rex, &t->subs.norm, &m->norm);
 #ifdef FEAT_SYN_HL
-		    if (nfa_has_zsubexpr)
-			copy_sub_off(&t->subs.synt, &m->synt);
+		    if (rex->nfa_has_zsubexpr)
+			copy_sub_off(rex, &t->subs.synt, &m->synt);
 #endif
 		    /* Now we need to skip over the matched text and then
 		     * continue with what follows. */
 		    if (REG_MULTI)
 			/* TODO: multi-line match */
 			bytelen = m->norm.list.multi[0].end_col
-						  - (int)(reginput - regline);
+					       - (int)(rex->input - rex->line);
 		    else
-			bytelen = (int)(m->norm.list.line[0].end - reginput);
+			bytelen = (int)(m->norm.list.line[0].end - rex->input);
 
 #ifdef ENABLE_LOG
 		    fprintf(log_fd, "NFA_START_PATTERN length: %d\n", bytelen);
@@ -5920,7 +5901,7 @@ nfa_regmatch(prog, start, submatch, m)
 	      }
 
 	    case NFA_BOL:
-		if (reginput == regline)
+		if (rex->input == rex->line)
 		{
 		    add_here = TRUE;
 		    add_state = t->state->out;
@@ -5946,16 +5927,16 @@ nfa_regmatch(prog, start, submatch, m)
 		    int this_class;
 
 		    /* Get class of current and previous char (if it exists). */
-		    this_class = mb_get_class_buf(reginput, reg_buf);
+		    this_class = mb_get_class_buf(rex->input, rex->reg_buf);
 		    if (this_class <= 1)
 			result = FALSE;
-		    else if (reg_prev_class() == this_class)
+		    else if (reg_prev_class(rex) == this_class)
 			result = FALSE;
 		}
 #endif
-		else if (!vim_iswordc_buf(curc, reg_buf)
-			   || (reginput > regline
-				   && vim_iswordc_buf(reginput[-1], reg_buf)))
+		else if (!vim_iswordc_buf(curc, rex->reg_buf)
+			|| (rex->input > rex->line
+			    && vim_iswordc_buf(rex->input[-1], rex->reg_buf)))
 		    result = FALSE;
 		if (result)
 		{
@@ -5966,7 +5947,7 @@ nfa_regmatch(prog, start, submatch, m)
 
 	    case NFA_EOW:
 		result = TRUE;
-		if (reginput == regline)
+		if (rex->input == rex->line)
 		    result = FALSE;
 #ifdef FEAT_MBYTE
 		else if (has_mbyte)
@@ -5974,16 +5955,16 @@ nfa_regmatch(prog, start, submatch, m)
 		    int this_class, prev_class;
 
 		    /* Get class of current and previous char (if it exists). */
-		    this_class = mb_get_class_buf(reginput, reg_buf);
-		    prev_class = reg_prev_class();
+		    this_class = mb_get_class_buf(rex->input, rex->reg_buf);
+		    prev_class = reg_prev_class(rex);
 		    if (this_class == prev_class
 					|| prev_class == 0 || prev_class == 1)
 			result = FALSE;
 		}
 #endif
-		else if (!vim_iswordc_buf(reginput[-1], reg_buf)
-			|| (reginput[0] != NUL
-					   && vim_iswordc_buf(curc, reg_buf)))
+		else if (!vim_iswordc_buf(rex->input[-1], rex->reg_buf)
+			|| (rex->input[0] != NUL
+				       && vim_iswordc_buf(curc, rex->reg_buf)))
 		    result = FALSE;
 		if (result)
 		{
@@ -5993,8 +5974,8 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_BOF:
-		if (reglnum == 0 && reginput == regline
-					&& (!REG_MULTI || reg_firstlnum == 1))
+		if (rex->lnum == 0 && rex->input == rex->line
+				    && (!REG_MULTI || rex->reg_firstlnum == 1))
 		{
 		    add_here = TRUE;
 		    add_state = t->state->out;
@@ -6002,7 +5983,7 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_EOF:
-		if (reglnum == reg_maxline && curc == NUL)
+		if (rex->lnum == rex->reg_maxline && curc == NUL)
 		{
 		    add_here = TRUE;
 		    add_state = t->state->out;
@@ -6029,7 +6010,7 @@ nfa_regmatch(prog, start, submatch, m)
 		     * (no preceding character). */
 		    len += mb_char2len(mc);
 		}
-		if (ireg_icombine && len == 0)
+		if (rex->reg_icombine && len == 0)
 		{
 		    /* If \Z was present, then ignore composing characters.
 		     * When ignoring the base character this always matches. */
@@ -6054,7 +6035,7 @@ nfa_regmatch(prog, start, submatch, m)
 		     * Get them into cchars[] first. */
 		    while (len < clen)
 		    {
-			mc = mb_ptr2char(reginput + len);
+			mc = mb_ptr2char(rex->input + len);
 			cchars[ccount++] = mc;
 			len += mb_char2len(mc);
 			if (ccount == MAX_MCO)
@@ -6088,8 +6069,8 @@ nfa_regmatch(prog, start, submatch, m)
 #endif
 
 	    case NFA_NEWL:
-		if (curc == NUL && !reg_line_lbr && REG_MULTI
-						    && reglnum <= reg_maxline)
+		if (curc == NUL && !rex->reg_line_lbr && REG_MULTI
+					      && rex->lnum <= rex->reg_maxline)
 		{
 		    go_to_nextline = TRUE;
 		    /* Pass -1 for the offset, which means taking the position
@@ -6097,7 +6078,7 @@ nfa_regmatch(prog, start, submatch, m)
 		    add_state = t->state->out;
 		    add_off = -1;
 		}
-		else if (curc == '\n' && reg_line_lbr)
+		else if (curc == '\n' && rex->reg_line_lbr)
 		{
 		    /* match \n as if it is an ordinary character */
 		    add_state = t->state->out;
@@ -6142,7 +6123,7 @@ nfa_regmatch(prog, start, submatch, m)
 			    result = result_if_matched;
 			    break;
 			}
-			if (ireg_ic)
+			if (rex->reg_ic)
 			{
 			    int curc_low = MB_TOLOWER(curc);
 			    int done = FALSE;
@@ -6160,7 +6141,7 @@ nfa_regmatch(prog, start, submatch, m)
 		    }
 		    else if (state->c < 0 ? check_char_class(state->c, curc)
 			        : (curc == state->c
-				   || (ireg_ic && MB_TOLOWER(curc)
+				   || (rex->reg_ic && MB_TOLOWER(curc)
 						    == MB_TOLOWER(state->c))))
 		    {
 			result = result_if_matched;
@@ -6218,13 +6199,13 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_KWORD:	/*  \k	*/
-		result = vim_iswordp_buf(reginput, reg_buf);
+		result = vim_iswordp_buf(rex->input, rex->reg_buf);
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
 	    case NFA_SKWORD:	/*  \K	*/
 		result = !VIM_ISDIGIT(curc)
-					&& vim_iswordp_buf(reginput, reg_buf);
+				  && vim_iswordp_buf(rex->input, rex->reg_buf);
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
@@ -6239,12 +6220,13 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_PRINT:	/*  \p	*/
-		result = vim_isprintc(PTR2CHAR(reginput));
+		result = vim_isprintc(PTR2CHAR(rex->input));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
 	    case NFA_SPRINT:	/*  \P	*/
-		result = !VIM_ISDIGIT(curc) && vim_isprintc(PTR2CHAR(reginput));
+		result = !VIM_ISDIGIT(curc)
+				       && vim_isprintc(PTR2CHAR(rex->input));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
@@ -6339,24 +6321,24 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_LOWER_IC:	/* [a-z] */
-		result = ri_lower(curc) || (ireg_ic && ri_upper(curc));
+		result = ri_lower(curc) || (rex->reg_ic && ri_upper(curc));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
 	    case NFA_NLOWER_IC:	/* [^a-z] */
 		result = curc != NUL
-			  && !(ri_lower(curc) || (ireg_ic && ri_upper(curc)));
+		       && !(ri_lower(curc) || (rex->reg_ic && ri_upper(curc)));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
 	    case NFA_UPPER_IC:	/* [A-Z] */
-		result = ri_upper(curc) || (ireg_ic && ri_lower(curc));
+		result = ri_upper(curc) || (rex->reg_ic && ri_lower(curc));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
 	    case NFA_NUPPER_IC:	/* ^[A-Z] */
 		result = curc != NUL
-			  && !(ri_upper(curc) || (ireg_ic && ri_lower(curc)));
+		       && !(ri_upper(curc) || (rex->reg_ic && ri_lower(curc)));
 		ADD_STATE_IF_MATCH(t->state);
 		break;
 
@@ -6388,13 +6370,14 @@ nfa_regmatch(prog, start, submatch, m)
 		if (t->state->c <= NFA_BACKREF9)
 		{
 		    subidx = t->state->c - NFA_BACKREF1 + 1;
-		    result = match_backref(&t->subs.norm, subidx, &bytelen);
+		    result = match_backref(rex, &t->subs.norm, subidx,
+								    &bytelen);
 		}
 #ifdef FEAT_SYN_HL
 		else
 		{
 		    subidx = t->state->c - NFA_ZREF1 + 1;
-		    result = match_zref(subidx, &bytelen);
+		    result = match_zref(rex, subidx, &bytelen);
 		}
 #endif
 
@@ -6447,7 +6430,7 @@ nfa_regmatch(prog, start, submatch, m)
 	    case NFA_LNUM_LT:
 		result = (REG_MULTI &&
 			nfa_re_num_cmp(t->state->val, t->state->c - NFA_LNUM,
-			    (long_u)(reglnum + reg_firstlnum)));
+			    (long_u)(rex->lnum + rex->reg_firstlnum)));
 		if (result)
 		{
 		    add_here = TRUE;
@@ -6459,7 +6442,7 @@ nfa_regmatch(prog, start, submatch, m)
 	    case NFA_COL_GT:
 	    case NFA_COL_LT:
 		result = nfa_re_num_cmp(t->state->val, t->state->c - NFA_COL,
-			(long_u)(reginput - regline) + 1);
+			(long_u)(rex->input - rex->line) + 1);
 		if (result)
 		{
 		    add_here = TRUE;
@@ -6472,8 +6455,8 @@ nfa_regmatch(prog, start, submatch, m)
 	    case NFA_VCOL_LT:
 		{
 		    int     op = t->state->c - NFA_VCOL;
-		    colnr_T col = (colnr_T)(reginput - regline);
-		    win_T   *wp = reg_win == NULL ? curwin : reg_win;
+		    colnr_T col = (colnr_T)(rex->input - rex->line);
+		    win_T   *wp = rex->reg_win == NULL ? curwin : rex->reg_win;
 
 		    /* Bail out quickly when there can't be a match, avoid the
 		     * overhead of win_linetabsize() on long lines. */
@@ -6496,7 +6479,7 @@ nfa_regmatch(prog, start, submatch, m)
 		    }
 		    if (!result)
 			result = nfa_re_num_cmp(t->state->val, op,
-				(long_u)win_linetabsize(wp, regline, col) + 1);
+			      (long_u)win_linetabsize(wp, rex->line, col) + 1);
 		    if (result)
 		    {
 			add_here = TRUE;
@@ -6509,18 +6492,20 @@ nfa_regmatch(prog, start, submatch, m)
 	    case NFA_MARK_GT:
 	    case NFA_MARK_LT:
 	      {
-		pos_T	*pos = getmark_buf(reg_buf, t->state->val, FALSE);
+		pos_T	*pos = getmark_buf(rex->reg_buf, t->state->val,
+									FALSE);
 
 		/* Compare the mark position to the match position. */
 		result = (pos != NULL		     /* mark doesn't exist */
-			&& pos->lnum > 0    /* mark isn't set in reg_buf */
-			&& (pos->lnum == reglnum + reg_firstlnum
-				? (pos->col == (colnr_T)(reginput - regline)
+		       && pos->lnum > 0    /* mark isn't set in rex->reg_buf */
+			&& (pos->lnum == rex->lnum + rex->reg_firstlnum
+			       ? (pos->col == (colnr_T)(rex->input - rex->line)
 				    ? t->state->c == NFA_MARK
-				    : (pos->col < (colnr_T)(reginput - regline)
+				    : (pos->col
+					    < (colnr_T)(rex->input - rex->line)
 					? t->state->c == NFA_MARK_GT
 					: t->state->c == NFA_MARK_LT))
-				: (pos->lnum < reglnum + reg_firstlnum
+				: (pos->lnum < rex->lnum + rex->reg_firstlnum
 				    ? t->state->c == NFA_MARK_GT
 				    : t->state->c == NFA_MARK_LT)));
 		if (result)
@@ -6532,10 +6517,11 @@ nfa_regmatch(prog, start, submatch, m)
 	      }
 
 	    case NFA_CURSOR:
-		result = (reg_win != NULL
-			&& (reglnum + reg_firstlnum == reg_win->w_cursor.lnum)
-			&& ((colnr_T)(reginput - regline)
-						   == reg_win->w_cursor.col));
+		result = (rex->reg_win != NULL
+			&& (rex->lnum + rex->reg_firstlnum
+					       == rex->reg_win->w_cursor.lnum)
+			&& ((colnr_T)(rex->input - rex->line)
+					       == rex->reg_win->w_cursor.col));
 		if (result)
 		{
 		    add_here = TRUE;
@@ -6544,7 +6530,7 @@ nfa_regmatch(prog, start, submatch, m)
 		break;
 
 	    case NFA_VISUAL:
-		result = reg_match_visual();
+		result = reg_match_visual(rex);
 		if (result)
 		{
 		    add_here = TRUE;
@@ -6589,12 +6575,12 @@ nfa_regmatch(prog, start, submatch, m)
 #endif
 		result = (c == curc);
 
-		if (!result && ireg_ic)
+		if (!result && rex->reg_ic)
 		    result = MB_TOLOWER(c) == MB_TOLOWER(curc);
 #ifdef FEAT_MBYTE
-		/* If ireg_icombine is not set only skip over the character
+		/* If rex->reg_icombine is not set only skip over the character
 		 * itself.  When it is set skip over composing characters. */
-		if (result && enc_utf8 && !ireg_icombine)
+		if (result && enc_utf8 && !rex->reg_icombine)
 		    clen = utf_char2len(curc);
 #endif
 		ADD_STATE_IF_MATCH(t->state);
@@ -6625,7 +6611,7 @@ nfa_regmatch(prog, start, submatch, m)
 			fprintf(log_fd, "Postponed recursive nfa_regmatch()\n");
 			fprintf(log_fd, "\n");
 #endif
-			result = recursive_regmatch(pim->state, pim,
+			result = recursive_regmatch(rex, pim->state, pim,
 						 prog, submatch, m, &listids);
 			pim->result = result ? NFA_PIM_MATCH : NFA_PIM_NOMATCH;
 			/* for \@! and \@<! it is a match when the result is
@@ -6638,10 +6624,10 @@ nfa_regmatch(prog, start, submatch, m)
 				     == NFA_START_INVISIBLE_BEFORE_NEG_FIRST))
 			{
 			    /* Copy submatch info from the recursive call */
-			    copy_sub_off(&pim->subs.norm, &m->norm);
+			    copy_sub_off(rex, &pim->subs.norm, &m->norm);
 #ifdef FEAT_SYN_HL
-			    if (nfa_has_zsubexpr)
-				copy_sub_off(&pim->subs.synt, &m->synt);
+			    if (rex->nfa_has_zsubexpr)
+				copy_sub_off(rex, &pim->subs.synt, &m->synt);
 #endif
 			}
 		    }
@@ -6665,10 +6651,10 @@ nfa_regmatch(prog, start, submatch, m)
 				     == NFA_START_INVISIBLE_BEFORE_NEG_FIRST))
 		    {
 			/* Copy submatch info from the recursive call */
-			copy_sub_off(&t->subs.norm, &pim->subs.norm);
+			copy_sub_off(rex, &t->subs.norm, &pim->subs.norm);
 #ifdef FEAT_SYN_HL
-			if (nfa_has_zsubexpr)
-			    copy_sub_off(&t->subs.synt, &pim->subs.synt);
+			if (rex->nfa_has_zsubexpr)
+			    copy_sub_off(rex, &t->subs.synt, &pim->subs.synt);
 #endif
 		    }
 		    else
@@ -6685,15 +6671,16 @@ nfa_regmatch(prog, start, submatch, m)
 		 * local copy to avoid that. */
 		if (pim == &t->pim)
 		{
-		    copy_pim(&pim_copy, pim);
+		    copy_pim(rex, &pim_copy, pim);
 		    pim = &pim_copy;
 		}
 
 		if (add_here)
-		    addstate_here(thislist, add_state, &t->subs, pim, &listidx);
+		    addstate_here(rex, thislist, add_state, &t->subs, pim,
+								    &listidx);
 		else
 		{
-		    addstate(nextlist, add_state, &t->subs, pim, add_off);
+		    addstate(rex, nextlist, add_state, &t->subs, pim, add_off);
 		    if (add_count > 0)
 			nextlist->t[nextlist->n - 1].count = add_count;
 		}
@@ -6707,21 +6694,22 @@ nfa_regmatch(prog, start, submatch, m)
 	 * matters!
 	 * Do not add the start state in recursive calls of nfa_regmatch(),
 	 * because recursive calls should only start in the first position.
-	 * Unless "nfa_endp" is not NULL, then we match the end position.
+	 * Unless "rex->nfa_endp" is not NULL, then we match the end position.
 	 * Also don't start a match past the first line. */
-	if (nfa_match == FALSE
+	if (rex->nfa_match == FALSE
 		&& ((toplevel
-			&& reglnum == 0
+			&& rex->lnum == 0
 			&& clen != 0
-			&& (ireg_maxcol == 0
-			    || (colnr_T)(reginput - regline) < ireg_maxcol))
-		    || (nfa_endp != NULL
+			&& (rex->reg_maxcol == 0
+			    || (colnr_T)(rex->input - rex->line)
+							    < rex->reg_maxcol))
+		    || (rex->nfa_endp != NULL
 			&& (REG_MULTI
-			    ? (reglnum < nfa_endp->se_u.pos.lnum
-			       || (reglnum == nfa_endp->se_u.pos.lnum
-			           && (int)(reginput - regline)
-						    < nfa_endp->se_u.pos.col))
-			    : reginput < nfa_endp->se_u.ptr))))
+			    ? (rex->lnum < rex->nfa_endp->se_u.pos.lnum
+			       || (rex->lnum == rex->nfa_endp->se_u.pos.lnum
+			           && (int)(rex->input - rex->line)
+						< rex->nfa_endp->se_u.pos.col))
+			    : rex->input < rex->nfa_endp->se_u.ptr))))
 	{
 #ifdef ENABLE_LOG
 	    fprintf(log_fd, "(---) STARTSTATE\n");
@@ -6737,25 +6725,25 @@ nfa_regmatch(prog, start, submatch, m)
 		{
 		    if (nextlist->n == 0)
 		    {
-			colnr_T col = (colnr_T)(reginput - regline) + clen;
+			colnr_T col = (colnr_T)(rex->input - rex->line) + clen;
 
 			/* Nextlist is empty, we can skip ahead to the
 			 * character that must appear at the start. */
-			if (skip_to_start(prog->regstart, &col) == FAIL)
+			if (skip_to_start(rex, prog->regstart, &col) == FAIL)
 			    break;
 #ifdef ENABLE_LOG
 			fprintf(log_fd, "  Skipping ahead %d bytes to regstart\n",
-				col - ((colnr_T)(reginput - regline) + clen));
+			     col - ((colnr_T)(rex->input - rex->line) + clen));
 #endif
-			reginput = regline + col - clen;
+			rex->input = rex->line + col - clen;
 		    }
 		    else
 		    {
 			/* Checking if the required start character matches is
 			 * cheaper than adding a state that won't match. */
-			c = PTR2CHAR(reginput + clen);
-			if (c != prog->regstart && (!ireg_ic || MB_TOLOWER(c)
-					       != MB_TOLOWER(prog->regstart)))
+			c = PTR2CHAR(rex->input + clen);
+			if (c != prog->regstart && (!rex->reg_ic
+				|| MB_TOLOWER(c) != MB_TOLOWER(prog->regstart)))
 			{
 #ifdef ENABLE_LOG
 			    fprintf(log_fd, "  Skipping start state, regstart does not match\n");
@@ -6769,14 +6757,14 @@ nfa_regmatch(prog, start, submatch, m)
 		{
 		    if (REG_MULTI)
 			m->norm.list.multi[0].start_col =
-					 (colnr_T)(reginput - regline) + clen;
+				      (colnr_T)(rex->input - rex->line) + clen;
 		    else
-			m->norm.list.line[0].start = reginput + clen;
-		    addstate(nextlist, start->out, m, NULL, clen);
+			m->norm.list.line[0].start = rex->input + clen;
+		    addstate(rex, nextlist, start->out, m, NULL, clen);
 		}
 	    }
 	    else
-		addstate(nextlist, start, m, NULL, clen);
+		addstate(rex, nextlist, start, m, NULL, clen);
 	}
 
 #ifdef ENABLE_LOG
@@ -6794,23 +6782,24 @@ nextchar:
 	/* Advance to the next character, or advance to the next line, or
 	 * finish. */
 	if (clen != 0)
-	    reginput += clen;
-	else if (go_to_nextline || (nfa_endp != NULL && REG_MULTI
-					&& reglnum < nfa_endp->se_u.pos.lnum))
-	    reg_nextline();
+	    rex->input += clen;
+	else if (go_to_nextline || (rex->nfa_endp != NULL && REG_MULTI
+				  && rex->lnum < rex->nfa_endp->se_u.pos.lnum))
+	    reg_nextline(rex);
 	else
 	    break;
 
 	/* Allow interrupting with CTRL-C. */
-	line_breakcheck();
+	if (!rex->reg_thread)
+	    line_breakcheck();
 	if (got_int)
 	    break;
 #ifdef FEAT_RELTIME
 	/* Check for timeout once in a twenty times to avoid overhead. */
-	if (nfa_time_limit != NULL && ++nfa_time_count == 20)
+	if (rex->nfa_time_limit != NULL && ++rex->nfa_time_count == 20)
 	{
-	    nfa_time_count = 0;
-	    if (profile_passed_limit(nfa_time_limit))
+	    rex->nfa_time_count = 0;
+	    if (profile_passed_limit(rex->nfa_time_limit))
 		break;
 	}
 #endif
@@ -6832,15 +6821,558 @@ theend:
     fclose(debug);
 #endif
 
-    return nfa_match;
+    return rex->nfa_match;
+}
+
+/*
+ * Lazily built DFA.
+ *
+ * When a pattern only consists of characters, character classes,
+ * collections, "^", "$", "\<" and "\>" (no back references, look-around,
+ * "\z(" or line breaks) the NFA can be simulated with a DFA: a DFA state is
+ * the set of NFA states that are active at a position in the line.  DFA
+ * states and transitions are only created when they are needed while
+ * matching, the same lines are matched with the same pattern over and over
+ * again (syntax highlighting, searching).
+ *
+ * The DFA only tells whether there is a match in the line at all.  Most
+ * lines don't match, those are skipped quickly.  When there is a match the
+ * NFA is used to find its position and the submatches.
+ */
+
+#define NFA_DFA_OK	1	/* the DFA can be used for this pattern */
+#define NFA_DFA_WORD	2	/* uses 'iskeyword': "\<", "\>", "\k" */
+
+#define DFA_MAX_STATES	100	/* clear the DFA when it gets bigger */
+#define DFA_MAX_CLEAR	10	/* stop using the DFA when cleared this often */
+
+/* Values in ds_trans[] other than a state index plus one. */
+#define DS_UNKNOWN	0	/* transition not computed yet */
+#define DS_MATCH	(-1)	/* a match ends before this character */
+#define DS_NOMATCH	(-2)	/* no match in the line, only for NUL */
+
+/* Values for ds_flags. */
+#define DS_BOL		1	/* at the start of the line */
+#define DS_PREVWORD	2	/* previous character is a word character */
+
+/* Return values of nfa_dfa_match(). */
+#define DFA_NOMATCH	0
+#define DFA_MATCH	1
+#define DFA_UNKNOWN	2
+
+/* NFA states that don't need to be in a DFA state, only what they lead to. */
+#define DFA_EPSILON(c) ((c) == NFA_SPLIT || (c) == NFA_EMPTY \
+	|| (c) == NFA_NOPEN || (c) == NFA_NCLOSE \
+	|| (c) == NFA_ZSTART || (c) == NFA_ZEND \
+	|| ((c) >= NFA_MOPEN && (c) <= NFA_MCLOSE9))
+
+typedef struct
+{
+    short	ds_trans[256];	/* next state for characters below 256 */
+    int		ds_flags;	/* DS_ flags */
+    int		ds_count;	/* number of NFA states in ds_list[] */
+    int		ds_list[1];	/* sorted NFA state indexes, actually longer */
+} nfa_dstate_T;
+
+typedef struct nfa_dfa_S
+{
+    nfa_dstate_T *d_states[DFA_MAX_STATES];
+    int		d_count;	/* number of used entries in d_states[] */
+    int		d_init[4];	/* start state for each ds_flags value */
+    int		d_clear_count;	/* number of times the DFA was cleared */
+    char_u	d_chartab[32];	/* 'iskeyword' used for the states */
+    int		d_markid;	/* id used in d_mark[] for the current list */
+    int		*d_mark;	/* per NFA state: d_markid when in the list */
+    int		*d_list;	/* NFA states active at the current position */
+    nfa_state_T	**d_stack;	/* stack for nfa_dfa_closure() */
+} nfa_dfa_T;
+
+static int nfa_dfa_check __ARGS((nfa_regprog_T *prog));
+static nfa_dfa_T *nfa_dfa_alloc __ARGS((regexec_T *rex, nfa_regprog_T *prog));
+static void nfa_dfa_clear __ARGS((nfa_dfa_T *dfa));
+static void nfa_dfa_free __ARGS((nfa_dfa_T *dfa));
+static int nfa_dfa_closure __ARGS((nfa_regprog_T *prog, nfa_dfa_T *dfa, nfa_state_T *state, int *list, int count));
+static int nfa_dfa_state __ARGS((regexec_T *rex, nfa_regprog_T *prog, nfa_dfa_T *dfa, int flags));
+static int nfa_dfa_char_match __ARGS((regexec_T *rex, nfa_state_T *state, int c, char_u *p));
+static int nfa_dfa_step __ARGS((regexec_T *rex, nfa_regprog_T *prog, nfa_dfa_T *dfa, nfa_dstate_T *ds, int c, char_u *p, int addstart));
+static int nfa_dfa_match __ARGS((regexec_T *rex, nfa_regprog_T *prog, colnr_T col));
+
+/*
+ * Check if the DFA can be used for "prog".
+ * Returns NFA_DFA_ flags, zero when it can't be used.
+ */
+    static int
+nfa_dfa_check(prog)
+    nfa_regprog_T   *prog;
+{
+    int		i;
+    int		c;
+    int		flags = NFA_DFA_OK;
+
+    for (i = 0; i < prog->nstate; ++i)
+    {
+	c = prog->state[i].c;
+	if (c >= 0 || DFA_EPSILON(c))
+	    continue;
+	switch (c)
+	{
+	    case NFA_BOW:
+	    case NFA_EOW:
+	    case NFA_KWORD:
+	    case NFA_SKWORD:
+		flags |= NFA_DFA_WORD;
+		break;
+
+	    case NFA_MATCH:
+	    case NFA_BOL:
+	    case NFA_EOL:
+	    case NFA_START_COLL:
+	    case NFA_START_NEG_COLL:
+	    case NFA_END_COLL:
+	    case NFA_RANGE_MIN:
+	    case NFA_RANGE_MAX:
+	    case NFA_ANY:
+		break;
+
+	    default:
+		/* Character classes that only depend on the character.  "\i",
+		 * "\f", "\p" and [:print:] depend on options, the NFA handles
+		 * them. */
+		if ((c >= NFA_WHITE && c <= NFA_NUPPER_IC)
+			|| (c >= NFA_CLASS_ALNUM && c <= NFA_CLASS_ESCAPE
+						    && c != NFA_CLASS_PRINT))
+		    break;
+		return 0;
+	}
+    }
+    return flags;
+}
+
+/*
+ * Allocate an empty DFA for "prog".
+ */
+    static nfa_dfa_T *
+nfa_dfa_alloc(rex, prog)
+    regexec_T	    *rex;
+    nfa_regprog_T   *prog;
+{
+    nfa_dfa_T	*dfa;
+
+    dfa = (nfa_dfa_T *)rex_alloc(rex, (long_u)sizeof(nfa_dfa_T));
+    if (dfa == NULL)
+	return NULL;
+    vim_memset(dfa, 0, sizeof(nfa_dfa_T));
+    dfa->d_mark = (int *)rex_alloc(rex, (long_u)(prog->nstate * sizeof(int)));
+    if (dfa->d_mark != NULL)
+	vim_memset(dfa->d_mark, 0, prog->nstate * sizeof(int));
+    dfa->d_list = (int *)rex_alloc(rex, (long_u)(prog->nstate * sizeof(int)));
+    dfa->d_stack = (nfa_state_T **)rex_alloc(rex,
+		    (long_u)((prog->nstate * 2 + 1) * sizeof(nfa_state_T *)));
+    if (dfa->d_mark == NULL || dfa->d_list == NULL || dfa->d_stack == NULL)
+    {
+	nfa_dfa_free(dfa);
+	return NULL;
+    }
+    return dfa;
+}
+
+/*
+ * Remove all states from "dfa".
+ */
+    static void
+nfa_dfa_clear(dfa)
+    nfa_dfa_T	*dfa;
+{
+    int		i;
+
+    for (i = 0; i < dfa->d_count; ++i)
+	vim_free(dfa->d_states[i]);
+    dfa->d_count = 0;
+    for (i = 0; i < 4; ++i)
+	dfa->d_init[i] = DS_UNKNOWN;
+}
+
+    static void
+nfa_dfa_free(dfa)
+    nfa_dfa_T	*dfa;
+{
+    if (dfa != NULL)
+    {
+	nfa_dfa_clear(dfa);
+	vim_free(dfa->d_mark);
+	vim_free(dfa->d_list);
+	vim_free(dfa->d_stack);
+	vim_free(dfa);
+    }
+}
+
+/*
+ * Mark "state" and the states that can be reached from it without consuming
+ * a character with "d_markid".  When "list" is not NULL the states that
+ * do something are appended to it, it has "count" entries.
+ * Returns the new number of entries in "list".
+ */
+    static int
+nfa_dfa_closure(prog, dfa, state, list, count)
+    nfa_regprog_T   *prog;
+    nfa_dfa_T	    *dfa;
+    nfa_state_T	    *state;
+    int		    *list;
+    int		    count;
+{
+    int		sp = 0;
+    int		idx;
+
+    dfa->d_stack[sp++] = state;
+    while (sp > 0)
+    {
+	state = dfa->d_stack[--sp];
+	idx = (int)(state - prog->state);
+	if (dfa->d_mark[idx] == dfa->d_markid)
+	    continue;
+	dfa->d_mark[idx] = dfa->d_markid;
+	if (state->c == NFA_SPLIT)
+	{
+	    dfa->d_stack[sp++] = state->out1;
+	    dfa->d_stack[sp++] = state->out;
+	}
+	else if (DFA_EPSILON(state->c))
+	    dfa->d_stack[sp++] = state->out;
+	else if (list != NULL)
+	    list[count++] = idx;
+    }
+    return count;
 }
 
 /*
- * Try match of "prog" with at regline["col"].
+ * Find the DFA state for the NFA states marked with "d_markid" and "flags".
+ * Adds a new state when there is none yet.
+ * Returns the state index plus one, DS_UNKNOWN when there are too many
+ * states or out of memory.
+ */
+    static int
+nfa_dfa_state(rex, prog, dfa, flags)
+    regexec_T	    *rex;
+    nfa_regprog_T   *prog;
+    nfa_dfa_T	    *dfa;
+    int		    flags;
+{
+    int		    count = 0;
+    int		    i;
+    nfa_dstate_T    *ds;
+
+    /* Make a sorted list of the states, so that equal sets compare equal. */
+    for (i = 0; i < prog->nstate; ++i)
+	if (dfa->d_mark[i] == dfa->d_markid && !DFA_EPSILON(prog->state[i].c))
+	    dfa->d_list[count++] = i;
+
+    for (i = 0; i < dfa->d_count; ++i)
+    {
+	ds = dfa->d_states[i];
+	if (ds->ds_flags == flags && ds->ds_count == count
+		&& memcmp(ds->ds_list, dfa->d_list, count * sizeof(int)) == 0)
+	    return i + 1;
+    }
+
+    if (dfa->d_count == DFA_MAX_STATES)
+	return DS_UNKNOWN;
+    ds = (nfa_dstate_T *)rex_alloc(rex,
+			  (long_u)(sizeof(nfa_dstate_T) + count * sizeof(int)));
+    if (ds == NULL)
+	return DS_UNKNOWN;
+    vim_memset(ds, 0, sizeof(nfa_dstate_T));
+    ds->ds_flags = flags;
+    ds->ds_count = count;
+    mch_memmove(ds->ds_list, dfa->d_list, count * sizeof(int));
+    dfa->d_states[dfa->d_count++] = ds;
+    return dfa->d_count;
+}
+
+/*
+ * Return TRUE if NFA state "state" matches character "c" at "p".
+ * Must do the same as nfa_regmatch().
+ */
+    static int
+nfa_dfa_char_match(rex, state, c, p)
+    regexec_T	*rex;
+    nfa_state_T	*state;
+    int		c;
+    char_u	*p;
+{
+    nfa_state_T	*s;
+    int		c1, c2;
+
+    switch (state->c)
+    {
+	case NFA_START_COLL:
+	case NFA_START_NEG_COLL:
+	    if (c == NUL)
+		return FALSE;
+	    for (s = state->out; s->c != NFA_END_COLL; s = s->out)
+	    {
+		if (s->c == NFA_RANGE_MIN)
+		{
+		    c1 = s->val;
+		    s = s->out;
+		    c2 = s->val;
+		    if (c >= c1 && c <= c2)
+			break;
+		    if (rex->reg_ic)
+		    {
+			int c_low = MB_TOLOWER(c);
+
+			for ( ; c1 <= c2; ++c1)
+			    if (MB_TOLOWER(c1) == c_low)
+				break;
+			if (c1 <= c2)
+			    break;
+		    }
+		}
+		else if (s->c < 0 ? check_char_class(s->c, c)
+			     : (c == s->c
+				|| (rex->reg_ic
+				      && MB_TOLOWER(c) == MB_TOLOWER(s->c))))
+		    break;
+	    }
+	    return (s->c == NFA_END_COLL) == (state->c == NFA_START_NEG_COLL);
+
+	case NFA_ANY:	 return c > 0;
+	case NFA_KWORD:	 return vim_iswordp_buf(p, rex->reg_buf);
+	case NFA_SKWORD: return !VIM_ISDIGIT(c)
+					   && vim_iswordp_buf(p, rex->reg_buf);
+	case NFA_WHITE:	 return vim_iswhite(c);
+	case NFA_NWHITE: return c != NUL && !vim_iswhite(c);
+	case NFA_DIGIT:	 return ri_digit(c);
+	case NFA_NDIGIT: return c != NUL && !ri_digit(c);
+	case NFA_HEX:	 return ri_hex(c);
+	case NFA_NHEX:	 return c != NUL && !ri_hex(c);
+	case NFA_OCTAL:	 return ri_octal(c);
+	case NFA_NOCTAL: return c != NUL && !ri_octal(c);
+	case NFA_WORD:	 return ri_word(c);
+	case NFA_NWORD:	 return c != NUL && !ri_word(c);
+	case NFA_HEAD:	 return ri_head(c);
+	case NFA_NHEAD:	 return c != NUL && !ri_head(c);
+	case NFA_ALPHA:	 return ri_alpha(c);
+	case NFA_NALPHA: return c != NUL && !ri_alpha(c);
+	case NFA_LOWER:	 return ri_lower(c);
+	case NFA_NLOWER: return c != NUL && !ri_lower(c);
+	case NFA_UPPER:	 return ri_upper(c);
+	case NFA_NUPPER: return c != NUL && !ri_upper(c);
+	case NFA_LOWER_IC:
+	    return ri_lower(c) || (rex->reg_ic && ri_upper(c));
+	case NFA_NLOWER_IC:
+	    return c != NUL && !(ri_lower(c) || (rex->reg_ic && ri_upper(c)));
+	case NFA_UPPER_IC:
+	    return ri_upper(c) || (rex->reg_ic && ri_lower(c));
+	case NFA_NUPPER_IC:
+	    return c != NUL && !(ri_upper(c) || (rex->reg_ic && ri_lower(c)));
+
+	default:
+	    if (state->c < 0)
+		return FALSE;	/* "^", "$", etc. */
+	    return state->c == c
+		     || (rex->reg_ic && MB_TOLOWER(state->c) == MB_TOLOWER(c));
+    }
+}
+
+/*
+ * Compute the DFA state that follows "ds" for character "c" at "p".
+ * When "addstart" is TRUE a match may start after "c".
+ * Returns a state index plus one, DS_MATCH, DS_NOMATCH or DS_UNKNOWN.
+ */
+    static int
+nfa_dfa_step(rex, prog, dfa, ds, c, p, addstart)
+    regexec_T	    *rex;
+    nfa_regprog_T   *prog;
+    nfa_dfa_T	    *dfa;
+    nfa_dstate_T    *ds;
+    int		    c;
+    char_u	    *p;
+    int		    addstart;
+{
+    nfa_state_T	*state;
+    int		count;
+    int		i;
+    int		ok;
+    int		flags = 0;
+
+    /* Add the states after a "^", "$", "\<" or "\>" that matches here. */
+    ++dfa->d_markid;
+    count = 0;
+    for (i = 0; i < ds->ds_count; ++i)
+    {
+	dfa->d_mark[ds->ds_list[i]] = dfa->d_markid;
+	dfa->d_list[count++] = ds->ds_list[i];
+    }
+    for (i = 0; i < count; ++i)
+    {
+	state = &prog->state[dfa->d_list[i]];
+	switch (state->c)
+	{
+	    case NFA_MATCH:
+		return DS_MATCH;
+	    case NFA_BOL:
+		ok = (ds->ds_flags & DS_BOL);
+		break;
+	    case NFA_EOL:
+		ok = (c == NUL);
+		break;
+	    case NFA_BOW:
+		ok = c != NUL && !(ds->ds_flags & DS_PREVWORD)
+					   && vim_iswordc_buf(c, rex->reg_buf);
+		break;
+	    case NFA_EOW:
+		ok = (ds->ds_flags & DS_PREVWORD)
+			    && (c == NUL || !vim_iswordc_buf(c, rex->reg_buf));
+		break;
+	    default:
+		ok = FALSE;
+		break;
+	}
+	if (ok)
+	    count = nfa_dfa_closure(prog, dfa, state->out, dfa->d_list, count);
+    }
+    if (c == NUL)
+	return DS_NOMATCH;
+
+    /* Advance the states that match "c".  Only mark the states,
+     * nfa_dfa_state() collects them. */
+    ++dfa->d_markid;
+    for (i = 0; i < count; ++i)
+    {
+	state = &prog->state[dfa->d_list[i]];
+	if (nfa_dfa_char_match(rex, state, c, p))
+	    nfa_dfa_closure(prog, dfa, state->c == NFA_START_COLL
+				  || state->c == NFA_START_NEG_COLL
+				     ? state->out1->out : state->out, NULL, 0);
+    }
+    if (addstart)
+	nfa_dfa_closure(prog, dfa, prog->start, NULL, 0);
+
+    if ((prog->dfa_flags & NFA_DFA_WORD) && vim_iswordc_buf(c, rex->reg_buf))
+	flags = DS_PREVWORD;
+    return nfa_dfa_state(rex, prog, dfa, flags);
+}
+
+/*
+ * Use the DFA to find out whether "prog" matches in "rex->line" at or after
+ * "col".
+ * Returns DFA_MATCH, DFA_NOMATCH or DFA_UNKNOWN when the NFA has to find
+ * out.
+ */
+    static int
+nfa_dfa_match(rex, prog, col)
+    regexec_T	    *rex;
+    nfa_regprog_T   *prog;
+    colnr_T	    col;
+{
+    nfa_dfa_T	    *dfa;
+    nfa_dstate_T    *ds;
+    char_u	    *p = rex->line + col;
+    int		    c;
+    int		    len;
+    int		    flags;
+    int		    addstart;
+    int		    idx;
+
+#ifdef FEAT_MBYTE
+    if (has_mbyte && !enc_utf8)
+	return DFA_UNKNOWN;
+#endif
+    dfa = prog->dfa[rex->reg_ic ? 1 : 0];
+    if (dfa == NULL)
+    {
+	dfa = nfa_dfa_alloc(rex, prog);
+	if (dfa == NULL)
+	    return DFA_UNKNOWN;
+	prog->dfa[rex->reg_ic ? 1 : 0] = dfa;
+    }
+
+    flags = col == 0 ? DS_BOL : 0;
+    if (prog->dfa_flags & NFA_DFA_WORD)
+    {
+	/* The states depend on 'iskeyword' of the buffer. */
+	if (memcmp(dfa->d_chartab, rex->reg_buf->b_chartab, 32) != 0)
+	{
+	    nfa_dfa_clear(dfa);
+	    mch_memmove(dfa->d_chartab, rex->reg_buf->b_chartab, 32);
+	}
+	if (col > 0)
+	{
+#ifdef FEAT_MBYTE
+	    /* For multi-byte characters the word class matters. */
+	    if (enc_utf8 && p[-1] >= 0x80)
+		return DFA_UNKNOWN;
+#endif
+	    if (vim_iswordc_buf(p[-1], rex->reg_buf))
+		flags |= DS_PREVWORD;
+	}
+    }
+
+    idx = dfa->d_init[flags];
+    if (idx == DS_UNKNOWN)
+    {
+	++dfa->d_markid;
+	nfa_dfa_closure(prog, dfa, prog->start, NULL, 0);
+	idx = nfa_dfa_state(rex, prog, dfa, flags);
+	dfa->d_init[flags] = idx;
+    }
+
+    while (idx > 0)
+    {
+	ds = dfa->d_states[idx - 1];
+	c = *p;
+	len = 1;
+#ifdef FEAT_MBYTE
+	if (enc_utf8 && c >= 0x80)
+	{
+	    /* Composing characters are handled in a special way and "\<"
+	     * and "\>" use the word class, let the NFA do that. */
+	    c = utf_ptr2char(p);
+	    len = utf_ptr2len(p);
+	    if (utf_iscomposing(c) || utfc_ptr2len(p) != len
+					  || (prog->dfa_flags & NFA_DFA_WORD))
+		return DFA_UNKNOWN;
+	}
+#endif
+	/* A match can't start at or after 'synmaxcol'. */
+	addstart = rex->reg_maxcol == 0
+				 || (colnr_T)(p - rex->line) < rex->reg_maxcol;
+
+	if (c < 256 && addstart)
+	{
+	    idx = ds->ds_trans[c];
+	    if (idx == DS_UNKNOWN)
+	    {
+		idx = nfa_dfa_step(rex, prog, dfa, ds, c, p, TRUE);
+		ds->ds_trans[c] = idx;
+	    }
+	}
+	else
+	    idx = nfa_dfa_step(rex, prog, dfa, ds, c, p, addstart);
+	p += len;
+    }
+
+    if (idx == DS_MATCH)
+	return DFA_MATCH;
+    if (idx == DS_NOMATCH)
+	return DFA_NOMATCH;
+
+    /* Too many states.  Start all over next time, unless this happens too
+     * often, then the pattern is too complicated for the DFA. */
+    nfa_dfa_clear(dfa);
+    if (++dfa->d_clear_count >= DFA_MAX_CLEAR)
+	prog->dfa_flags = 0;
+    return DFA_UNKNOWN;
+}
+
+/*
+ * Try match of "prog" with at rex->line["col"].
  * Returns <= 0 for failure, number of lines contained in the match otherwise.
  */
     static long
-nfa_regtry(prog, col, tm)
+nfa_regtry(rex, prog, col, tm)
+    regexec_T	    *rex;
     nfa_regprog_T   *prog;
     colnr_T	    col;
     proftime_T	    *tm UNUSED;	/* timeout limit or NULL */
@@ -6853,10 +7385,10 @@ nfa_regtry(prog, col, tm)
     FILE	*f;
 #endif
 
-    reginput = regline + col;
+    rex->input = rex->line + col;
 #ifdef FEAT_RELTIME
-    nfa_time_limit = tm;
-    nfa_time_count = 0;
+    rex->nfa_time_limit = tm;
+    rex->nfa_time_count = 0;
 #endif
 
 #ifdef ENABLE_LOG
@@ -6867,7 +7399,7 @@ nfa_regtry(prog, col, tm)
 #ifdef DEBUG
 	fprintf(f, "\tRegexp is \"%s\"\n", nfa_regengine.expr);
 #endif
-	fprintf(f, "\tInput text is \"%s\" \n", reginput);
+	fprintf(f, "\tInput text is \"%s\" \n", rex->input);
 	fprintf(f, "\t=======================================================\n\n");
 	nfa_print_state(f, start);
 	fprintf(f, "\n\n");
@@ -6877,68 +7409,73 @@ nfa_regtry(prog, col, tm)
 	EMSG(_("Could not open temporary log file for writing "));
 #endif
 
-    clear_sub(&subs.norm);
-    clear_sub(&m.norm);
+    clear_sub(rex, &subs.norm);
+    clear_sub(rex, &m.norm);
 #ifdef FEAT_SYN_HL
-    clear_sub(&subs.synt);
-    clear_sub(&m.synt);
+    clear_sub(rex, &subs.synt);
+    clear_sub(rex, &m.synt);
 #endif
 
-    result = nfa_regmatch(prog, start, &subs, &m);
+    result = nfa_regmatch(rex, prog, start, &subs, &m);
     if (result == FALSE)
 	return 0;
     else if (result == NFA_TOO_EXPENSIVE)
 	return result;
 
-    cleanup_subexpr();
+    cleanup_subexpr(rex);
     if (REG_MULTI)
     {
 	for (i = 0; i < subs.norm.in_use; i++)
 	{
-	    reg_startpos[i].lnum = subs.norm.list.multi[i].start_lnum;
-	    reg_startpos[i].col = subs.norm.list.multi[i].start_col;
+	    rex->reg_startpos[i].lnum = subs.norm.list.multi[i].start_lnum;
+	    rex->reg_startpos[i].col = subs.norm.list.multi[i].start_col;
 
-	    reg_endpos[i].lnum = subs.norm.list.multi[i].end_lnum;
-	    reg_endpos[i].col = subs.norm.list.multi[i].end_col;
+	    rex->reg_endpos[i].lnum = subs.norm.list.multi[i].end_lnum;
+	    rex->reg_endpos[i].col = subs.norm.list.multi[i].end_col;
 	}
 
-	if (reg_startpos[0].lnum < 0)
+	if (rex->reg_startpos[0].lnum < 0)
 	{
-	    reg_startpos[0].lnum = 0;
-	    reg_startpos[0].col = col;
+	    rex->reg_startpos[0].lnum = 0;
+	    rex->reg_startpos[0].col = col;
 	}
-	if (reg_endpos[0].lnum < 0)
+	if (rex->reg_endpos[0].lnum < 0)
 	{
 	    /* pattern has a \ze but it didn't match, use current end */
-	    reg_endpos[0].lnum = reglnum;
-	    reg_endpos[0].col = (int)(reginput - regline);
+	    rex->reg_endpos[0].lnum = rex->lnum;
+	    rex->reg_endpos[0].col = (int)(rex->input - rex->line);
 	}
 	else
 	    /* Use line number of "\ze". */
-	    reglnum = reg_endpos[0].lnum;
+	    rex->lnum = rex->reg_endpos[0].lnum;
     }
     else
     {
 	for (i = 0; i < subs.norm.in_use; i++)
 	{
-	    reg_startp[i] = subs.norm.list.line[i].start;
-	    reg_endp[i] = subs.norm.list.line[i].end;
+	    rex->reg_startp[i] = subs.norm.list.line[i].start;
+	    rex->reg_endp[i] = subs.norm.list.line[i].end;
 	}
 
-	if (reg_startp[0] == NULL)
-	    reg_startp[0] = regline + col;
-	if (reg_endp[0] == NULL)
-	    reg_endp[0] = reginput;
+	if (rex->reg_startp[0] == NULL)
+	    rex->reg_startp[0] = rex->line + col;
+	if (rex->reg_endp[0] == NULL)
+	    rex->reg_endp[0] = rex->input;
     }
 
 #ifdef FEAT_SYN_HL
-    /* Package any found \z(...\) matches for export. Default is none. */
-    unref_extmatch(re_extmatch_out);
-    re_extmatch_out = NULL;
+    /* Package any found \z(...\) matches for export. Default is none.
+     * A pattern executed in a thread can't have them, leave the global
+     * alone. */
+    if (!rex->reg_thread)
+    {
+	unref_extmatch(re_extmatch_out);
+	re_extmatch_out = NULL;
+    }
 
     if (prog->reghasz == REX_SET)
     {
-	cleanup_zsubexpr();
+	cleanup_zsubexpr(rex);
 	re_extmatch_out = make_extmatch();
 	for (i = 0; i < subs.synt.in_use; i++)
 	{
@@ -6951,7 +7488,7 @@ nfa_regtry(prog, col, tm)
 			&& mpos->start_lnum == mpos->end_lnum
 			&& mpos->end_col >= mpos->start_col)
 		    re_extmatch_out->matches[i] =
-			vim_strnsave(reg_getline(mpos->start_lnum)
+			vim_strnsave(reg_getline(rex, mpos->start_lnum)
 							    + mpos->start_col,
 					     mpos->end_col - mpos->start_col);
 	    }
@@ -6968,7 +7505,7 @@ nfa_regtry(prog, col, tm)
     }
 #endif
 
-    return 1 + reglnum;
+    return 1 + rex->lnum;
 }
 
 /*
@@ -6978,7 +7515,8 @@ nfa_regtry(prog, col, tm)
  * Returns <= 0 for failure, number of lines contained in the match otherwise.
  */
     static long
-nfa_regexec_both(line, startcol, tm)
+nfa_regexec_both(rex, line, startcol, tm)
+    regexec_T	*rex;
     char_u	*line;
     colnr_T	startcol;	/* column to start looking for match */
     proftime_T	*tm;		/* timeout limit or NULL */
@@ -6990,96 +7528,106 @@ nfa_regexec_both(line, startcol, tm)
 
     if (REG_MULTI)
     {
-	prog = (nfa_regprog_T *)reg_mmatch->regprog;
-	line = reg_getline((linenr_T)0);    /* relative to the cursor */
-	reg_startpos = reg_mmatch->startpos;
-	reg_endpos = reg_mmatch->endpos;
+	prog = (nfa_regprog_T *)rex->reg_mmatch->regprog;
+	line = reg_getline(rex, (linenr_T)0);    /* relative to the cursor */
+	rex->reg_startpos = rex->reg_mmatch->startpos;
+	rex->reg_endpos = rex->reg_mmatch->endpos;
     }
     else
     {
-	prog = (nfa_regprog_T *)reg_match->regprog;
-	reg_startp = reg_match->startp;
-	reg_endp = reg_match->endp;
+	prog = (nfa_regprog_T *)rex->reg_match->regprog;
+	rex->reg_startp = rex->reg_match->startp;
+	rex->reg_endp = rex->reg_match->endp;
     }
 
     /* Be paranoid... */
     if (prog == NULL || line == NULL)
     {
-	EMSG(_(e_null));
+	REX_EMSG(_(e_null));
 	goto theend;
     }
 
-    /* If pattern contains "\c" or "\C": overrule value of ireg_ic */
+    /* If pattern contains "\c" or "\C": overrule value of rex->reg_ic */
     if (prog->regflags & RF_ICASE)
-	ireg_ic = TRUE;
+	rex->reg_ic = TRUE;
     else if (prog->regflags & RF_NOICASE)
-	ireg_ic = FALSE;
+	rex->reg_ic = FALSE;
 
 #ifdef FEAT_MBYTE
-    /* If pattern contains "\Z" overrule value of ireg_icombine */
+    /* If pattern contains "\Z" overrule value of rex->reg_icombine */
     if (prog->regflags & RF_ICOMBINE)
-	ireg_icombine = TRUE;
+	rex->reg_icombine = TRUE;
 #endif
 
-    regline = line;
-    reglnum = 0;    /* relative to line */
+    rex->line = line;
+    rex->lnum = 0;    /* relative to line */
 
-    nfa_has_zend = prog->has_zend;
-    nfa_has_backref = prog->has_backref;
-    nfa_nsubexpr = prog->nsubexp;
-    nfa_listid = 1;
-    nfa_alt_listid = 2;
+    rex->nfa_has_zend = prog->has_zend;
+    rex->nfa_has_backref = prog->has_backref;
+    rex->nfa_nsubexpr = prog->nsubexp;
+    rex->nfa_listid = 1;
+    rex->nfa_alt_listid = 2;
+#ifdef DEBUG
     nfa_regengine.expr = prog->pattern;
+#endif
 
     if (prog->reganch && col > 0)
 	return 0L;
 
-    need_clear_subexpr = TRUE;
+    rex->need_clear_subexpr = TRUE;
 #ifdef FEAT_SYN_HL
     /* Clear the external match subpointers if necessary. */
     if (prog->reghasz == REX_SET)
     {
-	nfa_has_zsubexpr = TRUE;
-	need_clear_zsubexpr = TRUE;
+	rex->nfa_has_zsubexpr = TRUE;
+	rex->need_clear_zsubexpr = TRUE;
     }
     else
-	nfa_has_zsubexpr = FALSE;
+	rex->nfa_has_zsubexpr = FALSE;
 #endif
 
     if (prog->regstart != NUL)
     {
 	/* Skip ahead until a character we know the match must start with.
 	 * When there is none there is no match. */
-	if (skip_to_start(prog->regstart, &col) == FAIL)
+	if (skip_to_start(rex, prog->regstart, &col) == FAIL)
 	    return 0L;
 
 	/* If match_text is set it contains the full text that must match.
 	 * Nothing else to try. Doesn't handle combining chars well. */
 	if (prog->match_text != NULL
 #ifdef FEAT_MBYTE
-		    && !ireg_icombine
+		    && !rex->reg_icombine
 #endif
 		)
-	    return find_match_text(col, prog->regstart, prog->match_text);
+	    return find_match_text(rex, col, prog->regstart, prog->match_text);
     }
 
     /* If the start column is past the maximum column: no need to try. */
-    if (ireg_maxcol > 0 && col >= ireg_maxcol)
+    if (rex->reg_maxcol > 0 && col >= rex->reg_maxcol)
+	goto theend;
+
+    /* Use the DFA to quickly skip a line without a match. */
+    if (prog->dfa_flags != 0 && nfa_dfa_match(rex, prog, col) == DFA_NOMATCH)
 	goto theend;
 
-    nstate = prog->nstate;
-    for (i = 0; i < nstate; ++i)
+    for (i = 0; i < prog->nstate; ++i)
     {
 	prog->state[i].id = i;
 	prog->state[i].lastlist[0] = 0;
 	prog->state[i].lastlist[1] = 0;
     }
 
-    retval = nfa_regtry(prog, col, tm);
+    retval = nfa_regtry(rex, prog, col, tm);
 
+#ifdef DEBUG
     nfa_regengine.expr = NULL;
+#endif
 
 theend:
+    /* match_with_backref() may have made a copy of the line. */
+    vim_free(rex->reg_tofree);
+    rex->reg_tofree = NULL;
     return retval;
 }
 
@@ -7165,6 +7713,10 @@ nfa_regcomp(expr, re_flags)
 
     nfa_postprocess(prog);
 
+    prog->dfa_flags = nfa_dfa_check(prog);
+    prog->dfa[0] = NULL;
+    prog->dfa[1] = NULL;
+
     prog->reganch = nfa_get_reganch(prog->start, 0);
     prog->regstart = nfa_get_regstart(prog->start, 0);
     prog->match_text = nfa_get_match_text(prog->start);
@@ -7205,6 +7757,8 @@ nfa_regfree(prog)
 {
     if (prog != NULL)
     {
+	nfa_dfa_free(((nfa_regprog_T *)prog)->dfa[0]);
+	nfa_dfa_free(((nfa_regprog_T *)prog)->dfa[1]);
 	vim_free(((nfa_regprog_T *)prog)->match_text);
 	vim_free(((nfa_regprog_T *)prog)->pattern);
 	vim_free(prog);
@@ -7220,24 +7774,25 @@ nfa_regfree(prog)
  * Returns <= 0 for failure, number of lines contained in the match otherwise.
  */
     static int
-nfa_regexec_nl(rmp, line, col, line_lbr)
+nfa_regexec_nl(rex, rmp, line, col, line_lbr)
+    regexec_T	*rex;
     regmatch_T	*rmp;
     char_u	*line;	/* string to match against */
     colnr_T	col;	/* column to start looking for match */
     int		line_lbr;
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    reg_line_lbr = line_lbr;
-    reg_buf = curbuf;
-    reg_win = NULL;
-    ireg_ic = rmp->rm_ic;
+    rex->reg_match = rmp;
+    rex->reg_mmatch = NULL;
+    rex->reg_maxline = 0;
+    rex->reg_line_lbr = line_lbr;
+    rex->reg_buf = curbuf;
+    rex->reg_win = NULL;
+    rex->reg_ic = rmp->rm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex->reg_icombine = FALSE;
 #endif
-    ireg_maxcol = 0;
-    return nfa_regexec_both(line, col, NULL);
+    rex->reg_maxcol = 0;
+    return nfa_regexec_both(rex, line, col, NULL);
 }
 
 
@@ -7267,7 +7822,8 @@ nfa_regexec_nl(rmp, line, col, line_lbr)
  * FIXME if this behavior is not compatible.
  */
     static long
-nfa_regexec_multi(rmp, win, buf, lnum, col, tm)
+nfa_regexec_multi(rex, rmp, win, buf, lnum, col, tm)
+    regexec_T	*rex;
     regmmatch_T	*rmp;
     win_T	*win;		/* window in which to search or NULL */
     buf_T	*buf;		/* buffer in which to search */
@@ -7275,20 +7831,20 @@ nfa_regexec_multi(rmp, win, buf, lnum, col, tm)
     colnr_T	col;		/* column to start looking for match */
     proftime_T	*tm;		/* timeout limit or NULL */
 {
-    reg_match = NULL;
-    reg_mmatch = rmp;
-    reg_buf = buf;
-    reg_win = win;
-    reg_firstlnum = lnum;
-    reg_maxline = reg_buf->b_ml.ml_line_count - lnum;
-    reg_line_lbr = FALSE;
-    ireg_ic = rmp->rmm_ic;
+    rex->reg_match = NULL;
+    rex->reg_mmatch = rmp;
+    rex->reg_buf = buf;
+    rex->reg_win = win;
+    rex->reg_firstlnum = lnum;
+    rex->reg_maxline = rex->reg_buf->b_ml.ml_line_count - lnum;
+    rex->reg_line_lbr = FALSE;
+    rex->reg_ic = rmp->rmm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex->reg_icombine = FALSE;
 #endif
-    ireg_maxcol = rmp->rmm_maxcol;
+    rex->reg_maxcol = rmp->rmm_maxcol;
 
-    return nfa_regexec_both(NULL, col, tm);
+    return nfa_regexec_both(rex, NULL, col, tm);
 }
 
 #ifdef DEBUG
@@ -937,6 +937,22 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 	    }
 	    at_first_line = FALSE;
 
+#ifdef FEAT_MMAP
+	    /* Went past the last line while lines of a file read with "++mmap"
+	     * are still to be added: add them and continue searching. */
+	    if (lnum > buf->b_ml.ml_line_count && buf->b_ml.ml_mmap != NULL)
+	    {
+		linenr_T    old_line_count = buf->b_ml.ml_line_count;
+
+		ml_mmap_finish(buf);
+		if (buf->b_ml.ml_line_count > old_line_count)
+		{
+		    --loop;
+		    continue;
+		}
+	    }
+#endif
+
 	    /*
 	     * Stop the search if wrapscan isn't set, "stop_lnum" is
 	     * specified, after an interrupt, after a match and after looping
@@ -957,7 +973,12 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 	     * written.
 	     */
 	    if (dir == BACKWARD)    /* start second loop at the other end */
+	    {
+#ifdef FEAT_MMAP
+		ml_mmap_finish(buf);
+#endif
 		lnum = buf->b_ml.ml_line_count;
+	    }
 	    else
 		lnum = 1;
 	    if (!shortmess(SHM_SEARCH) && (options & SEARCH_MSG))
@@ -112,6 +112,15 @@ typedef struct xfilemark
     char_u	*fname;		/* file name, used when fnum == 0 */
 } xfmark_T;
 
+/* Line number change that is applied to marks later, see markadj_add(). */
+typedef struct markadj
+{
+    linenr_T	ma_line1;	/* arguments of mark_adjust() */
+    linenr_T	ma_line2;
+    long	ma_amount;
+    long	ma_amount_after;
+} markadj_T;
+
 /*
  * The taggy struct is used to store the information about a :tag command.
  */
@@ -317,6 +326,10 @@ struct u_entry
     linenr_T	ue_lcount;	/* linecount when u_save called */
     char_u	**ue_array;	/* array of lines in undo block */
     long	ue_size;	/* number of lines in ue_array */
+    long	ue_alloc;	/* number of entries allocated for ue_array
+				   when more than ue_size, see u_extend_entry() */
+    char_u	*ue_delta;	/* bit set for each line in ue_array that is
+				   stored as a change, NULL if there are none */
 #ifdef U_DEBUG
     int		ue_magic;	/* magic number to check allocation */
 #endif
@@ -356,6 +369,11 @@ struct u_header
     time_t	uh_time;	/* timestamp when the change was made */
     long	uh_save_nr;	/* set when the file was saved after the
 				   changes in this block */
+#ifdef FEAT_PERSISTENT_UNDO
+    long	uh_file_off;	/* offset of the header in the undo file, zero
+				   when changed after it was written */
+    long	uh_file_len;	/* size of the header in the undo file */
+#endif
 #ifdef U_DEBUG
     int		uh_magic;	/* magic number to check allocation */
 #endif
@@ -364,6 +382,8 @@ struct u_header
 /* values for uh_flags */
 #define UH_CHANGED  0x01	/* b_changed flag before undo/after redo */
 #define UH_EMPTYBUF 0x02	/* buffer was empty */
+#define UH_UNLOADED 0x04	/* cursor, marks and entries are still in the
+				   undo file; not written */
 
 /*
  * structures used in undo.c
@@ -438,6 +458,12 @@ typedef struct mf_hashtab_S
  * The used list is a doubly linked list, most recently used block first.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
+ *	The list has two parts: first the "hot" blocks, which were used again
+ *	after they were read or created, then the other blocks, starting at
+ *	mf_used_mid.  A block that is read or created is inserted at
+ *	mf_used_mid, blocks are released from the end.  Thus reading many
+ *	blocks once does not push the hot blocks out.  A block only becomes
+ *	hot when used again at least MF_HOT_DELAY seconds after it was read.
  * The hash lists are used to quickly find a block in the used list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
@@ -453,10 +479,13 @@ struct block_hdr
     bhdr_T	*bh_prev;	    /* previous block_hdr in used list */
     char_u	*bh_data;	    /* pointer to memory (for used block) */
     int		bh_page_count;	    /* number of pages in this block */
+    long_u	bh_stamp;	    /* when last inserted in the used list */
+    time_t	bh_time;	    /* when read, created or no longer hot */
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
-    char	bh_flags;	    /* BH_DIRTY or BH_LOCKED */
+#define BH_HOT	    4		    /* in the hot part of the used list */
+    char	bh_flags;	    /* BH_DIRTY, BH_LOCKED and BH_HOT */
 };
 
 /*
@@ -567,8 +596,14 @@ struct memfile
     bhdr_T	*mf_free_first;		/* first block_hdr in free list */
     bhdr_T	*mf_used_first;		/* mru block_hdr in used list */
     bhdr_T	*mf_used_last;		/* lru block_hdr in used list */
+    bhdr_T	*mf_used_mid;		/* first block_hdr in used list that is
+					   not hot, NULL if there is none */
     unsigned	mf_used_count;		/* number of pages in used list */
     unsigned	mf_used_count_max;	/* maximum number of pages in memory */
+    unsigned	mf_hot_count;		/* number of pages with BH_HOT */
+    long	mf_hits;		/* mf_get() found the block in memory */
+    long	mf_misses;		/* mf_get() had to read the block */
+    long	mf_evictions;		/* number of blocks released */
     mf_hashtab_T mf_hash;		/* hash lists */
     mf_hashtab_T mf_trans;		/* trans lists */
     blocknr_T	mf_blocknr_max;		/* highest positive block number + 1*/
@@ -577,8 +612,19 @@ struct memfile
     blocknr_T	mf_infile_count;	/* number of pages in the file */
     unsigned	mf_page_size;		/* number of bytes in a page */
     int		mf_dirty;		/* TRUE if there are dirty blocks */
-#ifdef FEAT_CRYPT
+#if defined(FEAT_CRYPT) || defined(FEAT_MMAP)
     buf_T	*mf_buffer;		/* buffer this memfile is for */
+#endif
+#ifdef FEAT_MMAP
+    int		mf_lazy;		/* TRUE if negative blocks that are not
+					   in memory can be built with
+					   ml_mmap_read() */
+#endif
+#ifdef FEAT_SWAP_THREAD
+    int		mf_bg_failed;		/* TRUE if the writer thread failed to
+					   write blocks, see mf_bg_wait() */
+#endif
+#ifdef FEAT_CRYPT
     char_u	mf_seed[MF_SEED_LEN];	/* seed for encryption */
 
     /* Values for key, method and seed used for reading data blocks when
@@ -619,6 +665,21 @@ typedef struct ml_chunksize
 #define ML_CHNK_UPDLINE 3
 #endif
 
+#ifdef FEAT_PERSISTENT_UNDO
+/* Chunk of lines for the hash of the buffer text, see ml_hash_root(). */
+typedef struct ml_hashchunk
+{
+    linenr_T	mlhc_lines;	/* number of lines in the chunk */
+    int		mlhc_dirty;	/* lines changed, mlhc_hash is invalid */
+    char_u	mlhc_hash[32];	/* SHA-256 of the lines */
+} hashchunk_T;
+#endif
+
+#ifdef FEAT_MMAP
+/* Info about a file read with "++mmap", defined in memline.c. */
+typedef struct mlmmap mlmmap_T;
+#endif
+
 /*
  * the memline structure holds all the information about a memline
  */
@@ -645,13 +706,37 @@ typedef struct memline
     linenr_T	ml_locked_low;	/* first line in ml_locked */
     linenr_T	ml_locked_high;	/* last line in ml_locked */
     int		ml_locked_lineadd;  /* number of lines inserted in ml_locked */
+    linenr_T	ml_compact_lnum; /* blocks from this line on may be merged,
+				    zero if not, see ml_compact_step() */
 #ifdef FEAT_BYTEOFF
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+    chunksize_T *ml_chunktree;	/* Fenwick tree over ml_chunksize[] */
+    int		ml_chunktree_size; /* allocated entries in ml_chunktree */
+    int		ml_chunktree_len; /* nr of chunks in ml_chunktree, -1 when it
+				     needs to be built again */
+#endif
+#ifdef FEAT_PERSISTENT_UNDO
+    hashchunk_T	*ml_hashchunk;	/* chunks for ml_hash_root(), NULL if none */
+    int		ml_hashchunk_len; /* nr of chunks in ml_hashchunk[] */
+    int		ml_hashchunk_idx; /* chunk of the last change */
+    linenr_T	ml_hashchunk_lnum; /* first line of ml_hashchunk_idx */
+#endif
+#ifdef FEAT_MMAP
+    mlmmap_T	*ml_mmap;	/* file read with "++mmap", NULL if none */
 #endif
 } memline_T;
 
+/*
+ * For reading the lines of a buffer one after another, see ml_iter_init().
+ */
+typedef struct
+{
+    buf_T	*li_buf;	/* buffer the lines are in */
+    linenr_T	li_lnum;	/* line returned by the next ml_iter_next() */
+} lineiter_T;
+
 #if defined(FEAT_SIGNS) || defined(PROTO)
 typedef struct signlist signlist_T;
 
@@ -1092,6 +1177,7 @@ typedef struct hashtable_S
     int		ht_locked;	/* counter for hash_lock() */
     int		ht_error;	/* when set growing failed, can't add more
 				   items before growing works */
+    long_u	ht_changed;	/* incremented when an item is removed */
     hashitem_T	*ht_array;	/* points to the array, allocated when it's
 				   not "ht_smallarray" */
     hashitem_T	ht_smallarray[HT_INIT_SIZE];   /* initial array */
@@ -1340,6 +1426,9 @@ typedef struct {
     int		b_sst_freecount;
     linenr_T	b_sst_check_lnum;
     short_u	b_sst_lasttick;	/* last display tick */
+# ifdef FEAT_PERSISTENT_UNDO
+    int		b_sst_cache_read; /* tried reading the syntax cache */
+# endif
 #endif /* FEAT_SYN_HL */
 
 #ifdef FEAT_SPELL
@@ -1506,6 +1595,13 @@ struct file_buffer
     long	b_u_seq_cur;	/* hu_seq of header below which we are now */
     time_t	b_u_time_cur;	/* uh_time of header below which we are now */
     long	b_u_save_nr_cur; /* file write nr after which we are now */
+    long_u	b_u_mem;	/* bytes used for undo headers and entries */
+#ifdef FEAT_PERSISTENT_UNDO
+    char_u	*b_u_file;	/* undo file last read or written, NULL when
+				   all headers must be written again */
+    off_t	b_u_file_size;	/* size of b_u_file at that time */
+    time_t	b_u_file_mtime;	/* modification time of b_u_file then */
+#endif
 
     /*
      * variables for "U" command in undo.c
@@ -1803,8 +1899,15 @@ struct file_buffer
 				 * may use a different synblock_T. */
 #endif
 
+#ifdef FEAT_QUICKFIX
+    garray_T	b_qf_adjust;	/* line changes not yet applied to the
+				 * quickfix and location lists (markadj_T) */
+#endif
+
 #ifdef FEAT_SIGNS
     signlist_T	*b_signlist;	/* list of signs to draw */
+    garray_T	b_sign_adjust;	/* line changes not yet applied to
+				 * b_signlist (markadj_T) */
 # ifdef FEAT_NETBEANS_INTG
     int		b_has_sign_column; /* Flag that is set when a first sign is
 				    * added and remains set until the end of
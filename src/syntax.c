@@ -376,6 +376,17 @@ static int	current_line_id = 0;	/* unique number for current line */
 #define CUR_STATE(idx)	((stateitem_T *)(current_state.ga_data))[idx]
 
 static void syn_sync __ARGS((win_T *wp, linenr_T lnum, synstate_T *last_valid));
+static linenr_T syn_idle_start __ARGS((win_T *wp, linenr_T *targetp));
+#ifdef FEAT_PERSISTENT_UNDO
+static void syn_hash_nr __ARGS((context_sha256_T *ctx, long nr));
+static void syn_hash_str __ARGS((context_sha256_T *ctx, char_u *s));
+static void syn_hash_id __ARGS((context_sha256_T *ctx, int id));
+static void syn_hash_id_list __ARGS((context_sha256_T *ctx, short *list));
+static void syn_compute_hash __ARGS((synblock_T *block, char_u *hash));
+static int syn_next_list_nr __ARGS((synblock_T *block, short *list));
+static int syn_cache_state_ok __ARGS((synblock_T *block, synstate_T *sp));
+static void syn_cache_read __ARGS((win_T *wp));
+#endif
 static int syn_match_linecont __ARGS((linenr_T lnum));
 static void syn_start_line __ARGS((void));
 static void syn_update_ends __ARGS((int startofline));
@@ -524,6 +535,10 @@ syntax_start(wp, lnum)
     if (syn_block->b_sst_array == NULL)
 	return;		/* out of memory */
     syn_block->b_sst_lasttick = display_tick;
+#ifdef FEAT_PERSISTENT_UNDO
+    if (!syn_block->b_sst_cache_read)
+	syn_cache_read(wp);
+#endif
 
     /*
      * If the state of the end of the previous line is useful, store it.
@@ -660,6 +675,593 @@ syntax_start(wp, lnum)
     syn_start_line();
 }
 
+/* Number of lines parsed at least by one call to syn_idle_update(). */
+#define SYN_IDLE_LINES	100
+
+/* Line up to where syn_idle_update() parsed, for "syn_idle_block" at
+ * "syn_idle_changedtick". */
+static synblock_T *syn_idle_block = NULL;
+static int	syn_idle_changedtick = 0;
+static linenr_T	syn_idle_lnum = 0;
+
+/*
+ * Find the line from where the syntax state for window "wp" is to be
+ * computed while waiting for a character to be typed, see 'syntaxahead'.
+ * Sets "*targetp" to the line where the next step ends.
+ * Returns zero when there is nothing to be done.
+ */
+    static linenr_T
+syn_idle_start(wp, targetp)
+    win_T	*wp;
+    linenr_T	*targetp;
+{
+    synblock_T	*block = wp->w_s;
+    buf_T	*buf = wp->w_buffer;
+    synstate_T	*p;
+    linenr_T	lnum;
+    linenr_T	limit;
+    int		dist;
+
+    if (p_sya <= 0 || !syntax_present(wp) || block->b_sst_array == NULL
+	    || wp->w_redr_type != 0 || buf->b_mod_set)
+	return 0;
+
+    /* The saved states are only used to start parsing from when syncing
+     * may go back at least the distance between saved states. */
+    if (block->b_sst_len <= Rows)
+	dist = 999999;
+    else
+	dist = buf->b_ml.ml_line_count / (block->b_sst_len - Rows) + 1;
+    if (block->b_syn_sync_minlines < dist)
+	return 0;
+
+    limit = wp->w_botline + p_sya;
+    if (limit > buf->b_ml.ml_line_count || limit < wp->w_botline)
+	limit = buf->b_ml.ml_line_count;
+
+    /* Find the end of the valid saved states from the first line, without a
+     * gap of more than "dist" lines. */
+    lnum = 1;
+    for (p = block->b_sst_first; p != NULL; p = p->sst_next)
+    {
+	if (p->sst_lnum > limit || p->sst_lnum > lnum + dist
+						   || p->sst_change_lnum != 0)
+	    break;
+	lnum = p->sst_lnum;
+    }
+    if (syn_idle_block == block
+	    && syn_idle_changedtick == buf->b_changedtick
+	    && syn_idle_lnum > lnum)
+	lnum = syn_idle_lnum;
+    if (lnum >= limit)
+	return 0;
+
+    if (dist < SYN_IDLE_LINES
+			   && block->b_syn_sync_minlines >= SYN_IDLE_LINES)
+	dist = SYN_IDLE_LINES;
+    *targetp = lnum + dist > limit ? limit : lnum + dist;
+    return lnum;
+}
+
+/*
+ * Return TRUE when the syntax state for the current window is to be computed
+ * while waiting for a character to be typed.
+ */
+    int
+syn_idle_pending()
+{
+    linenr_T	target;
+
+    return syn_idle_start(curwin, &target) != 0;
+}
+
+/*
+ * Called while waiting for the user to type a character: compute the syntax
+ * state for the next lines of the current window and save it in
+ * b_sst_array[], so that redrawing later doesn't need to parse from far back.
+ */
+    void
+syn_idle_update()
+{
+    linenr_T	target;
+
+    if (syn_idle_start(curwin, &target) == 0)
+	return;
+
+    syntax_start(curwin, target);
+    if (got_int)
+    {
+	/* Interrupted, the state is wrong. */
+	invalidate_current_state();
+	return;
+    }
+    syn_idle_block = curwin->w_s;
+    syn_idle_changedtick = curbuf->b_changedtick;
+    syn_idle_lnum = target;
+}
+
+#if defined(FEAT_PERSISTENT_UNDO) || defined(PROTO)
+
+# define SYC_START_MAGIC	"Vim\237SyN\345"  /* magic at start of file */
+# define SYC_START_MAGIC_LEN	9
+# define SYC_VERSION		1	/* 2-byte syntax cache version number */
+# define SYC_END_MAGIC		0x5e3a	/* magic after last entry */
+
+/*
+ * Add number "nr" to the hash in "ctx".
+ */
+    static void
+syn_hash_nr(ctx, nr)
+    context_sha256_T	*ctx;
+    long		nr;
+{
+    char_u	buf[4];
+    int		i;
+
+    for (i = 0; i < 4; ++i)
+	buf[i] = (char_u)(nr >> ((3 - i) * 8));
+    sha256_update(ctx, buf, 4);
+}
+
+/*
+ * Add string "s" to the hash in "ctx".  NULL is handled like an empty string.
+ */
+    static void
+syn_hash_str(ctx, s)
+    context_sha256_T	*ctx;
+    char_u		*s;
+{
+    if (s == NULL)
+	s = (char_u *)"";
+    sha256_update(ctx, s, (UINT32_T)(STRLEN(s) + 1));
+}
+
+/*
+ * Add highlight group ID "id" to the hash in "ctx".  The name of the group is
+ * used, the ID depends on the order in which groups were defined.
+ */
+    static void
+syn_hash_id(ctx, id)
+    context_sha256_T	*ctx;
+    int			id;
+{
+    if (id > 0 && id <= highlight_ga.ga_len)
+	syn_hash_str(ctx, HL_TABLE()[id - 1].sg_name);
+    else
+	syn_hash_nr(ctx, (long)id);
+}
+
+/*
+ * Add the list of group IDs "list" to the hash in "ctx".
+ */
+    static void
+syn_hash_id_list(ctx, list)
+    context_sha256_T	*ctx;
+    short		*list;
+{
+    if (list == NULL || list == ID_LIST_ALL)
+	syn_hash_nr(ctx, list == NULL ? 0L : -1L);
+    else
+    {
+	for ( ; *list != 0; ++list)
+	    syn_hash_id(ctx, *list);
+	syn_hash_nr(ctx, 0L);
+    }
+}
+
+/*
+ * Compute the hash of the syntax items in "block" into hash[UNDO_HASH_SIZE].
+ * A saved syntax state can only be used when this hash is the same.
+ */
+    static void
+syn_compute_hash(block, hash)
+    synblock_T	*block;
+    char_u	*hash;
+{
+    context_sha256_T	ctx;
+    synpat_T		*spp;
+    syn_cluster_T	*scl;
+    hashtab_T		*ht;
+    hashitem_T		*hi;
+    keyentry_T		*kp;
+    int			todo;
+    int			i;
+    int			j;
+
+    sha256_start(&ctx);
+    syn_hash_nr(&ctx, (long)block->b_syn_ic);
+    syn_hash_nr(&ctx, (long)block->b_syn_containedin);
+    syn_hash_nr(&ctx, (long)block->b_syn_sync_flags);
+    syn_hash_id(&ctx, block->b_syn_sync_id);
+    syn_hash_nr(&ctx, block->b_syn_sync_minlines);
+    syn_hash_nr(&ctx, block->b_syn_sync_maxlines);
+    syn_hash_nr(&ctx, block->b_syn_sync_linebreaks);
+    syn_hash_str(&ctx, block->b_syn_linecont_pat);
+    syn_hash_nr(&ctx, (long)block->b_syn_linecont_ic);
+
+    for (i = 0; i < block->b_syn_patterns.ga_len; ++i)
+    {
+	spp = &(SYN_ITEMS(block)[i]);
+	syn_hash_nr(&ctx, (long)spp->sp_type);
+	syn_hash_nr(&ctx, (long)spp->sp_syncing);
+	syn_hash_nr(&ctx, (long)spp->sp_flags);
+#ifdef FEAT_CONCEAL
+	syn_hash_nr(&ctx, (long)spp->sp_cchar);
+#endif
+	syn_hash_nr(&ctx, (long)spp->sp_syn.inc_tag);
+	syn_hash_id(&ctx, spp->sp_syn.id);
+	syn_hash_id_list(&ctx, spp->sp_syn.cont_in_list);
+	syn_hash_id(&ctx, spp->sp_syn_match_id);
+	syn_hash_str(&ctx, spp->sp_pattern);
+	syn_hash_nr(&ctx, (long)spp->sp_ic);
+	syn_hash_nr(&ctx, (long)spp->sp_off_flags);
+	for (j = 0; j < SPO_COUNT; ++j)
+	    syn_hash_nr(&ctx, (long)spp->sp_offsets[j]);
+	syn_hash_id_list(&ctx, spp->sp_cont_list);
+	syn_hash_id_list(&ctx, spp->sp_next_list);
+	syn_hash_nr(&ctx, (long)spp->sp_sync_idx);
+    }
+
+    for (i = 0; i < block->b_syn_clusters.ga_len; ++i)
+    {
+	scl = &(SYN_CLSTR(block)[i]);
+	syn_hash_str(&ctx, scl->scl_name);
+	syn_hash_id_list(&ctx, scl->scl_list);
+    }
+
+    for (j = 0; j < 2; ++j)
+    {
+	ht = j == 0 ? &block->b_keywtab : &block->b_keywtab_ic;
+	todo = (int)ht->ht_used;
+	for (hi = ht->ht_array; todo > 0; ++hi)
+	{
+	    if (!HASHITEM_EMPTY(hi))
+	    {
+		--todo;
+		for (kp = HI2KE(hi); kp != NULL; kp = kp->ke_next)
+		{
+		    syn_hash_str(&ctx, kp->keyword);
+		    syn_hash_nr(&ctx, (long)kp->k_syn.inc_tag);
+		    syn_hash_id(&ctx, kp->k_syn.id);
+		    syn_hash_id_list(&ctx, kp->k_syn.cont_in_list);
+		    syn_hash_id_list(&ctx, kp->next_list);
+		    syn_hash_nr(&ctx, (long)kp->flags);
+		    syn_hash_nr(&ctx, (long)kp->k_char);
+		}
+	    }
+	}
+    }
+    sha256_finish(&ctx, hash);
+}
+
+/*
+ * Return the number of the syntax item in "block" that "list" is the
+ * "nextgroup" list of, plus one.  Zero for a NULL list, -1 when not found.
+ */
+    static int
+syn_next_list_nr(block, list)
+    synblock_T	*block;
+    short	*list;
+{
+    int		i;
+
+    if (list == NULL)
+	return 0;
+    for (i = 0; i < block->b_syn_patterns.ga_len; ++i)
+	if (SYN_ITEMS(block)[i].sp_next_list == list)
+	    return i + 1;
+    return -1;
+}
+
+/*
+ * Return TRUE when the saved state "sp" can be written to the syntax cache.
+ */
+    static int
+syn_cache_state_ok(block, sp)
+    synblock_T	*block;
+    synstate_T	*sp;
+{
+    bufstate_T	*bp;
+    int		i;
+
+    if (sp->sst_change_lnum != 0
+			     || syn_next_list_nr(block, sp->sst_next_list) < 0)
+	return FALSE;
+    if (sp->sst_stacksize > SST_FIX_STATES)
+	bp = SYN_STATE_P(&(sp->sst_union.sst_ga));
+    else
+	bp = sp->sst_union.sst_stack;
+    for (i = 0; i < sp->sst_stacksize; ++i)
+	if (bp[i].bs_extmatch != NULL)
+	    return FALSE;
+    return TRUE;
+}
+
+/*
+ * Write the saved syntax states of buffer "buf" to its syntax cache file,
+ * so that they can be used when the file is edited again, see 'syntaxcache'.
+ * Only done when the buffer is unchanged and the file wasn't changed outside
+ * of Vim.
+ */
+    void
+syn_cache_write(buf)
+    buf_T	*buf;
+{
+    synblock_T	*block = &buf->b_s;
+    synstate_T	*sp;
+    bufstate_T	*bp;
+    char_u	*file_name;
+    char_u	hash[UNDO_HASH_SIZE];
+    struct stat	st;
+    FILE	*fp;
+    int		fd;
+    int		perm;
+    int		count;
+    int		i;
+    int		write_ok = FALSE;
+
+    if (!p_syc || buf->b_ffname == NULL || buf->b_ml.ml_mfp == NULL
+	    || block->b_sst_array == NULL || block->b_sst_first == NULL
+	    || bufIsChanged(buf) || buf->b_mod_set || buf->b_mtime == 0)
+	return;
+    if (mch_stat((char *)buf->b_ffname, &st) < 0
+	    || time_differs((long)st.st_mtime, buf->b_mtime)
+	    || st.st_size != buf->b_orig_size)
+	return;
+
+    count = 0;
+    for (sp = block->b_sst_first; sp != NULL; sp = sp->sst_next)
+	if (syn_cache_state_ok(block, sp))
+	    ++count;
+    if (count == 0)
+	return;
+
+    file_name = u_get_syntax_file_name(buf->b_ffname, FALSE);
+    if (file_name == NULL)
+	return;
+
+    /* Only overwrite a syntax cache file. */
+    fp = mch_fopen((char *)file_name, "r");
+    if (fp != NULL)
+    {
+	char_u	mbuf[SYC_START_MAGIC_LEN];
+
+	i = (int)fread(mbuf, SYC_START_MAGIC_LEN, 1, fp);
+	fclose(fp);
+	if (i != 1 || memcmp(mbuf, SYC_START_MAGIC, SYC_START_MAGIC_LEN) != 0)
+	{
+	    if (p_verbose > 0)
+	    {
+		verbose_enter();
+		smsg((char_u *)
+		  _("Will not overwrite, this is not a syntax cache file: %s"),
+								   file_name);
+		verbose_leave();
+	    }
+	    goto theend;
+	}
+    }
+    mch_remove(file_name);
+
+    /* Use the permission of the original file, the cache contains
+     * information about the text. */
+    perm = st.st_mode & 0666;
+    fd = mch_open((char *)file_name,
+			    O_CREAT|O_EXTRA|O_WRONLY|O_EXCL|O_NOFOLLOW, perm);
+    if (fd < 0)
+	goto theend;
+    fp = fdopen(fd, "w");
+    if (fp == NULL)
+    {
+	close(fd);
+	mch_remove(file_name);
+	goto theend;
+    }
+    if (p_verbose > 0)
+    {
+	verbose_enter();
+	smsg((char_u *)_("Writing syntax cache: %s"), file_name);
+	verbose_leave();
+    }
+
+    syn_compute_hash(block, hash);
+    if (fwrite(SYC_START_MAGIC, (size_t)SYC_START_MAGIC_LEN, (size_t)1, fp)
+									 != 1
+	    || put_bytes(fp, (long_u)SYC_VERSION, 2) == FAIL
+	    || fwrite(hash, (size_t)UNDO_HASH_SIZE, (size_t)1, fp) != 1)
+	goto write_error;
+    put_time(fp, (time_t)buf->b_mtime);
+    put_bytes(fp, (long_u)buf->b_orig_size, 4);
+    put_bytes(fp, (long_u)buf->b_ml.ml_line_count, 4);
+    put_bytes(fp, (long_u)count, 4);
+
+    for (sp = block->b_sst_first; sp != NULL; sp = sp->sst_next)
+    {
+	if (!syn_cache_state_ok(block, sp))
+	    continue;
+	put_bytes(fp, (long_u)sp->sst_lnum, 4);
+	put_bytes(fp, (long_u)sp->sst_next_flags, 4);
+	put_bytes(fp, (long_u)syn_next_list_nr(block, sp->sst_next_list), 4);
+	put_bytes(fp, (long_u)sp->sst_stacksize, 4);
+	if (sp->sst_stacksize > SST_FIX_STATES)
+	    bp = SYN_STATE_P(&(sp->sst_union.sst_ga));
+	else
+	    bp = sp->sst_union.sst_stack;
+	for (i = 0; i < sp->sst_stacksize; ++i)
+	{
+	    put_bytes(fp, (long_u)bp[i].bs_idx, 4);
+	    put_bytes(fp, (long_u)bp[i].bs_flags, 4);
+#ifdef FEAT_CONCEAL
+	    put_bytes(fp, (long_u)bp[i].bs_seqnr, 4);
+	    put_bytes(fp, (long_u)bp[i].bs_cchar, 4);
+#else
+	    put_bytes(fp, (long_u)0, 4);
+	    put_bytes(fp, (long_u)0, 4);
+#endif
+	}
+    }
+    if (put_bytes(fp, (long_u)SYC_END_MAGIC, 2) == OK)
+	write_ok = TRUE;
+
+write_error:
+    if (fclose(fp) != 0)
+	write_ok = FALSE;
+    if (!write_ok)
+	mch_remove(file_name);
+
+theend:
+    vim_free(file_name);
+}
+
+/*
+ * Read the saved syntax states for the buffer of window "wp" from its syntax
+ * cache file, if there is one that matches the text and the syntax items.
+ * Only done when no state was saved yet.
+ */
+    static void
+syn_cache_read(wp)
+    win_T	*wp;
+{
+    buf_T	*buf = wp->w_buffer;
+    synblock_T	*block = wp->w_s;
+    synstate_T	*sp;
+    synstate_T	*last = NULL;
+    bufstate_T	*bp;
+    char_u	*file_name;
+    char_u	hash[UNDO_HASH_SIZE];
+    char_u	read_hash[UNDO_HASH_SIZE];
+    char_u	magic_buf[SYC_START_MAGIC_LEN];
+    FILE	*fp;
+    linenr_T	lnum;
+    int		count;
+    int		stacksize;
+    int		nr;
+    int		i;
+
+    block->b_sst_cache_read = TRUE;
+    if (!p_syc || block != &buf->b_s || block->b_sst_first != NULL
+	    || buf->b_ffname == NULL || bufIsChanged(buf) || buf->b_mod_set
+	    || buf->b_mtime == 0)
+	return;
+
+    file_name = u_get_syntax_file_name(buf->b_ffname, TRUE);
+    if (file_name == NULL)
+	return;
+    fp = mch_fopen((char *)file_name, "r");
+    if (fp == NULL)
+	goto theend;
+
+    syn_compute_hash(block, hash);
+    if (fread(magic_buf, SYC_START_MAGIC_LEN, 1, fp) != 1
+	    || memcmp(magic_buf, SYC_START_MAGIC, SYC_START_MAGIC_LEN) != 0
+	    || get2c(fp) != SYC_VERSION
+	    || fread(read_hash, UNDO_HASH_SIZE, 1, fp) != 1
+	    || memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
+	    || time_differs((long)get8ctime(fp), buf->b_mtime)
+	    || get4c(fp) != (int)buf->b_orig_size
+	    || get4c(fp) != buf->b_ml.ml_line_count)
+    {
+	/* Not for this text or these syntax items. */
+	if (p_verbose > 0)
+	{
+	    verbose_enter();
+	    smsg((char_u *)_("Syntax cache does not match, ignoring: %s"),
+								   file_name);
+	    verbose_leave();
+	}
+	goto theend;
+    }
+    if (p_verbose > 0)
+    {
+	verbose_enter();
+	smsg((char_u *)_("Reading syntax cache: %s"), file_name);
+	verbose_leave();
+    }
+
+    /* Keep room for the states of the displayed lines. */
+    count = get4c(fp);
+    while (count > 0 && block->b_sst_freecount > Rows)
+    {
+	--count;
+	lnum = get4c(fp);
+	if (lnum < 1 || lnum > buf->b_ml.ml_line_count
+				       || (last != NULL && lnum <= last->sst_lnum))
+	    goto error;
+
+	/* Take the first item from the free list and append it to the used
+	 * list. */
+	sp = block->b_sst_firstfree;
+	block->b_sst_firstfree = sp->sst_next;
+	--block->b_sst_freecount;
+	sp->sst_next = NULL;
+	if (last == NULL)
+	    block->b_sst_first = sp;
+	else
+	    last->sst_next = sp;
+	last = sp;
+
+	sp->sst_lnum = lnum;
+	sp->sst_stacksize = 0;
+	sp->sst_tick = display_tick;
+	sp->sst_change_lnum = 0;
+	sp->sst_next_flags = get4c(fp);
+	nr = get4c(fp);
+	if (nr < 0 || nr > block->b_syn_patterns.ga_len)
+	    goto error;
+	sp->sst_next_list = nr == 0 ? NULL
+				       : SYN_ITEMS(block)[nr - 1].sp_next_list;
+	stacksize = get4c(fp);
+	if (stacksize < 0 || stacksize > 10000)
+	    goto error;
+	if (stacksize > SST_FIX_STATES)
+	{
+	    ga_init2(&sp->sst_union.sst_ga, (int)sizeof(bufstate_T), 1);
+	    if (ga_grow(&sp->sst_union.sst_ga, stacksize) == FAIL)
+		goto error;
+	    sp->sst_union.sst_ga.ga_len = stacksize;
+	    bp = SYN_STATE_P(&(sp->sst_union.sst_ga));
+	}
+	else
+	    bp = sp->sst_union.sst_stack;
+	for (i = 0; i < stacksize; ++i)
+	    bp[i].bs_extmatch = NULL;
+	sp->sst_stacksize = stacksize;
+	for (i = 0; i < stacksize; ++i)
+	{
+	    bp[i].bs_idx = get4c(fp);
+	    bp[i].bs_flags = get4c(fp);
+#ifdef FEAT_CONCEAL
+	    bp[i].bs_seqnr = get4c(fp);
+	    bp[i].bs_cchar = get4c(fp);
+#else
+	    (void)get4c(fp);
+	    (void)get4c(fp);
+#endif
+	    if (bp[i].bs_idx < KEYWORD_IDX
+			       || bp[i].bs_idx >= block->b_syn_patterns.ga_len)
+		goto error;
+	}
+    }
+    /* When all entries were read the end marker must follow. */
+    if (count > 0 || get2c(fp) == SYC_END_MAGIC)
+	goto theend;
+
+error:
+    EMSG2(_("E892: Corrupted syntax cache file: %s"), file_name);
+    while (block->b_sst_first != NULL)
+    {
+	sp = block->b_sst_first;
+	block->b_sst_first = sp->sst_next;
+	syn_stack_free_entry(block, sp);
+    }
+
+theend:
+    if (fp != NULL)
+	fclose(fp);
+    vim_free(file_name);
+}
+#endif
+
 /*
  * We cannot simply discard growarrays full of state_items or buf_states; we
  * have to manually release their extmatch pointers first.
@@ -1149,6 +1751,7 @@ syn_stack_free_block(block)
 	block->b_sst_array = NULL;
 	block->b_sst_len = 0;
     }
+    block->b_sst_cache_read = FALSE;
 }
 /*
  * Free b_sst_array[] for buffer "buf".
@@ -1161,7 +1764,8 @@ syn_stack_free_all(block)
     win_T	*wp;
 
     syn_stack_free_block(block);
-
+    if (block == syn_idle_block)
+	syn_idle_block = NULL;
 
 #ifdef FEAT_FOLDING
     /* When using "syntax" fold method, must update all folds. */
@@ -45,17 +45,31 @@ SCRIPTS = test1.out test3.out test4.out test5.out test6.out \
 		test_command_count.out \
 		test_erasebackword.out \
 		test_eval.out \
+		test_funccompile.out \
+		test_globalrange.out \
 		test_insertcount.out \
 		test_listlbr.out \
 		test_listlbr_utf8.out \
 		test_mapping.out \
 		test_marks.out \
+		test_memcompact.out \
+		test_memstat.out \
+		test_mmap.out \
 		test_nested_function.out \
 		test_options.out \
+		test_qf_lnum.out \
 		test_qf_title.out \
+		test_regexp_cache.out \
 		test_signs.out \
+		test_sort.out \
+		test_substundo.out \
+		test_swapthread.out \
+		test_syncache.out \
 		test_textobjects.out \
-		test_utf8.out
+		test_undojournal.out \
+		test_undomem.out \
+		test_utf8.out \
+		test_vimgrep.out
 
 .SUFFIXES: .in .out
 
@@ -188,14 +202,28 @@ test_close_count.out: test_close_count.in
 test_command_count.out: test_command_count.in
 test_erasebackword.out: test_erasebackword.in
 test_eval.out: test_eval.in
+test_funccompile.out: test_funccompile.in
+test_globalrange.out: test_globalrange.in
 test_insertcount.out: test_insertcount.in
 test_listlbr.out: test_listlbr.in
 test_listlbr_utf8.out: test_listlbr_utf8.in
 test_mapping.out: test_mapping.in
 test_marks.out: test_marks.in
+test_memcompact.out: test_memcompact.in
+test_memstat.out: test_memstat.in
+test_mmap.out: test_mmap.in
 test_nested_function.out: test_nested_function.in
 test_options.out: test_options.in
+test_qf_lnum.out: test_qf_lnum.in
 test_qf_title.out: test_qf_title.in
+test_regexp_cache.out: test_regexp_cache.in
 test_signs.out: test_signs.in
+test_sort.out: test_sort.in
+test_substundo.out: test_substundo.in
+test_swapthread.out: test_swapthread.in
+test_syncache.out: test_syncache.in
 test_textobjects.out: test_textobjects.in
+test_undojournal.out: test_undojournal.in
+test_undomem.out: test_undomem.in
 test_utf8.out: test_utf8.in
+test_vimgrep.out: test_vimgrep.in
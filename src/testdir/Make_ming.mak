@@ -66,23 +66,37 @@ SCRIPTS =	test3.out test4.out test5.out test6.out test7.out \
 		test_command_count.out \
 		test_erasebackword.out \
 		test_eval.out \
+		test_funccompile.out \
+		test_globalrange.out \
 		test_insertcount.out \
 		test_listlbr.out \
 		test_listlbr_utf8.out \
 		test_mapping.out \
 		test_marks.out \
+		test_memcompact.out \
+		test_memstat.out \
+		test_mmap.out \
 		test_nested_function.out \
 		test_options.out \
+		test_qf_lnum.out \
 		test_qf_title.out \
+		test_regexp_cache.out \
 		test_signs.out \
+		test_sort.out \
+		test_substundo.out \
+		test_swapthread.out \
+		test_syncache.out \
 		test_textobjects.out \
-		test_utf8.out
+		test_undojournal.out \
+		test_undomem.out \
+		test_utf8.out \
+		test_vimgrep.out
 
 SCRIPTS32 =	test50.out test70.out
 
 SCRIPTS_GUI = test16.out
 
-SCRIPTS_BENCH = bench_re_freeze.out
+SCRIPTS_BENCH = bench_re_freeze.out bench_re_search.out
 
 .SUFFIXES: .in .out
 
@@ -133,3 +147,8 @@ bench_re_freeze.out: bench_re_freeze.vim
 	-$(DEL) benchmark.out
 	$(VIMPROG) -u dos.vim -U NONE --noplugin $*.in
 	$(CAT) benchmark.out
+
+bench_re_search.out: bench_re_search.vim
+	-$(DEL) benchmark.out
+	$(VIMPROG) -u dos.vim -U NONE --noplugin $*.in
+	$(CAT) benchmark.out
@@ -0,0 +1,148 @@
+" Benchmark for the regexp engines: runs a corpus of patterns, taken from the
+" bundled syntax files and typical user searches, over generated buffers with
+" each 'regexpengine'.  One line is written per measurement:
+"	re_search<Tab>{buffer}<Tab>{name}<Tab>re={n}<Tab>{lines}<Tab>{matches}<Tab>{ns/line}
+" Set g:bench_lines to change the size of the generated buffers.
+
+so small.vim
+scriptencoding utf-8
+if !has("reltime") || !has("float") | finish | endif
+
+let s:lines = exists('g:bench_lines') ? g:bench_lines : 20000
+
+" Patterns as they appear in runtime/syntax/c.vim, vim.vim and others.
+let s:syntax_patterns = [
+      \ ['c_space_error', '\s\+$'],
+      \ ['c_special', '\\\(x\x\+\|\o\{1,3}\|.\|$\)'],
+      \ ['c_format', '%\(\d\+\$\)\=[-+'' #0*]*\(\d*\|\*\|\*\d\+\$\)\(\.\(\d*\|\*\|\*\d\+\$\)\)\=\([hlLjzt]\|ll\|hh\)\=\([aAbdiuoxXDOUfFeEgGcCsSpn]\|\[\^\=.[^]]*\]\)'],
+      \ ['c_string', '\(L\|u\|u8\|U\|R\|LR\|u8R\|uR\|UR\)\="\%(\\\\\|\\"\|[^"]\)*"'],
+      \ ['c_number', '\<\d\+\(u\=l\{0,2}\|ll\=u\)\>'],
+      \ ['c_float', '\d\+\.\d*\(e[-+]\=\d\+\)\=[fl]\='],
+      \ ['c_comment', '/\*\_.\{-}\*/'],
+      \ ['c_preproc', '^\s*\(%:\|#\)\s*\(if\|ifdef\|ifndef\|elif\)\>'],
+      \ ['c_include', '^\s*\(%:\|#\)\s*include\>\s*["<]'],
+      \ ['c_todo', '\<\(TODO\|FIXME\|XXX\)\>'],
+      \ ['vim_function', '\<fu\%[nction]!\=\s\+\%([sSgGbBwWtTlL]:\|<[sS][iI][dD]>\)\=\%(\i\|[#.]\|{.\{-1,}}\)*\ze\s*('],
+      \ ['vim_var', '\<[bwglsav]:\h[a-zA-Z0-9#_]*\>'],
+      \ ['html_tag', '<\/\=\%(\a\+\)\%(\s\+\a\+\%(=\%("[^"]*"\|''[^'']*''\)\)\=\)*\s*\/\=>'],
+      \ ['url', '\v<(https?|ftp)://[-a-zA-Z0-9./?=_%:&#~+]+'],
+      \ ]
+
+" Searches users commonly type.
+let s:user_patterns = [
+      \ ['literal', 'buffer'],
+      \ ['literal_rare', 'xyzzy'],
+      \ ['word', '\<line\>'],
+      \ ['ignorecase', '\cRETURN'],
+      \ ['alternation', 'if\|while\|for\|switch'],
+      \ ['char_class', '[A-Z][a-z]\+[A-Z]'],
+      \ ['dot_star', 'int.*;'],
+      \ ['ident_call', '\h\w*\s*('],
+      \ ['lookbehind', '\(foo\)\@<=bar'],
+      \ ['backref', '\(\<\w\+\>\) \1'],
+      \ ['trailing_nl', 'x\n\s*}'],
+      \ ]
+
+" Generate {count} lines of C code.
+func! s:CodeLines(count)
+  let tmpl = [
+	\ '/* Copy %d bytes of the line into the buffer, TODO: check size. */',
+	\ '#ifdef FEAT_LINE_%d',
+	\ 'static int line_%d(char_u *buffer, long len) ',
+	\ '{',
+	\ '    int		idx = %d;',
+	\ '    double	ratio = %d.25e-3;',
+	\ '',
+	\ '    if (len > 0x%x && buffer[idx] != NUL)',
+	\ '	return foo_bar(buffer, L"wide \\n string", 0%o);',
+	\ '    while (--len >= 0)',
+	\ '	smsg((char_u *)_("Line %%ld: %%s \"%d\""), len, buffer);',
+	\ '    return (int)ReturnValue(idx, %dUL);',
+	\ '}',
+	\ '#endif',
+	\ ]
+  let result = []
+  let i = 0
+  while len(result) < a:count
+    for t in tmpl
+      call add(result, substitute(t, '%[dxo]', i, 'g'))
+    endfor
+    let i += 1
+  endwhile
+  return result[: a:count - 1]
+endfunc
+
+" Generate {count} lines of text mixed with Vim script and markup.
+func! s:TextLines(count)
+  let tmpl = [
+	\ 'The quick brown fox jumps over the lazy dog %d times.',
+	\ 'See http://www.vim.org/scripts/script.php?script_id=%d for details.',
+	\ '<a href="index%d.html" class=''link''>Next page</a>',
+	\ 'function! s:Func%d(arg) abort',
+	\ '  let l:count = a:arg + g:offset_%d',
+	\ '  return foobar the the line %d',
+	\ 'endfunction',
+	\ 'Día %d: naïve café, ÜBER straße — 日本語 text.',
+	\ ]
+  let result = []
+  let i = 0
+  while len(result) < a:count
+    for t in tmpl
+      call add(result, substitute(t, '%d', i, 'g'))
+    endfor
+    let i += 1
+  endwhile
+  return result[: a:count - 1]
+endfunc
+
+" Run ":s///gn" with pattern {pat} and return the number of matches.
+func! s:CountMatches(pat)
+  let @/ = a:pat
+  redir => msg
+  silent! %s///gne
+  redir END
+  let n = matchstr(msg, '\d\+\ze match')
+  return n == '' ? 0 : str2nr(n)
+endfunc
+
+" Return one result line for each pattern and engine.
+func! s:MeasureBuffer(bufname, lines, patterns)
+  let results = []
+  new
+  call setline(1, a:lines)
+  for re in [1, 2]
+    let &re = re
+    for [name, pat] in a:patterns
+      " First run compiles the pattern and warms up the caches.
+      call s:CountMatches(pat)
+      let start = reltime()
+      let matches = s:CountMatches(pat)
+      call add(results, [name, re, matches, reltime(start)])
+    endfor
+    " Highlight the whole buffer with the C syntax.
+    if a:bufname == 'code' && has('syntax')
+      syntax clear
+      unlet! b:current_syntax
+      runtime! syntax/c.vim
+      syntax sync fromstart
+      let start = reltime()
+      call synID(line('$'), 1, 1)
+      call add(results, ['syntax_c', re, 0, reltime(start)])
+      syntax clear
+    endif
+  endfor
+  let nlines = line('$')
+  set re=0
+  bwipe!
+  return map(results, 'printf("re_search\t%s\t%s\tre=%d\t%d\t%d\t%.0f",'
+	\ . ' a:bufname, v:val[0], v:val[1], nlines, v:val[2],'
+	\ . ' str2float(reltimestr(v:val[3])) * 1.0e9 / nlines)')
+endfunc
+
+" Append the results to the current buffer.
+func! RunBenchmark()
+  let patterns = s:syntax_patterns + s:user_patterns
+  let results = s:MeasureBuffer('code', s:CodeLines(s:lines), patterns)
+  let results += s:MeasureBuffer('text', s:TextLines(s:lines), patterns)
+  call append('$', results)
+endfunc
@@ -99,6 +99,21 @@ typedef struct {
 #endif
 } bufinfo_T;
 
+/*
+ * A saved line that was changed in place can be stored as the bytes that
+ * differ from the line in the buffer: this header with the number of equal
+ * bytes at the start and at the end, followed by the other bytes and a NUL.
+ * The bit for the line in ue_delta[] is set then.
+ */
+typedef struct {
+    colnr_T	ud_prefix;	/* number of equal bytes at the start */
+    colnr_T	ud_suffix;	/* number of equal bytes at the end */
+} u_delta_T;
+
+#define UD_TEXT(p)	((char_u *)(p) + sizeof(u_delta_T))
+#define UE_IS_DELTA(uep, i) ((uep)->ue_delta != NULL \
+			    && ((uep)->ue_delta[(i) >> 3] & (1 << ((i) & 7))))
+
 
 static long get_undolevel __ARGS((void));
 static void u_unch_branch __ARGS((u_header_T *uhp));
@@ -112,7 +127,14 @@ static void u_freeheader __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp)
 static void u_freebranch __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp));
 static void u_freeentries __ARGS((buf_T *buf, u_header_T *uhp, u_header_T **uhpp));
 static void u_freeentry __ARGS((u_entry_T *, long));
+static long_u u_entry_mem __ARGS((u_entry_T *uep));
+static void u_encode_entry __ARGS((u_entry_T *uep));
+static int u_decode_entry __ARGS((u_entry_T *uep));
+static void u_compress_header __ARGS((u_header_T *uhp));
+static int u_extend_entry __ARGS((linenr_T top));
+static void u_expand_header __ARGS((u_header_T *uhp));
 #ifdef FEAT_PERSISTENT_UNDO
+static char_u *get_udir_file_name __ARGS((char_u *buf_ffname, int reading, char *ext));
 static void corruption_error __ARGS((char *mesg, char_u *file_name));
 static void u_free_uhp __ARGS((u_header_T *uhp));
 static int undo_write __ARGS((bufinfo_T *bi, char_u *ptr, size_t len));
@@ -129,15 +151,36 @@ static char_u *read_string_decrypt __ARGS((bufinfo_T *bi, int len));
 static int serialize_header __ARGS((bufinfo_T *bi, char_u *hash));
 static int serialize_uhp __ARGS((bufinfo_T *bi, u_header_T *uhp));
 static u_header_T *unserialize_uhp __ARGS((bufinfo_T *bi, char_u *file_name));
+static int serialize_entries __ARGS((bufinfo_T *bi, u_header_T *uhp));
+static int unserialize_entries __ARGS((bufinfo_T *bi, u_header_T *uhp, char_u *file_name));
 static int serialize_uep __ARGS((bufinfo_T *bi, u_entry_T *uep));
 static u_entry_T *unserialize_uep __ARGS((bufinfo_T *bi, int *error, char_u *file_name));
 static void serialize_pos __ARGS((bufinfo_T *bi, pos_T pos));
 static void unserialize_pos __ARGS((bufinfo_T *bi, pos_T *pos));
 static void serialize_visualinfo __ARGS((bufinfo_T *bi, visualinfo_T *info));
 static void unserialize_visualinfo __ARGS((bufinfo_T *bi, visualinfo_T *info));
+static u_header_T **u_header_table __ARGS((buf_T *buf, int *countp));
+static int
+# ifdef __BORLANDC__
+_RTLENTRYF
+# endif
+	u_seq_compare __ARGS((const void *s1, const void *s2));
+static void u_compute_line_hash __ARGS((buf_T *buf, char_u *hash));
+static u_header_T *u_find_seq __ARGS((u_header_T **table, int count, long seq));
+static void u_set_undo_file __ARGS((buf_T *buf, char_u *file_name));
+static int u_same_undo_file __ARGS((buf_T *buf, char_u *file_name));
+static int u_load_header __ARGS((buf_T *buf, u_header_T *uhp));
+static int u_load_all __ARGS((buf_T *buf));
+static int serialize_journal __ARGS((bufinfo_T *bi, char_u *hash, u_header_T **table, int count));
+static int unserialize_journal __ARGS((bufinfo_T *bi, char_u *hash, char_u *name, char_u *file_name));
+static int u_append_undo __ARGS((buf_T *buf, char_u *file_name, char_u *hash));
+# define U_HEADER_CHANGED(uhp)	((uhp)->uh_file_off = 0, (uhp)->uh_file_len = 0)
+#else
+# define U_HEADER_CHANGED(uhp)
 #endif
 
 #define U_ALLOC_LINE(size) lalloc((long_u)(size), FALSE)
+#define U_EXTEND_GAP	8	/* max lines between entry and added line */
 static char_u *u_save_line __ARGS((linenr_T));
 
 /* used in undo_end() to report number of added and deleted lines */
@@ -395,6 +438,13 @@ u_savecommon(top, bot, newbot, reload)
     u_entry_T	*prev_uep;
     long	size;
 
+#ifdef FEAT_MMAP
+    /* Get all the lines of a file read with "++mmap" before making a change,
+     * "bot" may be one below the last line added so far. */
+    if (curbuf->b_ml.ml_mmap != NULL)
+	ml_mmap_finish(curbuf);
+#endif
+
     if (!reload)
     {
 	/* When making changes is not allowed return FAIL.  It's a crude way
@@ -484,9 +534,11 @@ u_savecommon(top, bot, newbot, reload)
 	}
 
 	/*
-	 * free headers to keep the size right
+	 * free headers to keep the size right, also when using more memory
+	 * than 'undomaxmem'
 	 */
-	while (curbuf->b_u_numhead > get_undolevel()
+	while ((curbuf->b_u_numhead > get_undolevel()
+		    || (p_umm > 0 && (curbuf->b_u_mem >> 10) >= (long_u)p_umm))
 					       && curbuf->b_u_oldhead != NULL)
 	{
 	    u_header_T	    *uhfree = curbuf->b_u_oldhead;
@@ -543,6 +595,7 @@ u_savecommon(top, bot, newbot, reload)
 	uhp->uh_walk = 0;
 	uhp->uh_entry = NULL;
 	uhp->uh_getbot_entry = NULL;
+	U_HEADER_CHANGED(uhp);
 	uhp->uh_cursor = curwin->w_cursor;	/* save cursor pos. for undo */
 #ifdef FEAT_VIRTUALEDIT
 	if (virtual_active() && curwin->w_cursor.coladd > 0)
@@ -563,6 +616,7 @@ u_savecommon(top, bot, newbot, reload)
 	if (curbuf->b_u_oldhead == NULL)
 	    curbuf->b_u_oldhead = uhp;
 	++curbuf->b_u_numhead;
+	curbuf->b_u_mem += sizeof(u_header_T);
     }
     else
     {
@@ -622,6 +676,8 @@ u_savecommon(top, bot, newbot, reload)
 			curbuf->b_u_newhead->uh_entry = uep;
 		    }
 
+		    U_HEADER_CHANGED(curbuf->b_u_newhead);
+
 		    /* The executed command may change the line count. */
 		    if (newbot != 0)
 			uep->ue_bot = newbot;
@@ -639,6 +695,15 @@ u_savecommon(top, bot, newbot, reload)
 	    }
 	}
 
+	/* When saving the line just below the lines of the last entry add it
+	 * to that entry, e.g. for ":%s/a/b/". */
+	if (size == 1 && newbot == bot && u_extend_entry(top) == OK)
+	{
+	    U_HEADER_CHANGED(curbuf->b_u_newhead);
+	    undo_undoes = FALSE;
+	    return OK;
+	}
+
 	/* find line number for ue_bot for previous u_save() */
 	u_getbot();
     }
@@ -706,6 +771,8 @@ u_savecommon(top, bot, newbot, reload)
 	uep->ue_array = NULL;
     uep->ue_next = curbuf->b_u_newhead->uh_entry;
     curbuf->b_u_newhead->uh_entry = uep;
+    curbuf->b_u_mem += u_entry_mem(uep);
+    U_HEADER_CHANGED(curbuf->b_u_newhead);
     curbuf->b_u_synced = FALSE;
     undo_undoes = FALSE;
 
@@ -726,6 +793,66 @@ nomem:
     return FAIL;
 }
 
+/*
+ * Add line "top + 1" to the newest entry of the current header when that
+ * entry saved the lines just above it and did not change the number of
+ * lines.  When there are a few lines in between they are saved as well, that
+ * costs less than another entry.  Used when the line is changed without
+ * changing the number of lines, thus substituting in many lines results in
+ * one entry.
+ * Returns FAIL when a new entry has to be used.
+ */
+    static int
+u_extend_entry(top)
+    linenr_T	top;
+{
+    u_entry_T	*uep = curbuf->b_u_newhead->uh_entry;
+    char_u	**array;
+    char_u	*line;
+    long	size;
+    long	alloc;
+
+    if (uep == NULL
+	    || uep == curbuf->b_u_newhead->uh_getbot_entry
+	    || uep->ue_delta != NULL
+	    || uep->ue_bot == 0
+	    || uep->ue_top + uep->ue_size + 1 != uep->ue_bot
+	    || top + 1 < uep->ue_bot
+	    || top + 1 > uep->ue_bot + U_EXTEND_GAP)
+	return FAIL;
+
+    size = uep->ue_size + top + 2 - uep->ue_bot;
+#if !defined(UNIX) && !defined(DJGPP) && !defined(WIN32) && !defined(__EMX__)
+    /* Same limit as in u_savecommon(). */
+    if (size >= 8000)
+	return FAIL;
+#endif
+    if (size > (uep->ue_alloc > uep->ue_size ? uep->ue_alloc : uep->ue_size))
+    {
+	/* Double the size of the array, to avoid copying it for each line. */
+	alloc = uep->ue_size * 2 > size ? uep->ue_size * 2 : size;
+	array = (char_u **)U_ALLOC_LINE(sizeof(char_u *) * alloc);
+	if (array == NULL)
+	    return FAIL;
+	if (uep->ue_size > 0)
+	    mch_memmove(array, uep->ue_array,
+					    sizeof(char_u *) * uep->ue_size);
+	vim_free(uep->ue_array);
+	uep->ue_array = array;
+	uep->ue_alloc = alloc;
+    }
+
+    while (uep->ue_bot <= top + 1)
+    {
+	if ((line = u_save_line(uep->ue_bot)) == NULL)
+	    return FAIL;
+	uep->ue_array[uep->ue_size++] = line;
+	++uep->ue_bot;
+	curbuf->b_u_mem += sizeof(char_u *) + STRLEN(line) + 1;
+    }
+    return OK;
+}
+
 #if defined(FEAT_PERSISTENT_UNDO) || defined(PROTO)
 
 # define UF_START_MAGIC	    "Vim\237UnDo\345"  /* magic at start of undofile */
@@ -734,8 +861,18 @@ nomem:
 # define UF_HEADER_END_MAGIC	0xe7aa	/* magic after last header */
 # define UF_ENTRY_MAGIC		0xf518	/* magic at start of entry */
 # define UF_ENTRY_END_MAGIC	0x3581	/* magic after last entry */
-# define UF_VERSION		2	/* 2-byte undofile version number */
-# define UF_VERSION_CRYPT	0x8002	/* idem, encrypted */
+# define UF_VERSION		3	/* 2-byte undofile version number */
+# define UF_VERSION_CRYPT	0x8003	/* idem, encrypted */
+# define UF_VERSION_OLD		2	/* version without changed lines */
+# define UF_VERSION_OLD_CRYPT	0x8002	/* idem, encrypted */
+# define UF_VERSION_JOURNAL	5	/* not encrypted, index at the end */
+# define UF_VERSION_OLD_JOURNAL	4	/* idem, hash over all lines */
+# define UF_INDEX_MAGIC		0x1dc4	/* magic at start of index */
+# define UF_INDEX_END_MAGIC	0xd11e	/* magic before offset of index */
+# define UF_FOOTER_LEN		6	/* UF_INDEX_END_MAGIC and offset */
+
+/* flag in the length of a line stored as a change */
+# define UF_DELTA_LINE		0x80000000L
 
 /* extra fields for header */
 # define UF_LAST_SAVE_NR	1
@@ -747,20 +884,37 @@ static char_u e_not_open[] = N_("E828: Cannot open undo file for writing: %s");
 
 /*
  * Compute the hash for the current buffer text into hash[UNDO_HASH_SIZE].
+ * Only the chunks of lines that changed since the last time are hashed, see
+ * ml_hash_root().
  */
     void
 u_compute_hash(hash)
     char_u *hash;
+{
+    ml_hash_root(curbuf, hash);
+}
+
+/*
+ * Compute the hash over all lines of the text of "buf" into
+ * hash[UNDO_HASH_SIZE], as used for an encrypted or older undo file.
+ */
+    static void
+u_compute_line_hash(buf, hash)
+    buf_T	*buf;
+    char_u	*hash;
 {
     context_sha256_T	ctx;
     linenr_T		lnum;
+    lineiter_T		iter;
     char_u		*p;
+    colnr_T		len;
 
     sha256_start(&ctx);
-    for (lnum = 1; lnum <= curbuf->b_ml.ml_line_count; ++lnum)
+    ml_iter_init(&iter, buf, (linenr_T)1);
+    for (lnum = 1; lnum <= buf->b_ml.ml_line_count; ++lnum)
     {
-	p = ml_get(lnum);
-	sha256_update(&ctx, p, (UINT32_T)(STRLEN(p) + 1));
+	p = ml_iter_next(&iter, &len);
+	sha256_update(&ctx, p, (UINT32_T)(len + 1));
     }
     sha256_finish(&ctx, hash);
 }
@@ -776,6 +930,33 @@ u_compute_hash(hash)
 u_get_undo_file_name(buf_ffname, reading)
     char_u	*buf_ffname;
     int		reading;
+{
+    return get_udir_file_name(buf_ffname, reading, "un");
+}
+
+# if defined(FEAT_SYN_HL) || defined(PROTO)
+/*
+ * Like u_get_undo_file_name(), but for the file that caches the syntax state,
+ * see 'syntaxcache'.
+ */
+    char_u *
+u_get_syntax_file_name(buf_ffname, reading)
+    char_u	*buf_ffname;
+    int		reading;
+{
+    return get_udir_file_name(buf_ffname, reading, "sy");
+}
+# endif
+
+/*
+ * Return an allocated string of the full path of a file in 'undodir' for
+ * "buf_ffname", with a name that uses "ext".
+ */
+    static char_u *
+get_udir_file_name(buf_ffname, reading, ext)
+    char_u	*buf_ffname;
+    int		reading;
+    char	*ext;
 {
     char_u	*dirp;
     char_u	dir_name[IOSIZE + 1];
@@ -818,14 +999,19 @@ u_get_undo_file_name(buf_ffname, reading)
 	     * use "dir/name" -> "dir/_un_name" - add _un_
 	     * at the beginning to keep the extension */
 	    mch_memmove(p + 4,  p, STRLEN(p) + 1);
-	    mch_memmove(p, "_un_", 4);
+	    p[0] = '_';
+	    p[1] = ext[0];
+	    p[2] = ext[1];
+	    p[3] = '_';
 
 #else
 	    /* Use same directory as the ffname,
 	     * "dir/name" -> "dir/.name.un~" */
 	    mch_memmove(p + 1, p, STRLEN(p) + 1);
 	    *p = '.';
-	    STRCAT(p, ".un~");
+	    STRCAT(p, ".");
+	    STRCAT(p, ext);
+	    STRCAT(p, "~");
 #endif
 	}
 	else
@@ -843,6 +1029,19 @@ u_get_undo_file_name(buf_ffname, reading)
 			    *p = '%';
 		}
 		undo_file_name = concat_fnames(dir_name, munged_name, TRUE);
+		/* An undo file in a directory doesn't have an extension, other
+		 * files get ".sy~" appended. */
+		if (undo_file_name != NULL && STRCMP(ext, "un") != 0)
+		{
+		    p = concat_str(undo_file_name, (char_u *)".");
+		    vim_free(undo_file_name);
+		    undo_file_name = NULL;
+		    if (p != NULL)
+		    {
+			undo_file_name = concat_str(p, (char_u *)ext);
+			vim_free(p);
+		    }
+		}
 	    }
 	}
 
@@ -1257,7 +1456,6 @@ serialize_uhp(bi, uhp)
     u_header_T	*uhp;
 {
     int		i;
-    u_entry_T	*uep;
     char_u	time_buf[8];
 
     if (undo_write_bytes(bi, (long_u)UF_HEADER_MAGIC, 2) == FAIL)
@@ -1274,7 +1472,7 @@ serialize_uhp(bi, uhp)
 #else
     undo_write_bytes(bi, (long_u)0, 4);
 #endif
-    undo_write_bytes(bi, (long_u)uhp->uh_flags, 2);
+    undo_write_bytes(bi, (long_u)(uhp->uh_flags & ~UH_UNLOADED), 2);
     /* Assume NMARKS will stay the same. */
     for (i = 0; i < NMARKS; ++i)
 	serialize_pos(bi, uhp->uh_namedm[i]);
@@ -1289,15 +1487,26 @@ serialize_uhp(bi, uhp)
 
     undo_write_bytes(bi, 0, 1);  /* end marker */
 
-    /* Write all the entries. */
+    return serialize_entries(bi, uhp);
+}
+
+/*
+ * Write all the entries of "uhp".
+ */
+    static int
+serialize_entries(bi, uhp)
+    bufinfo_T	*bi;
+    u_header_T	*uhp;
+{
+    u_entry_T	*uep;
+
     for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
     {
 	undo_write_bytes(bi, (long_u)UF_ENTRY_MAGIC, 2);
 	if (serialize_uep(bi, uep) == FAIL)
 	    return FAIL;
     }
-    undo_write_bytes(bi, (long_u)UF_ENTRY_END_MAGIC, 2);
-    return OK;
+    return undo_write_bytes(bi, (long_u)UF_ENTRY_END_MAGIC, 2);
 }
 
     static u_header_T *
@@ -1307,9 +1516,6 @@ unserialize_uhp(bi, file_name)
 {
     u_header_T	*uhp;
     int		i;
-    u_entry_T	*uep, *last_uep;
-    int		c;
-    int		error;
 
     uhp = (u_header_T *)U_ALLOC_LINE(sizeof(u_header_T));
     if (uhp == NULL)
@@ -1362,7 +1568,28 @@ unserialize_uhp(bi, file_name)
 	}
     }
 
-    /* Unserialize the uep list. */
+    if (unserialize_entries(bi, uhp, file_name) == FAIL)
+    {
+	u_free_uhp(uhp);
+	return NULL;
+    }
+    return uhp;
+}
+
+/*
+ * Read the entry list of "uhp".  On failure the entries read so far are in
+ * the list.
+ */
+    static int
+unserialize_entries(bi, uhp, file_name)
+    bufinfo_T	*bi;
+    u_header_T	*uhp;
+    char_u	*file_name;
+{
+    u_entry_T	*uep, *last_uep;
+    int		c;
+    int		error;
+
     last_uep = NULL;
     while ((c = undo_read_2c(bi)) == UF_ENTRY_MAGIC)
     {
@@ -1374,19 +1601,14 @@ unserialize_uhp(bi, file_name)
 	    last_uep->ue_next = uep;
 	last_uep = uep;
 	if (uep == NULL || error)
-	{
-	    u_free_uhp(uhp);
-	    return NULL;
-	}
+	    return FAIL;
     }
     if (c != UF_ENTRY_END_MAGIC)
     {
 	corruption_error("entry end", file_name);
-	u_free_uhp(uhp);
-	return NULL;
+	return FAIL;
     }
-
-    return uhp;
+    return OK;
 }
 
 /*
@@ -1399,6 +1621,7 @@ serialize_uep(bi, uep)
 {
     int		i;
     size_t	len;
+    char_u	*p;
 
     undo_write_bytes(bi, (long_u)uep->ue_top, 4);
     undo_write_bytes(bi, (long_u)uep->ue_bot, 4);
@@ -1406,10 +1629,28 @@ serialize_uep(bi, uep)
     undo_write_bytes(bi, (long_u)uep->ue_size, 4);
     for (i = 0; i < uep->ue_size; ++i)
     {
-	len = STRLEN(uep->ue_array[i]);
-	if (undo_write_bytes(bi, (long_u)len, 4) == FAIL)
-	    return FAIL;
-	if (len > 0 && fwrite_crypt(bi, uep->ue_array[i], len) == FAIL)
+	if (UE_IS_DELTA(uep, i))
+	{
+	    /* A line stored as a change: the length with a flag, the number
+	     * of equal bytes at the start and end, then the changed bytes. */
+	    p = UD_TEXT(uep->ue_array[i]);
+	    len = STRLEN(p);
+	    if (undo_write_bytes(bi, (long_u)len | (long_u)UF_DELTA_LINE, 4)
+									== FAIL
+		    || undo_write_bytes(bi, (long_u)((u_delta_T *)
+				     uep->ue_array[i])->ud_prefix, 4) == FAIL
+		    || undo_write_bytes(bi, (long_u)((u_delta_T *)
+				     uep->ue_array[i])->ud_suffix, 4) == FAIL)
+		return FAIL;
+	}
+	else
+	{
+	    p = uep->ue_array[i];
+	    len = STRLEN(p);
+	    if (undo_write_bytes(bi, (long_u)len, 4) == FAIL)
+		return FAIL;
+	}
+	if (len > 0 && fwrite_crypt(bi, p, len) == FAIL)
 	    return FAIL;
     }
     return OK;
@@ -1425,7 +1666,10 @@ unserialize_uep(bi, error, file_name)
     u_entry_T	*uep;
     char_u	**array;
     char_u	*line;
+    char_u	*delta;
     int		line_len;
+    colnr_T	prefix;
+    colnr_T	suffix;
 
     uep = (u_entry_T *)U_ALLOC_LINE(sizeof(u_entry_T));
     if (uep == NULL)
@@ -1455,6 +1699,49 @@ unserialize_uep(bi, error, file_name)
     for (i = 0; i < uep->ue_size; ++i)
     {
 	line_len = undo_read_4c(bi);
+	if (line_len < 0 && line_len != -1)
+	{
+	    /* Line stored as a change against the line in the buffer. */
+	    line_len &= 0x7fffffff;
+	    prefix = undo_read_4c(bi);
+	    suffix = undo_read_4c(bi);
+	    if (prefix < 0 || suffix < 0)
+	    {
+		corruption_error("line change", file_name);
+		*error = TRUE;
+		return uep;
+	    }
+	    if (uep->ue_delta == NULL)
+	    {
+		uep->ue_delta = lalloc_clear(
+				      (long_u)(uep->ue_size + 7) / 8, FALSE);
+		if (uep->ue_delta == NULL)
+		{
+		    *error = TRUE;
+		    return uep;
+		}
+	    }
+	    line = read_string_decrypt(bi, line_len);
+	    if (line == NULL)
+	    {
+		*error = TRUE;
+		return uep;
+	    }
+	    delta = U_ALLOC_LINE(sizeof(u_delta_T) + line_len + 1);
+	    if (delta == NULL)
+	    {
+		vim_free(line);
+		*error = TRUE;
+		return uep;
+	    }
+	    ((u_delta_T *)delta)->ud_prefix = prefix;
+	    ((u_delta_T *)delta)->ud_suffix = suffix;
+	    mch_memmove(UD_TEXT(delta), line, (size_t)line_len + 1);
+	    vim_free(line);
+	    array[i] = delta;
+	    uep->ue_delta[i >> 3] |= 1 << (i & 7);
+	    continue;
+	}
 	if (line_len >= 0)
 	    line = read_string_decrypt(bi, line_len);
 	else
@@ -1469,75 +1756,669 @@ unserialize_uep(bi, error, file_name)
 	}
 	array[i] = line;
     }
-    return uep;
-}
+    return uep;
+}
+
+/*
+ * Serialize "pos".
+ */
+    static void
+serialize_pos(bi, pos)
+    bufinfo_T *bi;
+    pos_T pos;
+{
+    undo_write_bytes(bi, (long_u)pos.lnum, 4);
+    undo_write_bytes(bi, (long_u)pos.col, 4);
+#ifdef FEAT_VIRTUALEDIT
+    undo_write_bytes(bi, (long_u)pos.coladd, 4);
+#else
+    undo_write_bytes(bi, (long_u)0, 4);
+#endif
+}
+
+/*
+ * Unserialize the pos_T at the current position.
+ */
+    static void
+unserialize_pos(bi, pos)
+    bufinfo_T *bi;
+    pos_T *pos;
+{
+    pos->lnum = undo_read_4c(bi);
+    if (pos->lnum < 0)
+	pos->lnum = 0;
+    pos->col = undo_read_4c(bi);
+    if (pos->col < 0)
+	pos->col = 0;
+#ifdef FEAT_VIRTUALEDIT
+    pos->coladd = undo_read_4c(bi);
+    if (pos->coladd < 0)
+	pos->coladd = 0;
+#else
+    (void)undo_read_4c(bi);
+#endif
+}
+
+/*
+ * Serialize "info".
+ */
+    static void
+serialize_visualinfo(bi, info)
+    bufinfo_T	    *bi;
+    visualinfo_T    *info;
+{
+    serialize_pos(bi, info->vi_start);
+    serialize_pos(bi, info->vi_end);
+    undo_write_bytes(bi, (long_u)info->vi_mode, 4);
+    undo_write_bytes(bi, (long_u)info->vi_curswant, 4);
+}
+
+/*
+ * Unserialize the visualinfo_T at the current position.
+ */
+    static void
+unserialize_visualinfo(bi, info)
+    bufinfo_T	    *bi;
+    visualinfo_T    *info;
+{
+    unserialize_pos(bi, &info->vi_start);
+    unserialize_pos(bi, &info->vi_end);
+    info->vi_mode = undo_read_4c(bi);
+    info->vi_curswant = undo_read_4c(bi);
+}
+
+/*
+ * When the buffer is not encrypted the undo file is a journal.  Each time it
+ * is written the headers that were added or changed since the last write are
+ * appended, followed by an index of all headers.  The file ends in the offset
+ * of that index.  When reading the file only the index is read, the cursor,
+ * marks and entries of a header are read when it is undone or redone.
+ *
+ * A header:
+ *	UF_HEADER_MAGIC, uh_seq, uh_cursor, uh_cursor_vcol, uh_namedm[],
+ *	uh_visual and the entries, as written by serialize_entries().
+ * The index:
+ *	UF_INDEX_MAGIC, hash, line count, "U" line, seq of the old, new and
+ *	current header, number of headers, seq_last, seq_cur, time_cur,
+ *	save_nr_last, then for each header in order of uh_seq:
+ *	uh_seq, uh_next, uh_prev, uh_alt_next, uh_alt_prev, uh_flags,
+ *	uh_time, uh_save_nr, offset and size of the header.
+ * At the end:
+ *	UF_INDEX_END_MAGIC, offset of the index.
+ */
+
+/*
+ * Return an allocated table with the headers of "buf", ordered on uh_seq.
+ * "*countp" is set to the number of headers.
+ * Returns NULL when there are no headers or out of memory.
+ */
+    static u_header_T **
+u_header_table(buf, countp)
+    buf_T	*buf;
+    int		*countp;
+{
+    u_header_T	**table;
+    u_header_T	*uhp;
+    int		count = 0;
+    int		mark;
+
+    *countp = 0;
+    if (buf->b_u_numhead <= 0)
+	return NULL;
+    table = (u_header_T **)alloc((unsigned)(buf->b_u_numhead
+						     * sizeof(u_header_T *)));
+    if (table == NULL)
+	return NULL;
+
+    /* Walk through the tree - algorithm from undo_time(). */
+    mark = ++lastmark;
+    uhp = buf->b_u_oldhead;
+    while (uhp != NULL)
+    {
+	if (uhp->uh_walk != mark)
+	{
+	    uhp->uh_walk = mark;
+	    if (count == buf->b_u_numhead)
+	    {
+		vim_free(table);
+		return NULL;
+	    }
+	    table[count++] = uhp;
+	}
+	if (uhp->uh_prev.ptr != NULL && uhp->uh_prev.ptr->uh_walk != mark)
+	    uhp = uhp->uh_prev.ptr;
+	else if (uhp->uh_alt_next.ptr != NULL
+				     && uhp->uh_alt_next.ptr->uh_walk != mark)
+	    uhp = uhp->uh_alt_next.ptr;
+	else if (uhp->uh_next.ptr != NULL && uhp->uh_alt_prev.ptr == NULL
+					 && uhp->uh_next.ptr->uh_walk != mark)
+	    uhp = uhp->uh_next.ptr;
+	else if (uhp->uh_alt_prev.ptr != NULL)
+	    uhp = uhp->uh_alt_prev.ptr;
+	else
+	    uhp = uhp->uh_next.ptr;
+    }
+
+    qsort((void *)table, (size_t)count, sizeof(u_header_T *), u_seq_compare);
+    *countp = count;
+    return table;
+}
+
+/*
+ * Compare two header pointers on their sequence number, for qsort().
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+u_seq_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    long	seq1 = (*(u_header_T **)s1)->uh_seq;
+    long	seq2 = (*(u_header_T **)s2)->uh_seq;
+
+    return seq1 == seq2 ? 0 : seq1 > seq2 ? 1 : -1;
+}
+
+/*
+ * Find the header with sequence number "seq" in "table", which has "count"
+ * headers ordered on uh_seq.  Returns NULL when not found.
+ */
+    static u_header_T *
+u_find_seq(table, count, seq)
+    u_header_T	**table;
+    int		count;
+    long	seq;
+{
+    int		lo = 0;
+    int		hi = count - 1;
+    int		mid;
+
+    while (lo <= hi)
+    {
+	mid = (lo + hi) / 2;
+	if (table[mid]->uh_seq == seq)
+	    return table[mid];
+	if (table[mid]->uh_seq < seq)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    return NULL;
+}
+
+/*
+ * Remember the size and time of undo file "file_name" of "buf", so that it
+ * can be checked the file wasn't changed by someone else.
+ * When "file_name" is NULL all headers are written the next time.
+ */
+    static void
+u_set_undo_file(buf, file_name)
+    buf_T	*buf;
+    char_u	*file_name;
+{
+    struct stat	st;
+
+    vim_free(buf->b_u_file);
+    buf->b_u_file = NULL;
+    if (file_name != NULL && mch_stat((char *)file_name, &st) >= 0)
+    {
+	buf->b_u_file = vim_strsave(file_name);
+	buf->b_u_file_size = st.st_size;
+	buf->b_u_file_mtime = st.st_mtime;
+    }
+}
+
+/*
+ * Return TRUE when undo file "file_name" is the file last read or written
+ * for "buf" and it was not changed since then.
+ */
+    static int
+u_same_undo_file(buf, file_name)
+    buf_T	*buf;
+    char_u	*file_name;
+{
+    struct stat	st;
+
+    return buf->b_u_file != NULL
+	    && fnamecmp(buf->b_u_file, file_name) == 0
+	    && mch_stat((char *)file_name, &st) >= 0
+	    && st.st_size == buf->b_u_file_size
+	    && st.st_mtime == buf->b_u_file_mtime;
+}
+
+/*
+ * Read the cursor, marks and entries of header "uhp" of "buf" from the undo
+ * file, when this wasn't done yet.
+ * Returns FAIL when the undo file changed or is corrupted.
+ */
+    static int
+u_load_header(buf, uhp)
+    buf_T	*buf;
+    u_header_T	*uhp;
+{
+    FILE	*fp;
+    bufinfo_T	bi;
+    u_entry_T	*uep;
+    int		i;
+    int		retval = FAIL;
+
+    if (!(uhp->uh_flags & UH_UNLOADED))
+	return OK;
+    if (buf->b_u_file == NULL || !u_same_undo_file(buf, buf->b_u_file))
+    {
+	EMSG2(_("E893: Undo file changed, cannot read undo info: %s"),
+			 buf->b_u_file == NULL ? (char_u *)"" : buf->b_u_file);
+	return FAIL;
+    }
+    fp = mch_fopen((char *)buf->b_u_file, "r");
+    if (fp == NULL)
+    {
+	EMSG2(_("E822: Cannot open undo file for reading: %s"),
+								buf->b_u_file);
+	return FAIL;
+    }
+    vim_memset(&bi, 0, sizeof(bi));
+    bi.bi_buf = buf;
+    bi.bi_fp = fp;
+
+    if (fseek(fp, uhp->uh_file_off, SEEK_SET) != 0
+	    || undo_read_2c(&bi) != UF_HEADER_MAGIC
+	    || undo_read_4c(&bi) != uhp->uh_seq)
+	corruption_error("header", buf->b_u_file);
+    else
+    {
+	unserialize_pos(&bi, &uhp->uh_cursor);
+#ifdef FEAT_VIRTUALEDIT
+	uhp->uh_cursor_vcol = undo_read_4c(&bi);
+#else
+	(void)undo_read_4c(&bi);
+#endif
+	for (i = 0; i < NMARKS; ++i)
+	    unserialize_pos(&bi, &uhp->uh_namedm[i]);
+	unserialize_visualinfo(&bi, &uhp->uh_visual);
+	retval = unserialize_entries(&bi, uhp, buf->b_u_file);
+    }
+    fclose(fp);
+
+    if (retval == FAIL)
+    {
+	/* Drop what was read, it can't be used. */
+	while ((uep = uhp->uh_entry) != NULL)
+	{
+	    uhp->uh_entry = uep->ue_next;
+	    u_freeentry(uep, uep->ue_size);
+	}
+	return FAIL;
+    }
+    uhp->uh_flags &= ~UH_UNLOADED;
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+	buf->b_u_mem += u_entry_mem(uep);
+    return OK;
+}
+
+/*
+ * Read all headers of "buf" that are still in the undo file.
+ */
+    static int
+u_load_all(buf)
+    buf_T	*buf;
+{
+    u_header_T	**table;
+    int		count;
+    int		i;
+    int		retval = OK;
+
+    table = u_header_table(buf, &count);
+    for (i = 0; i < count && retval == OK; ++i)
+	retval = u_load_header(buf, table[i]);
+    vim_free(table);
+    return retval;
+}
+
+/*
+ * Write the headers in "table" that are not in the file yet, then the index
+ * and the offset of the index.
+ * The file position must be at the end of the file.
+ */
+    static int
+serialize_journal(bi, hash, table, count)
+    bufinfo_T	*bi;
+    char_u	*hash;
+    u_header_T	**table;
+    int		count;
+{
+    buf_T	*buf = bi->bi_buf;
+    FILE	*fp = bi->bi_fp;
+    u_header_T	*uhp;
+    long	index_off;
+    int		len;
+    int		i;
+    char_u	time_buf[8];
+
+    for (i = 0; i < count; ++i)
+    {
+	uhp = table[i];
+	if (uhp->uh_file_off != 0)
+	    continue;
+	uhp->uh_file_off = ftell(fp);
+	undo_write_bytes(bi, (long_u)UF_HEADER_MAGIC, 2);
+	undo_write_bytes(bi, (long_u)uhp->uh_seq, 4);
+	serialize_pos(bi, uhp->uh_cursor);
+#ifdef FEAT_VIRTUALEDIT
+	undo_write_bytes(bi, (long_u)uhp->uh_cursor_vcol, 4);
+#else
+	undo_write_bytes(bi, (long_u)0, 4);
+#endif
+	for (len = 0; len < NMARKS; ++len)
+	    serialize_pos(bi, uhp->uh_namedm[len]);
+	serialize_visualinfo(bi, &uhp->uh_visual);
+	if (serialize_entries(bi, uhp) == FAIL)
+	{
+	    uhp->uh_file_off = 0;
+	    return FAIL;
+	}
+	uhp->uh_file_len = ftell(fp) - uhp->uh_file_off;
+    }
+
+    index_off = ftell(fp);
+    if (index_off < 0)
+	return FAIL;
+    undo_write_bytes(bi, (long_u)UF_INDEX_MAGIC, 2);
+    if (undo_write(bi, hash, (size_t)UNDO_HASH_SIZE) == FAIL)
+	return FAIL;
+    undo_write_bytes(bi, (long_u)buf->b_ml.ml_line_count, 4);
+    len = buf->b_u_line_ptr != NULL ? (int)STRLEN(buf->b_u_line_ptr) : 0;
+    undo_write_bytes(bi, (long_u)len, 4);
+    if (len > 0 && undo_write(bi, buf->b_u_line_ptr, (size_t)len) == FAIL)
+	return FAIL;
+    undo_write_bytes(bi, (long_u)buf->b_u_line_lnum, 4);
+    undo_write_bytes(bi, (long_u)buf->b_u_line_colnr, 4);
+    put_header_ptr(bi, buf->b_u_oldhead);
+    put_header_ptr(bi, buf->b_u_newhead);
+    put_header_ptr(bi, buf->b_u_curhead);
+    undo_write_bytes(bi, (long_u)count, 4);
+    undo_write_bytes(bi, (long_u)buf->b_u_seq_last, 4);
+    undo_write_bytes(bi, (long_u)buf->b_u_seq_cur, 4);
+    time_to_bytes(buf->b_u_time_cur, time_buf);
+    undo_write(bi, time_buf, 8);
+    undo_write_bytes(bi, (long_u)buf->b_u_save_nr_last, 4);
+
+    for (i = 0; i < count; ++i)
+    {
+	uhp = table[i];
+	undo_write_bytes(bi, (long_u)uhp->uh_seq, 4);
+	put_header_ptr(bi, uhp->uh_next.ptr);
+	put_header_ptr(bi, uhp->uh_prev.ptr);
+	put_header_ptr(bi, uhp->uh_alt_next.ptr);
+	put_header_ptr(bi, uhp->uh_alt_prev.ptr);
+	undo_write_bytes(bi, (long_u)(uhp->uh_flags & ~UH_UNLOADED), 2);
+	time_to_bytes(uhp->uh_time, time_buf);
+	undo_write(bi, time_buf, 8);
+	undo_write_bytes(bi, (long_u)uhp->uh_save_nr, 4);
+	undo_write_bytes(bi, (long_u)uhp->uh_file_off, 4);
+	if (undo_write_bytes(bi, (long_u)uhp->uh_file_len, 4) == FAIL)
+	    return FAIL;
+    }
+
+    undo_write_bytes(bi, (long_u)UF_INDEX_END_MAGIC, 2);
+    return undo_write_bytes(bi, (long_u)index_off, 4);
+}
+
+/*
+ * Read the index of an undo file written by serialize_journal() and use it
+ * for the undo tree of the current buffer.
+ * Returns FAIL when the file can't be used.
+ */
+    static int
+unserialize_journal(bi, hash, name, file_name)
+    bufinfo_T	*bi;
+    char_u	*hash;
+    char_u	*name;
+    char_u	*file_name;
+{
+    FILE	*fp = bi->bi_fp;
+    long	index_off;
+    char_u	read_hash[UNDO_HASH_SIZE];
+    linenr_T	line_count;
+    char_u	*line_ptr = NULL;
+    long	str_len;
+    linenr_T	line_lnum;
+    colnr_T	line_colnr;
+    long	old_header_seq, new_header_seq, cur_header_seq;
+    long	seq_last, seq_cur;
+    time_t	seq_time;
+    long	last_save_nr;
+    int		num_head;
+    int		num_read = 0;
+    u_header_T	**table = NULL;
+    u_header_T	*uhp;
+    int		i;
+
+    if (fseek(fp, -(long)UF_FOOTER_LEN, SEEK_END) != 0
+				  || undo_read_2c(bi) != UF_INDEX_END_MAGIC)
+    {
+	corruption_error("index end", file_name);
+	return FAIL;
+    }
+    index_off = undo_read_4c(bi);
+    if (index_off <= 0 || fseek(fp, index_off, SEEK_SET) != 0
+				      || undo_read_2c(bi) != UF_INDEX_MAGIC)
+    {
+	corruption_error("index", file_name);
+	return FAIL;
+    }
+
+    if (undo_read(bi, read_hash, (size_t)UNDO_HASH_SIZE) == FAIL)
+    {
+	corruption_error("hash", file_name);
+	return FAIL;
+    }
+    line_count = (linenr_T)undo_read_4c(bi);
+    if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
+				  || line_count != curbuf->b_ml.ml_line_count)
+    {
+	if (p_verbose > 0 || name != NULL)
+	{
+	    if (name == NULL)
+		verbose_enter();
+	    give_warning((char_u *)
+		      _("File contents changed, cannot use undo info"), TRUE);
+	    if (name == NULL)
+		verbose_leave();
+	}
+	return FAIL;
+    }
+
+    /* Read undo data for "U" command. */
+    str_len = undo_read_4c(bi);
+    if (str_len < 0)
+	return FAIL;
+    if (str_len > 0)
+	line_ptr = read_string_decrypt(bi, str_len);
+    line_lnum = (linenr_T)undo_read_4c(bi);
+    line_colnr = (colnr_T)undo_read_4c(bi);
+    if (line_lnum < 0 || line_colnr < 0)
+    {
+	corruption_error("line lnum/col", file_name);
+	goto error;
+    }
+
+    old_header_seq = undo_read_4c(bi);
+    new_header_seq = undo_read_4c(bi);
+    cur_header_seq = undo_read_4c(bi);
+    num_head = undo_read_4c(bi);
+    seq_last = undo_read_4c(bi);
+    seq_cur = undo_read_4c(bi);
+    seq_time = undo_read_time(bi);
+    last_save_nr = undo_read_4c(bi);
+    if (num_head < 0)
+    {
+	corruption_error("num_head", file_name);
+	goto error;
+    }
+
+    if (num_head > 0)
+    {
+	table = (u_header_T **)U_ALLOC_LINE(num_head * sizeof(u_header_T *));
+	if (table == NULL)
+	    goto error;
+    }
+    for (num_read = 0; num_read < num_head; ++num_read)
+    {
+	uhp = (u_header_T *)U_ALLOC_LINE(sizeof(u_header_T));
+	if (uhp == NULL)
+	    goto error;
+	vim_memset(uhp, 0, sizeof(u_header_T));
+#ifdef U_DEBUG
+	uhp->uh_magic = UH_MAGIC;
+#endif
+	table[num_read] = uhp;
+	uhp->uh_seq = undo_read_4c(bi);
+	uhp->uh_next.seq = undo_read_4c(bi);
+	uhp->uh_prev.seq = undo_read_4c(bi);
+	uhp->uh_alt_next.seq = undo_read_4c(bi);
+	uhp->uh_alt_prev.seq = undo_read_4c(bi);
+	uhp->uh_flags = undo_read_2c(bi) | UH_UNLOADED;
+	uhp->uh_time = undo_read_time(bi);
+	uhp->uh_save_nr = undo_read_4c(bi);
+	uhp->uh_file_off = undo_read_4c(bi);
+	uhp->uh_file_len = undo_read_4c(bi);
+	if (uhp->uh_seq <= 0 || uhp->uh_file_off <= 0
+		|| uhp->uh_file_off >= index_off
+		|| (num_read > 0 && uhp->uh_seq <= table[num_read - 1]->uh_seq))
+	{
+	    ++num_read;
+	    corruption_error("uh_seq", file_name);
+	    goto error;
+	}
+    }
 
-/*
- * Serialize "pos".
- */
-    static void
-serialize_pos(bi, pos)
-    bufinfo_T *bi;
-    pos_T pos;
-{
-    undo_write_bytes(bi, (long_u)pos.lnum, 4);
-    undo_write_bytes(bi, (long_u)pos.col, 4);
-#ifdef FEAT_VIRTUALEDIT
-    undo_write_bytes(bi, (long_u)pos.coladd, 4);
-#else
-    undo_write_bytes(bi, (long_u)0, 4);
-#endif
-}
+    /* Turn the sequence numbers into pointers, the table is ordered on
+     * uh_seq. */
+    for (i = 0; i < num_head; ++i)
+    {
+	uhp = table[i];
+	uhp->uh_next.ptr = u_find_seq(table, num_head, uhp->uh_next.seq);
+	uhp->uh_prev.ptr = u_find_seq(table, num_head, uhp->uh_prev.seq);
+	uhp->uh_alt_next.ptr = u_find_seq(table, num_head,
+						       uhp->uh_alt_next.seq);
+	uhp->uh_alt_prev.ptr = u_find_seq(table, num_head,
+						       uhp->uh_alt_prev.seq);
+    }
 
-/*
- * Unserialize the pos_T at the current position.
- */
-    static void
-unserialize_pos(bi, pos)
-    bufinfo_T *bi;
-    pos_T *pos;
-{
-    pos->lnum = undo_read_4c(bi);
-    if (pos->lnum < 0)
-	pos->lnum = 0;
-    pos->col = undo_read_4c(bi);
-    if (pos->col < 0)
-	pos->col = 0;
-#ifdef FEAT_VIRTUALEDIT
-    pos->coladd = undo_read_4c(bi);
-    if (pos->coladd < 0)
-	pos->coladd = 0;
-#else
-    (void)undo_read_4c(bi);
+    u_blockfree(curbuf);
+    curbuf->b_u_oldhead = u_find_seq(table, num_head, old_header_seq);
+    curbuf->b_u_newhead = u_find_seq(table, num_head, new_header_seq);
+    curbuf->b_u_curhead = u_find_seq(table, num_head, cur_header_seq);
+    curbuf->b_u_line_ptr = line_ptr;
+    curbuf->b_u_line_lnum = line_lnum;
+    curbuf->b_u_line_colnr = line_colnr;
+    curbuf->b_u_numhead = num_head;
+    curbuf->b_u_seq_last = seq_last;
+    curbuf->b_u_seq_cur = seq_cur;
+    curbuf->b_u_time_cur = seq_time;
+    curbuf->b_u_save_nr_last = last_save_nr;
+    curbuf->b_u_save_nr_cur = last_save_nr;
+    curbuf->b_u_mem = num_head * sizeof(u_header_T);
+    curbuf->b_u_synced = TRUE;
+    u_set_undo_file(curbuf, file_name);
+    vim_free(table);
+#ifdef U_DEBUG
+    u_check(TRUE);
 #endif
-}
+    return OK;
 
-/*
- * Serialize "info".
- */
-    static void
-serialize_visualinfo(bi, info)
-    bufinfo_T	    *bi;
-    visualinfo_T    *info;
-{
-    serialize_pos(bi, info->vi_start);
-    serialize_pos(bi, info->vi_end);
-    undo_write_bytes(bi, (long_u)info->vi_mode, 4);
-    undo_write_bytes(bi, (long_u)info->vi_curswant, 4);
+error:
+    vim_free(line_ptr);
+    for (i = 0; i < num_read; ++i)
+	vim_free(table[i]);
+    vim_free(table);
+    return FAIL;
 }
 
 /*
- * Unserialize the visualinfo_T at the current position.
+ * Add the headers of "buf" that changed since the undo file was written to
+ * undo file "file_name".  Only possible when the file was read or written
+ * for "buf" before and did not change since then.  When the file contains
+ * more old headers than current ones FAIL is returned to have it written
+ * again.
+ * Returns FAIL when the whole file must be written.
  */
-    static void
-unserialize_visualinfo(bi, info)
-    bufinfo_T	    *bi;
-    visualinfo_T    *info;
+    static int
+u_append_undo(buf, file_name, hash)
+    buf_T	*buf;
+    char_u	*file_name;
+    char_u	*hash;
 {
-    unserialize_pos(bi, &info->vi_start);
-    unserialize_pos(bi, &info->vi_end);
-    info->vi_mode = undo_read_4c(bi);
-    info->vi_curswant = undo_read_4c(bi);
+    u_header_T	**table;
+    int		count;
+    int		i;
+    long	used = 0;
+    int		fd;
+    FILE	*fp;
+    bufinfo_T	bi;
+    char_u	magic_buf[UF_START_MAGIC_LEN];
+    int		retval;
+
+    if (buf->b_u_numhead == 0 || !u_same_undo_file(buf, file_name))
+	return FAIL;
+
+    /* Undo must be synced. */
+    u_sync(TRUE);
+
+    table = u_header_table(buf, &count);
+    if (table == NULL)
+	return FAIL;
+    /* Only count headers that are in the file, a changed header will be
+     * appended. */
+    for (i = 0; i < count; ++i)
+	if (table[i]->uh_file_off != 0)
+	    used += table[i]->uh_file_len;
+    if (buf->b_u_file_size - used > used)
+    {
+	/* More than half of the file is unused, write it again. */
+	vim_free(table);
+	return FAIL;
+    }
+
+    fd = mch_open((char *)file_name, O_RDWR|O_EXTRA|O_NOFOLLOW, 0);
+    fp = fd < 0 ? NULL : fdopen(fd, "r+");
+    if (fp == NULL)
+    {
+	if (fd >= 0)
+	    close(fd);
+	vim_free(table);
+	return FAIL;
+    }
+    /* A file with the hash over all lines is written again. */
+    if (fread(magic_buf, UF_START_MAGIC_LEN, 1, fp) != 1
+	    || memcmp(magic_buf, UF_START_MAGIC, UF_START_MAGIC_LEN) != 0
+	    || get2c(fp) != UF_VERSION_JOURNAL)
+    {
+	fclose(fp);
+	vim_free(table);
+	return FAIL;
+    }
+    if (p_verbose > 0)
+    {
+	verbose_enter();
+	smsg((char_u *)_("Appending to undo file: %s"), file_name);
+	verbose_leave();
+    }
+    vim_memset(&bi, 0, sizeof(bi));
+    bi.bi_buf = buf;
+    bi.bi_fp = fp;
+    retval = fseek(fp, 0L, SEEK_END) == 0
+		   ? serialize_journal(&bi, hash, table, count) : FAIL;
+    if (fclose(fp) != 0)
+	retval = FAIL;
+    vim_free(table);
+    /* When appending failed the headers that were in the file can still be
+     * read, the whole file will be written. */
+    u_set_undo_file(buf, file_name);
+    return retval;
 }
 
 /*
@@ -1572,6 +2453,7 @@ u_write_undo(name, forceit, buf, hash)
     struct stat	st_new;
 #endif
     bufinfo_T	bi;
+    char_u	line_hash[UNDO_HASH_SIZE];
 
     vim_memset(&bi, 0, sizeof(bi));
 
@@ -1593,6 +2475,19 @@ u_write_undo(name, forceit, buf, hash)
     else
 	file_name = name;
 
+    /* Only add what changed when the file was written before.  Not when
+     * encrypting, then the whole file is written. */
+#ifdef FEAT_CRYPT
+    if (*buf->b_p_key == NUL)
+#endif
+	if (u_append_undo(buf, file_name, hash) == OK)
+	    goto theend;
+
+    /* The whole file is written, first get the headers that are still in
+     * the old file. */
+    if (u_load_all(buf) == FAIL)
+	goto theend;
+
     /*
      * Decide about the permission to use for the undo file.  If the buffer
      * has a name use the permission of the original file.  Otherwise only
@@ -1727,12 +2622,37 @@ u_write_undo(name, forceit, buf, hash)
     /* Undo must be synced. */
     u_sync(TRUE);
 
-    /*
-     * Write the header.  Initializes encryption, if enabled.
-     */
     bi.bi_buf = buf;
     bi.bi_fp = fp;
-    if (serialize_header(&bi, hash) == FAIL)
+#ifdef FEAT_CRYPT
+    if (*buf->b_p_key == NUL)
+#endif
+    {
+	u_header_T	**table;
+	int		count;
+	int		i;
+
+	/* Write all the headers and the index. */
+	table = u_header_table(buf, &count);
+	if (count != buf->b_u_numhead)
+	    goto write_error;
+	for (i = 0; i < count; ++i)
+	    U_HEADER_CHANGED(table[i]);
+	if (fwrite(UF_START_MAGIC, (size_t)UF_START_MAGIC_LEN, (size_t)1, fp)
+									   == 1
+		&& undo_write_bytes(&bi, (long_u)UF_VERSION_JOURNAL, 2) == OK
+		&& serialize_journal(&bi, hash, table, count) == OK)
+	    write_ok = TRUE;
+	vim_free(table);
+	goto write_error;
+    }
+
+    /*
+     * Write the header.  Initializes encryption, if enabled.  The encrypted
+     * file uses the hash over all lines.
+     */
+    u_compute_line_hash(buf, line_hash);
+    if (serialize_header(&bi, line_hash) == FAIL)
 	goto write_error;
 
     /*
@@ -1784,9 +2704,15 @@ u_write_undo(name, forceit, buf, hash)
 #endif
 
 write_error:
-    fclose(fp);
+    if (fclose(fp) != 0)
+	write_ok = FALSE;
     if (!write_ok)
 	EMSG2(_("E829: write error in undo file: %s"), file_name);
+    u_set_undo_file(buf, write_ok
+#ifdef FEAT_CRYPT
+	    && *buf->b_p_key == NUL
+#endif
+	    ? file_name : NULL);
 
 #if defined(MACOS_CLASSIC) || defined(WIN3264)
     /* Copy file attributes; for systems where this can only be done after
@@ -1846,8 +2772,10 @@ u_read_undo(name, hash, orig_name)
     int		i, j;
     int		c;
     u_header_T	*uhp;
+    u_entry_T	*uep;
     u_header_T	**uhp_table = NULL;
     char_u	read_hash[UNDO_HASH_SIZE];
+    char_u	line_hash[UNDO_HASH_SIZE];
     char_u	magic_buf[UF_START_MAGIC_LEN];
 #ifdef U_DEBUG
     int		*uhp_table_used;
@@ -1914,7 +2842,19 @@ u_read_undo(name, hash, orig_name)
 	goto error;
     }
     version = get2c(fp);
-    if (version == UF_VERSION_CRYPT)
+    if (version == UF_VERSION_JOURNAL || version == UF_VERSION_OLD_JOURNAL)
+    {
+	if (version == UF_VERSION_OLD_JOURNAL)
+	{
+	    u_compute_line_hash(curbuf, line_hash);
+	    hash = line_hash;
+	}
+	if (unserialize_journal(&bi, hash, name, file_name) == OK
+							     && name != NULL)
+	    smsg((char_u *)_("Finished reading undo file %s"), file_name);
+	goto theend;
+    }
+    if (version == UF_VERSION_CRYPT || version == UF_VERSION_OLD_CRYPT)
     {
 #ifdef FEAT_CRYPT
 	if (*curbuf->b_p_key == NUL)
@@ -1946,7 +2886,7 @@ u_read_undo(name, hash, orig_name)
 	goto error;
 #endif
     }
-    else if (version != UF_VERSION)
+    else if (version != UF_VERSION && version != UF_VERSION_OLD)
     {
 	EMSG2(_("E824: Incompatible undo file: %s"), file_name);
 	goto error;
@@ -1958,7 +2898,8 @@ u_read_undo(name, hash, orig_name)
 	goto error;
     }
     line_count = (linenr_T)undo_read_4c(&bi);
-    if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
+    u_compute_line_hash(curbuf, line_hash);
+    if (memcmp(line_hash, read_hash, UNDO_HASH_SIZE) != 0
 				  || line_count != curbuf->b_ml.ml_line_count)
     {
 	if (p_verbose > 0 || name != NULL)
@@ -2141,6 +3082,12 @@ u_read_undo(name, hash, orig_name)
     curbuf->b_u_time_cur = seq_time;
     curbuf->b_u_save_nr_last = last_save_nr;
     curbuf->b_u_save_nr_cur = last_save_nr;
+    for (i = 0; i < num_head; ++i)
+    {
+	curbuf->b_u_mem += sizeof(u_header_T);
+	for (uep = uhp_table[i]->uh_entry; uep != NULL; uep = uep->ue_next)
+	    curbuf->b_u_mem += u_entry_mem(uep);
+    }
 
     curbuf->b_u_synced = TRUE;
     vim_free(uhp_table);
@@ -2673,6 +3620,17 @@ u_undoredo(undo)
 #ifdef U_DEBUG
     u_check(FALSE);
 #endif
+#ifdef FEAT_PERSISTENT_UNDO
+    /* Get the entries from the undo file when not done yet. */
+    if (u_load_header(curbuf, curhead) == FAIL)
+    {
+# ifdef FEAT_AUTOCMD
+	unblock_autocmds();
+# endif
+	return;
+    }
+#endif
+    U_HEADER_CHANGED(curhead);
     old_flags = curhead->uh_flags;
     new_flags = (curbuf->b_changed ? UH_CHANGED : 0) +
 	       ((curbuf->b_ml.ml_flags & ML_EMPTY) ? UH_EMPTYBUF : 0);
@@ -2708,6 +3666,20 @@ u_undoredo(undo)
 	oldsize = bot - top - 1;    /* number of lines before undo */
 	newsize = uep->ue_size;	    /* number of lines after undo */
 
+	/* Lines stored as a change need the lines in the buffer now. */
+	curbuf->b_u_mem -= u_entry_mem(uep);
+	if (uep->ue_delta != NULL
+		   && (oldsize != newsize || u_decode_entry(uep) == FAIL))
+	{
+	    curbuf->b_u_mem += u_entry_mem(uep);
+#ifdef FEAT_AUTOCMD
+	    unblock_autocmds();
+#endif
+	    EMSG(_("E438: u_undo: line numbers wrong"));
+	    changed();		/* don't want UNCHANGED now */
+	    return;
+	}
+
 	if (top < newlnum)
 	{
 	    /* If the saved cursor is somewhere in this undo block, move it to
@@ -2758,27 +3730,44 @@ u_undoredo(undo)
 		    nuep = uep->ue_next;
 		    u_freeentry(uep, uep->ue_size);
 		    uep = nuep;
+		    if (uep != NULL)
+			curbuf->b_u_mem -= u_entry_mem(uep);
 		}
 		break;
 	    }
-	    /* delete backwards, it goes faster in most cases */
-	    for (lnum = bot - 1, i = oldsize; --i >= 0; --lnum)
+	    if (oldsize == newsize)
+	    {
+		/* Same number of lines: replace them, that is a lot faster
+		 * than deleting and appending them. */
+		for (lnum = top + 1, i = 0; i < oldsize; ++i, ++lnum)
+		{
+		    if ((newarray[i] = u_save_line(lnum)) == NULL)
+			do_outofmem_msg((long_u)0);
+		    ml_replace(lnum, uep->ue_array[i], FALSE);
+		}
+		vim_free((char_u *)uep->ue_array);
+	    }
+	    else
 	    {
-		/* what can we do when we run out of memory? */
-		if ((newarray[i] = u_save_line(lnum)) == NULL)
-		    do_outofmem_msg((long_u)0);
-		/* remember we deleted the last line in the buffer, and a
-		 * dummy empty line will be inserted */
-		if (curbuf->b_ml.ml_line_count == 1)
-		    empty_buffer = TRUE;
-		ml_delete(lnum, FALSE);
+		/* delete backwards, it goes faster in most cases */
+		for (lnum = bot - 1, i = oldsize; --i >= 0; --lnum)
+		{
+		    /* what can we do when we run out of memory? */
+		    if ((newarray[i] = u_save_line(lnum)) == NULL)
+			do_outofmem_msg((long_u)0);
+		    /* remember we deleted the last line in the buffer, and a
+		     * dummy empty line will be inserted */
+		    if (curbuf->b_ml.ml_line_count == 1)
+			empty_buffer = TRUE;
+		    ml_delete(lnum, FALSE);
+		}
 	    }
 	}
 	else
 	    newarray = NULL;
 
 	/* insert the lines in u_array between top and bot */
-	if (newsize)
+	if (newsize && oldsize != newsize)
 	{
 	    for (lnum = top, i = 0; i < newsize; ++i, ++lnum)
 	    {
@@ -2819,8 +3808,10 @@ u_undoredo(undo)
 	u_newcount += newsize;
 	u_oldcount += oldsize;
 	uep->ue_size = oldsize;
+	uep->ue_alloc = 0;
 	uep->ue_array = newarray;
 	uep->ue_bot = top + newsize + 1;
+	curbuf->b_u_mem += u_entry_mem(uep);
 
 	/*
 	 * insert this entry in front of the new entry list
@@ -2832,6 +3823,7 @@ u_undoredo(undo)
 
     curhead->uh_entry = newlist;
     curhead->uh_flags = new_flags;
+    u_compress_header(curhead);
     if ((old_flags & UH_EMPTYBUF) && bufempty())
 	curbuf->b_ml.ml_flags |= ML_EMPTY;
     if (old_flags & UH_CHANGED)
@@ -3032,6 +4024,8 @@ u_sync(force)
     {
 	u_getbot();		    /* compute ue_bot of previous u_save */
 	curbuf->b_u_curhead = NULL;
+	if (curbuf->b_u_newhead != NULL)
+	    u_compress_header(curbuf->b_u_newhead);
     }
 }
 
@@ -3190,7 +4184,13 @@ ex_undojoin(eap)
 	return;		    /* no entries, nothing to do */
     else
     {
-	/* Go back to the last entry */
+	/* Go back to the last entry.  Entries may be extended, the lines
+	 * must not be stored as a change. */
+#ifdef FEAT_PERSISTENT_UNDO
+	if (u_load_header(curbuf, curbuf->b_u_newhead) == FAIL)
+	    return;
+#endif
+	u_expand_header(curbuf->b_u_newhead);
 	curbuf->b_u_curhead = curbuf->b_u_newhead;
 	curbuf->b_u_synced = FALSE;  /* no entries, nothing to do */
     }
@@ -3221,11 +4221,16 @@ u_find_first_changed()
 
     if (curbuf->b_u_curhead != NULL || uhp == NULL)
 	return;  /* undid something in an autocmd? */
+#ifdef FEAT_PERSISTENT_UNDO
+    if (u_load_header(curbuf, uhp) == FAIL)
+	return;
+#endif
 
     /* Check that the last undo block was for the whole file. */
     uep = uhp->uh_entry;
     if (uep->ue_top != 0 || uep->ue_bot != 0)
 	return;
+    u_expand_header(uhp);
 
     for (lnum = 1; lnum < curbuf->b_ml.ml_line_count
 					      && lnum <= uep->ue_size; ++lnum)
@@ -3234,6 +4239,7 @@ u_find_first_changed()
 	{
 	    clearpos(&(uhp->uh_cursor));
 	    uhp->uh_cursor.lnum = lnum;
+	    U_HEADER_CHANGED(uhp);
 	    return;
 	}
     if (curbuf->b_ml.ml_line_count != uep->ue_size)
@@ -3241,6 +4247,7 @@ u_find_first_changed()
 	/* lines added or deleted at the end, put the cursor there */
 	clearpos(&(uhp->uh_cursor));
 	uhp->uh_cursor.lnum = lnum;
+	U_HEADER_CHANGED(uhp);
     }
 }
 
@@ -3328,6 +4335,7 @@ u_getbot()
 	}
 
 	curbuf->b_u_newhead->uh_getbot_entry = NULL;
+	U_HEADER_CHANGED(curbuf->b_u_newhead);
     }
 
     curbuf->b_u_synced = TRUE;
@@ -3425,6 +4433,7 @@ u_freeentries(buf, uhp, uhpp)
     for (uep = uhp->uh_entry; uep != NULL; uep = nuep)
     {
 	nuep = uep->ue_next;
+	buf->b_u_mem -= u_entry_mem(uep);
 	u_freeentry(uep, uep->ue_size);
     }
 
@@ -3433,6 +4442,7 @@ u_freeentries(buf, uhp, uhpp)
 #endif
     vim_free((char_u *)uhp);
     --buf->b_u_numhead;
+    buf->b_u_mem -= sizeof(u_header_T);
 }
 
 /*
@@ -3446,12 +4456,194 @@ u_freeentry(uep, n)
     while (n > 0)
 	vim_free(uep->ue_array[--n]);
     vim_free((char_u *)uep->ue_array);
+    vim_free(uep->ue_delta);
 #ifdef U_DEBUG
     uep->ue_magic = 0;
 #endif
     vim_free((char_u *)uep);
 }
 
+/*
+ * Return the number of bytes used for entry "uep" and its lines.
+ */
+    static long_u
+u_entry_mem(uep)
+    u_entry_T	*uep;
+{
+    long_u	mem = sizeof(u_entry_T);
+    long	i;
+
+    if (uep->ue_array != NULL)
+	mem += uep->ue_size * sizeof(char_u *);
+    if (uep->ue_delta != NULL)
+	mem += (uep->ue_size + 7) / 8;
+    for (i = 0; i < uep->ue_size && uep->ue_array != NULL; ++i)
+    {
+	if (uep->ue_array[i] == NULL)
+	    break;
+	if (UE_IS_DELTA(uep, i))
+	    mem += sizeof(u_delta_T) + STRLEN(UD_TEXT(uep->ue_array[i])) + 1;
+	else
+	    mem += STRLEN(uep->ue_array[i]) + 1;
+    }
+    return mem;
+}
+
+/*
+ * Store the lines of "uep" that differ only a bit from the lines in the
+ * buffer at the same position as the bytes that differ.
+ */
+    static void
+u_encode_entry(uep)
+    u_entry_T	*uep;
+{
+    long	i;
+    char_u	*line;
+    char_u	*text;
+    char_u	*p;
+    size_t	len;
+    size_t	text_len;
+    size_t	prefix;
+    size_t	suffix;
+
+    for (i = 0; i < uep->ue_size; ++i)
+    {
+	if (UE_IS_DELTA(uep, i))
+	    continue;
+	line = uep->ue_array[i];
+	text = ml_get(uep->ue_top + 1 + i);
+	len = STRLEN(line);
+	text_len = STRLEN(text);
+	for (prefix = 0; prefix < len && prefix < text_len
+					   && line[prefix] == text[prefix]; ++prefix)
+	    ;
+	for (suffix = 0; suffix < len - prefix && suffix < text_len - prefix
+		   && line[len - suffix - 1] == text[text_len - suffix - 1];
+								     ++suffix)
+	    ;
+	/* Not worth it when the header is bigger than what is saved. */
+	if (prefix + suffix <= sizeof(u_delta_T))
+	    continue;
+
+	if (uep->ue_delta == NULL)
+	{
+	    uep->ue_delta = lalloc_clear((long_u)(uep->ue_size + 7) / 8,
+									FALSE);
+	    if (uep->ue_delta == NULL)
+		return;
+	}
+	p = U_ALLOC_LINE(sizeof(u_delta_T) + len - prefix - suffix + 1);
+	if (p == NULL)
+	    return;
+	((u_delta_T *)p)->ud_prefix = (colnr_T)prefix;
+	((u_delta_T *)p)->ud_suffix = (colnr_T)suffix;
+	vim_strncpy(UD_TEXT(p), line + prefix, len - prefix - suffix);
+	vim_free(line);
+	uep->ue_array[i] = p;
+	uep->ue_delta[i >> 3] |= 1 << (i & 7);
+    }
+}
+
+/*
+ * Turn the lines of "uep" that are stored as a change back into whole lines,
+ * using the lines in the buffer at the same position.
+ * Returns FAIL when a line doesn't fit or out of memory.
+ */
+    static int
+u_decode_entry(uep)
+    u_entry_T	*uep;
+{
+    long	i;
+    u_delta_T	*dp;
+    char_u	*line;
+    char_u	*text;
+    size_t	len;
+    size_t	text_len;
+
+    for (i = 0; i < uep->ue_size; ++i)
+    {
+	if (!UE_IS_DELTA(uep, i))
+	    continue;
+	dp = (u_delta_T *)uep->ue_array[i];
+	text = ml_get(uep->ue_top + 1 + i);
+	text_len = STRLEN(text);
+	if ((size_t)dp->ud_prefix + dp->ud_suffix > text_len)
+	    return FAIL;
+	len = STRLEN(UD_TEXT(dp));
+	line = U_ALLOC_LINE(dp->ud_prefix + len + dp->ud_suffix + 1);
+	if (line == NULL)
+	    return FAIL;
+	mch_memmove(line, text, (size_t)dp->ud_prefix);
+	mch_memmove(line + dp->ud_prefix, UD_TEXT(dp), len);
+	mch_memmove(line + dp->ud_prefix + len,
+			  text + text_len - dp->ud_suffix, dp->ud_suffix + 1);
+	vim_free(dp);
+	uep->ue_array[i] = line;
+	uep->ue_delta[i >> 3] &= ~(1 << (i & 7));
+    }
+    vim_free(uep->ue_delta);
+    uep->ue_delta = NULL;
+    return OK;
+}
+
+/*
+ * Store the lines of the entries of "uhp" that were changed in place as a
+ * change against the buffer text.  Must be called when the buffer text is
+ * what undoing or redoing "uhp" starts with.
+ * An entry is only done when the entries applied before it don't touch its
+ * lines, thus they are the same as now when the entry is applied.  Entries
+ * after one that changes the number of lines are skipped, their line numbers
+ * are only valid after it.
+ */
+    static void
+u_compress_header(uhp)
+    u_header_T	*uhp;
+{
+    u_entry_T	*uep;
+    linenr_T	bot;
+    linenr_T	lo = MAXLNUM;	/* range of lines of earlier entries */
+    linenr_T	hi = 0;
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+    {
+	bot = uep->ue_bot == 0 ? curbuf->b_ml.ml_line_count + 1 : uep->ue_bot;
+	if (bot > curbuf->b_ml.ml_line_count + 1
+				    || bot - uep->ue_top - 1 != uep->ue_size)
+	    break;
+	if (uep->ue_size > 0 && (uep->ue_top + uep->ue_size < lo
+						    || uep->ue_top + 1 > hi))
+	{
+	    curbuf->b_u_mem -= u_entry_mem(uep);
+	    u_encode_entry(uep);
+	    curbuf->b_u_mem += u_entry_mem(uep);
+	}
+	if (uep->ue_top + 1 < lo)
+	    lo = uep->ue_top + 1;
+	if (uep->ue_top + uep->ue_size > hi)
+	    hi = uep->ue_top + uep->ue_size;
+    }
+}
+
+/*
+ * Turn all the lines of "uhp" stored as a change back into whole lines.  Must
+ * be called with the same buffer text as when u_compress_header() was.
+ */
+    static void
+u_expand_header(uhp)
+    u_header_T	*uhp;
+{
+    u_entry_T	*uep;
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+	if (uep->ue_delta != NULL)
+	{
+	    curbuf->b_u_mem -= u_entry_mem(uep);
+	    if (u_decode_entry(uep) == FAIL)
+		EMSG(_("E439: undo list corrupt"));
+	    curbuf->b_u_mem += u_entry_mem(uep);
+	}
+}
+
 /*
  * invalidate the undo buffer; called when storage has already been released
  */
@@ -3462,6 +4654,7 @@ u_clearall(buf)
     buf->b_u_newhead = buf->b_u_oldhead = buf->b_u_curhead = NULL;
     buf->b_u_synced = TRUE;
     buf->b_u_numhead = 0;
+    buf->b_u_mem = 0;
     buf->b_u_line_ptr = NULL;
     buf->b_u_line_lnum = 0;
 }
@@ -3557,6 +4750,10 @@ u_blockfree(buf)
     while (buf->b_u_oldhead != NULL)
 	u_freeheader(buf, buf->b_u_oldhead, NULL);
     vim_free(buf->b_u_line_ptr);
+#ifdef FEAT_PERSISTENT_UNDO
+    vim_free(buf->b_u_file);
+    buf->b_u_file = NULL;
+#endif
 }
 
 /*
@@ -347,6 +347,11 @@ static char *(features[]) =
 #else
 	"-mksession",
 #endif
+#ifdef FEAT_MMAP
+	"+mmap",
+#else
+	"-mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"+modify_fname",
 #else
@@ -513,6 +518,11 @@ static char *(features[]) =
 #else
 	"-quickfix",
 #endif
+#ifdef FEAT_RE_CACHE
+	"+regexp_cache",
+#else
+	"-regexp_cache",
+#endif
 #ifdef FEAT_RELTIME
 	"+reltime",
 #else
@@ -552,6 +562,11 @@ static char *(features[]) =
 #else
 	"-sniff",
 #endif
+#ifdef FEAT_SORT_THREAD
+	"+sortthread",
+#else
+	"-sortthread",
+#endif
 #ifdef STARTUPTIME
 	"+startuptime",
 #else
@@ -567,6 +582,11 @@ static char *(features[]) =
 #else
 	"-sun_workshop",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"+swapthread",
+#else
+	"-swapthread",
+#endif
 #ifdef FEAT_SYN_HL
 	"+syntax",
 #else
@@ -644,6 +664,11 @@ static char *(features[]) =
 #else
 	"-vertsplit",
 #endif
+#ifdef FEAT_VIMGREP_THREAD
+	"+vimgrepthread",
+#else
+	"-vimgrepthread",
+#endif
 #ifdef FEAT_VIRTUALEDIT
 	"+virtualedit",
 #else
@@ -990,6 +990,12 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 #define READ_DUMMY	0x10	/* reading into a dummy buffer */
 #define READ_KEEP_UNDO	0x20	/* keep undo info*/
 
+/* Values for readfile_unchanged_how() */
+#define RU_NEVER	0	/* text is always changed */
+#define RU_ASCII	1	/* ASCII text is unchanged */
+#define RU_UTF8		2	/* valid UTF-8 is unchanged */
+#define RU_ANY		3	/* any text is unchanged */
+
 /* Values for change_indent() */
 #define INDENT_SET	1	/* set indent */
 #define INDENT_INC	2	/* increase indent */